@@ -14,7 +14,10 @@ use std::ffi::{CStr, CString};
 use std::mem::{size_of, transmute};
 use std::sync::{Arc, Mutex};
 
-use udi::{Error, EventData, Process, ProcessConfig, Register, Thread, UserData};
+use udi::{
+    BranchTrace, Error, EventData, EventType, Process, ProcessConfig, Register, SignalPolicy,
+    StopMode, Thread, UserData,
+};
 
 /// Opaque thread handle
 pub struct udi_thread {
@@ -72,6 +75,21 @@ pub enum udi_thread_state_e {
     UDI_TS_SUSPENDED = 1,
 }
 
+/// The handling of a signal received by a debuggee
+#[repr(u32)]
+pub enum udi_signal_policy_e {
+    UDI_SIGNAL_POLICY_STOP = 0,
+    UDI_SIGNAL_POLICY_PASS = 1,
+    UDI_SIGNAL_POLICY_IGNORE = 2,
+}
+
+/// Whether an event stops all threads of a debuggee
+#[repr(u32)]
+pub enum udi_stop_mode_e {
+    UDI_STOP_MODE_ALL = 0,
+    UDI_STOP_MODE_NON_STOP = 1,
+}
+
 /// Register identifiers
 #[repr(u32)]
 pub enum udi_register_e {
@@ -148,6 +166,63 @@ pub enum udi_register_e {
     UDI_X86_64_XMM13,
     UDI_X86_64_XMM14,
     UDI_X86_64_XMM15,
+    UDI_X86_64_YMM0,
+    UDI_X86_64_YMM1,
+    UDI_X86_64_YMM2,
+    UDI_X86_64_YMM3,
+    UDI_X86_64_YMM4,
+    UDI_X86_64_YMM5,
+    UDI_X86_64_YMM6,
+    UDI_X86_64_YMM7,
+    UDI_X86_64_YMM8,
+    UDI_X86_64_YMM9,
+    UDI_X86_64_YMM10,
+    UDI_X86_64_YMM11,
+    UDI_X86_64_YMM12,
+    UDI_X86_64_YMM13,
+    UDI_X86_64_YMM14,
+    UDI_X86_64_YMM15,
+    UDI_X86_64_ZMM0,
+    UDI_X86_64_ZMM1,
+    UDI_X86_64_ZMM2,
+    UDI_X86_64_ZMM3,
+    UDI_X86_64_ZMM4,
+    UDI_X86_64_ZMM5,
+    UDI_X86_64_ZMM6,
+    UDI_X86_64_ZMM7,
+    UDI_X86_64_ZMM8,
+    UDI_X86_64_ZMM9,
+    UDI_X86_64_ZMM10,
+    UDI_X86_64_ZMM11,
+    UDI_X86_64_ZMM12,
+    UDI_X86_64_ZMM13,
+    UDI_X86_64_ZMM14,
+    UDI_X86_64_ZMM15,
+    UDI_X86_64_ZMM16,
+    UDI_X86_64_ZMM17,
+    UDI_X86_64_ZMM18,
+    UDI_X86_64_ZMM19,
+    UDI_X86_64_ZMM20,
+    UDI_X86_64_ZMM21,
+    UDI_X86_64_ZMM22,
+    UDI_X86_64_ZMM23,
+    UDI_X86_64_ZMM24,
+    UDI_X86_64_ZMM25,
+    UDI_X86_64_ZMM26,
+    UDI_X86_64_ZMM27,
+    UDI_X86_64_ZMM28,
+    UDI_X86_64_ZMM29,
+    UDI_X86_64_ZMM30,
+    UDI_X86_64_ZMM31,
+    UDI_X86_64_K0,
+    UDI_X86_64_K1,
+    UDI_X86_64_K2,
+    UDI_X86_64_K3,
+    UDI_X86_64_K4,
+    UDI_X86_64_K5,
+    UDI_X86_64_K6,
+    UDI_X86_64_K7,
+    UDI_X86_64_MXCSR,
     UDI_X86_64_MAX,
 }
 
@@ -456,6 +531,22 @@ pub unsafe extern "C" fn continue_process(process: *const udi_process) -> udi_er
     UnsafeFrom::from(process.continue_process())
 }
 
+/// Continue a stopped UDI process with a signal.
+///
+/// # Arguments
+///
+/// * `process` - the process to continue
+/// * `sig` - the signal to pass to the process
+#[no_mangle]
+pub unsafe extern "C" fn continue_process_with_signal(
+    process: *const udi_process,
+    sig: u32,
+) -> udi_error {
+    let mut process = try_err!((*process).handle.lock());
+
+    UnsafeFrom::from(process.continue_process_with_signal(sig))
+}
+
 /// Refresh the state of the specified process.
 ///
 /// # Arguments
@@ -793,6 +884,42 @@ pub unsafe extern "C" fn resume_thread(thr: *const udi_thread) -> udi_error {
     UnsafeFrom::from(thr.resume())
 }
 
+/// Continues the specified thread, which must be stopped in non-stop mode.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to continue
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn continue_thread(thr: *const udi_thread) -> udi_error {
+    let mut thr = try_err!((*thr).handle.lock());
+
+    UnsafeFrom::from(thr.continue_thread())
+}
+
+/// Continues the specified thread, which must be stopped in non-stop mode, with a signal.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to continue
+/// * `sig` - the signal to pass to the thread
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn continue_thread_with_signal(
+    thr: *const udi_thread,
+    sig: u32,
+) -> udi_error {
+    let mut thr = try_err!((*thr).handle.lock());
+
+    UnsafeFrom::from(thr.continue_thread_with_signal(sig))
+}
+
 /// Suspends the specified thread.
 ///
 /// # Arguments
@@ -845,6 +972,245 @@ pub unsafe extern "C" fn get_single_step(thr: *const udi_thread, output: *mut i3
     UnsafeFrom::from(Ok(()))
 }
 
+/// Single steps a specific thread through an address range once it is continued, reporting a
+/// single step event when the pc leaves the range.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to step
+/// * `start` - the start of the range
+/// * `end` - the end of the range, exclusive
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn step_range(thr: *const udi_thread, start: u64, end: u64) -> udi_error {
+    let mut thr = try_err!((*thr).handle.lock());
+
+    UnsafeFrom::from(thr.step_range(start, end))
+}
+
+/// Like `step_range`, but calls made from the range are stepped over.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to step
+/// * `start` - the start of the range
+/// * `end` - the end of the range, exclusive
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn step_over(thr: *const udi_thread, start: u64, end: u64) -> udi_error {
+    let mut thr = try_err!((*thr).handle.lock());
+
+    UnsafeFrom::from(thr.step_over(start, end))
+}
+
+/// Steps a specific thread out of its current function once it is continued, reporting a single
+/// step event at the return address.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to step
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn step_out(thr: *const udi_thread) -> udi_error {
+    let mut thr = try_err!((*thr).handle.lock());
+
+    UnsafeFrom::from(thr.step_out())
+}
+
+/// Runs exactly `count` instructions in a specific thread once it is continued, reporting a single
+/// step event when the count is reached unless another event stops the thread first.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to run
+/// * `count` - the number of instructions to run
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn run_instructions(thr: *const udi_thread, count: u64) -> udi_error {
+    let mut thr = try_err!((*thr).handle.lock());
+
+    UnsafeFrom::from(thr.run_instructions(count))
+}
+
+/// Gets the final pc and the number of instructions executed by the run of instructions that the
+/// last event of a specific thread ended.
+///
+/// # Arguments
+///
+/// * `thr` - the thread
+/// * `pc` - populated with the final pc
+/// * `executed` - populated with the number of instructions executed
+/// * `valid` - populated with 0 if the last event did not end a run of instructions
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn get_instruction_run(
+    thr: *const udi_thread,
+    pc: *mut u64,
+    executed: *mut u64,
+    valid: *mut i32,
+) -> udi_error {
+    let thr = try_err!((*thr).handle.lock());
+
+    match thr.get_instruction_run() {
+        Some(run) => {
+            *pc = run.pc;
+            *executed = run.executed;
+            *valid = 1;
+        }
+        None => *valid = 0,
+    }
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Opaque branch trace handle
+pub struct udi_branch_trace {
+    trace: BranchTrace,
+}
+
+/// Records the target of each branch a specific thread takes into a ring buffer, stepping inside
+/// the runtime without reporting events.
+///
+/// # Arguments
+///
+/// * `thr` - the thread
+/// * `size` - the size of the ring buffer in bytes
+/// * `output` - populated with the trace on success, freed with `free_branch_trace`
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn record_branches(
+    thr: *const udi_thread,
+    size: u32,
+    output: *mut *mut udi_branch_trace,
+) -> udi_error {
+    let mut thr = try_err!((*thr).handle.lock());
+
+    let trace = try_err!(thr.record_branches(size));
+
+    *output = Box::into_raw(Box::new(udi_branch_trace { trace }));
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Stops recording the branches of a specific thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn stop_recording_branches(thr: *const udi_thread) -> udi_error {
+    let mut thr = try_err!((*thr).handle.lock());
+
+    UnsafeFrom::from(thr.stop_recording_branches())
+}
+
+/// Removes the branch targets recorded since the last drain from the ring buffer.
+///
+/// # Arguments
+///
+/// * `trace` - the trace
+/// * `targets` - populated with the targets on success, freed with `free`
+/// * `num_targets` - populated with the number of targets on success
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn drain_branch_trace(
+    trace: *mut udi_branch_trace,
+    targets: *mut *mut u64,
+    num_targets: *mut u32,
+) -> udi_error {
+    let drained = try_err!((*trace).trace.drain());
+
+    let size = size_of::<u64>() * std::cmp::max(drained.len(), 1);
+    let output = match try_malloc(size) {
+        Ok(ptr) => ptr as *mut u64,
+        Err(e) => return e,
+    };
+    std::ptr::copy_nonoverlapping(drained.as_ptr(), output, drained.len());
+
+    *targets = output;
+    *num_targets = drained.len() as u32;
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Gets the number of branch targets discarded because the ring buffer was full.
+///
+/// # Arguments
+///
+/// * `trace` - the trace
+/// * `dropped` - populated with the number of targets
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn get_branch_trace_dropped(
+    trace: *mut udi_branch_trace,
+    dropped: *mut u64,
+) -> udi_error {
+    *dropped = try_err!((*trace).trace.dropped());
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Frees a branch trace returned by `record_branches`.
+///
+/// # Arguments
+///
+/// * `trace` - the trace
+#[no_mangle]
+pub unsafe extern "C" fn free_branch_trace(trace: *mut udi_branch_trace) {
+    drop(Box::from_raw(trace));
+}
+
+/// Sets whether reading a single register of a specific thread reads all of the thread's
+/// registers in one request, caching the values until the thread is next resumed.
+///
+/// # Arguments
+///
+/// * `thr` - the thread
+/// * `enable` - the new setting
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn set_register_prefetch(
+    thr: *const udi_thread,
+    enable: libc::c_int,
+) -> udi_error {
+    let mut thr = try_err!((*thr).handle.lock());
+
+    thr.set_register_prefetch(enable != 0);
+
+    UnsafeFrom::from(Ok(()))
+}
+
 /// Creates a breakpoint in the specified process at the specified virtual address.
 ///
 /// # Arguments
@@ -969,108 +1335,704 @@ pub unsafe extern "C" fn write_mem(
     UnsafeFrom::from(process.write_mem(src, addr))
 }
 
-/// Read register from the specified thread.
+/// Configures the cache of memory pages read from the specified process during a stop.
 ///
 /// # Arguments
 ///
-/// * `thr` - the thread to read the register from
-/// * `reg` - the register to read
-/// * `value` - populated on success
+/// * `process` - the process
+/// * `capacity` - the maximum number of cached pages, 0 to disable the cache
+/// * `prefetch` - non-zero to also read the page following each read that misses
 ///
 /// # Returns
 ///
 /// The result of the operation.
 #[no_mangle]
-pub unsafe extern "C" fn read_register(
-    thr: *const udi_thread,
-    reg: udi_register_e,
-    value: *mut u64,
+pub unsafe extern "C" fn set_page_cache(
+    process: *const udi_process,
+    capacity: u32,
+    prefetch: libc::c_int,
 ) -> udi_error {
-    let mut thread = try_err!((*thr).handle.lock());
-
-    let register = transmute::<udi_register_e, Register>(reg);
+    let mut process = try_err!((*process).handle.lock());
 
-    *value = try_err!(thread.read_register(register));
+    process.set_page_cache_capacity(capacity as usize);
+    process.set_page_cache_prefetch(prefetch != 0);
 
     UnsafeFrom::from(Ok(()))
 }
 
-/// Write register in the specified thread.
+/// Gets the counters for the page cache of the specified process.
 ///
 /// # Arguments
 ///
-/// * `thr` - the thread to write the register in
-/// * `reg` - the register to write
-/// * `value` - the value to write
+/// * `process` - the process
+/// * `hits` - populated with the number of pages read from the cache
+/// * `misses` - populated with the number of pages read from the process
 ///
 /// # Returns
 ///
 /// The result of the operation.
 #[no_mangle]
-pub unsafe extern "C" fn write_register(
-    thr: *const udi_thread,
-    reg: udi_register_e,
-    value: u64,
+pub unsafe extern "C" fn get_page_cache_stats(
+    process: *const udi_process,
+    hits: *mut u64,
+    misses: *mut u64,
 ) -> udi_error {
-    let mut thread = try_err!((*thr).handle.lock());
+    let process = try_err!((*process).handle.lock());
 
-    let register = transmute::<udi_register_e, Register>(reg);
+    let stats = process.page_cache_stats();
+    *hits = stats.hits;
+    *misses = stats.misses;
 
-    UnsafeFrom::from(thread.write_register(register, value))
+    UnsafeFrom::from(Ok(()))
 }
 
-/// Get the program counter for the specified thread.
+#[repr(C)]
+pub struct udi_stop_stats {
+    pub stops: u64,
+    pub threads: u32,
+    pub fanout_ns: u64,
+    pub arrival_ns: u64,
+    pub total_ns: u64,
+    pub max_total_ns: u64,
+}
+
+/// Gets the timing of the specified process stopping all of its threads.
 ///
 /// # Arguments
 ///
-/// * `thr` - the thread to get the program counter for
-/// * `pc` - populated on success
+/// * `process` - the process
+/// * `stats` - populated with the stats
 ///
 /// # Returns
 ///
 /// The result of the operation.
 #[no_mangle]
-pub unsafe extern "C" fn get_pc(thr: *const udi_thread, pc: *mut u64) -> udi_error {
-    let mut thread = try_err!((*thr).handle.lock());
+pub unsafe extern "C" fn get_stop_stats(
+    process: *const udi_process,
+    stats: *mut udi_stop_stats,
+) -> udi_error {
+    let mut process = try_err!((*process).handle.lock());
 
-    *pc = try_err!(thread.get_pc());
+    let output = try_err!(process.stop_stats());
+    *stats = udi_stop_stats {
+        stops: output.stops,
+        threads: output.threads,
+        fanout_ns: output.fanout_ns,
+        arrival_ns: output.arrival_ns,
+        total_ns: output.total_ns,
+        max_total_ns: output.max_total_ns,
+    };
 
     UnsafeFrom::from(Ok(()))
 }
 
-/// Get the next instruction for the specified thread.
+/// Configures the registers and stack bytes included with breakpoint and single step events
+/// for the specified process, which are used to populate the register and memory caches.
 ///
 /// # Arguments
 ///
-/// * `thr` - the thread to get the next instruction for
-/// * `instr` - populated on success
+/// * `process` - the process
+/// * `regs` - the registers to include, may be null if `num_regs` is 0
+/// * `num_regs` - the number of entries in `regs`
+/// * `stack` - the number of bytes of the stack to include, starting at the stack pointer
 ///
 /// # Returns
 ///
 /// The result of the operation.
 #[no_mangle]
-pub unsafe extern "C" fn get_next_instruction(
-    thr: *const udi_thread,
-    instr: *mut u64,
+pub unsafe extern "C" fn set_event_payload(
+    process: *const udi_process,
+    regs: *const udi_register_e,
+    num_regs: u32,
+    stack: u32,
 ) -> udi_error {
-    let mut thread = try_err!((*thr).handle.lock());
+    let mut process = try_err!((*process).handle.lock());
 
-    *instr = try_err!(thread.get_next_instruction());
+    let mut registers = vec![];
+    for i in 0..num_regs as usize {
+        registers.push(transmute::<udi_register_e, Register>(*regs.add(i)));
+    }
 
-    UnsafeFrom::from(Ok(()))
+    UnsafeFrom::from(process.set_event_payload(&registers, stack))
 }
 
-#[repr(u32)]
-pub enum udi_event_type_e {
-    UDI_EVENT_UNKNOWN = 0,
-    UDI_EVENT_ERROR = 1,
-    UDI_EVENT_SIGNAL,
-    UDI_EVENT_BREAKPOINT,
-    UDI_EVENT_THREAD_CREATE,
-    UDI_EVENT_THREAD_DEATH,
-    UDI_EVENT_PROCESS_EXIT,
-    UDI_EVENT_PROCESS_FORK,
-    UDI_EVENT_PROCESS_EXEC,
+/// Configures the events that are not reported for the specified process. Only thread create,
+/// thread death and process fork events can be masked.
+///
+/// # Arguments
+///
+/// * `process` - the process
+/// * `events` - the events to mask, may be null if `num_events` is 0
+/// * `num_events` - the number of entries in `events`
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn set_event_mask(
+    process: *const udi_process,
+    events: *const udi_event_type_e,
+    num_events: u32,
+) -> udi_error {
+    let mut process = try_err!((*process).handle.lock());
+
+    let mut event_types = vec![];
+    for i in 0..num_events as usize {
+        event_types.push(to_event_type(&*events.add(i)));
+    }
+
+    UnsafeFrom::from(process.set_event_mask(&event_types))
+}
+
+fn to_event_type(event_type: &udi_event_type_e) -> EventType {
+    match event_type {
+        udi_event_type_e::UDI_EVENT_UNKNOWN => EventType::Unknown,
+        udi_event_type_e::UDI_EVENT_ERROR => EventType::Error,
+        udi_event_type_e::UDI_EVENT_SIGNAL => EventType::Signal,
+        udi_event_type_e::UDI_EVENT_BREAKPOINT => EventType::Breakpoint,
+        udi_event_type_e::UDI_EVENT_THREAD_CREATE => EventType::ThreadCreate,
+        udi_event_type_e::UDI_EVENT_THREAD_DEATH => EventType::ThreadDeath,
+        udi_event_type_e::UDI_EVENT_PROCESS_EXIT => EventType::ProcessExit,
+        udi_event_type_e::UDI_EVENT_PROCESS_FORK => EventType::ProcessFork,
+        udi_event_type_e::UDI_EVENT_PROCESS_EXEC => EventType::ProcessExec,
+        udi_event_type_e::UDI_EVENT_SINGLE_STEP => EventType::SingleStep,
+        udi_event_type_e::UDI_EVENT_PROCESS_CLEANUP => EventType::ProcessCleanup,
+    }
+}
+
+/// Configures how the specified process handles a signal.
+///
+/// # Arguments
+///
+/// * `process` - the process
+/// * `sig` - the signal
+/// * `policy` - the policy for the signal
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn set_signal_policy(
+    process: *const udi_process,
+    sig: u32,
+    policy: udi_signal_policy_e,
+) -> udi_error {
+    let mut process = try_err!((*process).handle.lock());
+
+    let policy = match policy {
+        udi_signal_policy_e::UDI_SIGNAL_POLICY_STOP => SignalPolicy::Stop,
+        udi_signal_policy_e::UDI_SIGNAL_POLICY_PASS => SignalPolicy::Pass,
+        udi_signal_policy_e::UDI_SIGNAL_POLICY_IGNORE => SignalPolicy::Ignore,
+    };
+
+    UnsafeFrom::from(process.set_signal_policy(sig, policy))
+}
+
+/// Configures whether an event stops all threads of the specified process.
+///
+/// # Arguments
+///
+/// * `process` - the process
+/// * `mode` - the stop mode
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn set_stop_mode(
+    process: *const udi_process,
+    mode: udi_stop_mode_e,
+) -> udi_error {
+    let mut process = try_err!((*process).handle.lock());
+
+    let mode = match mode {
+        udi_stop_mode_e::UDI_STOP_MODE_ALL => StopMode::All,
+        udi_stop_mode_e::UDI_STOP_MODE_NON_STOP => StopMode::NonStop,
+    };
+
+    UnsafeFrom::from(process.set_stop_mode(mode))
+}
+
+/// Search memory in the specified process for a pattern.
+///
+/// # Arguments
+///
+/// * `process` - the process to search memory in
+/// * `addr` - the virtual address of the start of the range to search
+/// * `len` - the length of the range to search
+/// * `pattern` - the pattern to search for
+/// * `mask` - the mask applied before comparing the pattern, NULL to compare all bits
+/// * `pattern_len` - the length of the pattern and mask
+/// * `hits` - populated with the addresses of the matches
+/// * `max_hits` - the capacity of the `hits` array, 0 completes without searching
+/// * `num_hits` - populated with the number of matches on success
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn search_mem(
+    process: *const udi_process,
+    addr: u64,
+    len: u64,
+    pattern: *const u8,
+    mask: *const u8,
+    pattern_len: u32,
+    hits: *mut u64,
+    max_hits: u32,
+    num_hits: *mut u32,
+) -> udi_error {
+    // the runtime treats 0 as its own limit, but none of the matches could be returned
+    if max_hits == 0 {
+        *num_hits = 0;
+        return UnsafeFrom::from(Ok(()));
+    }
+
+    let mut process = try_err!((*process).handle.lock());
+
+    let pattern = std::slice::from_raw_parts(pattern, pattern_len as usize);
+    let mask = if !mask.is_null() {
+        Some(std::slice::from_raw_parts(mask, pattern_len as usize))
+    } else {
+        None
+    };
+
+    let addrs = try_err!(process.search_mem(addr, len, pattern, mask, max_hits));
+
+    let count = std::cmp::min(addrs.len(), max_hits as usize);
+    std::ptr::copy_nonoverlapping(addrs.as_ptr(), hits, count);
+    *num_hits = count as u32;
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Hash fixed-size blocks of memory in the specified process.
+///
+/// # Arguments
+///
+/// * `process` - the process to hash memory in
+/// * `addr` - the virtual address of the start of the range to hash
+/// * `len` - the length of the range to hash
+/// * `block_size` - the size of the blocks, 0 for the default
+/// * `hashes` - populated with the hash of each block
+/// * `readable` - populated with whether each block could be read, may be NULL
+/// * `max_blocks` - the capacity of the `hashes` and `readable` arrays
+/// * `num_blocks` - populated with the number of blocks on success
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn hash_mem(
+    process: *const udi_process,
+    addr: u64,
+    len: u64,
+    block_size: u32,
+    hashes: *mut u64,
+    readable: *mut u8,
+    max_blocks: u32,
+    num_blocks: *mut u32,
+) -> udi_error {
+    let mut process = try_err!((*process).handle.lock());
+
+    let mut result = try_err!(process.hash_mem(&[(addr, len)], block_size));
+    let block_hashes = result.pop().unwrap_or_default();
+
+    let count = std::cmp::min(block_hashes.len(), max_blocks as usize);
+    for (i, hash) in block_hashes.iter().take(count).enumerate() {
+        *hashes.add(i) = hash.unwrap_or(0);
+        if !readable.is_null() {
+            *readable.add(i) = hash.is_some() as u8;
+        }
+    }
+    *num_blocks = count as u32;
+
+    UnsafeFrom::from(Ok(()))
+}
+
+#[repr(C)]
+pub struct udi_memory_region {
+    pub start: u64,
+    pub end: u64,
+    pub offset: u64,
+    pub prot: u32,
+    pub path: *const libc::c_char,
+}
+
+/// Retrieve the memory map for the specified process.
+///
+/// # Arguments
+///
+/// * `process` - the process
+/// * `regions` - populated with the regions on success, freed with `free_memory_map`
+/// * `num_regions` - populated with the number of regions on success
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn memory_map(
+    process: *const udi_process,
+    regions: *mut *mut udi_memory_region,
+    num_regions: *mut u32,
+) -> udi_error {
+    let mut process = try_err!((*process).handle.lock());
+
+    let map = try_err!(process.memory_map());
+
+    let size = size_of::<udi_memory_region>() * std::cmp::max(map.len(), 1);
+    let output = match try_malloc(size) {
+        Ok(ptr) => ptr as *mut udi_memory_region,
+        Err(e) => return e,
+    };
+
+    for (i, region) in map.iter().enumerate() {
+        let path = if region.path.is_empty() {
+            std::ptr::null()
+        } else {
+            to_c_string(&region.path)
+        };
+
+        output.add(i).write(udi_memory_region {
+            start: region.start,
+            end: region.end,
+            offset: region.offset,
+            prot: region.prot,
+            path,
+        });
+    }
+
+    *regions = output;
+    *num_regions = map.len() as u32;
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Free a memory map returned by `memory_map`.
+///
+/// # Arguments
+///
+/// * `regions` - the regions
+/// * `num_regions` - the number of regions
+#[no_mangle]
+pub unsafe extern "C" fn free_memory_map(regions: *mut udi_memory_region, num_regions: u32) {
+    if regions.is_null() {
+        return;
+    }
+
+    for i in 0..num_regions as usize {
+        libc::free((*regions.add(i)).path as *mut libc::c_void);
+    }
+
+    libc::free(regions as *mut libc::c_void);
+}
+
+/// Read register from the specified thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to read the register from
+/// * `reg` - the register to read
+/// * `value` - populated on success
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn read_register(
+    thr: *const udi_thread,
+    reg: udi_register_e,
+    value: *mut u64,
+) -> udi_error {
+    let mut thread = try_err!((*thr).handle.lock());
+
+    let register = transmute::<udi_register_e, Register>(reg);
+
+    *value = try_err!(thread.read_register(register));
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Write register in the specified thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to write the register in
+/// * `reg` - the register to write
+/// * `value` - the value to write
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn write_register(
+    thr: *const udi_thread,
+    reg: udi_register_e,
+    value: u64,
+) -> udi_error {
+    let mut thread = try_err!((*thr).handle.lock());
+
+    let register = transmute::<udi_register_e, Register>(reg);
+
+    UnsafeFrom::from(thread.write_register(register, value))
+}
+
+/// Read a register, of any width, from the specified thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to read the register from
+/// * `reg` - the register to read
+/// * `value` - populated with the register value, in little-endian order, on success
+/// * `max_len` - the size of `value`
+/// * `len` - populated with the size of the register value on success
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn read_register_bytes(
+    thr: *const udi_thread,
+    reg: udi_register_e,
+    value: *mut u8,
+    max_len: u32,
+    len: *mut u32,
+) -> udi_error {
+    let mut thread = try_err!((*thr).handle.lock());
+
+    let register = transmute::<udi_register_e, Register>(reg);
+
+    let bytes = try_err!(thread.read_register_bytes(register));
+
+    let count = std::cmp::min(bytes.len(), max_len as usize);
+    std::ptr::copy_nonoverlapping(bytes.as_ptr(), value, count);
+    *len = bytes.len() as u32;
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Write a register, of any width, in the specified thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to write the register in
+/// * `reg` - the register to write
+/// * `value` - the value to write, in little-endian order
+/// * `len` - the size of `value`, which must be the size of the register
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn write_register_bytes(
+    thr: *const udi_thread,
+    reg: udi_register_e,
+    value: *const u8,
+    len: u32,
+) -> udi_error {
+    let mut thread = try_err!((*thr).handle.lock());
+
+    let register = transmute::<udi_register_e, Register>(reg);
+    let bytes = std::slice::from_raw_parts(value, len as usize);
+
+    UnsafeFrom::from(thread.write_register_bytes(register, bytes))
+}
+
+/// Read all the vector registers from the specified thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to read the registers from
+/// * `width` - populated with the width of each vector register in bytes
+/// * `data` - populated with the register values, each in little-endian order at the offset
+///   of its index multiplied by `width`
+/// * `max_len` - the size of `data`
+/// * `len` - populated with the size of the register values
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn read_vector_registers(
+    thr: *const udi_thread,
+    width: *mut u32,
+    data: *mut u8,
+    max_len: u32,
+    len: *mut u32,
+) -> udi_error {
+    let mut thread = try_err!((*thr).handle.lock());
+
+    let regs = try_err!(thread.read_vector_registers());
+
+    let count = std::cmp::min(regs.data.len(), max_len as usize);
+    std::ptr::copy_nonoverlapping(regs.data.as_ptr(), data, count);
+    *width = regs.width;
+    *len = regs.data.len() as u32;
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Write all the vector registers in the specified thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to write the registers in
+/// * `width` - the width of each vector register in bytes
+/// * `data` - the register values, in the same layout as `read_vector_registers`
+/// * `len` - the size of `data`
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn write_vector_registers(
+    thr: *const udi_thread,
+    width: u32,
+    data: *const u8,
+    len: u32,
+) -> udi_error {
+    let mut thread = try_err!((*thr).handle.lock());
+
+    let data = std::slice::from_raw_parts(data, len as usize);
+
+    UnsafeFrom::from(thread.write_vector_registers(width, data))
+}
+
+/// Read all the registers from the specified thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to read the registers from
+/// * `values` - populated with the register values, ordered from the register after the
+///   architecture's MIN register
+/// * `available` - populated with whether each register could be read, may be null
+/// * `max_values` - the number of entries in `values` and `available`
+/// * `num_values` - populated with the number of entries populated
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn read_registers(
+    thr: *const udi_thread,
+    values: *mut u64,
+    available: *mut u8,
+    max_values: u32,
+    num_values: *mut u32,
+) -> udi_error {
+    let mut thread = try_err!((*thr).handle.lock());
+
+    let regs = Register::for_architecture(thread.get_architecture());
+    let read = try_err!(thread.read_registers());
+
+    let count = std::cmp::min(regs.len(), max_values as usize);
+    for i in 0..count {
+        *values.add(i) = 0;
+        if !available.is_null() {
+            *available.add(i) = 0;
+        }
+    }
+
+    let first = regs[0] as usize;
+    for (reg, value) in read {
+        let i = reg as usize - first;
+        if i < count {
+            *values.add(i) = value;
+            if !available.is_null() {
+                *available.add(i) = 1;
+            }
+        }
+    }
+    *num_values = count as u32;
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Write registers in the specified thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to write the registers in
+/// * `values` - the register values, in the same order as `read_registers`
+/// * `present` - whether each value should be written, may be null to write all values
+/// * `num_values` - the number of entries in `values` and `present`
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn write_registers(
+    thr: *const udi_thread,
+    values: *const u64,
+    present: *const u8,
+    num_values: u32,
+) -> udi_error {
+    let mut thread = try_err!((*thr).handle.lock());
+
+    let regs = Register::for_architecture(thread.get_architecture());
+
+    let mut writes = vec![];
+    for (i, reg) in regs.iter().take(num_values as usize).enumerate() {
+        if present.is_null() || *present.add(i) != 0 {
+            writes.push((*reg, *values.add(i)));
+        }
+    }
+
+    UnsafeFrom::from(thread.write_registers(&writes))
+}
+
+/// Get the program counter for the specified thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to get the program counter for
+/// * `pc` - populated on success
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn get_pc(thr: *const udi_thread, pc: *mut u64) -> udi_error {
+    let mut thread = try_err!((*thr).handle.lock());
+
+    *pc = try_err!(thread.get_pc());
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Get the next instruction for the specified thread.
+///
+/// # Arguments
+///
+/// * `thr` - the thread to get the next instruction for
+/// * `instr` - populated on success
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn get_next_instruction(
+    thr: *const udi_thread,
+    instr: *mut u64,
+) -> udi_error {
+    let mut thread = try_err!((*thr).handle.lock());
+
+    *instr = try_err!(thread.get_next_instruction());
+
+    UnsafeFrom::from(Ok(()))
+}
+
+#[repr(u32)]
+pub enum udi_event_type_e {
+    UDI_EVENT_UNKNOWN = 0,
+    UDI_EVENT_ERROR = 1,
+    UDI_EVENT_SIGNAL,
+    UDI_EVENT_BREAKPOINT,
+    UDI_EVENT_THREAD_CREATE,
+    UDI_EVENT_THREAD_DEATH,
+    UDI_EVENT_PROCESS_EXIT,
+    UDI_EVENT_PROCESS_FORK,
+    UDI_EVENT_PROCESS_EXEC,
     UDI_EVENT_SINGLE_STEP,
     UDI_EVENT_PROCESS_CLEANUP,
 }
@@ -1163,66 +2125,188 @@ pub unsafe extern "C" fn wait_for_events(
 
     let events = try_err!(udi::wait_for_events(&procs_vec));
 
-    let mut output_events;
-    if !events.is_empty() {
-        output_events = std::ptr::null();
-        let mut last_event = std::ptr::null();
-        for event in events {
-            let proc_handle = match find_proc_handle(procs_slice, &event.process) {
-                Ok(p) => p,
-                Err(e) => {
-                    free_event_list(output_events);
-                    return e;
-                }
-            };
+    *output = match to_event_list(procs_slice, events) {
+        Ok(event_list) => event_list,
+        Err(e) => return e,
+    };
 
-            match handle_thread_create(proc_handle, &event) {
-                Ok(()) => {}
-                Err(e) => {
-                    free_event_list(output_events);
-                    return e;
-                }
-            }
+    UnsafeFrom::from(Ok(()))
+}
 
-            let thr_handle = match find_thr_handle(proc_handle, &event.thread) {
-                Ok(t) => t,
-                Err(e) => {
-                    free_event_list(output_events);
-                    return e;
-                }
-            };
+/// Opaque event loop handle
+pub struct udi_event_loop {
+    event_loop: udi::EventLoop,
+    procs: Vec<*const udi_process>,
+}
 
-            let event_struct = match to_event_struct(proc_handle, thr_handle, &event.data) {
-                Ok(val) => val,
-                Err(e) => {
-                    free_event_list(output_events);
-                    return e;
-                }
-            };
+/// Creates an event loop, which waits for events from a set of processes that is maintained
+/// across waits.
+///
+/// # Arguments
+///
+/// * `max_events` - the maximum number of events returned by a wait
+/// * `output` - populated with the event loop on success
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn create_event_loop(
+    max_events: u32,
+    output: *mut *mut udi_event_loop,
+) -> udi_error {
+    let event_loop = try_err!(udi::EventLoop::new(max_events as usize));
 
-            let current_event = match try_malloc(size_of::<udi_event>()) {
-                Ok(p) => p as *mut udi_event,
-                Err(e) => {
-                    free_event_list(output_events);
-                    return e;
-                }
-            };
+    *output = Box::into_raw(Box::new(udi_event_loop {
+        event_loop,
+        procs: vec![],
+    }));
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Adds a process to an event loop.
+///
+/// # Arguments
+///
+/// * `event_loop` - the event loop
+/// * `process` - the process
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn event_loop_add_process(
+    event_loop: *mut udi_event_loop,
+    process: *const udi_process,
+) -> udi_error {
+    try_err!((*event_loop).event_loop.add_process(&(*process).handle));
+
+    (*event_loop).procs.push(process);
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Removes a process from an event loop. Processes are removed automatically once their
+/// cleanup event is returned.
+///
+/// # Arguments
+///
+/// * `event_loop` - the event loop
+/// * `process` - the process
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn event_loop_remove_process(
+    event_loop: *mut udi_event_loop,
+    process: *const udi_process,
+) -> udi_error {
+    try_err!((*event_loop).event_loop.remove_process(&(*process).handle));
+
+    (*event_loop).procs.retain(|p| *p != process);
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Waits for events from the processes in an event loop.
+///
+/// # Arguments
+///
+/// * `event_loop` - the event loop
+/// * `timeout_ms` - the maximum time to wait in milliseconds, negative to wait indefinitely
+/// * `output` - populated on success. NULL if no events were received before the timeout.
+///
+/// # Returns
+///
+/// The result of the operation.
+#[no_mangle]
+pub unsafe extern "C" fn event_loop_wait(
+    event_loop: *mut udi_event_loop,
+    timeout_ms: i64,
+    output: *mut *const udi_event,
+) -> udi_error {
+    let timeout = if timeout_ms < 0 {
+        None
+    } else {
+        Some(std::time::Duration::from_millis(timeout_ms as u64))
+    };
 
-            *current_event = event_struct;
-            (*current_event).next_event = last_event;
-            last_event = current_event;
+    let events = try_err!((*event_loop).event_loop.wait(timeout));
 
-            if output_events.is_null() {
-                output_events = current_event;
+    *output = match to_event_list(&(*event_loop).procs, events) {
+        Ok(event_list) => event_list,
+        Err(e) => return e,
+    };
+
+    // the handles for processes that have been cleaned up are no longer needed
+    let mut event_iter = *output;
+    while !event_iter.is_null() {
+        if let udi_event_type_e::UDI_EVENT_PROCESS_CLEANUP = (*event_iter).event_type {
+            let process = (*event_iter).process;
+            (*event_loop).procs.retain(|p| *p != process);
+        }
+        event_iter = (*event_iter).next_event;
+    }
+
+    UnsafeFrom::from(Ok(()))
+}
+
+/// Frees an event loop. The processes in the event loop are not freed.
+///
+/// # Arguments
+///
+/// * `event_loop` - the event loop
+#[no_mangle]
+pub unsafe extern "C" fn free_event_loop(event_loop: *mut udi_event_loop) {
+    drop(Box::from_raw(event_loop));
+}
+
+unsafe fn to_event_list(
+    procs_slice: &[*const udi_process],
+    events: Vec<udi::Event>,
+) -> Result<*const udi_event, udi_error> {
+    let mut output_events: *const udi_event = std::ptr::null();
+    let mut last_event: *mut udi_event = std::ptr::null_mut();
+    for event in events {
+        let result = to_event_list_entry(procs_slice, &event);
+        let current_event = match result {
+            Ok(e) => e,
+            Err(e) => {
+                free_event_list(output_events);
+                return Err(e);
             }
+        };
+
+        if last_event.is_null() {
+            output_events = current_event;
+        } else {
+            (*last_event).next_event = current_event;
         }
-    } else {
-        output_events = std::ptr::null();
+        last_event = current_event;
     }
 
-    *output = output_events;
+    Ok(output_events)
+}
 
-    UnsafeFrom::from(Ok(()))
+unsafe fn to_event_list_entry(
+    procs_slice: &[*const udi_process],
+    event: &udi::Event,
+) -> Result<*mut udi_event, udi_error> {
+    let proc_handle = find_proc_handle(procs_slice, &event.process)?;
+
+    handle_thread_create(proc_handle, event)?;
+
+    let thr_handle = find_thr_handle(proc_handle, &event.thread)?;
+
+    let mut event_struct = to_event_struct(proc_handle, thr_handle, &event.data)?;
+    event_struct.next_event = std::ptr::null();
+
+    let current_event = try_malloc(size_of::<udi_event>())? as *mut udi_event;
+    *current_event = event_struct;
+
+    Ok(current_event)
 }
 
 unsafe fn handle_thread_create(
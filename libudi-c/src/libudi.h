@@ -22,6 +22,12 @@ typedef struct udi_process_struct udi_process;
 /** Opaque thread handle */
 typedef struct udi_thread_struct udi_thread;
 
+/** Opaque event loop handle */
+typedef struct udi_event_loop_struct udi_event_loop;
+
+/** Opaque branch trace handle */
+typedef struct udi_branch_trace_struct udi_branch_trace;
+
 /**
  * library error codes
  */
@@ -141,6 +147,63 @@ typedef enum {
   UDI_X86_64_XMM13,
   UDI_X86_64_XMM14,
   UDI_X86_64_XMM15,
+  UDI_X86_64_YMM0,
+  UDI_X86_64_YMM1,
+  UDI_X86_64_YMM2,
+  UDI_X86_64_YMM3,
+  UDI_X86_64_YMM4,
+  UDI_X86_64_YMM5,
+  UDI_X86_64_YMM6,
+  UDI_X86_64_YMM7,
+  UDI_X86_64_YMM8,
+  UDI_X86_64_YMM9,
+  UDI_X86_64_YMM10,
+  UDI_X86_64_YMM11,
+  UDI_X86_64_YMM12,
+  UDI_X86_64_YMM13,
+  UDI_X86_64_YMM14,
+  UDI_X86_64_YMM15,
+  UDI_X86_64_ZMM0,
+  UDI_X86_64_ZMM1,
+  UDI_X86_64_ZMM2,
+  UDI_X86_64_ZMM3,
+  UDI_X86_64_ZMM4,
+  UDI_X86_64_ZMM5,
+  UDI_X86_64_ZMM6,
+  UDI_X86_64_ZMM7,
+  UDI_X86_64_ZMM8,
+  UDI_X86_64_ZMM9,
+  UDI_X86_64_ZMM10,
+  UDI_X86_64_ZMM11,
+  UDI_X86_64_ZMM12,
+  UDI_X86_64_ZMM13,
+  UDI_X86_64_ZMM14,
+  UDI_X86_64_ZMM15,
+  UDI_X86_64_ZMM16,
+  UDI_X86_64_ZMM17,
+  UDI_X86_64_ZMM18,
+  UDI_X86_64_ZMM19,
+  UDI_X86_64_ZMM20,
+  UDI_X86_64_ZMM21,
+  UDI_X86_64_ZMM22,
+  UDI_X86_64_ZMM23,
+  UDI_X86_64_ZMM24,
+  UDI_X86_64_ZMM25,
+  UDI_X86_64_ZMM26,
+  UDI_X86_64_ZMM27,
+  UDI_X86_64_ZMM28,
+  UDI_X86_64_ZMM29,
+  UDI_X86_64_ZMM30,
+  UDI_X86_64_ZMM31,
+  UDI_X86_64_K0,
+  UDI_X86_64_K1,
+  UDI_X86_64_K2,
+  UDI_X86_64_K3,
+  UDI_X86_64_K4,
+  UDI_X86_64_K5,
+  UDI_X86_64_K6,
+  UDI_X86_64_K7,
+  UDI_X86_64_MXCSR,
   UDI_X86_64_MAX
 } udi_register_e;
 
@@ -154,6 +217,58 @@ typedef struct udi_proc_config_struct {
   const char *rt_lib_path;
 } udi_proc_config;
 
+/**
+ * The handling of a signal received by a process
+ */
+typedef enum {
+  UDI_SIGNAL_POLICY_STOP = 0, /// stop the process and report a signal event
+  UDI_SIGNAL_POLICY_PASS,     /// pass the signal to the process without stopping
+  UDI_SIGNAL_POLICY_IGNORE,   /// discard the signal without stopping
+} udi_signal_policy_e;
+
+/**
+ * Whether an event stops all threads of a process
+ */
+typedef enum {
+  UDI_STOP_MODE_ALL = 0,      /// an event stops all threads
+  UDI_STOP_MODE_NON_STOP,     /// an event only stops the thread that triggered it
+} udi_stop_mode_e;
+
+/**
+ * Memory protection bits for a memory region
+ */
+typedef enum {
+  UDI_MEM_PROT_READ = 0x1,
+  UDI_MEM_PROT_WRITE = 0x2,
+  UDI_MEM_PROT_EXEC = 0x4,
+} udi_mem_prot_e;
+
+/**
+ * A mapped region of memory in a process
+ */
+typedef struct udi_memory_region_struct {
+  uint64_t start;
+  uint64_t end;
+  uint64_t offset;
+  uint32_t prot;
+
+  /** The path of the mapped file, NULL for anonymous mappings */
+  const char *path;
+} udi_memory_region;
+
+/**
+ * The timing of a process stopping all of its threads. Except for stops and max_total_ns, the
+ * values describe the last stop.
+ */
+typedef struct udi_stop_stats_struct {
+  uint64_t stops;        /// the number of times all threads were stopped
+  uint32_t threads;      /// the number of threads signaled
+  uint64_t fanout_ns;    /// the time spent signaling the threads
+  uint64_t arrival_ns;   /// the time until the last signaled thread stopped
+  uint64_t total_ns;     /// the time until the thread with the event resumed
+  uint64_t max_total_ns; /// the largest total_ns of all stops
+} udi_stop_stats;
+
 /*
  * Create UDI-controlled process
  *
@@ -189,6 +304,16 @@ void free_process(udi_process *proc);
  */
 udi_error continue_process(udi_process *proc);
 
+/**
+ * Continue a stopped UDI process with a signal
+ *
+ * @param proc          the process handle
+ * @param sig           the signal to pass to the process
+ *
+ * @return the result of the operation
+ */
+udi_error continue_process_with_signal(udi_process *proc, uint32_t sig);
+
 /**
  * Refreshes the state of the specified process
  *
@@ -341,6 +466,23 @@ udi_error get_next_thread(udi_process *proc, udi_thread *thr,
  */
 udi_error resume_thread(udi_thread *thr);
 
+/**
+ * Continues the specified thread, which must be stopped in non-stop mode
+ *
+ * @return the result of the operation
+ */
+udi_error continue_thread(udi_thread *thr);
+
+/**
+ * Continues the specified thread, which must be stopped in non-stop mode, with a signal
+ *
+ * @param thr           the thread handle
+ * @param sig           the signal to pass to the thread
+ *
+ * @return the result of the operation
+ */
+udi_error continue_thread_with_signal(udi_thread *thr, uint32_t sig);
+
 /**
  * Suspend the specified thread.
  *
@@ -367,6 +509,126 @@ udi_error set_single_step(udi_thread *thr, int enable);
  */
 udi_error get_single_step(udi_thread *thr, int *output);
 
+/**
+ * Single steps a specific thread through the range [start, end) once it is continued. A single
+ * step event is reported when the pc leaves the range.
+ *
+ * @param thr the thread
+ * @param start the start of the range
+ * @param end the end of the range
+ *
+ * @return the result of the operation
+ */
+udi_error step_range(udi_thread *thr, uint64_t start, uint64_t end);
+
+/**
+ * Like step_range, but calls made from the range are stepped over
+ *
+ * @param thr the thread
+ * @param start the start of the range
+ * @param end the end of the range
+ *
+ * @return the result of the operation
+ */
+udi_error step_over(udi_thread *thr, uint64_t start, uint64_t end);
+
+/**
+ * Steps a specific thread out of its current function once it is continued. A single step event
+ * is reported at the return address.
+ *
+ * @param thr the thread
+ *
+ * @return the result of the operation
+ */
+udi_error step_out(udi_thread *thr);
+
+/**
+ * Runs exactly count instructions in a specific thread once it is continued. A single step event
+ * is reported once the count is reached, unless another event stops the thread first.
+ *
+ * @param thr the thread
+ * @param count the number of instructions to run
+ *
+ * @return the result of the operation
+ */
+udi_error run_instructions(udi_thread *thr, uint64_t count);
+
+/**
+ * Gets the final pc and the number of instructions executed by the run of instructions that the
+ * last event of a specific thread ended
+ *
+ * @param thr the thread
+ * @param pc populated with the final pc
+ * @param executed populated with the number of instructions executed
+ * @param valid populated with 0 if the last event did not end a run of instructions
+ *
+ * @return the result of the operation
+ */
+udi_error get_instruction_run(udi_thread *thr, uint64_t *pc, uint64_t *executed, int *valid);
+
+/**
+ * Records the target of each branch a specific thread takes into a ring buffer, stepping inside
+ * the runtime without reporting events. The first target is the pc of the thread when recording
+ * starts. A trace returned by an earlier call must not be drained anymore.
+ *
+ * @param thr the thread
+ * @param size the size of the ring buffer in bytes
+ * @param trace populated with the trace on success, freed with free_branch_trace
+ *
+ * @return the result of the operation
+ */
+udi_error record_branches(udi_thread *thr, uint32_t size, udi_branch_trace **trace);
+
+/**
+ * Stops recording the branches of a specific thread. The records left in the ring buffer can
+ * still be drained.
+ *
+ * @param thr the thread
+ *
+ * @return the result of the operation
+ */
+udi_error stop_recording_branches(udi_thread *thr);
+
+/**
+ * Removes the branch targets recorded since the last drain from the ring buffer, while the thread
+ * may be running
+ *
+ * @param trace the trace
+ * @param targets populated with the targets in the order they were branched to, freed with free
+ * @param num_targets populated with the number of targets
+ *
+ * @return the result of the operation
+ */
+udi_error drain_branch_trace(udi_branch_trace *trace, uint64_t **targets, uint32_t *num_targets);
+
+/**
+ * Gets the number of branch targets discarded because the ring buffer was full
+ *
+ * @param trace the trace
+ * @param dropped populated with the number of targets
+ *
+ * @return the result of the operation
+ */
+udi_error get_branch_trace_dropped(udi_branch_trace *trace, uint64_t *dropped);
+
+/**
+ * Frees a branch trace returned by record_branches
+ *
+ * @param trace the trace
+ */
+void free_branch_trace(udi_branch_trace *trace);
+
+/**
+ * Sets whether reading a single register reads all of the thread's registers,
+ * caching the values until the thread is next resumed
+ *
+ * @param thr the thread
+ * @param enable the new setting
+ *
+ * @return the result of the operation
+ */
+udi_error set_register_prefetch(udi_thread *thr, int enable);
+
 // Breakpoint interface //
 
 /**
@@ -439,6 +701,123 @@ udi_error read_mem(udi_process *proc, uint8_t *dst, uint32_t size,
 udi_error write_mem(udi_process *proc, const uint8_t *src, uint32_t size,
                     uint64_t addr);
 
+/**
+ * Configures the cache of memory pages read during a stop of a process
+ *
+ * @param proc          the process handle
+ * @param capacity      the maximum number of cached pages, 0 to disable the cache
+ * @param prefetch      non-zero to also read the page following a read that misses
+ */
+udi_error set_page_cache(udi_process *proc, uint32_t capacity, int prefetch);
+
+/**
+ * Gets the counters for the page cache of a process
+ *
+ * @param proc          the process handle
+ * @param hits          populated with the number of pages read from the cache
+ * @param misses        populated with the number of pages read from the process
+ */
+udi_error get_page_cache_stats(udi_process *proc, uint64_t *hits,
+                               uint64_t *misses);
+
+/**
+ * Gets the timing of a process stopping all of its threads
+ *
+ * @param proc          the process handle
+ * @param stats         populated with the stats
+ */
+udi_error get_stop_stats(udi_process *proc, udi_stop_stats *stats);
+
+/**
+ * Configures the registers and stack bytes included with breakpoint and single step
+ * events, which are used to populate the register and memory caches
+ *
+ * @param proc          the process handle
+ * @param regs          the registers to include
+ * @param num_regs      the number of registers to include
+ * @param stack         the number of bytes of the stack to include
+ */
+udi_error set_event_payload(udi_process *proc, const udi_register_e *regs,
+                            uint32_t num_regs, uint32_t stack);
+
+/**
+ * Configures how a process handles a signal
+ *
+ * @param proc          the process handle
+ * @param sig           the signal
+ * @param policy        the policy for the signal
+ */
+udi_error set_signal_policy(udi_process *proc, uint32_t sig,
+                            udi_signal_policy_e policy);
+
+/**
+ * Configures whether an event stops all threads of a process. The mode takes effect once
+ * no thread is stopped.
+ *
+ * @param proc          the process handle
+ * @param mode          the stop mode
+ */
+udi_error set_stop_mode(udi_process *proc, udi_stop_mode_e mode);
+
+/**
+ * Search memory in a process for a pattern, skipping memory that cannot be read
+ *
+ * @param proc          the process handle
+ * @param addr          the address of the start of the range to search
+ * @param len           the length of the range to search
+ * @param pattern       the pattern to search for
+ * @param mask          the mask applied before comparison or NULL to compare all bits
+ * @param pattern_len   the length of the pattern and mask
+ * @param hits          the output array for the addresses of the matches
+ * @param max_hits      the capacity of the hits array, 0 sets num_hits to 0 without searching
+ * @param num_hits      the output parameter for the number of matches
+ *
+ * @return the result of the operation
+ */
+udi_error search_mem(udi_process *proc, uint64_t addr, uint64_t len,
+                     const uint8_t *pattern, const uint8_t *mask,
+                     uint32_t pattern_len, uint64_t *hits, uint32_t max_hits,
+                     uint32_t *num_hits);
+
+/**
+ * Hash fixed-size blocks of memory in a process, for detecting changes between stops
+ *
+ * @param proc          the process handle
+ * @param addr          the address of the start of the range to hash
+ * @param len           the length of the range to hash
+ * @param block_size    the size of the blocks (a power of two) or 0 for the default
+ * @param hashes        the output array for the xxHash64 of each block
+ * @param readable      the output array for whether each block could be read or NULL
+ * @param max_blocks    the capacity of the hashes and readable arrays
+ * @param num_blocks    the output parameter for the number of blocks
+ *
+ * @return the result of the operation
+ */
+udi_error hash_mem(udi_process *proc, uint64_t addr, uint64_t len,
+                   uint32_t block_size, uint64_t *hashes, uint8_t *readable,
+                   uint32_t max_blocks, uint32_t *num_blocks);
+
+/**
+ * Retrieves the memory map of a process
+ *
+ * @param proc          the process handle
+ * @param regions       populated with the regions, sorted by address, on success
+ * @param num_regions   populated with the number of regions on success
+ *
+ * @return the result of the operation
+ * @see free_memory_map
+ */
+udi_error memory_map(udi_process *proc, udi_memory_region **regions,
+                     uint32_t *num_regions);
+
+/**
+ * Frees a memory map returned by memory_map
+ *
+ * @param regions       the regions to free
+ * @param num_regions   the number of regions
+ */
+void free_memory_map(udi_memory_region *regions, uint32_t num_regions);
+
 /**
  * Reads a register for the specified thread
  *
@@ -461,6 +840,90 @@ udi_error read_register(udi_thread *thr, udi_register_e reg, uint64_t *value);
  */
 udi_error write_register(udi_thread *thr, udi_register_e reg, uint64_t value);
 
+/**
+ * Reads a register of any width for the specified thread
+ *
+ * @param thr the thread
+ * @param reg the register
+ * @param value the output value, in little-endian order
+ * @param max_len the size of value
+ * @param len populated with the size of the register value
+ *
+ * @return the result of the operation
+ */
+udi_error read_register_bytes(udi_thread *thr, udi_register_e reg, uint8_t *value,
+                              uint32_t max_len, uint32_t *len);
+
+/**
+ * Writes a register of any width for the specified thread
+ *
+ * @param thr the thread
+ * @param reg the register
+ * @param value the value, in little-endian order
+ * @param len the size of value, which must be the size of the register
+ *
+ * @return the result of the operation
+ */
+udi_error write_register_bytes(udi_thread *thr, udi_register_e reg, const uint8_t *value,
+                               uint32_t len);
+
+/**
+ * Reads all the vector registers for the specified thread, using the widest registers
+ * available (e.g., UDI_X86_64_ZMM0-31 with AVX-512)
+ *
+ * @param thr the thread
+ * @param width populated with the width of each register in bytes
+ * @param data populated with the register values, each in little-endian order at the
+ *        offset of its index multiplied by width
+ * @param max_len the size of data
+ * @param len populated with the size of the register values
+ *
+ * @return the result of the operation
+ */
+udi_error read_vector_registers(udi_thread *thr, uint32_t *width, uint8_t *data,
+                                uint32_t max_len, uint32_t *len);
+
+/**
+ * Writes all the vector registers for the specified thread
+ *
+ * @param thr the thread
+ * @param width the width of each register in bytes
+ * @param data the register values, in the same layout as read_vector_registers
+ * @param len the size of data
+ *
+ * @return the result of the operation
+ */
+udi_error write_vector_registers(udi_thread *thr, uint32_t width, const uint8_t *data,
+                                 uint32_t len);
+
+/**
+ * Reads all the registers for the specified thread. The values are ordered from the
+ * register after the architecture's MIN register (e.g., UDI_X86_64_MIN + 1).
+ *
+ * @param thr the thread
+ * @param values populated with the register values
+ * @param available populated with whether each register could be read, may be NULL
+ * @param max_values the number of entries in values and available
+ * @param num_values populated with the number of entries populated
+ *
+ * @return the result of the operation
+ */
+udi_error read_registers(udi_thread *thr, uint64_t *values, uint8_t *available,
+                         uint32_t max_values, uint32_t *num_values);
+
+/**
+ * Writes registers for the specified thread
+ *
+ * @param thr the thread
+ * @param values the register values, in the same order as read_registers
+ * @param present whether each value should be written, may be NULL to write all values
+ * @param num_values the number of entries in values and present
+ *
+ * @return the result of the operation
+ */
+udi_error write_registers(udi_thread *thr, const uint64_t *values,
+                          const uint8_t *present, uint32_t num_values);
+
 /**
  * Gets the PC for the specified thread
  *
@@ -594,6 +1057,69 @@ const char *get_event_type_str(udi_event_type_e event_type);
  */
 void free_event_list(udi_event *event_list);
 
+/**
+ * Creates an event loop, which waits for events from a set of processes that is
+ * maintained across waits
+ *
+ * @param max_events    the maximum number of events returned by a wait
+ * @param event_loop    populated with the event loop on success
+ *
+ * @return the result of the operation
+ */
+udi_error create_event_loop(uint32_t max_events, udi_event_loop **event_loop);
+
+/**
+ * Adds a process to an event loop
+ *
+ * @param event_loop    the event loop
+ * @param proc          the process handle
+ *
+ * @return the result of the operation
+ */
+udi_error event_loop_add_process(udi_event_loop *event_loop, udi_process *proc);
+
+/**
+ * Removes a process from an event loop. Processes are removed automatically once
+ * their cleanup event is returned.
+ *
+ * @param event_loop    the event loop
+ * @param proc          the process handle
+ *
+ * @return the result of the operation
+ */
+udi_error event_loop_remove_process(udi_event_loop *event_loop, udi_process *proc);
+
+/**
+ * Wait for events to occur in the processes of an event loop
+ *
+ * @param event_loop    the event loop
+ * @param timeout_ms    the maximum time to wait in milliseconds, negative to wait
+ *                      indefinitely
+ * @param events        the output events or NULL if no events occurred before the timeout
+ *
+ * @return the result of the operation
+ */
+udi_error event_loop_wait(udi_event_loop *event_loop, int64_t timeout_ms,
+                          udi_event **events);
+
+/**
+ * Frees an event loop. The processes in the event loop are not freed.
+ *
+ * @param event_loop    the event loop
+ */
+void free_event_loop(udi_event_loop *event_loop);
+
+/**
+ * Configures the events that are not reported for a process. Only thread create,
+ * thread death and process fork events can be masked.
+ *
+ * @param proc          the process handle
+ * @param events        the events to mask
+ * @param num_events    the number of events to mask
+ */
+udi_error set_event_mask(udi_process *proc, const udi_event_type_e *events,
+                         uint32_t num_events);
+
 #ifdef __cplusplus
 } // "C"
 #endif
@@ -0,0 +1,804 @@
+//
+// Copyright (c) 2011-2023, UDI Contributors
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+
+//! Asynchronous versions of the requests and event handling, usable with any executor.
+//!
+//! Readiness of the response and event pipes is tracked by a single reactor thread shared by
+//! all processes. A request future writes its request, waits for the response pipe to become
+//! readable without blocking the calling thread and then reads the response, so one thread can
+//! drive requests and events for many processes.
+
+use std::collections::{HashMap, VecDeque};
+use std::fs::File;
+use std::future::{poll_fn, Future};
+use std::io::Write;
+use std::os::unix::io::AsRawFd;
+use std::pin::Pin;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, OnceLock};
+use std::task::{Context, Poll, Waker};
+use std::thread;
+
+use mio::unix::SourceFd;
+use mio::{Events, Interest, Registry, Token};
+use serde::de::DeserializeOwned;
+use serde::Serialize;
+
+use super::branches::BranchTrace;
+use super::compress;
+use super::errors::*;
+use super::events::{handle_read_events, Event};
+use super::protocol::event::EventData;
+use super::protocol::{request, response, Architecture, MemoryCodec, Register};
+use super::Process;
+use super::Thread;
+
+const REACTOR_EVENTS_CAPACITY: usize = 1024;
+
+#[derive(Debug, Default)]
+struct SourceState {
+    ready: bool,
+    waker: Option<Waker>,
+    queue: Option<Arc<ReadyQueue>>,
+}
+
+/// Tokens of an event stream whose event pipes are readable
+#[derive(Debug, Default)]
+struct ReadyQueue {
+    state: Mutex<(VecDeque<Token>, Option<Waker>)>,
+}
+
+#[derive(Debug)]
+struct Reactor {
+    registry: Registry,
+    sources: Arc<Mutex<HashMap<Token, SourceState>>>,
+    next_token: AtomicUsize,
+}
+
+impl Reactor {
+    fn start() -> std::io::Result<Reactor> {
+        let mut poll = mio::Poll::new()?;
+        let registry = poll.registry().try_clone()?;
+        let sources: Arc<Mutex<HashMap<Token, SourceState>>> = Arc::new(Mutex::new(HashMap::new()));
+
+        let thread_sources = sources.clone();
+        thread::Builder::new()
+            .name("udi-reactor".to_owned())
+            .spawn(move || {
+                let mut events = Events::with_capacity(REACTOR_EVENTS_CAPACITY);
+                loop {
+                    if let Err(e) = poll.poll(&mut events, None) {
+                        if e.kind() == std::io::ErrorKind::Interrupted {
+                            continue;
+                        }
+                        return;
+                    }
+
+                    let mut wakers = vec![];
+                    if let Ok(mut sources) = thread_sources.lock() {
+                        for event in &events {
+                            if let Some(source) = sources.get_mut(&event.token()) {
+                                source.ready = true;
+                                if let Some(queue) = source.queue.as_ref() {
+                                    if let Some(waker) = queue.push(event.token()) {
+                                        wakers.push(waker);
+                                    }
+                                } else if let Some(waker) = source.waker.take() {
+                                    wakers.push(waker);
+                                }
+                            }
+                        }
+                    }
+
+                    // wake outside of the lock, a waker can poll the future inline
+                    for waker in wakers {
+                        waker.wake();
+                    }
+                }
+            })?;
+
+        Ok(Reactor {
+            registry,
+            sources,
+            next_token: AtomicUsize::new(0),
+        })
+    }
+}
+
+fn reactor() -> Result<&'static Reactor, Error> {
+    static REACTOR: OnceLock<Result<Reactor, String>> = OnceLock::new();
+
+    REACTOR
+        .get_or_init(|| Reactor::start().map_err(|e| e.to_string()))
+        .as_ref()
+        .map_err(|e| Error::Library(format!("Failed to start reactor: {}", e)))
+}
+
+impl ReadyQueue {
+    fn push(&self, token: Token) -> Option<Waker> {
+        let mut state = self.state.lock().ok()?;
+        if !state.0.contains(&token) {
+            state.0.push_back(token);
+        }
+        state.1.take()
+    }
+
+    fn pop(&self, cx: &mut Context<'_>) -> Result<Option<Token>, Error> {
+        let mut state = self
+            .state
+            .lock()
+            .map_err(|e| Error::Library(format!("{}", e)))?;
+
+        let token = state.0.pop_front();
+        if token.is_none() {
+            state.1 = Some(cx.waker().clone());
+        }
+        Ok(token)
+    }
+}
+
+/// A pipe registered with the reactor. The registration uses a duplicate of the file, so it
+/// is unaffected by the process or thread closing its files.
+#[derive(Debug)]
+struct Registration {
+    file: File,
+    token: Token,
+    registered: bool,
+    armed: bool,
+}
+
+impl Registration {
+    fn new(file: &File, queue: Option<Arc<ReadyQueue>>) -> Result<Registration, Error> {
+        let reactor = reactor()?;
+        let token = Token(reactor.next_token.fetch_add(1, Ordering::SeqCst));
+
+        reactor
+            .sources
+            .lock()
+            .map_err(|e| Error::Library(format!("{}", e)))?
+            .insert(
+                token,
+                SourceState {
+                    queue,
+                    ..SourceState::default()
+                },
+            );
+
+        Ok(Registration {
+            file: file.try_clone()?,
+            token,
+            registered: false,
+            armed: false,
+        })
+    }
+
+    /// Discards any stale readiness and asks the reactor to report the current readiness of
+    /// the pipe, which is required because the registrations are edge triggered
+    fn arm(&mut self) -> Result<(), Error> {
+        let reactor = reactor()?;
+
+        if let Some(source) = reactor
+            .sources
+            .lock()
+            .map_err(|e| Error::Library(format!("{}", e)))?
+            .get_mut(&self.token)
+        {
+            source.ready = false;
+        }
+
+        let fd = self.file.as_raw_fd();
+        if self.registered {
+            reactor
+                .registry
+                .reregister(&mut SourceFd(&fd), self.token, Interest::READABLE)?;
+        } else {
+            reactor
+                .registry
+                .register(&mut SourceFd(&fd), self.token, Interest::READABLE)?;
+            self.registered = true;
+        }
+
+        self.armed = true;
+
+        Ok(())
+    }
+
+    fn poll_readable(&mut self, cx: &mut Context<'_>) -> Poll<Result<(), Error>> {
+        if !self.armed {
+            if let Err(e) = self.arm() {
+                return Poll::Ready(Err(e));
+            }
+        }
+
+        let reactor = match reactor() {
+            Ok(reactor) => reactor,
+            Err(e) => return Poll::Ready(Err(e)),
+        };
+
+        let mut sources = match reactor.sources.lock() {
+            Ok(sources) => sources,
+            Err(e) => return Poll::Ready(Err(Error::Library(format!("{}", e)))),
+        };
+
+        match sources.get_mut(&self.token) {
+            Some(source) if source.ready => {
+                source.ready = false;
+                self.armed = false;
+                Poll::Ready(Ok(()))
+            }
+            Some(source) => {
+                source.waker = Some(cx.waker().clone());
+                Poll::Pending
+            }
+            None => Poll::Ready(Err(Error::Library(
+                "Pipe is not registered with the reactor".to_owned(),
+            ))),
+        }
+    }
+
+    async fn readable(&mut self) -> Result<(), Error> {
+        poll_fn(|cx| self.poll_readable(cx)).await
+    }
+}
+
+impl Drop for Registration {
+    fn drop(&mut self) {
+        if let Ok(reactor) = reactor() {
+            if self.registered {
+                let fd = self.file.as_raw_fd();
+                let _ = reactor.registry.deregister(&mut SourceFd(&fd));
+            }
+
+            if let Ok(mut sources) = reactor.sources.lock() {
+                sources.remove(&self.token);
+            }
+        }
+    }
+}
+
+/// The response a dropped request future did not read
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum PendingResponse {
+    None,
+    Data,
+    NoData,
+}
+
+/// Sends requests for a process and its threads without blocking while the runtime handles
+/// the request. Only one request can be outstanding at a time; a request future dropped before
+/// it completes has its response discarded by the next request.
+#[derive(Debug)]
+struct RequestChannel {
+    registration: Registration,
+    pending: PendingResponse,
+}
+
+impl RequestChannel {
+    fn new(response_file: &File) -> Result<RequestChannel, Error> {
+        Ok(RequestChannel {
+            registration: Registration::new(response_file, None)?,
+            pending: PendingResponse::None,
+        })
+    }
+
+    async fn send<F, R>(
+        &mut self,
+        write_request: F,
+        read_response: R,
+        kind: PendingResponse,
+    ) -> Result<(), Error>
+    where
+        F: FnOnce() -> Result<(), Error>,
+        R: FnOnce(PendingResponse) -> Result<(), Error>,
+    {
+        if self.pending != PendingResponse::None {
+            self.registration.readable().await?;
+            let pending = self.pending;
+            self.pending = PendingResponse::None;
+
+            // the outcome of the abandoned request is irrelevant
+            let _ = read_response(pending);
+        }
+
+        write_request()?;
+        self.pending = kind;
+
+        self.registration.readable().await?;
+        self.pending = PendingResponse::None;
+
+        Ok(())
+    }
+}
+
+fn read_discarded(file: &mut File, pending: PendingResponse) -> Result<(), Error> {
+    match pending {
+        PendingResponse::Data => response::read::<ciborium::value::Value, File>(file).map(|_| ()),
+        _ => response::read_no_data(file),
+    }
+}
+
+/// An asynchronous handle to a process
+#[derive(Debug)]
+pub struct AsyncProcess {
+    process: Arc<Mutex<Process>>,
+    channel: RequestChannel,
+}
+
+impl AsyncProcess {
+    pub fn new(process: &Arc<Mutex<Process>>) -> Result<AsyncProcess, Error> {
+        let channel = {
+            let mut proc = process.lock()?;
+            RequestChannel::new(&proc.get_file_context()?.response_file)?
+        };
+
+        Ok(AsyncProcess {
+            process: process.clone(),
+            channel,
+        })
+    }
+
+    pub fn process(&self) -> &Arc<Mutex<Process>> {
+        &self.process
+    }
+
+    /// Sends a request to the process, returning the response data
+    pub async fn send_request<T, S>(&mut self, msg: &S) -> Result<T, Error>
+    where
+        T: DeserializeOwned,
+        S: request::RequestType + Serialize,
+    {
+        let process = &self.process;
+        self.channel
+            .send(
+                || write_process_request(process, msg),
+                |pending| read_process_discarded(process, pending),
+                PendingResponse::Data,
+            )
+            .await?;
+
+        let mut proc = process.lock()?;
+        response::read::<T, File>(&mut proc.get_file_context()?.response_file)
+    }
+
+    /// Sends a request to the process that has no response data
+    pub async fn send_request_no_data<S>(&mut self, msg: &S) -> Result<(), Error>
+    where
+        S: request::RequestType + Serialize,
+    {
+        let process = &self.process;
+        self.channel
+            .send(
+                || write_process_request(process, msg),
+                |pending| read_process_discarded(process, pending),
+                PendingResponse::NoData,
+            )
+            .await?;
+
+        let mut proc = process.lock()?;
+        response::read_no_data::<File>(&mut proc.get_file_context()?.response_file)
+    }
+
+    pub async fn continue_process(&mut self) -> Result<(), Error> {
+        self.continue_process_with_signal(0).await
+    }
+
+    pub async fn continue_process_with_signal(&mut self, sig: u32) -> Result<(), Error> {
+        let terminating = self.process.lock()?.terminating;
+        if terminating {
+            // No response is expected when continuing a terminating process
+            return self.process.lock()?.continue_process_with_signal(sig);
+        }
+
+        self.process
+            .lock()?
+            .stop_epoch
+            .fetch_add(1, Ordering::SeqCst);
+
+        self.send_request_no_data(&request::Continue::new(sig))
+            .await?;
+
+        self.process.lock()?.running = true;
+
+        Ok(())
+    }
+
+    pub async fn read_mem(&mut self, size: u32, addr: u64) -> Result<Vec<u8>, Error> {
+        {
+            let mut proc = self.process.lock()?;
+            let epoch = proc.stop_epoch.load(Ordering::SeqCst);
+            proc.page_cache.sync(epoch);
+            if let Some(data) = proc.page_cache.read_range(addr, size) {
+                return Ok(data);
+            }
+        }
+
+        let codec = Process::read_codec(size);
+        let msg = request::ReadMemory::with_codec(addr, size, codec);
+
+        let resp: response::ReadMemory = self.send_request(&msg).await?;
+
+        match resp.codec {
+            MemoryCodec::None => Ok(resp.data),
+            MemoryCodec::Lz4 => compress::decompress_lz4(&resp.data, size as usize),
+        }
+    }
+
+    pub async fn write_mem(&mut self, data: &[u8], addr: u64) -> Result<(), Error> {
+        self.process
+            .lock()?
+            .page_cache
+            .invalidate(addr, data.len() as u64);
+
+        self.send_request_no_data(&request::WriteMemory::new(addr, data))
+            .await
+    }
+
+    pub async fn create_breakpoint(&mut self, addr: u64) -> Result<(), Error> {
+        self.send_request_no_data(&request::CreateBreakpoint::new(addr))
+            .await
+    }
+
+    pub async fn install_breakpoint(&mut self, addr: u64) -> Result<(), Error> {
+        self.process.lock()?.page_cache.invalidate(addr, 1);
+
+        self.send_request_no_data(&request::InstallBreakpoint::new(addr))
+            .await
+    }
+
+    pub async fn remove_breakpoint(&mut self, addr: u64) -> Result<(), Error> {
+        self.process.lock()?.page_cache.invalidate(addr, 1);
+
+        self.send_request_no_data(&request::RemoveBreakpoint::new(addr))
+            .await
+    }
+
+    pub async fn delete_breakpoint(&mut self, addr: u64) -> Result<(), Error> {
+        self.send_request_no_data(&request::DeleteBreakpoint::new(addr))
+            .await
+    }
+}
+
+fn write_process_request<S: request::RequestType + Serialize>(
+    process: &Arc<Mutex<Process>>,
+    msg: &S,
+) -> Result<(), Error> {
+    let mut proc = process.lock()?;
+    proc.get_file_context()?
+        .request_file
+        .write_all(&request::serialize(msg)?)?;
+    Ok(())
+}
+
+fn read_process_discarded(
+    process: &Arc<Mutex<Process>>,
+    pending: PendingResponse,
+) -> Result<(), Error> {
+    let mut proc = process.lock()?;
+    read_discarded(&mut proc.get_file_context()?.response_file, pending)
+}
+
+/// An asynchronous handle to a thread
+#[derive(Debug)]
+pub struct AsyncThread {
+    thread: Arc<Mutex<Thread>>,
+    channel: RequestChannel,
+}
+
+impl AsyncThread {
+    pub fn new(thread: &Arc<Mutex<Thread>>) -> Result<AsyncThread, Error> {
+        let channel = {
+            let mut thr = thread.lock()?;
+            RequestChannel::new(&thr.get_file_context()?.response_file)?
+        };
+
+        Ok(AsyncThread {
+            thread: thread.clone(),
+            channel,
+        })
+    }
+
+    pub fn thread(&self) -> &Arc<Mutex<Thread>> {
+        &self.thread
+    }
+
+    /// Sends a request to the thread, returning the response data
+    pub async fn send_request<T, S>(&mut self, msg: &S) -> Result<T, Error>
+    where
+        T: DeserializeOwned,
+        S: request::RequestType + Serialize,
+    {
+        let thread = &self.thread;
+        self.channel
+            .send(
+                || write_thread_request(thread, msg),
+                |pending| read_thread_discarded(thread, pending),
+                PendingResponse::Data,
+            )
+            .await?;
+
+        let mut thr = thread.lock()?;
+        response::read::<T, File>(&mut thr.get_file_context()?.response_file)
+    }
+
+    /// Sends a request to the thread that has no response data
+    pub async fn send_request_no_data<S>(&mut self, msg: &S) -> Result<(), Error>
+    where
+        S: request::RequestType + Serialize,
+    {
+        let thread = &self.thread;
+        self.channel
+            .send(
+                || write_thread_request(thread, msg),
+                |pending| read_thread_discarded(thread, pending),
+                PendingResponse::NoData,
+            )
+            .await?;
+
+        let mut thr = thread.lock()?;
+        response::read_no_data::<File>(&mut thr.get_file_context()?.response_file)
+    }
+
+    pub async fn read_register(&mut self, reg: Register) -> Result<u64, Error> {
+        if let Some(value) = self.thread.lock()?.cached_register(reg) {
+            return Ok(value);
+        }
+
+        let resp: response::ReadRegister = self
+            .send_request(&request::ReadRegister::new(reg as u32))
+            .await?;
+
+        let value = resp
+            .value
+            .ok_or_else(|| Error::Request(format!("Register {:?} is wider than 64 bits", reg)))?;
+        self.thread
+            .lock()?
+            .cache_registers(std::iter::once((reg, value)));
+
+        Ok(value)
+    }
+
+    pub async fn write_register(&mut self, reg: Register, value: u64) -> Result<(), Error> {
+        self.thread.lock()?.invalidate_register_cache();
+
+        self.send_request_no_data(&request::WriteRegister::new(reg as u32, value))
+            .await
+    }
+
+    pub async fn get_pc(&mut self) -> Result<u64, Error> {
+        let reg = match self.thread.lock()?.get_architecture() {
+            Architecture::X86 => Register::X86_EIP,
+            Architecture::X86_64 => Register::X86_64_RIP,
+        };
+
+        self.read_register(reg).await
+    }
+
+    pub async fn set_single_step(&mut self, setting: bool) -> Result<(), Error> {
+        self.thread.lock()?.invalidate_register_cache();
+
+        let _: response::SingleStep = self
+            .send_request(&request::SingleStep::new(setting))
+            .await?;
+
+        self.thread.lock()?.single_step = setting;
+
+        Ok(())
+    }
+
+    pub async fn step_range(&mut self, start: u64, end: u64) -> Result<(), Error> {
+        self.send_request_no_data(&request::StepRange::new(start, end))
+            .await
+    }
+
+    pub async fn step_over(&mut self, start: u64, end: u64) -> Result<(), Error> {
+        self.send_request_no_data(&request::StepOver::new(start, end))
+            .await
+    }
+
+    pub async fn step_out(&mut self) -> Result<(), Error> {
+        self.send_request_no_data(&request::StepOut::default())
+            .await
+    }
+
+    pub async fn run_instructions(&mut self, count: u64) -> Result<(), Error> {
+        self.send_request_no_data(&request::RunInstructions::new(count))
+            .await
+    }
+
+    pub async fn record_branches(&mut self, size: u32) -> Result<BranchTrace, Error> {
+        let resp: response::RecordBranches = self
+            .send_request(&request::RecordBranches::new(size))
+            .await?;
+
+        BranchTrace::open(&resp.path)
+    }
+
+    pub async fn stop_recording_branches(&mut self) -> Result<(), Error> {
+        self.send_request_no_data(&request::RecordBranches::new(0))
+            .await
+    }
+
+    pub async fn suspend(&mut self) -> Result<(), Error> {
+        self.send_request_no_data(&request::ThreadSuspend::default())
+            .await
+    }
+
+    pub async fn resume(&mut self) -> Result<(), Error> {
+        self.send_request_no_data(&request::ThreadResume::default())
+            .await
+    }
+}
+
+fn write_thread_request<S: request::RequestType + Serialize>(
+    thread: &Arc<Mutex<Thread>>,
+    msg: &S,
+) -> Result<(), Error> {
+    let mut thr = thread.lock()?;
+    thr.get_file_context()?
+        .request_file
+        .write_all(&request::serialize(msg)?)?;
+    Ok(())
+}
+
+fn read_thread_discarded(
+    thread: &Arc<Mutex<Thread>>,
+    pending: PendingResponse,
+) -> Result<(), Error> {
+    let mut thr = thread.lock()?;
+    read_discarded(&mut thr.get_file_context()?.response_file, pending)
+}
+
+#[derive(Debug)]
+struct StreamProcess {
+    process: Arc<Mutex<Process>>,
+    registration: Registration,
+    terminating: bool,
+}
+
+/// A stream of the events of a set of processes. `poll_next` has the same contract as
+/// `futures::Stream::poll_next`, so the stream can be adapted to any executor's stream types.
+/// At most the events of a single stop of a process are buffered by the stream.
+#[derive(Debug)]
+pub struct EventStream {
+    procs: HashMap<Token, StreamProcess>,
+    queue: Arc<ReadyQueue>,
+    pending: VecDeque<Event>,
+}
+
+impl EventStream {
+    pub fn new() -> EventStream {
+        EventStream {
+            procs: HashMap::new(),
+            queue: Arc::new(ReadyQueue::default()),
+            pending: VecDeque::new(),
+        }
+    }
+
+    pub fn add_process(&mut self, proc_ref: &Arc<Mutex<Process>>) -> Result<(), Error> {
+        let mut registration = {
+            let mut process = proc_ref.lock()?;
+            Registration::new(
+                &process.get_file_context()?.events_file,
+                Some(self.queue.clone()),
+            )?
+        };
+        registration.arm()?;
+
+        self.procs.insert(
+            registration.token,
+            StreamProcess {
+                process: proc_ref.clone(),
+                registration,
+                terminating: false,
+            },
+        );
+
+        Ok(())
+    }
+
+    /// Stops reporting the events of the process, discarding any events not yet returned.
+    /// Processes are removed automatically once their cleanup event is returned.
+    pub fn remove_process(&mut self, proc_ref: &Arc<Mutex<Process>>) {
+        self.procs.retain(|_, p| !Arc::ptr_eq(&p.process, proc_ref));
+        self.pending.retain(|e| !Arc::ptr_eq(&e.process, proc_ref));
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.procs.is_empty() && self.pending.is_empty()
+    }
+
+    pub fn poll_next(
+        self: Pin<&mut Self>,
+        cx: &mut Context<'_>,
+    ) -> Poll<Option<Result<Event, Error>>> {
+        let stream = self.get_mut();
+
+        loop {
+            if let Some(event) = stream.pending.pop_front() {
+                return Poll::Ready(Some(Ok(event)));
+            }
+
+            if stream.procs.is_empty() {
+                return Poll::Ready(None);
+            }
+
+            // See wait_for_events for why the events of terminating processes are read directly
+            let terminating = match stream.running_terminating() {
+                Ok(terminating) => terminating,
+                Err(e) => return Poll::Ready(Some(Err(e))),
+            };
+
+            let token = match terminating {
+                Some(token) => token,
+                None => match stream.queue.pop(cx) {
+                    Ok(Some(token)) => token,
+                    Ok(None) => return Poll::Pending,
+                    Err(e) => return Poll::Ready(Some(Err(e))),
+                },
+            };
+
+            if let Err(e) = stream.read_process_events(token) {
+                return Poll::Ready(Some(Err(e)));
+            }
+        }
+    }
+
+    pub fn next(&mut self) -> impl Future<Output = Option<Result<Event, Error>>> + '_ {
+        poll_fn(move |cx| Pin::new(&mut *self).poll_next(cx))
+    }
+
+    fn running_terminating(&self) -> Result<Option<Token>, Error> {
+        for (token, p) in &self.procs {
+            if p.terminating && p.process.lock()?.running {
+                return Ok(Some(*token));
+            }
+        }
+
+        Ok(None)
+    }
+
+    fn read_process_events(&mut self, token: Token) -> Result<(), Error> {
+        let proc_ref = match self.procs.get(&token) {
+            Some(p) => p.process.clone(),
+            None => {
+                // the process was removed after its pipe became readable
+                return Ok(());
+            }
+        };
+
+        let mut cleanup = false;
+        for event in handle_read_events(&proc_ref)? {
+            match event.data {
+                EventData::ProcessExit { .. } => {
+                    if let Some(p) = self.procs.get_mut(&token) {
+                        p.terminating = true;
+                    }
+                }
+                EventData::ProcessCleanup => cleanup = true,
+                _ => {}
+            }
+
+            self.pending.push_back(event);
+        }
+
+        if cleanup {
+            self.procs.remove(&token);
+        } else if let Some(p) = self.procs.get_mut(&token) {
+            p.registration.arm()?;
+        }
+
+        Ok(())
+    }
+}
+
+impl Default for EventStream {
+    fn default() -> EventStream {
+        EventStream::new()
+    }
+}
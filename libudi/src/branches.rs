@@ -0,0 +1,144 @@
+//
+// Copyright (c) 2011-2023, UDI Contributors
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+
+use std::fs;
+use std::io::{Read, Seek, SeekFrom, Write};
+
+use super::errors::*;
+
+// The layout of branch_trace_header in the runtime: head, tail, dropped, size and a reserved word
+const HEADER_SIZE: u64 = 32;
+const TAIL_OFFSET: u64 = 8;
+
+#[derive(Debug)]
+struct Header {
+    head: u64,
+    tail: u64,
+    dropped: u64,
+    size: u64,
+}
+
+/// The targets of the branches a thread takes, recorded by the runtime into a ring buffer that
+/// is shared with the debugger through a file. The buffer can be drained while the thread runs.
+#[derive(Debug)]
+pub struct BranchTrace {
+    file: fs::File,
+    last_target: u64,
+}
+
+impl BranchTrace {
+    pub(crate) fn open(path: &str) -> Result<BranchTrace, Error> {
+        let file = fs::OpenOptions::new().read(true).write(true).open(path)?;
+
+        Ok(BranchTrace {
+            file,
+            last_target: 0,
+        })
+    }
+
+    /// Removes the targets recorded since the last call from the buffer and returns them, in the
+    /// order the thread branched to them. The first target is the address the thread was at when
+    /// recording started.
+    pub fn drain(&mut self) -> Result<Vec<u64>, Error> {
+        let header = self.read_header()?;
+
+        let len = header.head.wrapping_sub(header.tail);
+        if header.size == 0 || len > header.size {
+            return Err(Error::Library(format!(
+                "Invalid branch trace with head {} and tail {} for size {}",
+                header.head, header.tail, header.size
+            )));
+        }
+
+        let mut data = vec![0; len as usize];
+        let start = header.tail % header.size;
+        let first = std::cmp::min(len, header.size - start) as usize;
+        self.read_at(HEADER_SIZE + start, &mut data[..first])?;
+        self.read_at(HEADER_SIZE, &mut data[first..])?;
+
+        let targets = self.decode(&data)?;
+
+        // the runtime reuses the space once the tail passes it
+        self.file.seek(SeekFrom::Start(TAIL_OFFSET))?;
+        self.file.write_all(&header.head.to_ne_bytes())?;
+
+        Ok(targets)
+    }
+
+    /// The number of targets the runtime discarded because the buffer was full
+    pub fn dropped(&mut self) -> Result<u64, Error> {
+        Ok(self.read_header()?.dropped)
+    }
+
+    /// Each target is the LEB128 encoding of one more than the zigzag encoded difference from the
+    /// previous target
+    fn decode(&mut self, data: &[u8]) -> Result<Vec<u64>, Error> {
+        let mut targets = vec![];
+        let mut value = 0u64;
+        let mut shift = 0;
+        for byte in data {
+            if shift >= 64 {
+                return Err(Error::Library("Invalid branch trace record".to_owned()));
+            }
+
+            value |= ((byte & 0x7f) as u64) << shift;
+            shift += 7;
+            if byte & 0x80 != 0 {
+                continue;
+            }
+
+            if value == 0 {
+                return Err(Error::Library("Invalid branch trace record".to_owned()));
+            }
+
+            let zigzag = value - 1;
+            let delta = ((zigzag >> 1) as i64) ^ -((zigzag & 1) as i64);
+            self.last_target = self.last_target.wrapping_add(delta as u64);
+            targets.push(self.last_target);
+
+            value = 0;
+            shift = 0;
+        }
+
+        // the runtime only publishes complete records
+        if shift != 0 {
+            return Err(Error::Library("Truncated branch trace record".to_owned()));
+        }
+
+        Ok(targets)
+    }
+
+    fn read_header(&mut self) -> Result<Header, Error> {
+        let mut data = [0u8; HEADER_SIZE as usize];
+        self.read_at(0, &mut data)?;
+
+        let word = |index: usize| {
+            let mut bytes = [0u8; 8];
+            bytes.copy_from_slice(&data[index * 8..(index + 1) * 8]);
+            u64::from_ne_bytes(bytes)
+        };
+
+        let mut size = [0u8; 4];
+        size.copy_from_slice(&data[24..28]);
+
+        Ok(Header {
+            head: word(0),
+            tail: word(1),
+            dropped: word(2),
+            size: u32::from_ne_bytes(size) as u64,
+        })
+    }
+
+    fn read_at(&mut self, offset: u64, data: &mut [u8]) -> Result<(), Error> {
+        self.file.seek(SeekFrom::Start(offset))?;
+        self.file.read_exact(data)?;
+
+        Ok(())
+    }
+}
@@ -0,0 +1,85 @@
+//
+// Copyright (c) 2011-2023, UDI Contributors
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+
+use super::errors::*;
+
+const LZ4_MIN_MATCH: usize = 4;
+
+fn invalid_data() -> Error {
+    Error::Library("Invalid LZ4 compressed memory data".to_owned())
+}
+
+fn read_length(input: &[u8], pos: &mut usize) -> Result<usize, Error> {
+    let mut len = 0;
+    loop {
+        let value = *input.get(*pos).ok_or_else(invalid_data)?;
+        *pos += 1;
+        len += value as usize;
+        if value != 255 {
+            return Ok(len);
+        }
+    }
+}
+
+pub fn decompress_lz4(input: &[u8], output_len: usize) -> Result<Vec<u8>, Error> {
+    let mut output = Vec::with_capacity(output_len);
+
+    let mut pos = 0;
+    while pos < input.len() {
+        let token = input[pos];
+        pos += 1;
+
+        let mut literal_len = (token >> 4) as usize;
+        if literal_len == 15 {
+            literal_len += read_length(input, &mut pos)?;
+        }
+
+        let literals = input.get(pos..pos + literal_len).ok_or_else(invalid_data)?;
+        if output.len() + literal_len > output_len {
+            return Err(invalid_data());
+        }
+        output.extend_from_slice(literals);
+        pos += literal_len;
+
+        // the last sequence only contains literals
+        if pos == input.len() {
+            break;
+        }
+
+        let offset_bytes = input.get(pos..pos + 2).ok_or_else(invalid_data)?;
+        let offset = u16::from_le_bytes([offset_bytes[0], offset_bytes[1]]) as usize;
+        pos += 2;
+
+        if offset == 0 || offset > output.len() {
+            return Err(invalid_data());
+        }
+
+        let mut match_len = (token & 0xf) as usize;
+        if match_len == 15 {
+            match_len += read_length(input, &mut pos)?;
+        }
+        match_len += LZ4_MIN_MATCH;
+
+        if output.len() + match_len > output_len {
+            return Err(invalid_data());
+        }
+
+        // the match can overlap the bytes it produces
+        for _ in 0..match_len {
+            let value = output[output.len() - offset];
+            output.push(value);
+        }
+    }
+
+    if output.len() != output_len {
+        return Err(invalid_data());
+    }
+
+    Ok(output)
+}
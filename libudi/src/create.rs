@@ -10,14 +10,17 @@
 use std::fs;
 use std::io::Write;
 use std::string::String;
+use std::sync::atomic::AtomicU64;
 use std::sync::{Arc, Mutex};
 
 use super::errors::*;
+use super::pagecache::{PageCache, DEFAULT_PAGE_CACHE_CAPACITY};
 use super::protocol;
 use super::protocol::request;
 use super::protocol::response;
 use super::Process;
 use super::ProcessFileContext;
+use super::RegisterCache;
 use super::Thread;
 use super::ThreadFileContext;
 use super::ThreadState;
@@ -78,9 +81,13 @@ fn initialize_process(mut child: UdiChild) -> Result<Process, Error> {
         multithread_capable: init.mt,
         running: false,
         terminating: false,
+        stop_mode: protocol::StopMode::All,
         user_data: None,
         threads: vec![],
         child,
+        stop_epoch: Arc::new(AtomicU64::new(0)),
+        page_cache: PageCache::new(DEFAULT_PAGE_CACHE_CAPACITY),
+        event_payload_regs: vec![],
     };
 
     initialize_thread(&mut process, init.tid)?;
@@ -127,6 +134,10 @@ pub fn initialize_thread(process: &mut Process, tid: u64) -> Result<(), Error> {
         state: ThreadState::Running,
         architecture: process.architecture,
         user_data: None,
+        stop_epoch: process.stop_epoch.clone(),
+        register_cache: RegisterCache::default(),
+        prefetch_registers: false,
+        instruction_run: None,
     };
 
     #[allow(clippy::arc_with_non_send_sync)]
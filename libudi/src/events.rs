@@ -7,8 +7,9 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 //
 
-use std::collections::HashMap;
+use std::collections::{HashMap, VecDeque};
 use std::sync::{Arc, Mutex};
+use std::time::Duration;
 
 use mio::{Events, Poll, Token};
 
@@ -16,8 +17,9 @@ use super::create::initialize_thread;
 use super::errors::*;
 use super::protocol::event::EventData;
 use super::protocol::event::EventMessage;
-use super::protocol::read_event;
+use super::protocol::read_events;
 use super::protocol::EventReadError;
+use super::protocol::StopMode;
 use super::Process;
 use super::Thread;
 
@@ -41,16 +43,17 @@ pub fn wait_for_events(procs: &Vec<Arc<Mutex<Process>>>) -> Result<Vec<Event>, E
         if terminating {
             // To work around an issue on macos with kqueue and fifos, if the process is
             // terminating, wait for the process to terminate, closing the event pipe.
-            let event = handle_read_event(proc_ref)?;
-            match event.data {
-                EventData::ProcessCleanup => {
-                    output.push(event);
-                }
-                _ => {
-                    let msg = format!("Unexpected event {:?} for terminating process", event);
-                    return Err(Error::Library(msg));
-                }
-            };
+            for event in handle_read_events(proc_ref)? {
+                match event.data {
+                    EventData::ProcessCleanup => {
+                        output.push(event);
+                    }
+                    _ => {
+                        let msg = format!("Unexpected event {:?} for terminating process", event);
+                        return Err(Error::Library(msg));
+                    }
+                };
+            }
         }
     }
 
@@ -77,8 +80,7 @@ pub fn wait_for_events(procs: &Vec<Arc<Mutex<Process>>>) -> Result<Vec<Event>, E
             if event.is_readable() {
                 let event_token = event.token();
                 if let Some(proc_ref) = event_procs.get(&event_token) {
-                    let event = handle_read_event(proc_ref)?;
-                    output.push(event);
+                    output.extend(handle_read_events(proc_ref)?);
                 } else {
                     let msg = format!("Unknown event token {:?}", event_token);
                     return Err(Error::Library(msg));
@@ -90,24 +92,186 @@ pub fn wait_for_events(procs: &Vec<Arc<Mutex<Process>>>) -> Result<Vec<Event>, E
     Ok(output)
 }
 
-fn handle_read_event(proc_ref: &Arc<Mutex<Process>>) -> Result<Event, Error> {
+/// Waits for events from a set of processes. Unlike `wait_for_events`, the processes stay
+/// registered between waits, so the cost of a wait does not depend on the number of processes.
+#[derive(Debug)]
+pub struct EventLoop {
+    poll: Poll,
+    events: Events,
+    max_events: usize,
+    next_token: usize,
+    procs: HashMap<Token, Arc<Mutex<Process>>>,
+    terminating: Vec<Token>,
+    pending: VecDeque<Event>,
+}
+
+impl EventLoop {
+    /// Creates an event loop that returns at most `max_events` events from each wait
+    pub fn new(max_events: usize) -> Result<EventLoop, Error> {
+        let max_events = std::cmp::max(max_events, 1);
+
+        Ok(EventLoop {
+            poll: Poll::new()?,
+            events: Events::with_capacity(max_events),
+            max_events,
+            next_token: 0,
+            procs: HashMap::new(),
+            terminating: vec![],
+            pending: VecDeque::new(),
+        })
+    }
+
+    pub fn add_process(&mut self, proc_ref: &Arc<Mutex<Process>>) -> Result<(), Error> {
+        let token = Token(self.next_token);
+
+        {
+            let mut process = proc_ref.lock()?;
+            let file_context = process.get_file_context()?;
+            sys::register_event_source(&self.poll, token, &file_context.events_file)?;
+        }
+
+        self.next_token += 1;
+        self.procs.insert(token, proc_ref.clone());
+
+        Ok(())
+    }
+
+    /// Stops waiting for events from the process, discarding any events not yet returned.
+    /// Processes are removed automatically once their cleanup event is returned.
+    pub fn remove_process(&mut self, proc_ref: &Arc<Mutex<Process>>) -> Result<(), Error> {
+        let token = self
+            .procs
+            .iter()
+            .find(|(_, p)| Arc::ptr_eq(p, proc_ref))
+            .map(|(token, _)| *token);
+
+        if let Some(token) = token {
+            let mut process = proc_ref.lock()?;
+            if let Some(file_context) = process.file_context.as_ref() {
+                sys::deregister_event_source(&self.poll, &file_context.events_file)?;
+            }
+
+            self.remove_token(token);
+        }
+
+        self.pending.retain(|e| !Arc::ptr_eq(&e.process, proc_ref));
+
+        Ok(())
+    }
+
+    pub fn processes(&self) -> impl Iterator<Item = &Arc<Mutex<Process>>> {
+        self.procs.values()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.procs.is_empty() && self.pending.is_empty()
+    }
+
+    /// Waits for events, returning at most the maximum number of events for the loop. Events
+    /// beyond the maximum are returned by the following waits. An empty vector is returned if
+    /// the timeout expires before any events occur.
+    pub fn wait(&mut self, timeout: Option<Duration>) -> Result<Vec<Event>, Error> {
+        if self.pending.is_empty() {
+            self.read_terminating()?;
+        }
+
+        while self.pending.is_empty() && !self.procs.is_empty() {
+            self.poll.poll(&mut self.events, timeout)?;
+
+            let tokens: Vec<Token> = self
+                .events
+                .iter()
+                .filter(|e| e.is_readable())
+                .map(|e| e.token())
+                .collect();
+            for token in tokens {
+                self.read_process_events(token)?;
+            }
+
+            if timeout.is_some() {
+                break;
+            }
+        }
+
+        let count = std::cmp::min(self.pending.len(), self.max_events);
+        Ok(self.pending.drain(..count).collect())
+    }
+
+    // See wait_for_events for why the events of terminating processes are read directly
+    fn read_terminating(&mut self) -> Result<(), Error> {
+        for token in self.terminating.clone() {
+            let proc_ref = match self.procs.get(&token) {
+                Some(proc_ref) => proc_ref.clone(),
+                None => continue,
+            };
+
+            let running = proc_ref.lock()?.running;
+            if running {
+                self.read_process_events(token)?;
+            }
+        }
+
+        Ok(())
+    }
+
+    fn read_process_events(&mut self, token: Token) -> Result<(), Error> {
+        let proc_ref = match self.procs.get(&token) {
+            Some(proc_ref) => proc_ref.clone(),
+            None => {
+                // the process was removed after the poll returned
+                return Ok(());
+            }
+        };
+
+        for event in handle_read_events(&proc_ref)? {
+            match event.data {
+                EventData::ProcessExit { .. } => self.terminating.push(token),
+                EventData::ProcessCleanup => self.remove_token(token),
+                _ => {}
+            }
+
+            self.pending.push_back(event);
+        }
+
+        // the registration is edge triggered and only one message was read, so re-arm it to be
+        // notified of any message that is already queued behind it
+        if self.procs.contains_key(&token) {
+            let process = proc_ref.lock()?;
+            if let Some(file_context) = process.file_context.as_ref() {
+                sys::reregister_event_source(&self.poll, token, &file_context.events_file)?;
+            }
+        }
+
+        Ok(())
+    }
+
+    fn remove_token(&mut self, token: Token) {
+        self.procs.remove(&token);
+        self.terminating.retain(|t| *t != token);
+    }
+}
+
+pub(crate) fn handle_read_events(proc_ref: &Arc<Mutex<Process>>) -> Result<Vec<Event>, Error> {
     let mut process = proc_ref.lock()?;
 
-    match read_event(&mut process.get_file_context()?.events_file) {
-        Ok(event_msg) => {
-            let event = handle_event_message(proc_ref, &mut process, event_msg)?;
+    match read_events(&mut process.get_file_context()?.events_file) {
+        Ok(event_msgs) => {
+            let mut events = Vec::with_capacity(event_msgs.len());
+            for event_msg in event_msgs {
+                events.push(handle_event_message(proc_ref, &mut process, event_msg)?);
+            }
 
-            Ok(event)
+            Ok(events)
         }
         Err(EventReadError::Eof) => {
             // Process has closed its pipe
             process.file_context = None;
 
-            Ok(Event {
+            Ok(vec![Event {
                 process: proc_ref.clone(),
                 thread: process.threads[0].clone(),
                 data: EventData::ProcessCleanup,
-            })
+            }])
         }
         Err(EventReadError::Udi(e)) => Err(e),
     }
@@ -118,7 +282,12 @@ fn handle_event_message(
     process: &mut Process,
     message: EventMessage,
 ) -> Result<Event, Error> {
-    process.running = false;
+    // in non-stop mode, the other threads keep running until the process exits
+    if process.stop_mode != StopMode::NonStop
+        || matches!(message.data, EventData::ProcessExit { .. })
+    {
+        process.running = false;
+    }
 
     // Locate the event thread
     let mut t = None;
@@ -130,11 +299,15 @@ fn handle_event_message(
     }
 
     let event = match t {
-        Some(thr) => Event {
-            process: proc_ref.clone(),
-            thread: thr,
-            data: message.data,
-        },
+        Some(thr) => {
+            process.cache_event_payload(&mut *thr.lock()?, message.payload)?;
+
+            Event {
+                process: proc_ref.clone(),
+                thread: thr,
+                data: message.data,
+            }
+        }
         None => {
             let msg = format!("Failed to locate event thread with tid {:?}", message.tid);
             return Err(Error::Library(msg));
@@ -175,6 +348,24 @@ mod sys {
             .registry()
             .register(&mut SourceFd(&file.as_raw_fd()), token, Interest::READABLE)?)
     }
+
+    pub fn reregister_event_source(
+        poll: &Poll,
+        token: Token,
+        file: &fs::File,
+    ) -> Result<(), Error> {
+        Ok(poll.registry().reregister(
+            &mut SourceFd(&file.as_raw_fd()),
+            token,
+            Interest::READABLE,
+        )?)
+    }
+
+    pub fn deregister_event_source(poll: &Poll, file: &fs::File) -> Result<(), Error> {
+        Ok(poll
+            .registry()
+            .deregister(&mut SourceFd(&file.as_raw_fd()))?)
+    }
 }
 
 #[cfg(windows)]
@@ -8,26 +8,49 @@
 #![deny(warnings)]
 #![recursion_limit = "1024"]
 
+use std::collections::HashMap;
 use std::fs;
+use std::sync::atomic::AtomicU64;
 use std::sync::{Arc, Mutex};
 
 use downcast_rs::Downcast;
 
+#[cfg(unix)]
+mod aio;
+mod branches;
+mod compress;
 mod create;
 mod errors;
 mod events;
+mod memstream;
+mod mirror;
+mod pagecache;
 mod process;
 pub mod protocol;
 mod thread;
 
+#[cfg(unix)]
+pub use aio::{AsyncProcess, AsyncThread, EventStream};
+pub use branches::BranchTrace;
 pub use create::create_process;
 pub use create::ProcessConfig;
 pub use errors::*;
 pub use events::wait_for_events;
 pub use events::Event;
+pub use events::EventLoop;
+pub use memstream::{MemoryReader, MemoryWriter};
+pub use mirror::MemoryMirror;
+pub use pagecache::PageCacheStats;
 pub use protocol::event::EventData;
+pub use protocol::event::InstructionRun;
+pub use protocol::event::Type as EventType;
+pub use protocol::response::MemoryRegion;
+pub use protocol::response::StopStats;
+pub use protocol::response::VectorRegisters;
 pub use protocol::Architecture;
 pub use protocol::Register;
+pub use protocol::SignalPolicy;
+pub use protocol::StopMode;
 
 pub trait UserData: Downcast + std::fmt::Debug {}
 downcast_rs::impl_downcast!(UserData);
@@ -49,9 +72,13 @@ pub struct Process {
     multithread_capable: bool,
     running: bool,
     terminating: bool,
+    stop_mode: StopMode,
     user_data: Option<Box<dyn UserData>>,
     threads: Vec<Arc<Mutex<Thread>>>,
     child: create::UdiChild,
+    stop_epoch: Arc<AtomicU64>,
+    page_cache: pagecache::PageCache,
+    event_payload_regs: Vec<Register>,
 }
 
 #[derive(Debug, Copy, Clone, PartialEq)]
@@ -66,6 +93,14 @@ struct ThreadFileContext {
     response_file: fs::File,
 }
 
+/// Register values read during a single stop of a thread
+#[derive(Debug, Default)]
+struct RegisterCache {
+    epoch: u64,
+    values: HashMap<u32, u64>,
+    complete: bool,
+}
+
 #[allow(dead_code)]
 #[derive(Debug)]
 pub struct Thread {
@@ -76,4 +111,8 @@ pub struct Thread {
     state: ThreadState,
     architecture: Architecture,
     user_data: Option<Box<dyn UserData>>,
+    stop_epoch: Arc<AtomicU64>,
+    register_cache: RegisterCache,
+    prefetch_registers: bool,
+    instruction_run: Option<InstructionRun>,
 }
@@ -0,0 +1,297 @@
+//
+// Copyright (c) 2011-2023, UDI Contributors
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+
+use std::io::{self, Read, Write};
+
+use ciborium::ser::into_writer as cbor_into_writer;
+
+use super::errors::*;
+use super::protocol::{request, response};
+use super::Process;
+
+// The maximum size of a chunk sent to the runtime, which bounds its memory use
+const MAX_WRITE_CHUNK: usize = 64 * 1024;
+
+const MAJOR_UNSIGNED: u8 = 0;
+const MAJOR_BYTES: u8 = 2;
+const MAJOR_TEXT: u8 = 3;
+const MAJOR_MAP: u8 = 5;
+const MAJOR_SIMPLE: u8 = 7;
+const INDEFINITE: u8 = 31;
+const BREAK: u8 = 0xff;
+
+fn write_header<W: Write>(writer: &mut W, major: u8, value: u64) -> io::Result<()> {
+    let major = major << 5;
+    if value < 24 {
+        writer.write_all(&[major | value as u8])
+    } else if value <= u8::MAX as u64 {
+        writer.write_all(&[major | 24, value as u8])
+    } else if value <= u16::MAX as u64 {
+        writer.write_all(&[major | 25])?;
+        writer.write_all(&(value as u16).to_be_bytes())
+    } else if value <= u32::MAX as u64 {
+        writer.write_all(&[major | 26])?;
+        writer.write_all(&(value as u32).to_be_bytes())
+    } else {
+        writer.write_all(&[major | 27])?;
+        writer.write_all(&value.to_be_bytes())
+    }
+}
+
+fn write_text<W: Write>(writer: &mut W, text: &str) -> io::Result<()> {
+    write_header(writer, MAJOR_TEXT, text.len() as u64)?;
+    writer.write_all(text.as_bytes())
+}
+
+/// Reads a header, returning the major type and the value. The value is None for an
+/// indefinite length item and for a break.
+fn read_header<R: Read>(reader: &mut R) -> Result<(u8, Option<u64>), Error> {
+    let mut initial = [0u8; 1];
+    reader.read_exact(&mut initial)?;
+
+    let major = initial[0] >> 5;
+    let info = initial[0] & 0x1f;
+    let value = match info {
+        0..=23 => Some(info as u64),
+        24..=27 => {
+            let mut buf = [0u8; 8];
+            let size = 1 << (info - 24);
+            reader.read_exact(&mut buf[8 - size..])?;
+            Some(u64::from_be_bytes(buf))
+        }
+        INDEFINITE => None,
+        _ => {
+            return Err(Error::Library(format!(
+                "Invalid CBOR header {:x} in memory stream",
+                initial[0]
+            )))
+        }
+    };
+
+    Ok((major, value))
+}
+
+fn read_text<R: Read>(reader: &mut R) -> Result<String, Error> {
+    match read_header(reader)? {
+        (MAJOR_TEXT, Some(len)) => {
+            let mut text = String::new();
+            (&mut *reader).take(len).read_to_string(&mut text)?;
+            Ok(text)
+        }
+        _ => Err(Error::Library(
+            "Expected text string in memory stream".to_owned(),
+        )),
+    }
+}
+
+fn expect_key<R: Read>(reader: &mut R, key: &str) -> Result<(), Error> {
+    let actual = read_text(reader)?;
+    if actual != key {
+        return Err(Error::Library(format!(
+            "Expected key {} in memory stream, found {}",
+            key, actual
+        )));
+    }
+    Ok(())
+}
+
+fn to_io_error(err: Error) -> io::Error {
+    match err {
+        Error::Io(err) => err,
+        err => io::Error::other(err.to_string()),
+    }
+}
+
+/// Reads debuggee memory as a stream. The process cannot be used for other requests
+/// until the reader is dropped; dropping the reader early discards the rest of the
+/// transfer.
+#[derive(Debug)]
+pub struct MemoryReader<'a> {
+    process: &'a mut Process,
+    chunk_remaining: u64,
+    done: bool,
+}
+
+impl<'a> MemoryReader<'a> {
+    pub(crate) fn new(
+        process: &'a mut Process,
+        addr: u64,
+        len: u64,
+    ) -> Result<MemoryReader<'a>, Error> {
+        let msg = request::ReadMemoryStream::new(addr, len);
+
+        let ctx = process.get_file_context()?;
+        ctx.request_file.write_all(&request::serialize(&msg)?)?;
+
+        let file = &mut ctx.response_file;
+        response::read_no_data(file)?;
+
+        if read_header(file)? != (MAJOR_MAP, Some(2)) {
+            return Err(Error::Library(
+                "Expected map in memory stream response".to_owned(),
+            ));
+        }
+        expect_key(file, "data")?;
+        if read_header(file)? != (MAJOR_BYTES, None) {
+            return Err(Error::Library(
+                "Expected indefinite byte string in memory stream response".to_owned(),
+            ));
+        }
+
+        Ok(MemoryReader {
+            process,
+            chunk_remaining: 0,
+            done: false,
+        })
+    }
+
+    fn next_chunk(&mut self) -> Result<(), Error> {
+        let file = &mut self.process.get_file_context()?.response_file;
+
+        match read_header(file)? {
+            (MAJOR_BYTES, Some(len)) => {
+                self.chunk_remaining = len;
+                Ok(())
+            }
+            (MAJOR_SIMPLE, None) => {
+                self.done = true;
+
+                expect_key(file, "error")?;
+                let msg = read_text(file)?;
+                if !msg.is_empty() {
+                    return Err(Error::Request(msg));
+                }
+                Ok(())
+            }
+            _ => Err(Error::Library(
+                "Unexpected item in memory stream response".to_owned(),
+            )),
+        }
+    }
+}
+
+impl<'a> Read for MemoryReader<'a> {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        while self.chunk_remaining == 0 {
+            if self.done || buf.is_empty() {
+                return Ok(0);
+            }
+            self.next_chunk().map_err(to_io_error)?;
+        }
+
+        let size = std::cmp::min(buf.len() as u64, self.chunk_remaining) as usize;
+
+        let file = &mut self
+            .process
+            .get_file_context()
+            .map_err(to_io_error)?
+            .response_file;
+        let count = file.read(&mut buf[..size])?;
+        if count == 0 {
+            return Err(io::ErrorKind::UnexpectedEof.into());
+        }
+
+        self.chunk_remaining -= count as u64;
+
+        Ok(count)
+    }
+}
+
+impl<'a> Drop for MemoryReader<'a> {
+    fn drop(&mut self) {
+        // the rest of the response needs to be consumed to keep the protocol in sync
+        let _ = io::copy(self, &mut io::sink());
+    }
+}
+
+/// Writes debuggee memory as a stream, sending the data in chunks as it is written.
+/// Errors writing memory are reported by `finish`. The process cannot be used for
+/// other requests until the writer is finished or dropped.
+#[derive(Debug)]
+pub struct MemoryWriter<'a> {
+    process: &'a mut Process,
+    addr: u64,
+    finished: bool,
+}
+
+impl<'a> MemoryWriter<'a> {
+    pub(crate) fn new(process: &'a mut Process, addr: u64) -> Result<MemoryWriter<'a>, Error> {
+        let mut header = vec![];
+
+        cbor_into_writer(&request::Type::WriteMemoryStream, &mut header)
+            .map_err(|e| Error::Library(format!("Failed to serialize request type: {}", e)))?;
+        write_header(&mut header, MAJOR_MAP, 2)?;
+        write_text(&mut header, "addr")?;
+        write_header(&mut header, MAJOR_UNSIGNED, addr)?;
+        write_text(&mut header, "data")?;
+        header.push((MAJOR_BYTES << 5) | INDEFINITE);
+
+        process
+            .get_file_context()?
+            .request_file
+            .write_all(&header)?;
+
+        Ok(MemoryWriter {
+            process,
+            addr,
+            finished: false,
+        })
+    }
+
+    pub fn finish(mut self) -> Result<(), Error> {
+        self.finish_stream()
+    }
+
+    fn finish_stream(&mut self) -> Result<(), Error> {
+        self.finished = true;
+
+        let ctx = self.process.get_file_context()?;
+        ctx.request_file.write_all(&[BREAK])?;
+
+        response::read_no_data(&mut ctx.response_file)
+    }
+}
+
+impl<'a> Write for MemoryWriter<'a> {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        if buf.is_empty() {
+            return Ok(0);
+        }
+
+        let size = std::cmp::min(buf.len(), MAX_WRITE_CHUNK);
+
+        let mut chunk = Vec::with_capacity(size + 9);
+        write_header(&mut chunk, MAJOR_BYTES, size as u64)?;
+        chunk.extend_from_slice(&buf[..size]);
+
+        let file = &mut self
+            .process
+            .get_file_context()
+            .map_err(to_io_error)?
+            .request_file;
+        file.write_all(&chunk)?;
+
+        self.process.page_cache.invalidate(self.addr, size as u64);
+        self.addr = self.addr.wrapping_add(size as u64);
+
+        Ok(size)
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
+
+impl<'a> Drop for MemoryWriter<'a> {
+    fn drop(&mut self) {
+        if !self.finished {
+            let _ = self.finish_stream();
+        }
+    }
+}
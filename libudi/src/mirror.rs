@@ -0,0 +1,159 @@
+//
+// Copyright (c) 2011-2023, UDI Contributors
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+
+use super::errors::*;
+use super::Process;
+
+pub const DEFAULT_MIRROR_BLOCK_SIZE: u32 = 4096;
+
+// Bounds the size of a single read request when re-fetching changed blocks
+const MAX_REFRESH_READ: u64 = 1 << 20;
+
+#[derive(Debug)]
+struct MirroredRange {
+    addr: u64,
+    data: Vec<u8>,
+    hashes: Vec<Option<u64>>,
+}
+
+/// A local copy of ranges of debuggee memory that is kept up to date by
+/// comparing per-block hashes computed in the debuggee and only re-reading the
+/// blocks that changed.
+#[derive(Debug)]
+pub struct MemoryMirror {
+    block_size: u32,
+    ranges: Vec<MirroredRange>,
+    refreshed: bool,
+}
+
+impl MemoryMirror {
+    /// Creates an empty mirror that hashes blocks of `block_size` bytes, 0 selects
+    /// `DEFAULT_MIRROR_BLOCK_SIZE` as the runtime does
+    pub fn new(block_size: u32) -> MemoryMirror {
+        let block_size = if block_size == 0 {
+            DEFAULT_MIRROR_BLOCK_SIZE
+        } else {
+            block_size
+        };
+
+        MemoryMirror {
+            block_size,
+            ranges: vec![],
+            refreshed: false,
+        }
+    }
+
+    pub fn add_range(&mut self, addr: u64, len: u64) {
+        self.ranges.push(MirroredRange {
+            addr,
+            data: vec![0; len as usize],
+            hashes: vec![],
+        });
+        self.refreshed = false;
+    }
+
+    /// Returns the mirrored data for the range that starts at the specified address
+    pub fn data(&self, addr: u64) -> Option<&[u8]> {
+        self.ranges
+            .iter()
+            .find(|r| r.addr == addr)
+            .map(|r| r.data.as_slice())
+    }
+
+    /// Brings the mirror up to date with the debuggee, returning the (address, length) of
+    /// each span that changed since the last refresh. Blocks that cannot be read are mirrored
+    /// as zeros.
+    pub fn refresh(&mut self, process: &mut Process) -> Result<Vec<(u64, u64)>, Error> {
+        let request: Vec<(u64, u64)> = self
+            .ranges
+            .iter()
+            .map(|r| (r.addr, r.data.len() as u64))
+            .collect();
+
+        let all_hashes = process.hash_mem(&request, self.block_size)?;
+
+        let block_size = self.block_size as u64;
+        let mut changed = vec![];
+        for (range, hashes) in self.ranges.iter_mut().zip(all_hashes) {
+            let len = range.data.len() as u64;
+            if hashes.len() as u64 != len.div_ceil(block_size) {
+                return Err(Error::Library(format!(
+                    "Unexpected number of block hashes for range at {:x}",
+                    range.addr
+                )));
+            }
+
+            let mut span_start: Option<u64> = None;
+            for (i, hash) in hashes.iter().enumerate() {
+                let offset = i as u64 * block_size;
+                let block_len = std::cmp::min(block_size, len - offset);
+
+                let prev = if self.refreshed {
+                    range.hashes.get(i).copied()
+                } else {
+                    None
+                };
+
+                let block_changed = prev != Some(*hash);
+                if block_changed && hash.is_some() {
+                    span_start.get_or_insert(offset);
+                    continue;
+                }
+
+                if let Some(start) = span_start.take() {
+                    Self::read_span(process, range, start, offset - start, &mut changed)?;
+                }
+
+                if block_changed {
+                    let block = &mut range.data[offset as usize..(offset + block_len) as usize];
+                    block.fill(0);
+                    changed.push((range.addr + offset, block_len));
+                }
+            }
+
+            if let Some(start) = span_start.take() {
+                Self::read_span(process, range, start, len - start, &mut changed)?;
+            }
+
+            range.hashes = hashes;
+        }
+
+        self.refreshed = true;
+
+        Ok(changed)
+    }
+
+    fn read_span(
+        process: &mut Process,
+        range: &mut MirroredRange,
+        start: u64,
+        len: u64,
+        changed: &mut Vec<(u64, u64)>,
+    ) -> Result<(), Error> {
+        let mut offset = start;
+        while offset < start + len {
+            let size = std::cmp::min(MAX_REFRESH_READ, start + len - offset);
+
+            let data = process.read_mem(size as u32, range.addr + offset)?;
+            range.data[offset as usize..(offset + size) as usize].copy_from_slice(&data);
+
+            offset += size;
+        }
+
+        changed.push((range.addr + start, len));
+
+        Ok(())
+    }
+}
+
+impl Default for MemoryMirror {
+    fn default() -> Self {
+        Self::new(DEFAULT_MIRROR_BLOCK_SIZE)
+    }
+}
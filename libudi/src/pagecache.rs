@@ -0,0 +1,219 @@
+//
+// Copyright (c) 2011-2023, UDI Contributors
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+
+use std::collections::HashMap;
+
+pub const PAGE_SIZE: u64 = 4096;
+
+pub const DEFAULT_PAGE_CACHE_CAPACITY: usize = 256;
+
+// Larger reads bypass the cache, so they do not evict the working set and can still be
+// compressed by the runtime
+const MAX_CACHED_READ_PAGES: u64 = 16;
+
+/// Counters describing the effectiveness of the page cache
+#[derive(Debug, Default, Copy, Clone, PartialEq)]
+pub struct PageCacheStats {
+    pub hits: u64,
+    pub misses: u64,
+}
+
+#[derive(Debug)]
+struct CachedPage {
+    data: Vec<u8>,
+    last_use: u64,
+}
+
+/// Pages of debuggee memory read during a single stop of the process. The cache is
+/// emptied when the stop epoch changes and evicts the least recently used page when
+/// it reaches its capacity. It also holds unaligned ranges of memory delivered with
+/// events, such as the top of a thread's stack.
+#[derive(Debug)]
+pub(crate) struct PageCache {
+    capacity: usize,
+    prefetch: bool,
+    epoch: u64,
+    tick: u64,
+    pages: HashMap<u64, CachedPage>,
+    ranges: Vec<(u64, Vec<u8>)>,
+    stats: PageCacheStats,
+}
+
+pub(crate) fn page_base(addr: u64) -> u64 {
+    addr & !(PAGE_SIZE - 1)
+}
+
+impl PageCache {
+    pub fn new(capacity: usize) -> PageCache {
+        PageCache {
+            capacity,
+            prefetch: false,
+            epoch: 0,
+            tick: 0,
+            pages: HashMap::new(),
+            ranges: vec![],
+            stats: PageCacheStats::default(),
+        }
+    }
+
+    pub fn capacity(&self) -> usize {
+        self.capacity
+    }
+
+    pub fn set_capacity(&mut self, capacity: usize) {
+        self.capacity = capacity;
+        if capacity == 0 {
+            self.ranges.clear();
+        }
+        while self.pages.len() > capacity {
+            self.evict();
+        }
+    }
+
+    pub fn prefetch(&self) -> bool {
+        self.prefetch
+    }
+
+    pub fn set_prefetch(&mut self, prefetch: bool) {
+        self.prefetch = prefetch;
+    }
+
+    pub fn stats(&self) -> PageCacheStats {
+        self.stats
+    }
+
+    /// Empties the cache if the process has been continued since it was filled
+    pub fn sync(&mut self, epoch: u64) {
+        if self.epoch != epoch {
+            self.pages.clear();
+            self.ranges.clear();
+            self.epoch = epoch;
+        }
+    }
+
+    /// Determines if a read of the specified range should go through the cache
+    pub fn is_cacheable(&self, addr: u64, size: u32) -> bool {
+        if size == 0 || addr.checked_add(size as u64).is_none() {
+            return false;
+        }
+
+        let num_pages = (page_base(addr + size as u64 - 1) - page_base(addr)) / PAGE_SIZE + 1;
+        num_pages <= std::cmp::min(self.capacity as u64, MAX_CACHED_READ_PAGES)
+    }
+
+    /// Looks up a page for a read, recording a hit or a miss
+    pub fn lookup(&mut self, page: u64) -> bool {
+        self.tick += 1;
+        match self.pages.get_mut(&page) {
+            Some(cached) => {
+                self.stats.hits += 1;
+                cached.last_use = self.tick;
+                true
+            }
+            None => {
+                self.stats.misses += 1;
+                false
+            }
+        }
+    }
+
+    pub fn contains(&self, page: u64) -> bool {
+        self.pages.contains_key(&page)
+    }
+
+    pub fn get(&self, page: u64) -> Option<&[u8]> {
+        self.pages.get(&page).map(|cached| cached.data.as_slice())
+    }
+
+    pub fn insert(&mut self, page: u64, data: Vec<u8>) {
+        if self.capacity == 0 {
+            return;
+        }
+
+        if !self.pages.contains_key(&page) && self.pages.len() >= self.capacity {
+            self.evict();
+        }
+
+        self.tick += 1;
+        self.pages.insert(
+            page,
+            CachedPage {
+                data,
+                last_use: self.tick,
+            },
+        );
+    }
+
+    pub fn insert_range(&mut self, addr: u64, data: Vec<u8>) {
+        if self.capacity == 0 || data.is_empty() {
+            return;
+        }
+
+        self.invalidate(addr, data.len() as u64);
+        self.ranges.push((addr, data));
+    }
+
+    /// Reads the specified memory from a cached range that contains all of it
+    pub fn read_range(&mut self, addr: u64, size: u32) -> Option<Vec<u8>> {
+        let end = addr.checked_add(size as u64)?;
+
+        let (start, data) = self
+            .ranges
+            .iter()
+            .find(|(start, data)| *start <= addr && end <= *start + data.len() as u64)?;
+
+        self.stats.hits += 1;
+
+        let offset = (addr - start) as usize;
+        Some(data[offset..offset + size as usize].to_vec())
+    }
+
+    /// Drops any cached pages and ranges that overlap the specified range
+    pub fn invalidate(&mut self, addr: u64, len: u64) {
+        if len == 0 {
+            return;
+        }
+
+        let end = addr.saturating_add(len);
+        self.ranges
+            .retain(|(start, data)| end <= *start || *start + data.len() as u64 <= addr);
+
+        if self.pages.is_empty() {
+            return;
+        }
+
+        let first = page_base(addr);
+        let last = page_base(addr.saturating_add(len - 1));
+        if (last - first) / PAGE_SIZE >= self.pages.len() as u64 {
+            self.pages.retain(|page, _| *page < first || *page > last);
+            return;
+        }
+
+        let mut page = first;
+        loop {
+            self.pages.remove(&page);
+            if page >= last {
+                break;
+            }
+            page += PAGE_SIZE;
+        }
+    }
+
+    fn evict(&mut self) {
+        let oldest = self
+            .pages
+            .iter()
+            .min_by_key(|(_, cached)| cached.last_use)
+            .map(|(page, _)| *page);
+
+        if let Some(page) = oldest {
+            self.pages.remove(&page);
+        }
+    }
+}
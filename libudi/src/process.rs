@@ -11,20 +11,32 @@
 use ::std::fs::File;
 use ::std::io::Write;
 use ::std::slice::Iter;
+use ::std::sync::atomic::Ordering;
 use ::std::sync::{Arc, Mutex};
 
 use serde::de::DeserializeOwned;
 use serde::Serialize;
 
+use super::compress;
 use super::errors::*;
-use super::protocol::{request, response};
+use super::pagecache::{page_base, PAGE_SIZE};
+use super::protocol::{event, request, response, MemoryCodec, SignalPolicy, StopMode};
 use super::Architecture;
+use super::MemoryReader;
+use super::MemoryRegion;
+use super::MemoryWriter;
+use super::PageCacheStats;
 use super::Process;
 use super::ProcessFileContext;
+use super::Register;
 use super::Thread;
 use super::ThreadState;
 use super::UserData;
 
+// Reads at least this large ask the runtime to compress the data, which it only
+// does when that makes the response smaller
+const COMPRESSED_READ_THRESHOLD: u32 = 64 * 1024;
+
 impl Process {
     pub fn is_multithread_capable(&self) -> bool {
         self.multithread_capable
@@ -65,7 +77,16 @@ impl Process {
     }
 
     pub fn continue_process(&mut self) -> Result<(), Error> {
-        let msg = request::Continue::new(0);
+        self.continue_process_with_signal(0)
+    }
+
+    /// Continues the process with the specified signal, usually the signal reported by the last
+    /// signal event, which is then delivered to the thread that received it
+    pub fn continue_process_with_signal(&mut self, sig: u32) -> Result<(), Error> {
+        let msg = request::Continue::new(sig);
+
+        // register values cached by the threads are stale once the process runs
+        self.stop_epoch.fetch_add(1, Ordering::SeqCst);
 
         if self.terminating {
             let ctx = self.get_file_context()?;
@@ -92,6 +113,8 @@ impl Process {
     pub fn install_breakpoint(&mut self, addr: u64) -> Result<(), Error> {
         let msg = request::InstallBreakpoint::new(addr);
 
+        self.page_cache.invalidate(addr, 1);
+
         self.send_request_no_data(&msg)?;
 
         Ok(())
@@ -100,6 +123,8 @@ impl Process {
     pub fn remove_breakpoint(&mut self, addr: u64) -> Result<(), Error> {
         let msg = request::RemoveBreakpoint::new(addr);
 
+        self.page_cache.invalidate(addr, 1);
+
         self.send_request_no_data(&msg)?;
 
         Ok(())
@@ -137,17 +162,304 @@ impl Process {
     pub fn write_mem(&mut self, data: &[u8], addr: u64) -> Result<(), Error> {
         let msg = request::WriteMemory::new(addr, data);
 
+        self.page_cache.invalidate(addr, data.len() as u64);
+
+        self.send_request_no_data(&msg)?;
+
+        Ok(())
+    }
+
+    pub fn set_page_cache_capacity(&mut self, pages: usize) {
+        self.page_cache.set_capacity(pages);
+    }
+
+    pub fn get_page_cache_capacity(&self) -> usize {
+        self.page_cache.capacity()
+    }
+
+    pub fn set_page_cache_prefetch(&mut self, prefetch: bool) {
+        self.page_cache.set_prefetch(prefetch);
+    }
+
+    pub fn get_page_cache_prefetch(&self) -> bool {
+        self.page_cache.prefetch()
+    }
+
+    pub fn page_cache_stats(&self) -> PageCacheStats {
+        self.page_cache.stats()
+    }
+
+    pub fn set_event_payload(&mut self, regs: &[Register], stack: u32) -> Result<(), Error> {
+        let reg_values: Vec<u32> = regs.iter().map(|reg| *reg as u32).collect();
+
+        let msg = request::SetEventPayload::new(&reg_values, stack);
+
         self.send_request_no_data(&msg)?;
 
+        self.event_payload_regs = regs.to_vec();
+
+        Ok(())
+    }
+
+    /// Configures the thread create, thread death and fork events that are not reported
+    /// for the process. A masked thread create or death is still reported alongside the
+    /// next event that refers to the thread.
+    pub fn set_event_mask(&mut self, events: &[event::Type]) -> Result<(), Error> {
+        let mask = events
+            .iter()
+            .fold(0, |mask, typ| mask | (1 << (*typ as u32)));
+
+        let msg = request::SetEventMask::new(mask);
+
+        self.send_request_no_data(&msg)
+    }
+
+    /// Configures how the process handles the specified signal. Fault signals must stop the
+    /// process, and a signal can only be passed while the debuggee has a handler for it.
+    pub fn set_signal_policy(&mut self, sig: u32, policy: SignalPolicy) -> Result<(), Error> {
+        let msg = request::SetSignalPolicy::new(sig, policy);
+
+        self.send_request_no_data(&msg)
+    }
+
+    /// Configures whether an event stops all threads of the process. The mode takes effect
+    /// once no thread is stopped. In non-stop mode, only the thread that triggered an event
+    /// stops and stopped threads are continued individually with `Thread::continue_thread`.
+    pub fn set_stop_mode(&mut self, mode: StopMode) -> Result<(), Error> {
+        let msg = request::SetStopMode::new(mode);
+
+        self.send_request_no_data(&msg)?;
+
+        self.stop_mode = mode;
+
+        Ok(())
+    }
+
+    pub fn get_stop_mode(&self) -> StopMode {
+        self.stop_mode
+    }
+
+    /// Populates the register and page caches with the data included with an event
+    pub(crate) fn cache_event_payload(
+        &mut self,
+        thr: &mut Thread,
+        payload: event::Payload,
+    ) -> Result<(), Error> {
+        thr.instruction_run = payload.run;
+
+        if let Some(values) = payload.regs {
+            if values.len() != self.event_payload_regs.len() {
+                return Err(Error::Library(format!(
+                    "Expected {} register values in event, received {}",
+                    self.event_payload_regs.len(),
+                    values.len()
+                )));
+            }
+
+            let regs = self
+                .event_payload_regs
+                .iter()
+                .zip(values)
+                .filter_map(|(reg, value)| value.map(|v| (*reg, v)));
+            thr.cache_registers(regs);
+        }
+
+        // memory changes while other threads run in non-stop mode, so it is not cached
+        if self.stop_mode == StopMode::NonStop {
+            return Ok(());
+        }
+
+        if let (Some(sp), Some(stack)) = (payload.sp, payload.stack) {
+            self.page_cache.sync(self.stop_epoch.load(Ordering::SeqCst));
+            self.page_cache.insert_range(sp, stack);
+        }
+
         Ok(())
     }
 
     pub fn read_mem(&mut self, size: u32, addr: u64) -> Result<Vec<u8>, Error> {
-        let msg = request::ReadMemory::new(addr, size);
+        if self.stop_mode == StopMode::NonStop {
+            return self.read_mem_uncached(size, addr);
+        }
+
+        self.page_cache.sync(self.stop_epoch.load(Ordering::SeqCst));
+        if let Some(data) = self.page_cache.read_range(addr, size) {
+            return Ok(data);
+        }
+
+        if !self.page_cache.is_cacheable(addr, size) {
+            return self.read_mem_uncached(size, addr);
+        }
+
+        let first = page_base(addr);
+        let last = page_base(addr + size as u64 - 1);
+
+        let mut missing = vec![];
+        let mut page = first;
+        while page <= last {
+            if !self.page_cache.lookup(page) {
+                missing.push(page);
+            }
+            page += PAGE_SIZE;
+        }
+
+        let prefetch_page = last
+            .checked_add(PAGE_SIZE)
+            .filter(|page| self.page_cache.prefetch() && !self.page_cache.contains(*page));
+
+        if !missing.is_empty() && self.fill_page_cache(&missing, prefetch_page).is_err() {
+            // let the runtime report the error for the requested range
+            return self.read_mem_uncached(size, addr);
+        }
+
+        let mut data = Vec::with_capacity(size as usize);
+        let end = addr + size as u64;
+        let mut page = first;
+        while page <= last {
+            let contents = match self.page_cache.get(page) {
+                Some(contents) => contents,
+                None => return self.read_mem_uncached(size, addr),
+            };
+
+            let start = std::cmp::max(addr, page) - page;
+            let stop = std::cmp::min(end, page + PAGE_SIZE) - page;
+            data.extend_from_slice(&contents[start as usize..stop as usize]);
+
+            page += PAGE_SIZE;
+        }
+
+        Ok(data)
+    }
+
+    /// Reads the missing pages into the page cache, one request per run of contiguous
+    /// pages. The prefetched page is dropped if it cannot be read.
+    fn fill_page_cache(
+        &mut self,
+        missing: &[u64],
+        prefetch_page: Option<u64>,
+    ) -> Result<(), Error> {
+        let mut runs: Vec<(u64, u64)> = vec![];
+        for page in missing {
+            match runs.last_mut() {
+                Some((start, count)) if *start + *count * PAGE_SIZE == *page => *count += 1,
+                _ => runs.push((*page, 1)),
+            }
+        }
+
+        let num_runs = runs.len();
+        for (i, (start, count)) in runs.into_iter().enumerate() {
+            let prefetch = i + 1 == num_runs && prefetch_page == Some(start + count * PAGE_SIZE);
+
+            let contents = if prefetch {
+                match self.read_mem_uncached(((count + 1) * PAGE_SIZE) as u32, start) {
+                    Ok(contents) => contents,
+                    Err(_) => self.read_mem_uncached((count * PAGE_SIZE) as u32, start)?,
+                }
+            } else {
+                self.read_mem_uncached((count * PAGE_SIZE) as u32, start)?
+            };
+
+            for (j, chunk) in contents.chunks(PAGE_SIZE as usize).enumerate() {
+                self.page_cache
+                    .insert(start + j as u64 * PAGE_SIZE, chunk.to_vec());
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Determines the codec used to transfer a memory read of the specified size
+    pub(crate) fn read_codec(size: u32) -> MemoryCodec {
+        if size >= COMPRESSED_READ_THRESHOLD {
+            MemoryCodec::Lz4
+        } else {
+            MemoryCodec::None
+        }
+    }
+
+    fn read_mem_uncached(&mut self, size: u32, addr: u64) -> Result<Vec<u8>, Error> {
+        let codec = Process::read_codec(size);
+
+        let msg = request::ReadMemory::with_codec(addr, size, codec);
 
         let resp: response::ReadMemory = self.send_request(&msg)?;
 
-        Ok(resp.data)
+        match resp.codec {
+            MemoryCodec::None => Ok(resp.data),
+            MemoryCodec::Lz4 => compress::decompress_lz4(&resp.data, size as usize),
+        }
+    }
+
+    pub fn read_mem_stream(&mut self, addr: u64, len: u64) -> Result<MemoryReader<'_>, Error> {
+        MemoryReader::new(self, addr, len)
+    }
+
+    pub fn write_mem_stream(&mut self, addr: u64) -> Result<MemoryWriter<'_>, Error> {
+        MemoryWriter::new(self, addr)
+    }
+
+    pub fn search_mem(
+        &mut self,
+        addr: u64,
+        len: u64,
+        pattern: &[u8],
+        mask: Option<&[u8]>,
+        max_hits: u32,
+    ) -> Result<Vec<u64>, Error> {
+        if pattern.is_empty() {
+            return Err(Error::Request("Search pattern cannot be empty".to_owned()));
+        }
+
+        let mask = mask.unwrap_or(&[]);
+        if !mask.is_empty() && mask.len() != pattern.len() {
+            return Err(Error::Request(
+                "Search mask must be the same length as the pattern".to_owned(),
+            ));
+        }
+
+        let msg = request::SearchMemory::new(addr, len, pattern, mask, max_hits);
+
+        let resp: response::SearchMemory = self.send_request(&msg)?;
+
+        Ok(resp.addrs)
+    }
+
+    pub fn hash_mem(
+        &mut self,
+        ranges: &[(u64, u64)],
+        block_size: u32,
+    ) -> Result<Vec<Vec<Option<u64>>>, Error> {
+        let addrs: Vec<u64> = ranges.iter().map(|r| r.0).collect();
+        let lens: Vec<u64> = ranges.iter().map(|r| r.1).collect();
+
+        let msg = request::HashMemory::new(&addrs, &lens, block_size);
+
+        let resp: response::HashMemory = self.send_request(&msg)?;
+
+        if resp.hashes.len() != ranges.len() {
+            return Err(Error::Library(format!(
+                "Expected hashes for {} ranges, received {}",
+                ranges.len(),
+                resp.hashes.len()
+            )));
+        }
+
+        Ok(resp.hashes)
+    }
+
+    /// Retrieves the timing of the debuggee stopping all of its threads
+    pub fn stop_stats(&mut self) -> Result<response::StopStats, Error> {
+        let msg = request::StopStats::default();
+
+        self.send_request(&msg)
+    }
+
+    pub fn memory_map(&mut self) -> Result<Vec<MemoryRegion>, Error> {
+        let msg = request::MemoryMap::default();
+
+        let resp: response::MemoryMap = self.send_request(&msg)?;
+
+        Ok(resp.regions)
     }
 
     fn send_request<T: DeserializeOwned, S: request::RequestType + Serialize>(
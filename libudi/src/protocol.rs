@@ -25,6 +25,38 @@ pub enum Architecture {
     X86_64 = 1,
 }
 
+#[repr(u8)]
+#[derive(Debug, Clone, Copy, PartialEq, Default, Deserialize_repr, Serialize_repr)]
+pub enum MemoryCodec {
+    #[default]
+    None = 0,
+    Lz4 = 1,
+}
+
+/// The handling of a signal received by the debuggee
+#[repr(u8)]
+#[derive(Debug, Clone, Copy, PartialEq, Default, Deserialize_repr, Serialize_repr)]
+pub enum SignalPolicy {
+    /// Stop the process and report a signal event
+    #[default]
+    Stop = 0,
+    /// Pass the signal to the debuggee without stopping
+    Pass = 1,
+    /// Discard the signal without stopping
+    Ignore = 2,
+}
+
+/// Whether an event stops all threads of the debuggee
+#[repr(u8)]
+#[derive(Debug, Clone, Copy, PartialEq, Default, Deserialize_repr, Serialize_repr)]
+pub enum StopMode {
+    /// An event stops all threads
+    #[default]
+    All = 0,
+    /// An event only stops the thread that triggered it
+    NonStop = 1,
+}
+
 pub mod request {
     use ciborium::ser::into_writer as cbor_into_writer;
     use serde::{Deserialize, Serialize};
@@ -51,6 +83,25 @@ pub mod request {
         ThreadResume = 13,
         NextInstruction = 14,
         SingleStep = 15,
+        SearchMemory = 16,
+        MemoryMap = 17,
+        HashMemory = 18,
+        ReadMemoryStream = 19,
+        WriteMemoryStream = 20,
+        ReadRegisters = 21,
+        WriteRegisters = 22,
+        ReadVectorRegisters = 23,
+        WriteVectorRegisters = 24,
+        SetEventPayload = 25,
+        SetEventMask = 26,
+        SetSignalPolicy = 27,
+        StopStats = 28,
+        SetStopMode = 29,
+        StepRange = 30,
+        StepOver = 31,
+        StepOut = 32,
+        RunInstructions = 33,
+        RecordBranches = 34,
     }
 
     impl std::fmt::Display for Type {
@@ -72,6 +123,25 @@ pub mod request {
                 Type::ThreadResume => "ThreadResume",
                 Type::NextInstruction => "NextInstruction",
                 Type::SingleStep => "SingleStep",
+                Type::SearchMemory => "SearchMemory",
+                Type::MemoryMap => "MemoryMap",
+                Type::HashMemory => "HashMemory",
+                Type::ReadMemoryStream => "ReadMemoryStream",
+                Type::WriteMemoryStream => "WriteMemoryStream",
+                Type::ReadRegisters => "ReadRegisters",
+                Type::WriteRegisters => "WriteRegisters",
+                Type::ReadVectorRegisters => "ReadVectorRegisters",
+                Type::WriteVectorRegisters => "WriteVectorRegisters",
+                Type::SetEventPayload => "SetEventPayload",
+                Type::SetEventMask => "SetEventMask",
+                Type::SetSignalPolicy => "SetSignalPolicy",
+                Type::StopStats => "StopStats",
+                Type::SetStopMode => "SetStopMode",
+                Type::StepRange => "StepRange",
+                Type::StepOver => "StepOver",
+                Type::StepOut => "StepOut",
+                Type::RunInstructions => "RunInstructions",
+                Type::RecordBranches => "RecordBranches",
             };
 
             write!(f, "{}", name)
@@ -136,18 +206,30 @@ pub mod request {
         typ: Type,
         pub addr: u64,
         pub len: u32,
+        #[serde(skip_serializing_if = "is_uncompressed")]
+        pub codec: super::MemoryCodec,
     }
 
     impl ReadMemory {
         pub fn new(addr: u64, len: u32) -> ReadMemory {
+            ReadMemory::with_codec(addr, len, super::MemoryCodec::None)
+        }
+
+        pub fn with_codec(addr: u64, len: u32, codec: super::MemoryCodec) -> ReadMemory {
             ReadMemory {
                 typ: Type::ReadMemory,
                 addr,
                 len,
+                codec,
             }
         }
     }
 
+    // Older runtimes do not accept the codec, so it is only sent when compression is requested
+    fn is_uncompressed(codec: &super::MemoryCodec) -> bool {
+        *codec == super::MemoryCodec::None
+    }
+
     impl RequestType for ReadMemory {
         fn typ(&self) -> Type {
             self.typ
@@ -224,6 +306,77 @@ pub mod request {
         }
     }
 
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct WriteRegisterBytes<'a> {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub reg: u32,
+        #[serde(serialize_with = "serialize_bytes")]
+        pub bytes: &'a [u8],
+    }
+
+    impl<'a> WriteRegisterBytes<'a> {
+        pub fn new(reg: u32, bytes: &'a [u8]) -> WriteRegisterBytes<'a> {
+            WriteRegisterBytes {
+                typ: Type::WriteRegister,
+                reg,
+                bytes,
+            }
+        }
+    }
+
+    impl<'a> RequestType for WriteRegisterBytes<'a> {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct ReadRegisters {
+        #[serde(skip_serializing)]
+        typ: Type,
+    }
+
+    impl Default for ReadRegisters {
+        fn default() -> Self {
+            Self {
+                typ: Type::ReadRegisters,
+            }
+        }
+    }
+
+    impl RequestType for ReadRegisters {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+
+        fn empty(&self) -> bool {
+            true
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct WriteRegisters<'a> {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub values: &'a [Option<u64>],
+    }
+
+    impl<'a> WriteRegisters<'a> {
+        pub fn new(values: &'a [Option<u64>]) -> WriteRegisters<'a> {
+            WriteRegisters {
+                typ: Type::WriteRegisters,
+                values,
+            }
+        }
+    }
+
+    impl<'a> RequestType for WriteRegisters<'a> {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
     #[derive(Deserialize, Serialize, Debug)]
     pub struct CreateBreakpoint {
         #[serde(skip_serializing)]
@@ -430,6 +583,405 @@ pub mod request {
         }
     }
 
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct SearchMemory<'a> {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub addr: u64,
+        pub len: u64,
+        #[serde(serialize_with = "serialize_bytes")]
+        pub pattern: &'a [u8],
+        #[serde(serialize_with = "serialize_bytes")]
+        pub mask: &'a [u8],
+        pub max: u32,
+    }
+
+    impl<'a> SearchMemory<'a> {
+        pub fn new(
+            addr: u64,
+            len: u64,
+            pattern: &'a [u8],
+            mask: &'a [u8],
+            max: u32,
+        ) -> SearchMemory<'a> {
+            SearchMemory {
+                typ: Type::SearchMemory,
+                addr,
+                len,
+                pattern,
+                mask,
+                max,
+            }
+        }
+    }
+
+    impl<'a> RequestType for SearchMemory<'a> {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct ReadMemoryStream {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub addr: u64,
+        pub len: u64,
+    }
+
+    impl ReadMemoryStream {
+        pub fn new(addr: u64, len: u64) -> ReadMemoryStream {
+            ReadMemoryStream {
+                typ: Type::ReadMemoryStream,
+                addr,
+                len,
+            }
+        }
+    }
+
+    impl RequestType for ReadMemoryStream {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct MemoryMap {
+        #[serde(skip_serializing)]
+        typ: Type,
+    }
+
+    impl Default for MemoryMap {
+        fn default() -> Self {
+            Self {
+                typ: Type::MemoryMap,
+            }
+        }
+    }
+
+    impl RequestType for MemoryMap {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+
+        fn empty(&self) -> bool {
+            true
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct HashMemory<'a> {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub addrs: &'a [u64],
+        pub lens: &'a [u64],
+        pub block: u32,
+    }
+
+    impl<'a> HashMemory<'a> {
+        pub fn new(addrs: &'a [u64], lens: &'a [u64], block: u32) -> HashMemory<'a> {
+            HashMemory {
+                typ: Type::HashMemory,
+                addrs,
+                lens,
+                block,
+            }
+        }
+    }
+
+    impl<'a> RequestType for HashMemory<'a> {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct ReadVectorRegisters {
+        #[serde(skip_serializing)]
+        typ: Type,
+    }
+
+    impl Default for ReadVectorRegisters {
+        fn default() -> Self {
+            Self {
+                typ: Type::ReadVectorRegisters,
+            }
+        }
+    }
+
+    impl RequestType for ReadVectorRegisters {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+
+        fn empty(&self) -> bool {
+            true
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct WriteVectorRegisters<'a> {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub width: u32,
+        #[serde(serialize_with = "serialize_bytes")]
+        pub data: &'a [u8],
+    }
+
+    impl<'a> WriteVectorRegisters<'a> {
+        pub fn new(width: u32, data: &'a [u8]) -> WriteVectorRegisters<'a> {
+            WriteVectorRegisters {
+                typ: Type::WriteVectorRegisters,
+                width,
+                data,
+            }
+        }
+    }
+
+    impl<'a> RequestType for WriteVectorRegisters<'a> {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct SetEventPayload<'a> {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub regs: &'a [u32],
+        pub stack: u32,
+    }
+
+    impl<'a> SetEventPayload<'a> {
+        pub fn new(regs: &'a [u32], stack: u32) -> SetEventPayload<'a> {
+            SetEventPayload {
+                typ: Type::SetEventPayload,
+                regs,
+                stack,
+            }
+        }
+    }
+
+    impl<'a> RequestType for SetEventPayload<'a> {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct SetEventMask {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub mask: u32,
+    }
+
+    impl SetEventMask {
+        pub fn new(mask: u32) -> SetEventMask {
+            SetEventMask {
+                typ: Type::SetEventMask,
+                mask,
+            }
+        }
+    }
+
+    impl RequestType for SetEventMask {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct SetSignalPolicy {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub sig: u32,
+        pub policy: super::SignalPolicy,
+    }
+
+    impl SetSignalPolicy {
+        pub fn new(sig: u32, policy: super::SignalPolicy) -> SetSignalPolicy {
+            SetSignalPolicy {
+                typ: Type::SetSignalPolicy,
+                sig,
+                policy,
+            }
+        }
+    }
+
+    impl RequestType for SetSignalPolicy {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct StopStats {
+        #[serde(skip_serializing)]
+        typ: Type,
+    }
+
+    impl Default for StopStats {
+        fn default() -> Self {
+            Self {
+                typ: Type::StopStats,
+            }
+        }
+    }
+
+    impl RequestType for StopStats {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+
+        fn empty(&self) -> bool {
+            true
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct SetStopMode {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub mode: super::StopMode,
+    }
+
+    impl SetStopMode {
+        pub fn new(mode: super::StopMode) -> SetStopMode {
+            SetStopMode {
+                typ: Type::SetStopMode,
+                mode,
+            }
+        }
+    }
+
+    impl RequestType for SetStopMode {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct StepRange {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub start: u64,
+        pub end: u64,
+    }
+
+    impl StepRange {
+        pub fn new(start: u64, end: u64) -> StepRange {
+            StepRange {
+                typ: Type::StepRange,
+                start,
+                end,
+            }
+        }
+    }
+
+    impl RequestType for StepRange {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct StepOver {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub start: u64,
+        pub end: u64,
+    }
+
+    impl StepOver {
+        pub fn new(start: u64, end: u64) -> StepOver {
+            StepOver {
+                typ: Type::StepOver,
+                start,
+                end,
+            }
+        }
+    }
+
+    impl RequestType for StepOver {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct StepOut {
+        #[serde(skip_serializing)]
+        typ: Type,
+    }
+
+    impl Default for StepOut {
+        fn default() -> Self {
+            Self { typ: Type::StepOut }
+        }
+    }
+
+    impl RequestType for StepOut {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+
+        fn empty(&self) -> bool {
+            true
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct RunInstructions {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub count: u64,
+    }
+
+    impl RunInstructions {
+        pub fn new(count: u64) -> RunInstructions {
+            RunInstructions {
+                typ: Type::RunInstructions,
+                count,
+            }
+        }
+    }
+
+    impl RequestType for RunInstructions {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct RecordBranches {
+        #[serde(skip_serializing)]
+        typ: Type,
+        pub size: u32,
+    }
+
+    impl RecordBranches {
+        pub fn new(size: u32) -> RecordBranches {
+            RecordBranches {
+                typ: Type::RecordBranches,
+                size,
+            }
+        }
+    }
+
+    impl RequestType for RecordBranches {
+        fn typ(&self) -> Type {
+            self.typ
+        }
+    }
+
+    // Byte slices need to be serialized as a CBOR byte string, not an array
+    fn serialize_bytes<S: serde::Serializer>(
+        data: &[u8],
+        serializer: S,
+    ) -> Result<S::Ok, S::Error> {
+        serializer.serialize_bytes(data)
+    }
+
     pub fn serialize<T: Serialize + RequestType>(req: &T) -> Result<Vec<u8>, Error> {
         let mut output: Vec<u8> = Vec::new();
 
@@ -481,11 +1033,43 @@ pub mod response {
     #[derive(Deserialize, Serialize, Debug)]
     pub struct ReadMemory {
         pub data: Vec<u8>,
+        #[serde(default)]
+        pub codec: super::MemoryCodec,
     }
 
     #[derive(Deserialize, Serialize, Debug)]
     pub struct ReadRegister {
-        pub value: u64,
+        #[serde(default)]
+        pub value: Option<u64>,
+        #[serde(default)]
+        pub bytes: Option<Vec<u8>>,
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct ReadRegisters {
+        pub values: Vec<Option<u64>>,
+    }
+
+    #[derive(Deserialize, Serialize, Debug, Clone, PartialEq)]
+    pub struct VectorRegisters {
+        pub width: u32,
+        pub data: Vec<u8>,
+    }
+
+    impl VectorRegisters {
+        pub fn count(&self) -> usize {
+            if self.width == 0 {
+                return 0;
+            }
+            self.data.len() / self.width as usize
+        }
+
+        /// Returns the value of the vector register with the specified index, in little-endian
+        /// order
+        pub fn get(&self, index: usize) -> Option<&[u8]> {
+            let width = self.width as usize;
+            self.data.get(index * width..(index + 1) * width)
+        }
     }
 
     #[derive(Deserialize, Serialize, Debug)]
@@ -498,6 +1082,57 @@ pub mod response {
         pub value: bool,
     }
 
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct RecordBranches {
+        pub path: String,
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct SearchMemory {
+        pub addrs: Vec<u64>,
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct MemoryMap {
+        pub regions: Vec<MemoryRegion>,
+    }
+
+    #[derive(Deserialize, Serialize, Debug, Clone, PartialEq)]
+    pub struct MemoryRegion {
+        pub start: u64,
+        pub end: u64,
+        pub offset: u64,
+        pub prot: u32,
+        pub path: String,
+    }
+
+    impl MemoryRegion {
+        pub const PROT_READ: u32 = 0x1;
+        pub const PROT_WRITE: u32 = 0x2;
+        pub const PROT_EXEC: u32 = 0x4;
+
+        pub fn contains(&self, addr: u64) -> bool {
+            self.start <= addr && addr < self.end
+        }
+    }
+
+    /// The timing of the debuggee stopping all of its threads. Except for `stops` and
+    /// `max_total_ns`, the values describe the last stop.
+    #[derive(Deserialize, Serialize, Debug, Default, Copy, Clone, PartialEq)]
+    pub struct StopStats {
+        pub stops: u64,
+        pub threads: u32,
+        pub fanout_ns: u64,
+        pub arrival_ns: u64,
+        pub total_ns: u64,
+        pub max_total_ns: u64,
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct HashMemory {
+        pub hashes: Vec<Vec<Option<u64>>>,
+    }
+
     #[derive(Deserialize, Serialize, Debug)]
     pub struct States {
         pub states: Vec<State>,
@@ -548,7 +1183,7 @@ pub mod event {
     use serde_repr::{Deserialize_repr, Serialize_repr};
 
     #[repr(u16)]
-    #[derive(Debug, Deserialize_repr, Serialize_repr)]
+    #[derive(Debug, Clone, Copy, PartialEq, Deserialize_repr, Serialize_repr)]
     pub enum Type {
         Unknown = 0,
         Error = 1,
@@ -561,6 +1196,7 @@ pub mod event {
         ProcessExec = 8,
         SingleStep = 9,
         ProcessCleanup = 10,
+        Batch = 11,
     }
 
     #[derive(Deserialize, Serialize, Debug)]
@@ -572,11 +1208,71 @@ pub mod event {
     pub struct Signal {
         pub addr: u64,
         pub sig: u32,
+        #[serde(default)]
+        pub pc: Option<u64>,
+        #[serde(default)]
+        pub executed: Option<u64>,
     }
 
     #[derive(Deserialize, Serialize, Debug)]
     pub struct Breakpoint {
         pub addr: u64,
+        #[serde(default)]
+        pub regs: Option<Vec<Option<u64>>>,
+        #[serde(default)]
+        pub sp: Option<u64>,
+        #[serde(default)]
+        pub stack: Option<Vec<u8>>,
+        #[serde(default)]
+        pub pc: Option<u64>,
+        #[serde(default)]
+        pub executed: Option<u64>,
+    }
+
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct SingleStep {
+        #[serde(default)]
+        pub regs: Option<Vec<Option<u64>>>,
+        #[serde(default)]
+        pub sp: Option<u64>,
+        #[serde(default)]
+        pub stack: Option<Vec<u8>>,
+        #[serde(default)]
+        pub pc: Option<u64>,
+        #[serde(default)]
+        pub executed: Option<u64>,
+    }
+
+    /// The final pc and the number of instructions executed, added to the event that ends a run
+    /// of instructions
+    #[derive(Debug, Clone, Copy, PartialEq)]
+    pub struct InstructionRun {
+        pub pc: u64,
+        pub executed: u64,
+    }
+
+    impl InstructionRun {
+        fn from_parts(pc: Option<u64>, executed: Option<u64>) -> Option<InstructionRun> {
+            match (pc, executed) {
+                (Some(pc), Some(executed)) => Some(InstructionRun { pc, executed }),
+                _ => None,
+            }
+        }
+    }
+
+    /// The registers and stack bytes added to an event by the runtime
+    #[derive(Debug, Default)]
+    pub struct Payload {
+        pub regs: Option<Vec<Option<u64>>>,
+        pub sp: Option<u64>,
+        pub stack: Option<Vec<u8>>,
+        pub run: Option<InstructionRun>,
+    }
+
+    /// Precedes the events of threads that stopped at the same time
+    #[derive(Deserialize, Serialize, Debug)]
+    pub struct Batch {
+        pub count: u32,
     }
 
     #[derive(Deserialize, Serialize, Debug)]
@@ -636,6 +1332,7 @@ pub mod event {
     pub struct EventMessage {
         pub tid: u64,
         pub data: EventData,
+        pub payload: Payload,
     }
 }
 
@@ -645,9 +1342,12 @@ pub enum EventReadError {
     Udi(Error),
 }
 
-pub fn read_event<R: io::Read>(reader: &mut R) -> Result<event::EventMessage, EventReadError> {
-    match read_event_local(reader) {
-        Ok(event) => Ok(event),
+/// Reads the next event, or all the events in the next batch of events
+pub fn read_events<R: io::Read>(
+    reader: &mut R,
+) -> Result<Vec<event::EventMessage>, EventReadError> {
+    match read_events_local(reader) {
+        Ok(events) => Ok(events),
         Err(Error::Io(err)) => {
             if err.kind() == io::ErrorKind::UnexpectedEof {
                 Err(EventReadError::Eof)
@@ -659,18 +1359,40 @@ pub fn read_event<R: io::Read>(reader: &mut R) -> Result<event::EventMessage, Ev
     }
 }
 
-fn read_event_local<R: io::Read>(reader: &mut R) -> Result<event::EventMessage, Error> {
+fn read_events_local<R: io::Read>(reader: &mut R) -> Result<Vec<event::EventMessage>, Error> {
     let event_type: event::Type = cbor_from_reader(&mut *reader)?;
     let tid: u64 = cbor_from_reader(&mut *reader)?;
 
-    let data = deserialize_event_data(&mut *reader, &event_type)?;
+    if let event::Type::Batch = event_type {
+        let batch: event::Batch = cbor_from_reader(&mut *reader)?;
 
-    Ok(event::EventMessage { tid, data })
+        let mut events = Vec::with_capacity(batch.count as usize);
+        for _ in 0..batch.count {
+            let event_type: event::Type = cbor_from_reader(&mut *reader)?;
+            let tid: u64 = cbor_from_reader(&mut *reader)?;
+            events.push(read_event_message(&mut *reader, event_type, tid)?);
+        }
+        return Ok(events);
+    }
+
+    Ok(vec![read_event_message(reader, event_type, tid)?])
+}
+
+fn read_event_message<R: io::Read>(
+    reader: &mut R,
+    event_type: event::Type,
+    tid: u64,
+) -> Result<event::EventMessage, Error> {
+    let mut payload = event::Payload::default();
+    let data = deserialize_event_data(&mut *reader, &event_type, &mut payload)?;
+
+    Ok(event::EventMessage { tid, data, payload })
 }
 
 fn deserialize_event_data<R: io::Read>(
     reader: &mut R,
     event_type: &event::Type,
+    payload: &mut event::Payload,
 ) -> Result<event::EventData, Error> {
     let event_data = match *event_type {
         event::Type::Unknown => {
@@ -685,6 +1407,7 @@ fn deserialize_event_data<R: io::Read>(
         }
         event::Type::Signal => {
             let signal_data: event::Signal = cbor_from_reader(reader)?;
+            payload.run = event::InstructionRun::from_parts(signal_data.pc, signal_data.executed);
             event::EventData::Signal {
                 addr: signal_data.addr,
                 sig: signal_data.sig,
@@ -692,6 +1415,12 @@ fn deserialize_event_data<R: io::Read>(
         }
         event::Type::Breakpoint => {
             let brkpt_data: event::Breakpoint = cbor_from_reader(reader)?;
+            *payload = event::Payload {
+                regs: brkpt_data.regs,
+                sp: brkpt_data.sp,
+                stack: brkpt_data.stack,
+                run: event::InstructionRun::from_parts(brkpt_data.pc, brkpt_data.executed),
+            };
             event::EventData::Breakpoint {
                 addr: brkpt_data.addr,
             }
@@ -721,8 +1450,21 @@ fn deserialize_event_data<R: io::Read>(
                 envp: exec_data.envp,
             }
         }
-        event::Type::SingleStep => event::EventData::SingleStep,
+        event::Type::SingleStep => {
+            let step_data: event::SingleStep = cbor_from_reader(reader)?;
+            *payload = event::Payload {
+                regs: step_data.regs,
+                sp: step_data.sp,
+                stack: step_data.stack,
+                run: event::InstructionRun::from_parts(step_data.pc, step_data.executed),
+            };
+            event::EventData::SingleStep
+        }
         event::Type::ProcessCleanup => event::EventData::ProcessCleanup,
+        event::Type::Batch => {
+            let msg = "Batch event reported within a batch".to_owned();
+            return Err(Error::Library(msg));
+        }
     };
 
     Ok(event_data)
@@ -804,5 +1546,203 @@ pub enum Register {
     X86_64_XMM13 = 67,
     X86_64_XMM14 = 68,
     X86_64_XMM15 = 69,
-    X86_64_MAX = 70,
+    X86_64_YMM0 = 70,
+    X86_64_YMM1 = 71,
+    X86_64_YMM2 = 72,
+    X86_64_YMM3 = 73,
+    X86_64_YMM4 = 74,
+    X86_64_YMM5 = 75,
+    X86_64_YMM6 = 76,
+    X86_64_YMM7 = 77,
+    X86_64_YMM8 = 78,
+    X86_64_YMM9 = 79,
+    X86_64_YMM10 = 80,
+    X86_64_YMM11 = 81,
+    X86_64_YMM12 = 82,
+    X86_64_YMM13 = 83,
+    X86_64_YMM14 = 84,
+    X86_64_YMM15 = 85,
+    X86_64_ZMM0 = 86,
+    X86_64_ZMM1 = 87,
+    X86_64_ZMM2 = 88,
+    X86_64_ZMM3 = 89,
+    X86_64_ZMM4 = 90,
+    X86_64_ZMM5 = 91,
+    X86_64_ZMM6 = 92,
+    X86_64_ZMM7 = 93,
+    X86_64_ZMM8 = 94,
+    X86_64_ZMM9 = 95,
+    X86_64_ZMM10 = 96,
+    X86_64_ZMM11 = 97,
+    X86_64_ZMM12 = 98,
+    X86_64_ZMM13 = 99,
+    X86_64_ZMM14 = 100,
+    X86_64_ZMM15 = 101,
+    X86_64_ZMM16 = 102,
+    X86_64_ZMM17 = 103,
+    X86_64_ZMM18 = 104,
+    X86_64_ZMM19 = 105,
+    X86_64_ZMM20 = 106,
+    X86_64_ZMM21 = 107,
+    X86_64_ZMM22 = 108,
+    X86_64_ZMM23 = 109,
+    X86_64_ZMM24 = 110,
+    X86_64_ZMM25 = 111,
+    X86_64_ZMM26 = 112,
+    X86_64_ZMM27 = 113,
+    X86_64_ZMM28 = 114,
+    X86_64_ZMM29 = 115,
+    X86_64_ZMM30 = 116,
+    X86_64_ZMM31 = 117,
+    X86_64_K0 = 118,
+    X86_64_K1 = 119,
+    X86_64_K2 = 120,
+    X86_64_K3 = 121,
+    X86_64_K4 = 122,
+    X86_64_K5 = 123,
+    X86_64_K6 = 124,
+    X86_64_K7 = 125,
+    X86_64_MXCSR = 126,
+    X86_64_MAX = 127,
 }
+
+impl Register {
+    /// Returns the registers of the architecture, in the order used by the bulk register
+    /// requests
+    pub fn for_architecture(arch: Architecture) -> &'static [Register] {
+        match arch {
+            Architecture::X86 => &X86_REGISTERS,
+            Architecture::X86_64 => &X86_64_REGISTERS,
+        }
+    }
+}
+
+const X86_REGISTERS: [Register; 24] = [
+    Register::X86_GS,
+    Register::X86_FS,
+    Register::X86_ES,
+    Register::X86_DS,
+    Register::X86_EDI,
+    Register::X86_ESI,
+    Register::X86_EBP,
+    Register::X86_ESP,
+    Register::X86_EBX,
+    Register::X86_EDX,
+    Register::X86_ECX,
+    Register::X86_EAX,
+    Register::X86_CS,
+    Register::X86_SS,
+    Register::X86_EIP,
+    Register::X86_FLAGS,
+    Register::X86_ST0,
+    Register::X86_ST1,
+    Register::X86_ST2,
+    Register::X86_ST3,
+    Register::X86_ST4,
+    Register::X86_ST5,
+    Register::X86_ST6,
+    Register::X86_ST7,
+];
+
+const X86_64_REGISTERS: [Register; 100] = [
+    Register::X86_64_R8,
+    Register::X86_64_R9,
+    Register::X86_64_R10,
+    Register::X86_64_R11,
+    Register::X86_64_R12,
+    Register::X86_64_R13,
+    Register::X86_64_R14,
+    Register::X86_64_R15,
+    Register::X86_64_RDI,
+    Register::X86_64_RSI,
+    Register::X86_64_RBP,
+    Register::X86_64_RBX,
+    Register::X86_64_RDX,
+    Register::X86_64_RAX,
+    Register::X86_64_RCX,
+    Register::X86_64_RSP,
+    Register::X86_64_RIP,
+    Register::X86_64_CSGSFS,
+    Register::X86_64_FLAGS,
+    Register::X86_64_ST0,
+    Register::X86_64_ST1,
+    Register::X86_64_ST2,
+    Register::X86_64_ST3,
+    Register::X86_64_ST4,
+    Register::X86_64_ST5,
+    Register::X86_64_ST6,
+    Register::X86_64_ST7,
+    Register::X86_64_XMM0,
+    Register::X86_64_XMM1,
+    Register::X86_64_XMM2,
+    Register::X86_64_XMM3,
+    Register::X86_64_XMM4,
+    Register::X86_64_XMM5,
+    Register::X86_64_XMM6,
+    Register::X86_64_XMM7,
+    Register::X86_64_XMM8,
+    Register::X86_64_XMM9,
+    Register::X86_64_XMM10,
+    Register::X86_64_XMM11,
+    Register::X86_64_XMM12,
+    Register::X86_64_XMM13,
+    Register::X86_64_XMM14,
+    Register::X86_64_XMM15,
+    Register::X86_64_YMM0,
+    Register::X86_64_YMM1,
+    Register::X86_64_YMM2,
+    Register::X86_64_YMM3,
+    Register::X86_64_YMM4,
+    Register::X86_64_YMM5,
+    Register::X86_64_YMM6,
+    Register::X86_64_YMM7,
+    Register::X86_64_YMM8,
+    Register::X86_64_YMM9,
+    Register::X86_64_YMM10,
+    Register::X86_64_YMM11,
+    Register::X86_64_YMM12,
+    Register::X86_64_YMM13,
+    Register::X86_64_YMM14,
+    Register::X86_64_YMM15,
+    Register::X86_64_ZMM0,
+    Register::X86_64_ZMM1,
+    Register::X86_64_ZMM2,
+    Register::X86_64_ZMM3,
+    Register::X86_64_ZMM4,
+    Register::X86_64_ZMM5,
+    Register::X86_64_ZMM6,
+    Register::X86_64_ZMM7,
+    Register::X86_64_ZMM8,
+    Register::X86_64_ZMM9,
+    Register::X86_64_ZMM10,
+    Register::X86_64_ZMM11,
+    Register::X86_64_ZMM12,
+    Register::X86_64_ZMM13,
+    Register::X86_64_ZMM14,
+    Register::X86_64_ZMM15,
+    Register::X86_64_ZMM16,
+    Register::X86_64_ZMM17,
+    Register::X86_64_ZMM18,
+    Register::X86_64_ZMM19,
+    Register::X86_64_ZMM20,
+    Register::X86_64_ZMM21,
+    Register::X86_64_ZMM22,
+    Register::X86_64_ZMM23,
+    Register::X86_64_ZMM24,
+    Register::X86_64_ZMM25,
+    Register::X86_64_ZMM26,
+    Register::X86_64_ZMM27,
+    Register::X86_64_ZMM28,
+    Register::X86_64_ZMM29,
+    Register::X86_64_ZMM30,
+    Register::X86_64_ZMM31,
+    Register::X86_64_K0,
+    Register::X86_64_K1,
+    Register::X86_64_K2,
+    Register::X86_64_K3,
+    Register::X86_64_K4,
+    Register::X86_64_K5,
+    Register::X86_64_K6,
+    Register::X86_64_K7,
+    Register::X86_64_MXCSR,
+];
@@ -10,13 +10,18 @@
 
 use ::std::fs::File;
 use ::std::io::Write;
+use ::std::sync::atomic::Ordering;
 
+use super::branches::BranchTrace;
 use super::errors::*;
+use super::protocol::event::InstructionRun;
 use super::protocol::request;
 use super::protocol::response;
+use super::protocol::response::VectorRegisters;
 use super::protocol::Architecture;
 use super::protocol::Register;
 use super::Thread;
+use super::ThreadFileContext;
 use super::UserData;
 
 use serde::de::DeserializeOwned;
@@ -39,6 +44,10 @@ impl Thread {
         self.state
     }
 
+    pub fn get_architecture(&self) -> Architecture {
+        self.architecture
+    }
+
     pub fn get_pc(&mut self) -> Result<u64, Error> {
         let reg = match self.architecture {
             Architecture::X86 => Register::X86_EIP,
@@ -51,6 +60,8 @@ impl Thread {
     pub fn set_single_step(&mut self, setting: bool) -> Result<(), Error> {
         let msg = request::SingleStep::new(setting);
 
+        self.invalidate_register_cache();
+
         let resp: response::SingleStep = self.send_request(&msg)?;
 
         self.single_step = setting;
@@ -62,6 +73,76 @@ impl Thread {
         self.single_step
     }
 
+    /// Single steps the thread through the range [start, end) once it is continued. A single
+    /// step event is reported when the pc leaves the range, after which the single step setting
+    /// is unchanged. Any other event reported by the thread ends the range.
+    pub fn step_range(&mut self, start: u64, end: u64) -> Result<(), Error> {
+        let msg = request::StepRange::new(start, end);
+
+        self.send_request_no_data(&msg)?;
+
+        Ok(())
+    }
+
+    /// Like `step_range`, but calls made from the range are stepped over. The runtime stops the
+    /// thread once a call returns to the frame that made it, so recursive calls are stepped over
+    /// as well.
+    pub fn step_over(&mut self, start: u64, end: u64) -> Result<(), Error> {
+        let msg = request::StepOver::new(start, end);
+
+        self.send_request_no_data(&msg)?;
+
+        Ok(())
+    }
+
+    /// Steps the thread out of the current function once it is continued. A single step event
+    /// is reported at the return address.
+    pub fn step_out(&mut self) -> Result<(), Error> {
+        let msg = request::StepOut::default();
+
+        self.send_request_no_data(&msg)?;
+
+        Ok(())
+    }
+
+    /// Runs exactly `count` instructions in the thread once it is continued, stepping inside the
+    /// runtime. A single step event is reported once the count is reached, unless a breakpoint or
+    /// another event stops the thread first.
+    pub fn run_instructions(&mut self, count: u64) -> Result<(), Error> {
+        let msg = request::RunInstructions::new(count);
+
+        self.send_request_no_data(&msg)?;
+
+        Ok(())
+    }
+
+    /// The final pc and the number of instructions executed, when the last event of the thread
+    /// ended a run of instructions
+    pub fn get_instruction_run(&self) -> Option<InstructionRun> {
+        self.instruction_run
+    }
+
+    /// Records the target of each branch the thread takes into a ring buffer of `size` bytes,
+    /// stepping inside the runtime without reporting events. The returned trace drains the buffer
+    /// while the thread runs, a trace returned by an earlier call must not be used anymore.
+    pub fn record_branches(&mut self, size: u32) -> Result<BranchTrace, Error> {
+        let msg = request::RecordBranches::new(size);
+
+        let resp: response::RecordBranches = self.send_request(&msg)?;
+
+        BranchTrace::open(&resp.path)
+    }
+
+    /// Stops recording the branches of the thread. The records left in the buffer can still be
+    /// drained.
+    pub fn stop_recording_branches(&mut self) -> Result<(), Error> {
+        let msg = request::RecordBranches::new(0);
+
+        self.send_request_no_data(&msg)?;
+
+        Ok(())
+    }
+
     pub fn get_next_instruction(&mut self) -> Result<u64, Error> {
         let msg = request::NextInstruction::default();
 
@@ -70,6 +151,23 @@ impl Thread {
         Ok(resp.addr)
     }
 
+    /// Continues the thread, which must be stopped in non-stop mode
+    pub fn continue_thread(&mut self) -> Result<(), Error> {
+        self.continue_thread_with_signal(0)
+    }
+
+    /// Continues the thread with the specified signal, which is delivered to the thread
+    pub fn continue_thread_with_signal(&mut self, sig: u32) -> Result<(), Error> {
+        let msg = request::Continue::new(sig);
+
+        self.send_request_no_data(&msg)?;
+
+        // the registers change once the thread runs
+        self.invalidate_register_cache();
+
+        Ok(())
+    }
+
     pub fn suspend(&mut self) -> Result<(), Error> {
         let msg = request::ThreadSuspend::default();
 
@@ -85,17 +183,174 @@ impl Thread {
         Ok(())
     }
 
+    pub fn set_register_prefetch(&mut self, prefetch: bool) {
+        self.prefetch_registers = prefetch;
+    }
+
+    pub fn get_register_prefetch(&self) -> bool {
+        self.prefetch_registers
+    }
+
+    /// Discards the register values cached for the current stop of the thread
+    pub fn invalidate_register_cache(&mut self) {
+        self.register_cache.values.clear();
+        self.register_cache.complete = false;
+    }
+
+    fn sync_register_cache(&mut self) {
+        let epoch = self.stop_epoch.load(Ordering::SeqCst);
+        if self.register_cache.epoch != epoch {
+            self.invalidate_register_cache();
+            self.register_cache.epoch = epoch;
+        }
+    }
+
+    pub(crate) fn cache_registers<I: Iterator<Item = (Register, u64)>>(&mut self, values: I) {
+        self.sync_register_cache();
+        self.register_cache
+            .values
+            .extend(values.map(|(reg, value)| (reg as u32, value)));
+    }
+
+    pub(crate) fn cached_register(&mut self, reg: Register) -> Option<u64> {
+        self.sync_register_cache();
+        self.register_cache.values.get(&(reg as u32)).copied()
+    }
+
     pub fn read_register(&mut self, reg: Register) -> Result<u64, Error> {
+        if let Some(value) = self.cached_register(reg) {
+            return Ok(value);
+        }
+
+        if self.prefetch_registers && !self.register_cache.complete {
+            self.read_registers()?;
+            if let Some(value) = self.cached_register(reg) {
+                return Ok(value);
+            }
+        }
+
         let msg = request::ReadRegister::new(reg as u32);
 
         let resp: response::ReadRegister = self.send_request(&msg)?;
 
-        Ok(resp.value)
+        let value = resp
+            .value
+            .ok_or_else(|| Error::Request(format!("Register {:?} is wider than 64 bits", reg)))?;
+        self.register_cache.values.insert(reg as u32, value);
+
+        Ok(value)
+    }
+
+    pub fn read_register_bytes(&mut self, reg: Register) -> Result<Vec<u8>, Error> {
+        let msg = request::ReadRegister::new(reg as u32);
+
+        let resp: response::ReadRegister = self.send_request(&msg)?;
+
+        match (resp.bytes, resp.value) {
+            (Some(bytes), _) => Ok(bytes),
+            (None, Some(value)) => Ok(value.to_le_bytes().to_vec()),
+            (None, None) => Err(Error::Library(format!(
+                "No value returned for register {:?}",
+                reg
+            ))),
+        }
     }
 
     pub fn write_register(&mut self, reg: Register, value: u64) -> Result<(), Error> {
         let msg = request::WriteRegister::new(reg as u32, value);
 
+        self.invalidate_register_cache();
+
+        self.send_request_no_data(&msg)?;
+
+        Ok(())
+    }
+
+    pub fn write_register_bytes(&mut self, reg: Register, bytes: &[u8]) -> Result<(), Error> {
+        let msg = request::WriteRegisterBytes::new(reg as u32, bytes);
+
+        self.invalidate_register_cache();
+
+        self.send_request_no_data(&msg)?;
+
+        Ok(())
+    }
+
+    pub fn read_registers(&mut self) -> Result<Vec<(Register, u64)>, Error> {
+        let regs = Register::for_architecture(self.architecture);
+
+        self.sync_register_cache();
+        if self.register_cache.complete {
+            let cache = &self.register_cache.values;
+            return Ok(regs
+                .iter()
+                .filter_map(|reg| cache.get(&(*reg as u32)).map(|v| (*reg, *v)))
+                .collect());
+        }
+
+        let msg = request::ReadRegisters::default();
+
+        let resp: response::ReadRegisters = self.send_request(&msg)?;
+
+        if resp.values.len() != regs.len() {
+            return Err(Error::Library(format!(
+                "Expected {} register values, received {}",
+                regs.len(),
+                resp.values.len()
+            )));
+        }
+
+        let values: Vec<(Register, u64)> = regs
+            .iter()
+            .zip(resp.values)
+            .filter_map(|(reg, value)| value.map(|v| (*reg, v)))
+            .collect();
+
+        self.register_cache
+            .values
+            .extend(values.iter().map(|(reg, value)| (*reg as u32, *value)));
+        self.register_cache.complete = true;
+
+        Ok(values)
+    }
+
+    pub fn write_registers(&mut self, values: &[(Register, u64)]) -> Result<(), Error> {
+        let regs = Register::for_architecture(self.architecture);
+
+        let mut packed = vec![None; regs.len()];
+        for (reg, value) in values {
+            let index = regs
+                .iter()
+                .position(|r| *r as u32 == *reg as u32)
+                .ok_or_else(|| {
+                    Error::Request(format!(
+                        "Register {:?} is not valid for architecture {:?}",
+                        reg, self.architecture
+                    ))
+                })?;
+            packed[index] = Some(*value);
+        }
+
+        let msg = request::WriteRegisters::new(&packed);
+
+        self.invalidate_register_cache();
+
+        self.send_request_no_data(&msg)?;
+
+        Ok(())
+    }
+
+    pub fn read_vector_registers(&mut self) -> Result<VectorRegisters, Error> {
+        let msg = request::ReadVectorRegisters::default();
+
+        self.send_request(&msg)
+    }
+
+    pub fn write_vector_registers(&mut self, width: u32, data: &[u8]) -> Result<(), Error> {
+        let msg = request::WriteVectorRegisters::new(width, data);
+
+        self.invalidate_register_cache();
+
         self.send_request_no_data(&msg)?;
 
         Ok(())
@@ -105,16 +360,7 @@ impl Thread {
         &mut self,
         msg: &S,
     ) -> Result<T, Error> {
-        let ctx = match self.file_context.as_mut() {
-            Some(ctx) => ctx,
-            None => {
-                let msg = format!(
-                    "Thread {:?} terminated, cannot performed requested operation",
-                    self.tid
-                );
-                return Err(Error::Request(msg));
-            }
-        };
+        let ctx = self.get_file_context()?;
 
         ctx.request_file.write_all(&request::serialize(msg)?)?;
 
@@ -125,20 +371,24 @@ impl Thread {
         &mut self,
         msg: &S,
     ) -> Result<(), Error> {
-        let ctx = match self.file_context.as_mut() {
-            Some(ctx) => ctx,
+        let ctx = self.get_file_context()?;
+
+        ctx.request_file.write_all(&request::serialize(msg)?)?;
+
+        response::read_no_data::<File>(&mut ctx.response_file)
+    }
+
+    pub(crate) fn get_file_context(&mut self) -> Result<&mut ThreadFileContext, Error> {
+        match self.file_context.as_mut() {
+            Some(ctx) => Ok(ctx),
             None => {
                 let msg = format!(
                     "Thread {:?} terminated, cannot performed requested operation",
                     self.tid
                 );
-                return Err(Error::Request(msg));
+                Err(Error::Request(msg))
             }
-        };
-
-        ctx.request_file.write_all(&request::serialize(msg)?)?;
-
-        response::read_no_data::<File>(&mut ctx.response_file)
+        }
     }
 }
 
@@ -0,0 +1,91 @@
+//
+// Copyright (c) 2011-2023, UDI Contributors
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+#![deny(warnings)]
+#![cfg(unix)]
+
+mod native_file_tests;
+mod utils;
+
+use std::future::Future;
+use std::pin::pin;
+use std::sync::Arc;
+use std::task::{Context, Poll, Wake, Waker};
+use std::thread::{self, Thread};
+
+use udi::EventData;
+
+struct ThreadWaker(Thread);
+
+impl Wake for ThreadWaker {
+    fn wake(self: Arc<Self>) {
+        self.0.unpark();
+    }
+}
+
+// A minimal executor, the async API does not depend on a specific runtime
+fn block_on<F: Future>(future: F) -> F::Output {
+    let mut future = pin!(future);
+    let waker = Waker::from(Arc::new(ThreadWaker(thread::current())));
+    let mut cx = Context::from_waker(&waker);
+
+    loop {
+        match future.as_mut().poll(&mut cx) {
+            Poll::Ready(output) => return output,
+            Poll::Pending => thread::park(),
+        }
+    }
+}
+
+#[test]
+fn aio() -> Result<(), udi::Error> {
+    let metadata = native_file_tests::get_test_metadata();
+    let binary_path = metadata.simple_path().to_str().unwrap();
+    let function_addr = metadata.simple_function1_addr();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(binary_path, &argv, &envp, &config)?;
+    let thr_ref = proc_ref.lock()?.get_initial_thread();
+
+    let mut process = udi::AsyncProcess::new(&proc_ref)?;
+    let mut thread = udi::AsyncThread::new(&thr_ref)?;
+    let mut events = udi::EventStream::new();
+    events.add_process(&proc_ref)?;
+
+    block_on(async {
+        process.create_breakpoint(function_addr).await?;
+        process.install_breakpoint(function_addr).await?;
+        process.continue_process().await?;
+
+        let event = events.next().await.expect("Missing breakpoint event")?;
+        assert_eq!(
+            EventData::Breakpoint {
+                addr: function_addr
+            },
+            event.data
+        );
+        assert_eq!(function_addr, thread.get_pc().await?);
+
+        process.remove_breakpoint(function_addr).await?;
+        process.continue_process().await?;
+
+        let event = events.next().await.expect("Missing exit event")?;
+        assert_eq!(EventData::ProcessExit { code: 1 }, event.data);
+        process.continue_process().await?;
+
+        let event = events.next().await.expect("Missing cleanup event")?;
+        assert_eq!(EventData::ProcessCleanup, event.data);
+
+        assert!(events.next().await.is_none());
+
+        Ok::<(), udi::Error>(())
+    })
+}
@@ -45,3 +45,65 @@ fn breakpoint() -> Result<(), udi::Error> {
 
     Ok(())
 }
+
+#[test]
+fn event_payload() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function1_addr();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    let sp_reg;
+    {
+        let mut process = proc_ref.lock()?;
+
+        let pc_reg = match process.get_architecture() {
+            udi::Architecture::X86 => udi::Register::X86_EIP,
+            udi::Architecture::X86_64 => udi::Register::X86_64_RIP,
+        };
+        sp_reg = match process.get_architecture() {
+            udi::Architecture::X86 => udi::Register::X86_ESP,
+            udi::Architecture::X86_64 => udi::Register::X86_64_RSP,
+        };
+
+        thr_ref = process.get_initial_thread();
+        process.set_event_payload(&[pc_reg, sp_reg], 256)?;
+        process.create_breakpoint(addr)?;
+        process.install_breakpoint(addr)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::Breakpoint { addr });
+
+    {
+        let mut process = proc_ref.lock()?;
+        let mut thread = thr_ref.lock()?;
+
+        assert_eq!(addr, thread.get_pc()?);
+        let sp = thread.read_register(sp_reg)?;
+
+        // the stack included with the event is read without a request to the debuggee
+        let stats = process.page_cache_stats();
+        let stack = process.read_mem(64, sp)?;
+        assert_eq!(stats.hits + 1, process.page_cache_stats().hits);
+        assert_eq!(stats.misses, process.page_cache_stats().misses);
+
+        process.set_page_cache_capacity(0);
+        assert_eq!(stack, process.read_mem(64, sp)?);
+
+        process.set_event_payload(&[], 0)?;
+    }
+
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
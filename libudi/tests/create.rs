@@ -11,6 +11,8 @@
 mod native_file_tests;
 mod utils;
 
+use std::time::Duration;
+
 #[test]
 fn create() -> Result<(), udi::Error> {
     let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
@@ -37,3 +39,125 @@ fn create() -> Result<(), udi::Error> {
 
     Ok(())
 }
+
+#[test]
+fn create_event_loop() -> Result<(), udi::Error> {
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    // each wait returns a single event, so the events of the processes are spread across waits
+    let mut event_loop = udi::EventLoop::new(1)?;
+
+    let mut procs = vec![];
+    for _ in 0..2 {
+        let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+        event_loop.add_process(&proc_ref)?;
+        procs.push(proc_ref);
+    }
+
+    for proc_ref in &procs {
+        proc_ref.lock()?.continue_process()?;
+    }
+
+    let mut exits = 0;
+    let mut cleanups = 0;
+    while !event_loop.is_empty() {
+        let events = event_loop.wait(None)?;
+        assert_eq!(1, events.len());
+
+        let event = &events[0];
+        match event.data {
+            udi::EventData::ProcessExit { code } => {
+                assert_eq!(1, code);
+                exits += 1;
+                event.process.lock()?.continue_process()?;
+            }
+            udi::EventData::ProcessCleanup => {
+                cleanups += 1;
+            }
+            _ => panic!("Unexpected event {:?}", event.data),
+        }
+    }
+
+    assert_eq!(2, exits);
+    assert_eq!(2, cleanups);
+
+    Ok(())
+}
+
+#[test]
+fn create_event_loop_queued_events() -> Result<(), udi::Error> {
+    let metadata = native_file_tests::get_test_metadata();
+    let exec_path = metadata.workerthreads_path().to_str().unwrap();
+    let thread_break_addr = metadata.thread_break_addr();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = vec!["2".to_owned()];
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+
+    let mut event_loop = udi::EventLoop::new(1)?;
+    event_loop.add_process(&proc_ref)?;
+
+    {
+        let mut process = proc_ref.lock()?;
+
+        process.set_event_mask(&[udi::EventType::ThreadCreate, udi::EventType::ThreadDeath])?;
+        process.set_stop_mode(udi::StopMode::NonStop)?;
+
+        process.create_breakpoint(thread_break_addr)?;
+        process.install_breakpoint(thread_break_addr)?;
+
+        process.continue_process()?;
+    }
+
+    // give both workers time to stop so their events are queued behind a single notification
+    std::thread::sleep(Duration::from_millis(500));
+
+    let mut stopped = vec![];
+    while stopped.len() < 2 {
+        let events = event_loop.wait(Some(Duration::from_secs(10)))?;
+        assert!(!events.is_empty(), "Timed out waiting for a queued event");
+
+        for event in events {
+            match event.data {
+                udi::EventData::Breakpoint { addr } if addr == thread_break_addr => {
+                    stopped.push(event.thread.clone());
+                }
+                _ => panic!("Unexpected event {:?}", event.data),
+            }
+        }
+    }
+
+    for thr_ref in &stopped {
+        thr_ref.lock()?.continue_thread()?;
+    }
+
+    while !event_loop.is_empty() {
+        let events = event_loop.wait(Some(Duration::from_secs(10)))?;
+        assert!(
+            !events.is_empty(),
+            "Timed out waiting for the process to exit"
+        );
+
+        for event in events {
+            match event.data {
+                udi::EventData::ProcessExit { code } => {
+                    assert_eq!(0, code);
+                    event.process.lock()?.continue_process()?;
+                }
+                udi::EventData::ProcessCleanup => {}
+                _ => panic!("Unexpected event {:?}", event.data),
+            }
+        }
+    }
+
+    Ok(())
+}
@@ -0,0 +1,318 @@
+//
+// Copyright (c) 2011-2023, UDI Contributors
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+#![deny(warnings)]
+
+mod native_file_tests;
+mod utils;
+
+#[test]
+fn search_mem() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function1_addr();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+
+        let pattern = process.read_mem(16, addr)?;
+
+        let hits = process.search_mem(addr - 4096, 8192, &pattern, None, 0)?;
+        assert!(hits.contains(&addr));
+
+        let mask = vec![0xff; pattern.len()];
+        let masked_hits = process.search_mem(addr - 4096, 8192, &pattern, Some(&mask), 0)?;
+        assert_eq!(hits, masked_hits);
+
+        let limited_hits = process.search_mem(addr, 16, &pattern, None, 1)?;
+        assert_eq!(vec![addr], limited_hits);
+
+        process.continue_process()?;
+    }
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn memory_map() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function1_addr();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+
+        let regions = process.memory_map()?;
+        let region = regions
+            .iter()
+            .find(|r| r.contains(addr))
+            .expect("no region contains the function");
+        assert_ne!(0, region.prot & udi::MemoryRegion::PROT_EXEC);
+
+        let unmapped = regions.windows(2).find(|w| w[0].end < w[1].start);
+        if let Some(w) = unmapped {
+            assert!(process.read_mem(1, w[0].end).is_err());
+        }
+
+        process.continue_process()?;
+    }
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn memory_mirror() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function1_addr();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+
+        let hashes = process.hash_mem(&[(addr, 256)], 64)?;
+        assert_eq!(1, hashes.len());
+        assert_eq!(4, hashes[0].len());
+        assert!(hashes[0].iter().all(|h| h.is_some()));
+
+        let mut mirror = udi::MemoryMirror::new(64);
+        mirror.add_range(addr, 256);
+
+        let changed = mirror.refresh(&mut process)?;
+        assert_eq!(vec![(addr, 256)], changed);
+        assert_eq!(process.read_mem(256, addr)?, mirror.data(addr).unwrap());
+
+        assert!(mirror.refresh(&mut process)?.is_empty());
+
+        let original = process.read_mem(1, addr + 70)?;
+        process.write_mem(&[!original[0]], addr + 70)?;
+
+        let changed = mirror.refresh(&mut process)?;
+        assert_eq!(vec![(addr + 64, 64)], changed);
+        assert_eq!(!original[0], mirror.data(addr).unwrap()[70]);
+
+        process.write_mem(&original, addr + 70)?;
+
+        process.continue_process()?;
+    }
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn compressed_read_mem() -> Result<(), udi::Error> {
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+
+        let len = 128 * 1024;
+        let region = process
+            .memory_map()?
+            .into_iter()
+            .find(|r| r.prot & udi::MemoryRegion::PROT_READ != 0 && r.end - r.start >= len)
+            .expect("no large readable region");
+
+        let data = process.read_mem(len as u32, region.start)?;
+        assert_eq!(len as usize, data.len());
+
+        // small reads are never compressed
+        for (i, chunk) in data.chunks(4096).enumerate() {
+            let expected = process.read_mem(4096, region.start + (i * 4096) as u64)?;
+            assert_eq!(expected, chunk);
+        }
+
+        process.continue_process()?;
+    }
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn mem_stream() -> Result<(), udi::Error> {
+    use std::io::{Read, Write};
+
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+
+        let regions = process.memory_map()?;
+
+        let len = 256 * 1024;
+        let region = regions
+            .iter()
+            .find(|r| r.prot & udi::MemoryRegion::PROT_READ != 0 && r.end - r.start >= len)
+            .expect("no large readable region");
+
+        let mut streamed = vec![];
+        process
+            .read_mem_stream(region.start, len)?
+            .read_to_end(&mut streamed)?;
+        assert_eq!(process.read_mem(len as u32, region.start)?, streamed);
+
+        // only the data of the executable is written, the rest could be in use by the runtime
+        let exec_name = std::path::Path::new(exec_path)
+            .file_name()
+            .unwrap()
+            .to_str()
+            .unwrap();
+        let rw = udi::MemoryRegion::PROT_READ | udi::MemoryRegion::PROT_WRITE;
+        let data_region = regions
+            .iter()
+            .find(|r| r.prot & rw == rw && r.path.ends_with(exec_name))
+            .expect("no data region for executable");
+        let data_len = data_region.end - data_region.start;
+
+        let original = process.read_mem(data_len as u32, data_region.start)?;
+        let pattern: Vec<u8> = (0..data_len).map(|i| (i % 251) as u8).collect();
+
+        let mut writer = process.write_mem_stream(data_region.start)?;
+        writer.write_all(&pattern)?;
+        writer.finish()?;
+        assert_eq!(
+            pattern,
+            process.read_mem(data_len as u32, data_region.start)?
+        );
+
+        let mut writer = process.write_mem_stream(data_region.start)?;
+        writer.write_all(&original)?;
+        writer.finish()?;
+
+        process.continue_process()?;
+    }
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn page_cache() -> Result<(), udi::Error> {
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+
+        let exec_name = std::path::Path::new(exec_path)
+            .file_name()
+            .unwrap()
+            .to_str()
+            .unwrap();
+        let rw = udi::MemoryRegion::PROT_READ | udi::MemoryRegion::PROT_WRITE;
+        let data_addr = process
+            .memory_map()?
+            .iter()
+            .find(|r| r.prot & rw == rw && r.path.ends_with(exec_name))
+            .expect("no data region for executable")
+            .start;
+
+        process.set_page_cache_prefetch(true);
+
+        let initial = process.page_cache_stats();
+        let original = process.read_mem(64, data_addr)?;
+        assert_eq!(original, process.read_mem(64, data_addr)?);
+        assert_eq!(original[8..16], process.read_mem(8, data_addr + 8)?[..]);
+
+        let stats = process.page_cache_stats();
+        assert_eq!(initial.misses + 1, stats.misses);
+        assert_eq!(initial.hits + 2, stats.hits);
+
+        // writes replace the cached contents
+        let pattern = vec![0xa5; 16];
+        process.write_mem(&pattern, data_addr + 4)?;
+        assert_eq!(pattern, process.read_mem(16, data_addr + 4)?);
+
+        process.write_mem(&original, data_addr)?;
+        assert_eq!(original, process.read_mem(64, data_addr)?);
+
+        process.set_page_cache_capacity(0);
+        assert_eq!(original, process.read_mem(64, data_addr)?);
+        assert_eq!(
+            process.page_cache_stats().misses,
+            stats.misses + 2,
+            "reads bypass a disabled cache"
+        );
+
+        process.continue_process()?;
+    }
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
@@ -0,0 +1,183 @@
+//
+// Copyright (c) 2011-2023, UDI Contributors
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+#![deny(warnings)]
+
+mod native_file_tests;
+mod utils;
+
+#[test]
+fn bulk_registers() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function1_addr();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+        process.create_breakpoint(addr)?;
+        process.install_breakpoint(addr)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::Breakpoint { addr });
+
+    {
+        let mut thread = thr_ref.lock()?;
+
+        let regs = thread.read_registers()?;
+        assert!(!regs.is_empty());
+
+        for (reg, value) in &regs {
+            assert_eq!(*value, thread.read_register(*reg)?);
+        }
+
+        let pc = thread.get_pc()?;
+        assert_eq!(addr, pc);
+
+        // writing back the same values leaves the context unchanged
+        thread.write_registers(&regs)?;
+        let values: Vec<u64> = regs.iter().map(|(_, v)| *v).collect();
+        let updated: Vec<u64> = thread.read_registers()?.iter().map(|(_, v)| *v).collect();
+        assert_eq!(values, updated);
+        assert_eq!(pc, thread.get_pc()?);
+    }
+
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn vector_registers() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function1_addr();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+        process.create_breakpoint(addr)?;
+        process.install_breakpoint(addr)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::Breakpoint { addr });
+
+    {
+        let mut thread = thr_ref.lock()?;
+
+        if let udi::Architecture::X86_64 = thread.get_architecture() {
+            let regs = thread.read_vector_registers()?;
+            assert!(regs.width == 16 || regs.width == 32 || regs.width == 64);
+            assert!(regs.count() == 16 || regs.count() == 32);
+
+            let xmm0 = thread.read_register_bytes(udi::Register::X86_64_XMM0)?;
+            assert_eq!(&regs.get(0).unwrap()[..16], xmm0.as_slice());
+
+            let st0 = thread.read_register_bytes(udi::Register::X86_64_ST0)?;
+            assert_eq!(10, st0.len());
+            assert!(thread.read_register(udi::Register::X86_64_ST0).is_err());
+
+            let mut xmm1 = thread.read_register_bytes(udi::Register::X86_64_XMM1)?;
+            xmm1[0] ^= 0xff;
+            thread.write_register_bytes(udi::Register::X86_64_XMM1, &xmm1)?;
+            assert_eq!(
+                xmm1,
+                thread.read_register_bytes(udi::Register::X86_64_XMM1)?
+            );
+
+            // restore the original values with a bulk write
+            thread.write_vector_registers(regs.width, &regs.data)?;
+            assert_eq!(regs, thread.read_vector_registers()?);
+        }
+    }
+
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn register_cache() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function1_addr();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+        process.create_breakpoint(addr)?;
+        process.install_breakpoint(addr)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::Breakpoint { addr });
+
+    {
+        let mut thread = thr_ref.lock()?;
+
+        thread.set_register_prefetch(true);
+        assert!(thread.get_register_prefetch());
+
+        assert_eq!(addr, thread.get_pc()?);
+
+        let reg = match thread.get_architecture() {
+            udi::Architecture::X86 => udi::Register::X86_EAX,
+            udi::Architecture::X86_64 => udi::Register::X86_64_RAX,
+        };
+
+        let value = thread.read_register(reg)?;
+        assert_eq!(value, thread.read_register(reg)?);
+
+        // writes must not be hidden by previously cached values
+        thread.write_register(reg, value.wrapping_add(1))?;
+        assert_eq!(value.wrapping_add(1), thread.read_register(reg)?);
+
+        thread.write_register(reg, value)?;
+        assert_eq!(value, thread.read_register(reg)?);
+        assert_eq!(addr, thread.get_pc()?);
+    }
+
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
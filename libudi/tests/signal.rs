@@ -0,0 +1,144 @@
+//
+// Copyright (c) 2011-2023, UDI Contributors
+// All rights reserved.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+#![deny(warnings)]
+#![cfg(target_os = "linux")]
+
+mod native_file_tests;
+mod utils;
+
+use std::process::Command;
+use std::sync::{Arc, Mutex};
+
+use udi::EventData;
+use udi::SignalPolicy;
+
+const SIGILL: u32 = 4;
+const SIGTRAP: u32 = 5;
+const SIGUSR1: u32 = 10;
+const SIGSEGV: u32 = 11;
+
+/// Creates the simple process and stops it at a breakpoint, so a signal sent to it stays pending
+/// until it is continued
+fn create_stopped_process(
+) -> Result<(Arc<Mutex<udi::Process>>, Arc<Mutex<udi::Thread>>), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function1_addr();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+        process.create_breakpoint(addr)?;
+        process.install_breakpoint(addr)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &EventData::Breakpoint { addr });
+
+    Ok((proc_ref, thr_ref))
+}
+
+fn send_signal(proc_ref: &Arc<Mutex<udi::Process>>, sig: u32) -> Result<(), udi::Error> {
+    let pid = proc_ref.lock()?.get_pid();
+
+    let status = Command::new("kill")
+        .arg(format!("-{}", sig))
+        .arg(pid.to_string())
+        .status()?;
+    assert!(status.success());
+
+    Ok(())
+}
+
+#[test]
+fn signal_policy_stop() -> Result<(), udi::Error> {
+    let (proc_ref, thr_ref) = create_stopped_process()?;
+
+    send_signal(&proc_ref, SIGUSR1)?;
+    proc_ref.lock()?.continue_process()?;
+
+    let events = udi::wait_for_events(&vec![proc_ref.clone()])?;
+    assert_eq!(1, events.len());
+    match events[0].data {
+        EventData::Signal { sig, .. } => assert_eq!(SIGUSR1, sig),
+        _ => panic!("Unexpected event {:?}", events[0].data),
+    }
+
+    // continuing without the signal discards it
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn signal_policy_ignore() -> Result<(), udi::Error> {
+    let (proc_ref, thr_ref) = create_stopped_process()?;
+
+    proc_ref
+        .lock()?
+        .set_signal_policy(SIGUSR1, SignalPolicy::Ignore)?;
+
+    // the signal is discarded without stopping the process
+    send_signal(&proc_ref, SIGUSR1)?;
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn signal_policy_rejected() -> Result<(), udi::Error> {
+    let (proc_ref, thr_ref) = create_stopped_process()?;
+
+    {
+        let mut process = proc_ref.lock()?;
+
+        // the process cannot make progress past a fault it does not stop for
+        for sig in [SIGSEGV, SIGILL] {
+            for policy in [SignalPolicy::Pass, SignalPolicy::Ignore] {
+                match process.set_signal_policy(sig, policy) {
+                    Err(udi::Error::Request(_)) => {}
+                    result => panic!("Unexpected result {:?} for signal {}", result, sig),
+                }
+            }
+        }
+
+        // breakpoints rely on the trap stopping the process
+        match process.set_signal_policy(SIGTRAP, SignalPolicy::Ignore) {
+            Err(udi::Error::Request(_)) => {}
+            result => panic!("Unexpected result {:?}", result),
+        }
+
+        // the test program has no handler for the signal, so there is nothing to pass it to
+        match process.set_signal_policy(SIGUSR1, SignalPolicy::Pass) {
+            Err(udi::Error::Request(_)) => {}
+            result => panic!("Unexpected result {:?}", result),
+        }
+
+        // a rejected policy leaves the process usable
+        process.set_signal_policy(SIGUSR1, SignalPolicy::Stop)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
@@ -63,3 +63,245 @@ fn singlestep() -> Result<(), udi::Error> {
 
     Ok(())
 }
+
+#[test]
+fn step_range() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function2_addr();
+    let len = native_file_tests::get_test_metadata().simple_function2_length();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+        process.create_breakpoint(addr)?;
+        process.install_breakpoint(addr)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::Breakpoint { addr });
+
+    // a single event is reported once the thread leaves the function
+    thr_ref.lock()?.step_range(addr, addr + len)?;
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::SingleStep);
+
+    let pc = thr_ref.lock()?.get_pc()?;
+    assert!(pc < addr || pc >= addr + len);
+    assert!(!thr_ref.lock()?.get_single_step());
+
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn step_out() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function2_addr();
+    let len = native_file_tests::get_test_metadata().simple_function2_length();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+        process.create_breakpoint(addr)?;
+        process.install_breakpoint(addr)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::Breakpoint { addr });
+
+    thr_ref.lock()?.step_out()?;
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::SingleStep);
+
+    let pc = thr_ref.lock()?.get_pc()?;
+    assert!(pc < addr || pc >= addr + len);
+
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn step_over() -> Result<(), udi::Error> {
+    let start_addr = native_file_tests::get_test_metadata().simple_function1_addr();
+    let addr = native_file_tests::get_test_metadata().simple_function2_addr();
+    let len = native_file_tests::get_test_metadata().simple_function2_length();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+        process.create_breakpoint(start_addr)?;
+        process.install_breakpoint(start_addr)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_event(
+        &proc_ref,
+        &thr_ref,
+        &udi::EventData::Breakpoint { addr: start_addr },
+    );
+
+    // single step up to the call of the test function
+    thr_ref.lock()?.set_single_step(true)?;
+    let mut steps = 0;
+    while thr_ref.lock()?.get_next_instruction()? != addr {
+        assert!(
+            steps < 10000,
+            "Failed to find the call of the test function"
+        );
+        steps += 1;
+
+        proc_ref.lock()?.continue_process()?;
+        utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::SingleStep);
+    }
+    thr_ref.lock()?.set_single_step(false)?;
+
+    let call_addr = thr_ref.lock()?.get_pc()?;
+
+    // the range only contains the call, so the next event is at the return address
+    thr_ref.lock()?.step_over(call_addr, call_addr + 1)?;
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::SingleStep);
+
+    let pc = thr_ref.lock()?.get_pc()?;
+    assert!(pc < addr || pc >= addr + len);
+    // the return address follows the call, and no x86 instruction is longer than 15 bytes
+    assert!(pc > call_addr && pc <= call_addr + 15);
+    assert!(!thr_ref.lock()?.get_single_step());
+
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn run_instructions() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function2_addr();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+        process.create_breakpoint(addr)?;
+        process.install_breakpoint(addr)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::Breakpoint { addr });
+    assert_eq!(None, thr_ref.lock()?.get_instruction_run());
+
+    thr_ref.lock()?.run_instructions(3)?;
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::SingleStep);
+
+    let mut thr = thr_ref.lock()?;
+    let run = thr.get_instruction_run().expect("Missing instruction run");
+    assert_eq!(3, run.executed);
+    assert_eq!(thr.get_pc()?, run.pc);
+    drop(thr);
+
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    Ok(())
+}
+
+#[test]
+fn record_branches() -> Result<(), udi::Error> {
+    let addr = native_file_tests::get_test_metadata().simple_function2_addr();
+    let exec_path = native_file_tests::get_test_metadata()
+        .simple_path()
+        .to_str()
+        .unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let argv = Vec::new();
+    let envp = Vec::new();
+
+    let proc_ref = udi::create_process(exec_path, &argv, &envp, &config)?;
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+        process.create_breakpoint(addr)?;
+        process.install_breakpoint(addr)?;
+        process.continue_process()?;
+    }
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::Breakpoint { addr });
+
+    let mut trace = thr_ref.lock()?.record_branches(4096)?;
+    thr_ref.lock()?.step_out()?;
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_event(&proc_ref, &thr_ref, &udi::EventData::SingleStep);
+
+    // the trace starts at the breakpoint and the return to the caller is the last branch taken
+    let targets = trace.drain()?;
+    assert_eq!(Some(&addr), targets.first());
+    assert_eq!(Some(&thr_ref.lock()?.get_pc()?), targets.last());
+    assert_eq!(0, trace.dropped()?);
+
+    thr_ref.lock()?.stop_recording_branches()?;
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 1);
+
+    assert!(trace.drain()?.is_empty());
+
+    Ok(())
+}
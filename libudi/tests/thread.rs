@@ -12,6 +12,8 @@ mod native_file_tests;
 mod utils;
 
 use udi::EventData;
+use udi::EventType;
+use udi::StopMode;
 use udi::ThreadState;
 
 const NUM_THREADS: u8 = 10;
@@ -137,3 +139,246 @@ fn thread() -> Result<(), udi::Error> {
 
     Ok(())
 }
+
+#[test]
+fn thread_batch() -> Result<(), udi::Error> {
+    let metadata = native_file_tests::get_test_metadata();
+    let binary_path = metadata.workerthreads_path().to_str().unwrap();
+    let thread_break_addr = metadata.thread_break_addr();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let envp = Vec::new();
+    let argv = vec![NUM_THREADS.to_string()];
+
+    let proc_ref = udi::create_process(binary_path, &argv, &envp, &config)?;
+
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+
+        process.set_event_mask(&[EventType::ThreadCreate, EventType::ThreadDeath])?;
+        process.create_breakpoint(thread_break_addr)?;
+        process.install_breakpoint(thread_break_addr)?;
+    }
+
+    proc_ref.lock()?.continue_process()?;
+
+    // the workers reach the breakpoint together, so the threads stopped with them in the same
+    // stop report their events in one batch. The workers continued from the breakpoint step over
+    // it, and the remaining workers still hit it once it is installed again.
+    let procs = vec![proc_ref.clone()];
+    let mut threads = std::collections::HashSet::new();
+    let mut largest_batch = 0;
+    while threads.len() < NUM_THREADS as usize {
+        let events = udi::wait_for_events(&procs)?;
+
+        let mut batch = 0;
+        for e in events {
+            match e.data {
+                EventData::Breakpoint { addr } if addr == thread_break_addr => {
+                    assert!(threads.insert(e.thread.lock()?.get_tid()));
+                    batch += 1;
+                }
+                _ => panic!("Unexpected event {:?}", e.data),
+            }
+        }
+        largest_batch = std::cmp::max(largest_batch, batch);
+
+        proc_ref.lock()?.continue_process()?;
+    }
+
+    assert!(largest_batch > 1);
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 0);
+
+    Ok(())
+}
+
+#[test]
+fn thread_foreign_step_breakpoint() -> Result<(), udi::Error> {
+    let metadata = native_file_tests::get_test_metadata();
+    let binary_path = metadata.workerthreads_path().to_str().unwrap();
+    let thread_break_addr = metadata.thread_break_addr();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let envp = Vec::new();
+    let argv = vec![NUM_THREADS.to_string()];
+
+    let proc_ref = udi::create_process(binary_path, &argv, &envp, &config)?;
+
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+
+        process.set_event_mask(&[EventType::ThreadCreate, EventType::ThreadDeath])?;
+        process.create_breakpoint(thread_break_addr)?;
+        process.install_breakpoint(thread_break_addr)?;
+    }
+
+    proc_ref.lock()?.continue_process()?;
+
+    // The first worker to hit the breakpoint single steps off it, which places a breakpoint for
+    // that worker after the instruction. The other workers run over that breakpoint without
+    // stopping, stepping past it in their own pads.
+    let procs = vec![proc_ref.clone()];
+    let mut stepping_tid = None;
+    let mut stepped = false;
+    let mut thread_breaks_received = 0;
+    while thread_breaks_received < NUM_THREADS || !stepped {
+        for e in udi::wait_for_events(&procs)? {
+            let mut thread = e.thread.lock()?;
+            match e.data {
+                EventData::Breakpoint { addr } if addr == thread_break_addr => {
+                    thread_breaks_received += 1;
+                    if stepping_tid.is_none() {
+                        stepping_tid = Some(thread.get_tid());
+                        thread.set_single_step(true)?;
+                    }
+                }
+                EventData::SingleStep => {
+                    assert_eq!(stepping_tid, Some(thread.get_tid()));
+                    assert!(!stepped);
+                    stepped = true;
+                    thread.set_single_step(false)?;
+                }
+                _ => panic!("Unexpected event {:?}", e.data),
+            }
+        }
+
+        proc_ref.lock()?.continue_process()?;
+    }
+
+    assert_eq!(NUM_THREADS, thread_breaks_received);
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 0);
+
+    Ok(())
+}
+
+#[test]
+fn thread_stop_stats() -> Result<(), udi::Error> {
+    let metadata = native_file_tests::get_test_metadata();
+    let binary_path = metadata.workerthreads_path().to_str().unwrap();
+    let thread_break_addr = metadata.thread_break_addr();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let envp = Vec::new();
+    let argv = vec![NUM_THREADS.to_string()];
+
+    let proc_ref = udi::create_process(binary_path, &argv, &envp, &config)?;
+
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+
+        process.set_event_mask(&[EventType::ThreadCreate, EventType::ThreadDeath])?;
+        process.create_breakpoint(thread_break_addr)?;
+        process.install_breakpoint(thread_break_addr)?;
+    }
+
+    proc_ref.lock()?.continue_process()?;
+
+    let mut thread_breaks_received = 0;
+    utils::handle_proc_events(&proc_ref, |e| {
+        match e.data {
+            EventData::Breakpoint { addr } if addr == thread_break_addr => {
+                thread_breaks_received += 1;
+            }
+            _ => panic!("Unexpected event {:?}", e.data),
+        }
+
+        thread_breaks_received == NUM_THREADS
+    });
+
+    // every event of the multithreaded process stopped the other threads first
+    let stats = proc_ref.lock()?.stop_stats()?;
+    assert!(stats.stops > 0);
+    assert!(stats.fanout_ns <= stats.arrival_ns);
+    assert!(stats.arrival_ns <= stats.total_ns);
+    assert!(stats.total_ns <= stats.max_total_ns);
+
+    proc_ref.lock()?.continue_process()?;
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 0);
+
+    Ok(())
+}
+
+#[test]
+fn thread_event_mask() -> Result<(), udi::Error> {
+    let metadata = native_file_tests::get_test_metadata();
+    let binary_path = metadata.workerthreads_path().to_str().unwrap();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let envp = Vec::new();
+    let argv = vec![NUM_THREADS.to_string()];
+
+    let proc_ref = udi::create_process(binary_path, &argv, &envp, &config)?;
+
+    let thr_ref = proc_ref.lock()?.get_initial_thread();
+
+    proc_ref
+        .lock()?
+        .set_event_mask(&[EventType::ThreadCreate, EventType::ThreadDeath])?;
+
+    proc_ref.lock()?.continue_process()?;
+
+    // None of the worker threads are reported, so the exit is the only event
+    utils::wait_for_exit(&proc_ref, &thr_ref, 0);
+
+    Ok(())
+}
+
+#[test]
+fn thread_non_stop() -> Result<(), udi::Error> {
+    let metadata = native_file_tests::get_test_metadata();
+    let binary_path = metadata.workerthreads_path().to_str().unwrap();
+    let thread_break_addr = metadata.thread_break_addr();
+
+    let config = udi::ProcessConfig::new(None, utils::rt_lib_path());
+    let envp = Vec::new();
+    let argv = vec![NUM_THREADS.to_string()];
+
+    let proc_ref = udi::create_process(binary_path, &argv, &envp, &config)?;
+
+    let thr_ref;
+    {
+        let mut process = proc_ref.lock()?;
+
+        thr_ref = process.get_initial_thread();
+
+        process.set_event_mask(&[EventType::ThreadCreate, EventType::ThreadDeath])?;
+        process.set_stop_mode(StopMode::NonStop)?;
+        assert_eq!(StopMode::NonStop, process.get_stop_mode());
+
+        process.create_breakpoint(thread_break_addr)?;
+        process.install_breakpoint(thread_break_addr)?;
+    }
+
+    proc_ref.lock()?.continue_process()?;
+
+    // each worker stops on its own and is continued while the others keep running
+    let procs = vec![proc_ref.clone()];
+    let mut thread_breaks_received = 0;
+    while thread_breaks_received < NUM_THREADS {
+        for e in udi::wait_for_events(&procs)? {
+            match e.data {
+                EventData::Breakpoint { addr } if addr == thread_break_addr => {
+                    thread_breaks_received += 1;
+                    e.thread.lock()?.continue_thread()?;
+                }
+                _ => panic!("Unexpected event {:?}", e.data),
+            }
+        }
+    }
+
+    utils::wait_for_exit(&proc_ref, &thr_ref, 0);
+
+    Ok(())
+}
@@ -122,6 +122,63 @@ typedef enum {
     UDI_X86_64_XMM13,
     UDI_X86_64_XMM14,
     UDI_X86_64_XMM15,
+    UDI_X86_64_YMM0,
+    UDI_X86_64_YMM1,
+    UDI_X86_64_YMM2,
+    UDI_X86_64_YMM3,
+    UDI_X86_64_YMM4,
+    UDI_X86_64_YMM5,
+    UDI_X86_64_YMM6,
+    UDI_X86_64_YMM7,
+    UDI_X86_64_YMM8,
+    UDI_X86_64_YMM9,
+    UDI_X86_64_YMM10,
+    UDI_X86_64_YMM11,
+    UDI_X86_64_YMM12,
+    UDI_X86_64_YMM13,
+    UDI_X86_64_YMM14,
+    UDI_X86_64_YMM15,
+    UDI_X86_64_ZMM0,
+    UDI_X86_64_ZMM1,
+    UDI_X86_64_ZMM2,
+    UDI_X86_64_ZMM3,
+    UDI_X86_64_ZMM4,
+    UDI_X86_64_ZMM5,
+    UDI_X86_64_ZMM6,
+    UDI_X86_64_ZMM7,
+    UDI_X86_64_ZMM8,
+    UDI_X86_64_ZMM9,
+    UDI_X86_64_ZMM10,
+    UDI_X86_64_ZMM11,
+    UDI_X86_64_ZMM12,
+    UDI_X86_64_ZMM13,
+    UDI_X86_64_ZMM14,
+    UDI_X86_64_ZMM15,
+    UDI_X86_64_ZMM16,
+    UDI_X86_64_ZMM17,
+    UDI_X86_64_ZMM18,
+    UDI_X86_64_ZMM19,
+    UDI_X86_64_ZMM20,
+    UDI_X86_64_ZMM21,
+    UDI_X86_64_ZMM22,
+    UDI_X86_64_ZMM23,
+    UDI_X86_64_ZMM24,
+    UDI_X86_64_ZMM25,
+    UDI_X86_64_ZMM26,
+    UDI_X86_64_ZMM27,
+    UDI_X86_64_ZMM28,
+    UDI_X86_64_ZMM29,
+    UDI_X86_64_ZMM30,
+    UDI_X86_64_ZMM31,
+    UDI_X86_64_K0,
+    UDI_X86_64_K1,
+    UDI_X86_64_K2,
+    UDI_X86_64_K3,
+    UDI_X86_64_K4,
+    UDI_X86_64_K5,
+    UDI_X86_64_K6,
+    UDI_X86_64_K7,
+    UDI_X86_64_MXCSR,
     UDI_X86_64_MAX
 } udi_register_e;
 
@@ -146,6 +203,25 @@ typedef enum
     UDI_REQ_THREAD_RESUME,
     UDI_REQ_NEXT_INSTRUCTION,
     UDI_REQ_SINGLE_STEP,
+    UDI_REQ_SEARCH_MEMORY,
+    UDI_REQ_MEMORY_MAP,
+    UDI_REQ_HASH_MEMORY,
+    UDI_REQ_READ_MEM_STREAM,
+    UDI_REQ_WRITE_MEM_STREAM,
+    UDI_REQ_READ_REGISTERS,
+    UDI_REQ_WRITE_REGISTERS,
+    UDI_REQ_READ_VECTOR_REGISTERS,
+    UDI_REQ_WRITE_VECTOR_REGISTERS,
+    UDI_REQ_SET_EVENT_PAYLOAD,
+    UDI_REQ_SET_EVENT_MASK,
+    UDI_REQ_SET_SIGNAL_POLICY,
+    UDI_REQ_STOP_STATS,
+    UDI_REQ_SET_STOP_MODE,
+    UDI_REQ_STEP_RANGE,
+    UDI_REQ_STEP_OVER,
+    UDI_REQ_STEP_OUT,
+    UDI_REQ_RUN_INSTRUCTIONS,
+    UDI_REQ_RECORD_BRANCHES,
 } udi_request_type_e;
 
 /* request payloads */
@@ -154,11 +230,30 @@ typedef struct continue_req_struct {
     uint32_t sig;
 } continue_req;
 
+typedef enum {
+    UDI_MEM_CODEC_NONE = 0,
+    UDI_MEM_CODEC_LZ4 = 1,
+} udi_mem_codec_e;
+
 typedef struct read_mem_req_struct {
     uint64_t addr;
     uint32_t len;
+    uint8_t codec;
 } read_mem_req;
 
+typedef struct read_mem_stream_req_struct {
+    uint64_t addr;
+    uint64_t len;
+} read_mem_stream_req;
+
+typedef struct write_mem_stream_req_struct {
+    uint64_t addr;
+    uint64_t offset;
+    uint8_t addr_set;
+    uint8_t indefinite;
+    uint8_t failed;
+} write_mem_stream_req;
+
 typedef struct write_mem_req_struct {
     uint64_t addr;
     const uint8_t *data;
@@ -169,11 +264,71 @@ typedef struct read_reg_req_struct {
     udi_register_e reg;
 } read_reg_req;
 
+/** The size of the widest register, in bytes */
+#define MAX_REGISTER_SIZE 64
+
 typedef struct write_reg_req_struct {
     udi_register_e reg;
     uint64_t value;
+    uint8_t bytes[MAX_REGISTER_SIZE];
+    uint32_t bytes_len;
+    uint8_t has_value;
+    uint8_t has_bytes;
 } write_reg_req;
 
+typedef struct write_regs_req_struct {
+    uint64_t *values;
+    uint8_t *present;
+    uint64_t num_values;
+    uint64_t values_read;
+    uint8_t bad_length;
+} write_regs_req;
+
+typedef struct write_vector_regs_req_struct {
+    uint32_t width;
+    uint8_t *data;
+    uint32_t len;
+} write_vector_regs_req;
+
+/** The limits on the data added to breakpoint and single step events */
+#define MAX_EVENT_PAYLOAD_REGS 32
+#define MAX_EVENT_PAYLOAD_STACK 4096
+
+typedef struct event_payload_req_struct {
+    udi_register_e regs[MAX_EVENT_PAYLOAD_REGS];
+    uint64_t num_regs;
+    uint64_t regs_read;
+    uint32_t stack;
+} event_payload_req;
+
+typedef struct event_mask_req_struct {
+    uint32_t mask;
+} event_mask_req;
+
+/** The bit for the event type in the mask of the set event mask request */
+#define UDI_EVENT_MASK_BIT(type) (1U << (type))
+
+/** The handling of a signal received by the debuggee */
+typedef enum {
+    UDI_SIGNAL_POLICY_STOP = 0, /* stop the process and report a signal event */
+    UDI_SIGNAL_POLICY_PASS,     /* pass the signal to the application without stopping */
+    UDI_SIGNAL_POLICY_IGNORE,   /* discard the signal without stopping */
+} udi_signal_policy_e;
+
+typedef struct signal_policy_req_struct {
+    uint32_t sig;
+    uint8_t policy;
+} signal_policy_req;
+
+typedef enum {
+    UDI_STOP_MODE_ALL = 0,  /* an event stops all threads */
+    UDI_STOP_MODE_NON_STOP, /* an event only stops the thread that triggered it */
+} udi_stop_mode_e;
+
+typedef struct stop_mode_req_struct {
+    uint8_t mode;
+} stop_mode_req;
+
 typedef struct brkpt_req_struct {
     uint64_t addr;
 } brkpt_req;
@@ -182,6 +337,51 @@ typedef struct single_step_req_struct {
     uint8_t setting;
 } single_step_req;
 
+typedef struct step_range_req_struct {
+    uint64_t start;
+    uint64_t end;
+} step_range_req;
+
+typedef struct run_instructions_req_struct {
+    uint64_t count;
+} run_instructions_req;
+
+typedef struct record_branches_req_struct {
+    uint32_t size;
+} record_branches_req;
+
+/**
+ * The header of the file a thread records its taken branches into, followed by the ring buffer
+ * of encoded branch targets. The offsets count bytes since recording started
+ */
+typedef struct branch_trace_header_struct {
+    uint64_t head;    /* bytes written by the debuggee */
+    uint64_t tail;    /* bytes consumed by the debugger */
+    uint64_t dropped; /* branches discarded while the ring buffer was full */
+    uint32_t size;    /* the size of the ring buffer */
+    uint32_t reserved;
+} branch_trace_header;
+
+typedef struct search_mem_req_struct {
+    uint64_t addr;
+    uint64_t len;
+    const uint8_t *pattern;
+    uint32_t pattern_len;
+    const uint8_t *mask;
+    uint32_t mask_len;
+    uint32_t max_hits;
+} search_mem_req;
+
+typedef struct hash_mem_req_struct {
+    uint64_t *addrs;
+    uint64_t num_addrs;
+    uint64_t addrs_read;
+    uint64_t *lens;
+    uint64_t num_lens;
+    uint64_t lens_read;
+    uint32_t block_size;
+} hash_mem_req;
+
 /*
  * Response types
  */
@@ -227,6 +427,28 @@ typedef struct single_step_resp_struct {
     uint8_t setting;
 } single_step_resp;
 
+/**
+ * Memory region protections
+ */
+typedef enum {
+    UDI_MEM_PROT_READ = 0x1,
+    UDI_MEM_PROT_WRITE = 0x2,
+    UDI_MEM_PROT_EXEC = 0x4,
+} udi_mem_prot_e;
+
+typedef struct memory_region_struct {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    uint32_t prot;
+    const char *path;
+} memory_region;
+
+typedef struct memory_map_resp_struct {
+    const memory_region *regions;
+    uint32_t len;
+} memory_map_resp;
+
 /**
  * Event types
  */
@@ -243,6 +465,7 @@ typedef enum
     UDI_EVENT_PROCESS_EXEC,
     UDI_EVENT_SINGLE_STEP,
     UDI_EVENT_PROCESS_CLEANUP,
+    UDI_EVENT_BATCH,
 } udi_event_type_e;
 
 /** event payloads */
@@ -15,6 +15,7 @@
 #include <ucontext.h>
 #include <inttypes.h>
 #include <errno.h>
+#include <string.h>
 
 #include "udi.h"
 #include "udirt.h"
@@ -96,6 +97,12 @@ uint64_t get_flags(const void *context) {
     return u_context->uc_mcontext->__ss.__rflags;
 }
 
+void set_flags(void *context, uint64_t flags) {
+    ucontext_t *u_context = (ucontext_t *)context;
+
+    u_context->uc_mcontext->__ss.__rflags = flags;
+}
+
 uint64_t get_trap_address(const ucontext_t *context) {
 
     return context->uc_mcontext->__ss.__rip - 1;
@@ -479,3 +486,47 @@ int set_register(udi_register_e reg,
     *address = value;
     return 0;
 }
+
+int get_register_bytes(udi_register_e reg,
+                       udi_errmsg *errmsg,
+                       uint8_t *value,
+                       const void *context)
+{
+    size_t size = get_register_size(reg);
+    if (size > sizeof(uint64_t)) {
+        udi_set_errmsg(errmsg, "register %s is not supported", register_str(reg));
+        return -1;
+    }
+
+    uint64_t reg_value;
+    if (get_register(reg, errmsg, &reg_value, context) != 0) {
+        return -1;
+    }
+
+    memcpy(value, &reg_value, size);
+    return 0;
+}
+
+int set_register_bytes(udi_register_e reg,
+                       udi_errmsg *errmsg,
+                       const uint8_t *value,
+                       void *context)
+{
+    size_t size = get_register_size(reg);
+    if (size > sizeof(uint64_t)) {
+        udi_set_errmsg(errmsg, "register %s is not supported", register_str(reg));
+        return -1;
+    }
+
+    uint64_t reg_value = 0;
+    memcpy(&reg_value, value, size);
+
+    return set_register(reg, errmsg, reg_value, context);
+}
+
+size_t get_vector_register_width(udi_errmsg *errmsg, const void *context) {
+    USE(context);
+
+    udi_set_errmsg(errmsg, "%s", "vector registers are not supported on this platform");
+    return 0;
+}
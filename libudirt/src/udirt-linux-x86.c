@@ -14,6 +14,8 @@
 
 #include <ucontext.h>
 #include <inttypes.h>
+#include <string.h>
+#include <cpuid.h>
 
 #include "udi.h"
 #include "udirt.h"
@@ -275,6 +277,16 @@ unsigned long get_flags(const void *context) {
     return u_context->uc_mcontext.gregs[X86_FLAGS_OFFSET];
 }
 
+void set_flags(void *context, uint64_t flags) {
+    ucontext_t *u_context = (ucontext_t *)context;
+
+    if (__WORDSIZE == 64) {
+        u_context->uc_mcontext.gregs[X86_64_FLAGS_OFFSET] = flags;
+    }else{
+        u_context->uc_mcontext.gregs[X86_FLAGS_OFFSET] = flags;
+    }
+}
+
 uint64_t get_trap_address(const ucontext_t *context) {
     if (__WORDSIZE == 64) {
         return (uint64_t)context->uc_mcontext.gregs[X86_64_RIP_OFFSET] - 1;
@@ -490,93 +502,351 @@ int get_udi_reg_context_offset(udi_register_e reg) {
         REG_CASE(X86_64_RIP);
         REG_CASE(X86_64_CSGSFS);
         REG_CASE(X86_64_FLAGS);
-        case UDI_X86_ST0:
-        case UDI_X86_ST1:
-        case UDI_X86_ST2:
-        case UDI_X86_ST3:
-        case UDI_X86_ST4:
-        case UDI_X86_ST5:
-        case UDI_X86_ST6:
-        case UDI_X86_ST7:
-        case UDI_X86_64_ST0:
-        case UDI_X86_64_ST1:
-        case UDI_X86_64_ST2:
-        case UDI_X86_64_ST3:
-        case UDI_X86_64_ST4:
-        case UDI_X86_64_ST5:
-        case UDI_X86_64_ST6:
-        case UDI_X86_64_ST7:
-        case UDI_X86_64_XMM0:
-        case UDI_X86_64_XMM1:
-        case UDI_X86_64_XMM2:
-        case UDI_X86_64_XMM3:
-        case UDI_X86_64_XMM4:
-        case UDI_X86_64_XMM5:
-        case UDI_X86_64_XMM6:
-        case UDI_X86_64_XMM7:
-        case UDI_X86_64_XMM8:
-        case UDI_X86_64_XMM9:
-        case UDI_X86_64_XMM10:
-        case UDI_X86_64_XMM11:
-        case UDI_X86_64_XMM12:
-        case UDI_X86_64_XMM13:
-        case UDI_X86_64_XMM14:
-        case UDI_X86_64_XMM15:
-            return -1;
         default:
-            return -2;
+            return is_fp_register(reg) ? -1 : -2;
     }
 }
 
+// Floating point register access
+//
+// The fpregs of a signal context point at the FXSAVE area in the signal frame (the FSAVE area
+// on x86), which is followed by the XSAVE header and extended state components when the kernel
+// saved the state with XSAVE. The registers are accessed in the signal frame, so writes take
+// effect when the signal handler returns.
+
+static const size_t FXSAVE_MXCSR_OFFSET = 24;
+static const size_t FXSAVE_XMM_OFFSET = 160;
+static const size_t FXSAVE_XMM_SIZE = 16 * 16;
+static const size_t FXSAVE_SW_BYTES_OFFSET = 464;
+static const size_t XSAVE_HEADER_OFFSET = 512;
+static const uint16_t X87_INIT_FCW = 0x037f;
+
+// The state components of the XSAVE feature set
+enum {
+    // not a state component, XSAVE always stores MXCSR in the legacy area whatever the state of
+    // the SSE component
+    XFEATURE_LEGACY = -1,
+    XFEATURE_X87 = 0,
+    XFEATURE_SSE = 1,
+    XFEATURE_YMM = 2,
+    XFEATURE_OPMASK = 5,
+    XFEATURE_ZMM_HI256 = 6,
+    XFEATURE_HI16_ZMM = 7,
+    NUM_XFEATURES = 8
+};
+
+// The part of a register stored in a single state component
+struct fp_reg_part {
+    int feature;
+    size_t offset;
+    size_t len;
+};
+
+#define MAX_FP_REG_PARTS 3
+
+static uint32_t xfeature_offsets[NUM_XFEATURES];
+static uint32_t xfeature_sizes[NUM_XFEATURES];
+static int xfeatures_loaded = 0;
+
+/**
+ * Loads the location of the extended state components in the (non-compacted) XSAVE area
+ */
+static
+void load_xfeature_layout() {
+    if (xfeatures_loaded) {
+        return;
+    }
+
+    if (__get_cpuid_max(0, NULL) >= 0xd) {
+        for (int i = XFEATURE_YMM; i < NUM_XFEATURES; ++i) {
+            unsigned int eax, ebx, ecx, edx;
+            __cpuid_count(0xd, i, eax, ebx, ecx, edx);
+            USE(ecx);
+            USE(edx);
+
+            xfeature_sizes[i] = eax;
+            xfeature_offsets[i] = ebx;
+        }
+    }
+
+    xfeatures_loaded = 1;
+}
+
+/**
+ * Gets the parts of the register, in the order they appear in the value of the register
+ *
+ * @param reg the register
+ * @param parts the output parameter for the parts
+ *
+ * @return the number of parts, 0 if the register is not a floating point register
+ */
+static
+int get_fp_reg_parts(udi_register_e reg, struct fp_reg_part *parts) {
+    size_t st_offset = (__WORDSIZE == 64) ? 32 : 28;
+    size_t st_stride = (__WORDSIZE == 64) ? 16 : 10;
+
+    if (reg >= UDI_X86_ST0 && reg <= UDI_X86_ST7) {
+        parts[0].feature = XFEATURE_X87;
+        parts[0].offset = st_offset + st_stride * (reg - UDI_X86_ST0);
+        parts[0].len = 10;
+        return 1;
+    }
+
+    if (reg >= UDI_X86_64_ST0 && reg <= UDI_X86_64_ST7) {
+        parts[0].feature = XFEATURE_X87;
+        parts[0].offset = st_offset + st_stride * (reg - UDI_X86_64_ST0);
+        parts[0].len = 10;
+        return 1;
+    }
+
+    int index;
+    if (reg >= UDI_X86_64_XMM0 && reg <= UDI_X86_64_XMM15) {
+        index = reg - UDI_X86_64_XMM0;
+    }else if (reg >= UDI_X86_64_YMM0 && reg <= UDI_X86_64_YMM15) {
+        index = reg - UDI_X86_64_YMM0;
+    }else if (reg >= UDI_X86_64_ZMM0 && reg <= UDI_X86_64_ZMM31) {
+        index = reg - UDI_X86_64_ZMM0;
+    }else if (reg >= UDI_X86_64_K0 && reg <= UDI_X86_64_K7) {
+        parts[0].feature = XFEATURE_OPMASK;
+        parts[0].offset = 8 * (reg - UDI_X86_64_K0);
+        parts[0].len = 8;
+        return 1;
+    }else if (reg == UDI_X86_64_MXCSR) {
+        parts[0].feature = XFEATURE_LEGACY;
+        parts[0].offset = FXSAVE_MXCSR_OFFSET;
+        parts[0].len = 4;
+        return 1;
+    }else{
+        return 0;
+    }
+
+    // ZMM16-31 do not overlap the SSE and AVX registers
+    if (index >= 16) {
+        parts[0].feature = XFEATURE_HI16_ZMM;
+        parts[0].offset = 64 * (index - 16);
+        parts[0].len = 64;
+        return 1;
+    }
+
+    size_t width = get_register_size(reg);
+
+    int num_parts = 0;
+    parts[num_parts].feature = XFEATURE_SSE;
+    parts[num_parts].offset = FXSAVE_XMM_OFFSET + 16 * index;
+    parts[num_parts].len = 16;
+    num_parts++;
+
+    if (width >= 32) {
+        parts[num_parts].feature = XFEATURE_YMM;
+        parts[num_parts].offset = 16 * index;
+        parts[num_parts].len = 16;
+        num_parts++;
+    }
+
+    if (width >= 64) {
+        parts[num_parts].feature = XFEATURE_ZMM_HI256;
+        parts[num_parts].offset = 32 * index;
+        parts[num_parts].len = 32;
+        num_parts++;
+    }
+
+    return num_parts;
+}
+
+/**
+ * Gets the location of the part of a register in the context
+ *
+ * @param context the context
+ * @param part the part of the register
+ * @param in_use populated with whether the state component is in use; when it is not, the
+ *        register has its initial value and the location does not contain the value
+ *
+ * @return the location, NULL if the state component is not available
+ */
+static
+uint8_t *get_fp_reg_part(const ucontext_t *context, const struct fp_reg_part *part, int *in_use) {
+    uint8_t *fpregs = (uint8_t *)context->uc_mcontext.fpregs;
+    if (fpregs == NULL) {
+        return NULL;
+    }
+
+    *in_use = 1;
+
+    if (part->feature == XFEATURE_LEGACY) {
+        return (__WORDSIZE == 64) ? fpregs + part->offset : NULL;
+    }
+
+    // the software reserved bytes of the FXSAVE area describe the XSAVE state in the frame
+    struct _fpx_sw_bytes sw;
+    memset(&sw, 0, sizeof(sw));
+    if (__WORDSIZE == 64) {
+        memcpy(&sw, fpregs + FXSAVE_SW_BYTES_OFFSET, sizeof(sw));
+    }
+
+    if (sw.magic1 != FP_XSTATE_MAGIC1) {
+        // only the legacy state is available
+        if (part->feature > XFEATURE_SSE || (__WORDSIZE != 64 && part->feature != XFEATURE_X87)) {
+            return NULL;
+        }
+        return fpregs + part->offset;
+    }
+
+    if ((sw.xstate_bv & (1ULL << part->feature)) == 0) {
+        return NULL;
+    }
+
+    uint64_t xstate_bv;
+    memcpy(&xstate_bv, fpregs + XSAVE_HEADER_OFFSET, sizeof(xstate_bv));
+    *in_use = (xstate_bv & (1ULL << part->feature)) != 0;
+
+    if (part->feature <= XFEATURE_SSE) {
+        return fpregs + part->offset;
+    }
+
+    load_xfeature_layout();
+
+    size_t offset = xfeature_offsets[part->feature];
+    if (offset == 0 || offset + xfeature_sizes[part->feature] > sw.xstate_size) {
+        return NULL;
+    }
+
+    return fpregs + offset + part->offset;
+}
+
+/**
+ * Marks the state component as in use, setting it to its initial state so it can be modified
+ *
+ * @param context the context
+ * @param feature the state component
+ */
+static
+void set_fp_feature_in_use(const ucontext_t *context, int feature) {
+    uint8_t *fpregs = (uint8_t *)context->uc_mcontext.fpregs;
+
+    switch (feature) {
+        case XFEATURE_LEGACY:
+            // always restored from the legacy area, XSTATE_BV does not apply
+            return;
+        case XFEATURE_X87:
+            // stops short of MXCSR, which is not part of the x87 state
+            memset(fpregs, 0, FXSAVE_MXCSR_OFFSET);
+            memcpy(fpregs, &X87_INIT_FCW, sizeof(X87_INIT_FCW));
+            memset(fpregs + 32, 0, 8 * 16);
+            break;
+        case XFEATURE_SSE:
+            memset(fpregs + FXSAVE_XMM_OFFSET, 0, FXSAVE_XMM_SIZE);
+            break;
+        default:
+            memset(fpregs + xfeature_offsets[feature], 0, xfeature_sizes[feature]);
+            break;
+    }
+
+    uint64_t xstate_bv;
+    memcpy(&xstate_bv, fpregs + XSAVE_HEADER_OFFSET, sizeof(xstate_bv));
+    xstate_bv |= (1ULL << feature);
+    memcpy(fpregs + XSAVE_HEADER_OFFSET, &xstate_bv, sizeof(xstate_bv));
+}
+
 static
 int get_fp_register(udi_register_e reg,
-                    uint64_t *value,
-                    const ucontext_t *context)
+                    uint8_t *value,
+                    const ucontext_t *context,
+                    udi_errmsg *errmsg)
 {
+    struct fp_reg_part parts[MAX_FP_REG_PARTS];
+    int num_parts = get_fp_reg_parts(reg, parts);
+    if (num_parts == 0) {
+        udi_set_errmsg(errmsg, "invalid register %s", register_str(reg));
+        return -1;
+    }
 
-    /** TODO need to rethink how floating point values are retrieved
-    switch (reg) {
-#ifndef __x86_64__
-        case UDI_X86_ST0: *value = context->uc_mcontext.fpregs->_st[0];
-        case UDI_X86_ST1: *value = context->uc_mcontext.fpregs->_st[1];
-        case UDI_X86_ST2: *value = context->uc_mcontext.fpregs->_st[2];
-        case UDI_X86_ST3: *value = context->uc_mcontext.fpregs->_st[3];
-        case UDI_X86_ST4: *value = context->uc_mcontext.fpregs->_st[4];
-        case UDI_X86_ST5: *value = context->uc_mcontext.fpregs->_st[5];
-        case UDI_X86_ST6: *value = context->uc_mcontext.fpregs->_st[6];
-        case UDI_X86_ST7: *value = context->uc_mcontext.fpregs->_st[7];
-#else // __x86_64__
-        case UDI_X86_64_ST0: *value = context->uc_mcontext.fpregs->_st[0];
-        case UDI_X86_64_ST1: *value = context->uc_mcontext.fpregs->_st[1];
-        case UDI_X86_64_ST2: *value = context->uc_mcontext.fpregs->_st[2];
-        case UDI_X86_64_ST3: *value = context->uc_mcontext.fpregs->_st[3];
-        case UDI_X86_64_ST4: *value = context->uc_mcontext.fpregs->_st[4];
-        case UDI_X86_64_ST5: *value = context->uc_mcontext.fpregs->_st[5];
-        case UDI_X86_64_ST6: *value = context->uc_mcontext.fpregs->_st[6];
-        case UDI_X86_64_ST7: *value = context->uc_mcontext.fpregs->_st[7];
-        case UDI_X86_64_XMM0: *value = context->
-        case UDI_X86_64_XMM1:
-        case UDI_X86_64_XMM2:
-        case UDI_X86_64_XMM3:
-        case UDI_X86_64_XMM4:
-        case UDI_X86_64_XMM5:
-        case UDI_X86_64_XMM6:
-        case UDI_X86_64_XMM7:
-        case UDI_X86_64_XMM8:
-        case UDI_X86_64_XMM9:
-        case UDI_X86_64_XMM10:
-        case UDI_X86_64_XMM11:
-        case UDI_X86_64_XMM12:
-        case UDI_X86_64_XMM13:
-        case UDI_X86_64_XMM14:
-        case UDI_X86_64_XMM15:
-#endif
-        default:
+    size_t pos = 0;
+    for (int i = 0; i < num_parts; ++i) {
+        int in_use;
+        const uint8_t *src = get_fp_reg_part(context, &parts[i], &in_use);
+        if (src == NULL) {
+            udi_set_errmsg(errmsg, "register %s is not available", register_str(reg));
             return -1;
+        }
+
+        if (in_use) {
+            memcpy(value + pos, src, parts[i].len);
+        }else{
+            memset(value + pos, 0, parts[i].len);
+        }
+        pos += parts[i].len;
     }
-    */
 
-    return -1;
+    return 0;
+}
+
+static
+int set_fp_register(udi_register_e reg,
+                    const uint8_t *value,
+                    ucontext_t *context,
+                    udi_errmsg *errmsg)
+{
+    struct fp_reg_part parts[MAX_FP_REG_PARTS];
+    int num_parts = get_fp_reg_parts(reg, parts);
+    if (num_parts == 0) {
+        udi_set_errmsg(errmsg, "invalid register %s", register_str(reg));
+        return -1;
+    }
+
+    // check all the parts before modifying any of them
+    for (int i = 0; i < num_parts; ++i) {
+        int in_use;
+        if (get_fp_reg_part(context, &parts[i], &in_use) == NULL) {
+            udi_set_errmsg(errmsg, "register %s is not available", register_str(reg));
+            return -1;
+        }
+    }
+
+    size_t pos = 0;
+    for (int i = 0; i < num_parts; ++i) {
+        int in_use;
+        uint8_t *dst = get_fp_reg_part(context, &parts[i], &in_use);
+        if (!in_use) {
+            set_fp_feature_in_use(context, parts[i].feature);
+        }
+
+        memcpy(dst, value + pos, parts[i].len);
+        pos += parts[i].len;
+    }
+
+    return 0;
+}
+
+size_t get_vector_register_width(udi_errmsg *errmsg, const void *context) {
+    const ucontext_t *u_context = (const ucontext_t *)context;
+
+    if (__WORDSIZE != 64) {
+        udi_set_errmsg(errmsg, "%s", "vector registers are not supported on this platform");
+        return 0;
+    }
+
+    struct fp_reg_part zmm_hi = { XFEATURE_ZMM_HI256, 0, 32 };
+    struct fp_reg_part hi16_zmm = { XFEATURE_HI16_ZMM, 0, 64 };
+    struct fp_reg_part ymm_hi = { XFEATURE_YMM, 0, 16 };
+    struct fp_reg_part xmm = { XFEATURE_SSE, FXSAVE_XMM_OFFSET, 16 };
+
+    int in_use;
+    if (get_fp_reg_part(u_context, &zmm_hi, &in_use) != NULL &&
+        get_fp_reg_part(u_context, &hi16_zmm, &in_use) != NULL)
+    {
+        return 64;
+    }
+
+    if (get_fp_reg_part(u_context, &ymm_hi, &in_use) != NULL) {
+        return 32;
+    }
+
+    if (get_fp_reg_part(u_context, &xmm, &in_use) != NULL) {
+        return 16;
+    }
+
+    udi_set_errmsg(errmsg, "%s", "vector registers are not available");
+    return 0;
 }
 
 int get_register(udi_register_e reg,
@@ -593,18 +863,27 @@ int get_register(udi_register_e reg,
     int offset = get_udi_reg_context_offset(reg);
     if (offset >= 0 ) {
         *value = (uint64_t)u_context->uc_mcontext.gregs[offset];
-    }else if (offset == -1) {
-        if ( get_fp_register(reg, value, u_context) != 0 ) {
-            offset = -2;
-        }
+        return 0;
     }
 
-    if (offset < -1) {
-        udi_set_errmsg(errmsg, "invalid register %d", reg);
-        return -1;
+    if (offset == -1) {
+        if (get_register_size(reg) > sizeof(uint64_t)) {
+            udi_set_errmsg(errmsg, "register %s is wider than 64 bits", register_str(reg));
+            return -1;
+        }
+
+        uint8_t bytes[sizeof(uint64_t)];
+        memset(bytes, 0, sizeof(bytes));
+        if (get_fp_register(reg, bytes, u_context, errmsg) != 0) {
+            return -1;
+        }
+
+        memcpy(value, bytes, sizeof(bytes));
+        return 0;
     }
 
-    return 0;
+    udi_set_errmsg(errmsg, "invalid register %d", reg);
+    return -1;
 }
 
 int set_register(udi_register_e reg,
@@ -621,14 +900,73 @@ int set_register(udi_register_e reg,
     int offset = get_udi_reg_context_offset(reg);
     if (offset >= 0 ) {
         u_context->uc_mcontext.gregs[offset] = (unsigned long)value;
-    }else if (offset == -1) {
-        // TODO set fp register
+        return 0;
+    }
+
+    if (offset == -1) {
+        if (get_register_size(reg) > sizeof(uint64_t)) {
+            udi_set_errmsg(errmsg, "register %s is wider than 64 bits", register_str(reg));
+            return -1;
+        }
+
+        uint8_t bytes[sizeof(uint64_t)];
+        memcpy(bytes, &value, sizeof(bytes));
+        return set_fp_register(reg, bytes, u_context, errmsg);
     }
 
-    if (offset < -1) {
-        udi_set_errmsg(errmsg, "invalid register %d", reg);
+    udi_set_errmsg(errmsg, "invalid register %d", reg);
+    return -1;
+}
+
+int get_register_bytes(udi_register_e reg,
+                       udi_errmsg *errmsg,
+                       uint8_t *value,
+                       const void *context)
+{
+    const ucontext_t *u_context = (const ucontext_t *)context;
+
+    if (validate_register(reg, errmsg)) {
         return -1;
     }
 
-    return 0;
+    int offset = get_udi_reg_context_offset(reg);
+    if (offset >= 0) {
+        uint64_t gp_value = (uint64_t)u_context->uc_mcontext.gregs[offset];
+        memcpy(value, &gp_value, get_register_size(reg));
+        return 0;
+    }
+
+    if (offset == -1) {
+        return get_fp_register(reg, value, u_context, errmsg);
+    }
+
+    udi_set_errmsg(errmsg, "invalid register %d", reg);
+    return -1;
+}
+
+int set_register_bytes(udi_register_e reg,
+                       udi_errmsg *errmsg,
+                       const uint8_t *value,
+                       void *context)
+{
+    ucontext_t *u_context = (ucontext_t *)context;
+
+    if (validate_register(reg, errmsg)) {
+        return -1;
+    }
+
+    int offset = get_udi_reg_context_offset(reg);
+    if (offset >= 0) {
+        uint64_t gp_value = 0;
+        memcpy(&gp_value, value, get_register_size(reg));
+        u_context->uc_mcontext.gregs[offset] = (unsigned long)gp_value;
+        return 0;
+    }
+
+    if (offset == -1) {
+        return set_fp_register(reg, value, u_context, errmsg);
+    }
+
+    udi_set_errmsg(errmsg, "invalid register %d", reg);
+    return -1;
 }
@@ -45,3 +45,8 @@ void *udi_realloc(void *ptr, size_t length) {
 
     return dlrealloc(ptr, length);
 }
+
+void *udi_memalign(size_t alignment, size_t length) {
+
+    return dlmemalign(alignment, length);
+}
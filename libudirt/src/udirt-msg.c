@@ -21,10 +21,138 @@
 #include "udirt.h"
 
 // Continue handling
-breakpoint *continue_bp = NULL;
 
-// the last hit breakpoint, set with continue_bp
-static uint64_t last_bp_address = 0;
+// A breakpoint used by a thread to step over the breakpoint it stopped at
+typedef struct continue_bp_struct {
+    breakpoint *bp;
+
+    // the breakpoint the thread stopped at, re-installed once the thread hits bp
+    uint64_t last_bp_address;
+
+    // NULL when the process is not multithreaded
+    thread *thr;
+    struct continue_bp_struct *next;
+} continue_bp_entry;
+
+static continue_bp_entry *continue_bps = NULL;
+
+int continue_pending() {
+    return continue_bps != NULL;
+}
+
+thread *get_continue_thread() {
+    if (continue_bps == NULL) {
+        return NULL;
+    }
+
+    return continue_bps->thr;
+}
+
+static
+continue_bp_entry *find_continue_bp(breakpoint *bp, thread *thr) {
+    continue_bp_entry *iter = continue_bps;
+    while (iter != NULL) {
+        if (iter->bp == bp && iter->thr == thr) {
+            return iter;
+        }
+        iter = iter->next;
+    }
+
+    return NULL;
+}
+
+/**
+ * @return non-zero if a thread still needs to hit the specified continue breakpoint
+ */
+static
+int is_continue_breakpoint(breakpoint *bp) {
+    continue_bp_entry *iter = continue_bps;
+    while (iter != NULL) {
+        if (iter->bp == bp) {
+            return 1;
+        }
+        iter = iter->next;
+    }
+
+    return 0;
+}
+
+/**
+ * @return non-zero if a thread still needs to step over the breakpoint at the specified address
+ */
+static
+int is_continuing_from(uint64_t bp_address) {
+    continue_bp_entry *iter = continue_bps;
+    while (iter != NULL) {
+        if (iter->last_bp_address == bp_address) {
+            return 1;
+        }
+        iter = iter->next;
+    }
+
+    return 0;
+}
+
+/**
+ * Creates the breakpoint that the thread uses to step over the specified breakpoint. Threads
+ * step over their breakpoints in the order they stopped.
+ */
+static
+int add_continue_bp(thread *thr, breakpoint *bp, uint64_t successor) {
+    continue_bp_entry *entry = (continue_bp_entry *)udi_malloc(sizeof(continue_bp_entry));
+    if (entry == NULL) {
+        udi_log("failed to allocate continue breakpoint");
+        return RESULT_ERROR;
+    }
+
+    entry->bp = create_breakpoint(successor);
+    if (entry->bp == NULL) {
+        udi_free(entry);
+        udi_log("failed to create continue breakpoint");
+        return RESULT_ERROR;
+    }
+    entry->last_bp_address = bp->address;
+    entry->thr = thr;
+    entry->next = NULL;
+
+    continue_bp_entry **tail = &continue_bps;
+    while (*tail != NULL) {
+        tail = &((*tail)->next);
+    }
+    *tail = entry;
+
+    return RESULT_SUCCESS;
+}
+
+/**
+ * Installs the continue breakpoints of the specified thread
+ */
+static
+int install_continue_bps(thread *thr, udi_errmsg *errmsg) {
+    continue_bp_entry *iter = continue_bps;
+    while (iter != NULL) {
+        if (iter->thr == thr && install_breakpoint(iter->bp, errmsg) != 0) {
+            udi_log("failed to install breakpoint for continue at %a", iter->bp->address);
+            return RESULT_ERROR;
+        }
+        iter = iter->next;
+    }
+
+    return RESULT_SUCCESS;
+}
+
+static
+void remove_continue_bp(continue_bp_entry *entry) {
+    continue_bp_entry **iter = &continue_bps;
+    while (*iter != NULL) {
+        if (*iter == entry) {
+            *iter = entry->next;
+            udi_free(entry);
+            return;
+        }
+        iter = &((*iter)->next);
+    }
+}
 
 struct msg_item {
     const char *key;
@@ -33,6 +161,9 @@ struct msg_item {
 
 struct msg_config {
     size_t num_items;
+
+    // the number of items, at the end of items, that can be omitted from a request
+    size_t num_optional;
     const struct msg_item *items;
 };
 
@@ -138,6 +269,7 @@ struct req_data_state {
     const struct msg_config *config;
     const struct msg_item *current_item;
     size_t item_count;
+    size_t expected_items;
 
     int error;
     udi_errmsg *errmsg;
@@ -158,7 +290,7 @@ void complete_item(void *ctx) {
     struct req_data_state *data_state = (struct req_data_state *)state->ctx;
 
     data_state->item_count++;
-    if (data_state->item_count >= data_state->config->num_items) {
+    if (data_state->item_count >= data_state->expected_items) {
         state->done = 1;
     }
     data_state->current_item = NULL;
@@ -373,12 +505,15 @@ void request_data_map_start(void *ctx, uint64_t len) {
     if (data_state->current_item != NULL) {
         map_start_callback(ctx, len);
     }else{
-        if (data_state->config->num_items != len) {
+        size_t num_required = data_state->config->num_items - data_state->config->num_optional;
+        if (len < num_required || len > data_state->config->num_items) {
             data_state->error = 1;
             udi_set_errmsg(data_state->errmsg,
                            "Unexpected number of data items in map (expected %d, actual %l)",
                            data_state->config->num_items,
                            len);
+        }else{
+            data_state->expected_items = len;
         }
     }
 }
@@ -432,6 +567,7 @@ int read_request_data(udirt_fd req_fd,
     data_state.errmsg = errmsg;
     data_state.config = config;
     data_state.data = data;
+    data_state.expected_items = config->num_items;
 
     struct cbor_callbacks callbacks = item_callbacks;
     callbacks.map_start = request_data_map_start;
@@ -596,7 +732,9 @@ int continue_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
     }
 
     // special handling for a continue from a breakpoint
-    if ( continue_bp != NULL ) {
+    continue_bp_entry *continue_entry = continue_bps;
+    while ( continue_entry != NULL ) {
+        breakpoint *continue_bp = continue_entry->bp;
         int install_result = install_breakpoint(continue_bp, errmsg);
         if ( install_result != 0 ) {
             udi_log("failed to install breakpoint for continue at %a",
@@ -608,6 +746,7 @@ int continue_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
             udi_log("installed breakpoint at %a for continue from breakpoint",
                     continue_bp->address);
         }
+        continue_entry = continue_entry->next;
     }
 
     if (get_multithread_capable()) {
@@ -626,6 +765,9 @@ int continue_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
     result = write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_CONTINUE, errmsg);
 
     if ( result == RESULT_SUCCESS ) {
+        // the mappings can change once the process is running
+        invalidate_memory_map();
+
         post_continue_hook(data.sig);
     }
 
@@ -642,6 +784,21 @@ void read_addr_callback(void *ctx, uint64_t value) {
     complete_item(ctx);
 }
 
+static
+void read_addr_uint32_callback(void *ctx, uint32_t value) {
+    read_addr_callback(ctx, value);
+}
+
+static
+void read_addr_uint16_callback(void *ctx, uint16_t value) {
+    read_addr_callback(ctx, value);
+}
+
+static
+void read_addr_uint8_callback(void *ctx, uint8_t value) {
+    read_addr_callback(ctx, value);
+}
+
 static
 void read_len_callback(void *ctx, uint32_t value) {
     read_mem_req *data = (read_mem_req *)req_state(ctx)->data;
@@ -650,6 +807,24 @@ void read_len_callback(void *ctx, uint32_t value) {
     complete_item(ctx);
 }
 
+static
+void read_len_uint16_callback(void *ctx, uint16_t value) {
+    read_len_callback(ctx, value);
+}
+
+static
+void read_len_uint8_callback(void *ctx, uint8_t value) {
+    read_len_callback(ctx, value);
+}
+
+static
+void read_codec_callback(void *ctx, uint8_t value) {
+    read_mem_req *data = (read_mem_req *)req_state(ctx)->data;
+    data->codec = value;
+
+    complete_item(ctx);
+}
+
 static
 void read_init_config(struct msg_config *config,
                       struct msg_item *items)
@@ -658,12 +833,22 @@ void read_init_config(struct msg_config *config,
         items[0].key = "addr";
         items[0].callbacks = invalid_callbacks;
         items[0].callbacks.uint64 = read_addr_callback;
+        items[0].callbacks.uint32 = read_addr_uint32_callback;
+        items[0].callbacks.uint16 = read_addr_uint16_callback;
+        items[0].callbacks.uint8 = read_addr_uint8_callback;
 
         items[1].key = "len";
         items[1].callbacks = invalid_callbacks;
         items[1].callbacks.uint32 = read_len_callback;
+        items[1].callbacks.uint16 = read_len_uint16_callback;
+        items[1].callbacks.uint8 = read_len_uint8_callback;
 
-        config->num_items = 2;
+        items[2].key = "codec";
+        items[2].callbacks = invalid_callbacks;
+        items[2].callbacks.uint8 = read_codec_callback;
+
+        config->num_items = 3;
+        config->num_optional = 1;
         config->items = items;
     }
 }
@@ -672,18 +857,31 @@ static
 int read_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
 
     static struct msg_config config;
-    static struct msg_item items[2];
+    static struct msg_item items[3];
     read_init_config(&config, items);
 
     int result;
     read_mem_req data;
     memset(&data, 0, sizeof(data));
 
+    data.codec = UDI_MEM_CODEC_NONE;
+
     result = read_request_data(req_fd, &config, &data, errmsg);
     if (result != RESULT_SUCCESS) {
         return result;
     }
 
+    if ( data.codec != UDI_MEM_CODEC_NONE && data.codec != UDI_MEM_CODEC_LZ4 ) {
+        udi_set_errmsg(errmsg, "unsupported memory codec %d", data.codec);
+        return RESULT_FAILURE;
+    }
+
+    if ( !is_range_mapped(data.addr, data.len) ) {
+        udi_set_errmsg(errmsg, "memory at %a is not mapped", data.addr);
+        udi_log("failed memory read: %a is not mapped", data.addr);
+        return RESULT_FAILURE;
+    }
+
     uint8_t *memory_read = udi_malloc(data.len);
     if ( memory_read == NULL ) {
         udi_set_errmsg(errmsg,
@@ -702,7 +900,36 @@ int read_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
         return RESULT_FAILURE;
     }
 
-    cbor_item_t *mem_item = cbor_build_bytestring((cbor_data)memory_read, data.len);
+    // the data is only sent compressed when that makes it smaller
+    uint8_t codec = UDI_MEM_CODEC_NONE;
+    uint8_t *compressed = NULL;
+    size_t compressed_len = 0;
+    if ( data.codec == UDI_MEM_CODEC_LZ4 ) {
+        compressed = udi_malloc(compress_bound(data.len));
+        if ( compressed == NULL ) {
+            udi_free(memory_read);
+            udi_set_errmsg(errmsg, "failed to allocate memory");
+            return RESULT_ERROR;
+        }
+
+        if ( compress_lz4(memory_read, data.len, compressed, &compressed_len, errmsg) != 0 ) {
+            udi_free(compressed);
+            udi_free(memory_read);
+            return RESULT_ERROR;
+        }
+
+        if ( compressed_len < data.len ) {
+            codec = UDI_MEM_CODEC_LZ4;
+            udi_log("compressed read of %d bytes to %l bytes", data.len, (uint64_t)compressed_len);
+        }
+    }
+
+    cbor_item_t *mem_item;
+    if ( codec == UDI_MEM_CODEC_LZ4 ) {
+        mem_item = cbor_build_bytestring((cbor_data)compressed, compressed_len);
+    }else{
+        mem_item = cbor_build_bytestring((cbor_data)memory_read, data.len);
+    }
 
     cbor_item_t *map = cbor_new_definite_map(2);
 
@@ -712,11 +939,20 @@ int read_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
     bool add_result = cbor_map_add(map, mem_map_item);
     assert(add_result);
 
+    if ( data.codec != UDI_MEM_CODEC_NONE ) {
+        struct cbor_pair codec_item;
+        codec_item.key = cbor_move(cbor_build_string("codec"));
+        codec_item.value = cbor_move(cbor_build_uint8(codec));
+        add_result = cbor_map_add(map, codec_item);
+        assert(add_result);
+    }
+
     result = write_response(resp_fd,
                             UDI_RESP_VALID,
                             UDI_REQ_READ_MEM,
                             map,
                             errmsg);
+    udi_free(compressed);
     udi_free(memory_read);
     return result;
 }
@@ -777,6 +1013,13 @@ int write_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
         return result;
     }
 
+    if ( !is_range_mapped(req.addr, req.len) ) {
+        udi_free((void *)req.data);
+        udi_set_errmsg(errmsg, "memory at %a is not mapped", req.addr);
+        udi_log("failed write request: %a is not mapped", req.addr);
+        return RESULT_FAILURE;
+    }
+
     // Perform the write operation
     int write_result = write_memory((uint8_t *)(uintptr_t)req.addr,
                                     req.data,
@@ -793,423 +1036,2578 @@ int write_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
     return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_WRITE_MEM, errmsg);
 }
 
-// state request handling
-
-static
-int state_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
-
-    USE(req_fd);
+// streaming memory request handling
 
-    int num_threads = get_num_threads();
+/** The size of the chunks memory is streamed in, which bounds the memory used by a transfer */
+static const size_t STREAM_CHUNK_SIZE = 64 * 1024;
 
-    cbor_item_t *array = cbor_new_definite_array(num_threads);
+static
+int write_raw(udirt_fd fd, const uint8_t *data, size_t len, udi_errmsg *errmsg) {
+    int result = write_to(fd, data, len);
+    if (result != 0) {
+        udi_set_errmsg(errmsg, "failed to write response data: %e", result);
+        return RESULT_ERROR;
+    }
 
-    thread *thr = get_thread_list();
-    while (thr != NULL) {
-        cbor_item_t *state_map = cbor_new_definite_map(2);
+    return RESULT_SUCCESS;
+}
 
-        struct cbor_pair tid_pair;
-        tid_pair.key = cbor_move(cbor_build_string("tid"));
-        tid_pair.value = cbor_move(cbor_build_uint64(get_thread_id(thr)));
-        bool add_result = cbor_map_add(state_map, tid_pair);
-        assert(add_result);
+static
+int write_raw_string(udirt_fd fd, const char *str, udi_errmsg *errmsg) {
+    uint8_t header[9];
+    size_t len = strlen(str);
 
-        struct cbor_pair state_pair;
-        state_pair.key = cbor_move(cbor_build_string("state"));
-        state_pair.value = cbor_move(cbor_build_uint16(get_thread_state(thr)));
-        add_result = cbor_map_add(state_map, state_pair);
-        assert(add_result);
+    size_t header_len = cbor_encode_string_start(len, header, sizeof(header));
+    int result = write_raw(fd, header, header_len, errmsg);
+    if (result == RESULT_SUCCESS) {
+        result = write_raw(fd, (const uint8_t *)str, len, errmsg);
+    }
 
-        add_result = cbor_array_push(array, cbor_move(state_map));
-        assert(add_result);
+    return result;
+}
 
-        thr = get_next_thread(thr);
-    }
+static
+void read_stream_addr_callback(void *ctx, uint64_t value) {
+    read_mem_stream_req *req = (read_mem_stream_req *)req_state(ctx)->data;
+    req->addr = value;
 
-    cbor_item_t *map = cbor_new_definite_map(1);
+    complete_item(ctx);
+}
 
-    struct cbor_pair states_pair;
-    states_pair.key = cbor_move(cbor_build_string("states"));
-    states_pair.value = cbor_move(array);
-    bool add_result = cbor_map_add(map, states_pair);
-    assert(add_result);
+static
+void read_stream_addr_uint32_callback(void *ctx, uint32_t value) {
+    read_stream_addr_callback(ctx, value);
+}
 
-    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_STATE, map, errmsg);
+static
+void read_stream_addr_uint16_callback(void *ctx, uint16_t value) {
+    read_stream_addr_callback(ctx, value);
 }
 
-// breakpoint request handling
+static
+void read_stream_addr_uint8_callback(void *ctx, uint8_t value) {
+    read_stream_addr_callback(ctx, value);
+}
 
 static
-void breakpoint_addr_callback(void *ctx, uint64_t value) {
-    brkpt_req *req = (brkpt_req *)req_state(ctx)->data;
-    req->addr = value;
+void read_stream_len_callback(void *ctx, uint64_t value) {
+    read_mem_stream_req *req = (read_mem_stream_req *)req_state(ctx)->data;
+    req->len = value;
 
     complete_item(ctx);
 }
 
 static
-void breakpoint_addr_uint32_callback(void *ctx, uint32_t value) {
-    breakpoint_addr_callback(ctx, value);
+void read_stream_len_uint32_callback(void *ctx, uint32_t value) {
+    read_stream_len_callback(ctx, value);
 }
 
 static
-void breakpoint_addr_uint16_callback(void *ctx, uint16_t value) {
-    breakpoint_addr_callback(ctx, value);
+void read_stream_len_uint16_callback(void *ctx, uint16_t value) {
+    read_stream_len_callback(ctx, value);
 }
 
 static
-void breakpoint_addr_uint8_callback(void *ctx, uint8_t value) {
-    breakpoint_addr_callback(ctx, value);
+void read_stream_len_uint8_callback(void *ctx, uint8_t value) {
+    read_stream_len_callback(ctx, value);
 }
 
 static
-void breakpoint_init_config(struct msg_config *config,
-                            struct msg_item *items) {
-
+void read_stream_init_config(struct msg_config *config,
+                             struct msg_item *items)
+{
     if (config->items == NULL) {
         items[0].key = "addr";
         items[0].callbacks = invalid_callbacks;
-        items[0].callbacks.uint64 = breakpoint_addr_callback;
-        items[0].callbacks.uint32 = breakpoint_addr_uint32_callback;
-        items[0].callbacks.uint16 = breakpoint_addr_uint16_callback;
-        items[0].callbacks.uint8 = breakpoint_addr_uint8_callback;
+        items[0].callbacks.uint64 = read_stream_addr_callback;
+        items[0].callbacks.uint32 = read_stream_addr_uint32_callback;
+        items[0].callbacks.uint16 = read_stream_addr_uint16_callback;
+        items[0].callbacks.uint8 = read_stream_addr_uint8_callback;
 
-        config->num_items = 1;
+        items[1].key = "len";
+        items[1].callbacks = invalid_callbacks;
+        items[1].callbacks.uint64 = read_stream_len_callback;
+        items[1].callbacks.uint32 = read_stream_len_uint32_callback;
+        items[1].callbacks.uint16 = read_stream_len_uint16_callback;
+        items[1].callbacks.uint8 = read_stream_len_uint8_callback;
+
+        config->num_items = 2;
         config->items = items;
     }
 }
 
+/**
+ * Streams the memory as an indefinite length byte string, reading one chunk at a
+ * time so the memory used is independent of the length of the transfer.
+ *
+ * Once the response has been started, a failure to read memory can no longer be
+ * reported with an error response. Instead, the stream ends early and the failure
+ * is reported in the error entry that follows the data.
+ */
 static
-int read_breakpoint_addr(udirt_fd req_fd, uint64_t *addr, udi_errmsg *errmsg) {
+int read_stream_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
 
     static struct msg_config config;
-    static struct msg_item items[1];
-    breakpoint_init_config(&config, items);
+    static struct msg_item items[2];
+    read_stream_init_config(&config, items);
 
-    brkpt_req req;
+    int result;
+    read_mem_stream_req req;
     memset(&req, 0, sizeof(req));
 
-    int result = read_request_data(req_fd, &config, &req, errmsg);
-    if (result == RESULT_SUCCESS) {
-        *addr = req.addr;
-    }
-    return result;
-}
-
-static
-int breakpoint_create_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
-
-    uint64_t addr;
-
-    int result = read_breakpoint_addr(req_fd, &addr, errmsg);
+    result = read_request_data(req_fd, &config, &req, errmsg);
     if (result != RESULT_SUCCESS) {
         return result;
     }
 
-    breakpoint *bp = find_breakpoint(addr);
-
-    // A breakpoint already exists
-    if ( bp != NULL ) {
-        udi_set_errmsg(errmsg,
-                       "breakpoint already exists at %a",
-                       addr);
-        udi_log("attempt to create duplicate breakpoint at %a", addr);
+    if ( !is_range_mapped(req.addr, req.len) ) {
+        udi_set_errmsg(errmsg, "memory at %a is not mapped", req.addr);
+        udi_log("failed memory stream read: %a is not mapped", req.addr);
         return RESULT_FAILURE;
     }
 
-    bp = create_breakpoint(addr);
-
-    if ( bp == NULL ) {
-        udi_set_errmsg(errmsg, "failed to create breakpoint at %a", addr);
-        udi_log("%s", errmsg->msg);
-        return RESULT_FAILURE;
+    uint8_t *chunk = (uint8_t *)udi_malloc(STREAM_CHUNK_SIZE);
+    if ( chunk == NULL ) {
+        udi_set_errmsg(errmsg, "failed to allocate memory");
+        return RESULT_ERROR;
     }
 
-    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_CREATE_BREAKPOINT, errmsg);
-}
+    uint8_t header[9];
+    const char *read_error = "";
+    do {
+        result = write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_READ_MEM_STREAM, errmsg);
+        if ( result != RESULT_SUCCESS ) {
+            break;
+        }
 
-static
-int read_breakpoint(udirt_fd req_fd, breakpoint **bp, udi_errmsg *errmsg) {
+        size_t header_len = cbor_encode_map_start(2, header, sizeof(header));
+        result = write_raw(resp_fd, header, header_len, errmsg);
+        if ( result != RESULT_SUCCESS ) {
+            break;
+        }
 
-    uint64_t addr;
+        result = write_raw_string(resp_fd, "data", errmsg);
+        if ( result != RESULT_SUCCESS ) {
+            break;
+        }
 
-    int result = read_breakpoint_addr(req_fd, &addr, errmsg);
-    if (result != RESULT_SUCCESS) {
-        return result;
-    }
+        header_len = cbor_encode_indef_bytestring_start(header, sizeof(header));
+        result = write_raw(resp_fd, header, header_len, errmsg);
+        if ( result != RESULT_SUCCESS ) {
+            break;
+        }
 
-    *bp = find_breakpoint(addr);
-    if ( bp == NULL ) {
-        udi_set_errmsg(errmsg, "no breakpoint exists at %a", addr);
-        udi_log("%s", errmsg->msg);
-        return RESULT_FAILURE;
-    }
+        uint64_t offset = 0;
+        while ( offset < req.len && result == RESULT_SUCCESS ) {
+            size_t chunk_len = STREAM_CHUNK_SIZE;
+            if ( req.len - offset < chunk_len ) {
+                chunk_len = (size_t)(req.len - offset);
+            }
 
-    return RESULT_SUCCESS;
+            uint64_t addr = req.addr + offset;
+            if ( read_memory(chunk, (const uint8_t *)(uintptr_t)addr, chunk_len, errmsg) != 0 ) {
+                read_error = get_mem_errstr();
+                udi_log("failed memory stream read at %a: %s", addr, read_error);
+                break;
+            }
+
+            header_len = cbor_encode_bytestring_start(chunk_len, header, sizeof(header));
+            result = write_raw(resp_fd, header, header_len, errmsg);
+            if ( result == RESULT_SUCCESS ) {
+                result = write_raw(resp_fd, chunk, chunk_len, errmsg);
+            }
+
+            offset += chunk_len;
+        }
+        if ( result != RESULT_SUCCESS ) {
+            break;
+        }
+
+        header_len = cbor_encode_break(header, sizeof(header));
+        result = write_raw(resp_fd, header, header_len, errmsg);
+        if ( result != RESULT_SUCCESS ) {
+            break;
+        }
+
+        result = write_raw_string(resp_fd, "error", errmsg);
+        if ( result != RESULT_SUCCESS ) {
+            break;
+        }
+
+        result = write_raw_string(resp_fd, read_error, errmsg);
+    }while (0);
+
+    udi_free(chunk);
+
+    // the response has been partially written so an error response cannot follow
+    if ( result != RESULT_SUCCESS ) {
+        result = RESULT_ERROR;
+    }
+
+    return result;
 }
 
 static
-int breakpoint_install_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+void write_stream_addr_callback(void *ctx, uint64_t value) {
+    write_mem_stream_req *req = (write_mem_stream_req *)req_state(ctx)->data;
+    req->addr = value;
+    req->addr_set = 1;
 
-    breakpoint *bp = NULL;
-    int result = read_breakpoint(req_fd, &bp, errmsg);
-    if (result != RESULT_SUCCESS) {
-        return result;
-    }
+    complete_item(ctx);
+}
 
-    result = install_breakpoint(bp, errmsg);
-    if (result != 0) {
-        return RESULT_FAILURE;
-    }
+static
+void write_stream_addr_uint32_callback(void *ctx, uint32_t value) {
+    write_stream_addr_callback(ctx, value);
+}
 
-    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_INSTALL_BREAKPOINT, errmsg);
+static
+void write_stream_addr_uint16_callback(void *ctx, uint16_t value) {
+    write_stream_addr_callback(ctx, value);
 }
 
 static
-int breakpoint_remove_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+void write_stream_addr_uint8_callback(void *ctx, uint8_t value) {
+    write_stream_addr_callback(ctx, value);
+}
 
-    breakpoint *bp = NULL;
-    int result = read_breakpoint(req_fd, &bp, errmsg);
-    if (result != RESULT_SUCCESS) {
-        return result;
+static
+void write_stream_data_start_callback(void *ctx) {
+    write_mem_stream_req *req = (write_mem_stream_req *)req_state(ctx)->data;
+    req->indefinite = 1;
+}
+
+/**
+ * Writes each chunk as it is decoded so the payload is never held in full. After a
+ * failure, the remaining chunks are consumed without being written.
+ */
+static
+void write_stream_data_callback(void *ctx, cbor_data data, uint64_t len) {
+    struct req_data_state *data_state = req_state(ctx);
+    write_mem_stream_req *req = (write_mem_stream_req *)data_state->data;
+
+    if ( !req->failed ) {
+        uint64_t addr = req->addr + req->offset;
+        if ( !req->addr_set ) {
+            udi_set_errmsg(data_state->errmsg, "addr must precede data in request");
+            req->failed = 1;
+        }else if ( !is_range_mapped(addr, len) ) {
+            udi_set_errmsg(data_state->errmsg, "memory at %a is not mapped", addr);
+            req->failed = 1;
+        }else if ( write_memory((uint8_t *)(uintptr_t)addr, data, len, data_state->errmsg) != 0 ) {
+            udi_set_errmsg(data_state->errmsg, "%s", get_mem_errstr());
+            req->failed = 1;
+        }
     }
 
-    result = remove_breakpoint(bp, errmsg);
-    if (result != 0) {
-        return RESULT_FAILURE;
+    req->offset += len;
+
+    if ( !req->indefinite ) {
+        complete_item(ctx);
     }
+}
 
-    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_REMOVE_BREAKPOINT, errmsg);
+static
+void write_stream_data_end_callback(void *ctx) {
+    complete_item(ctx);
 }
 
 static
-int breakpoint_delete_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+void write_stream_init_config(struct msg_config *config,
+                              struct msg_item *items)
+{
+    if (config->items == NULL) {
+        items[0].key = "addr";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.uint64 = write_stream_addr_callback;
+        items[0].callbacks.uint32 = write_stream_addr_uint32_callback;
+        items[0].callbacks.uint16 = write_stream_addr_uint16_callback;
+        items[0].callbacks.uint8 = write_stream_addr_uint8_callback;
 
-    breakpoint *bp = NULL;
-    int result = read_breakpoint(req_fd, &bp, errmsg);
+        items[1].key = "data";
+        items[1].callbacks = invalid_callbacks;
+        items[1].callbacks.byte_string_start = write_stream_data_start_callback;
+        items[1].callbacks.byte_string = write_stream_data_callback;
+        items[1].callbacks.indef_break = write_stream_data_end_callback;
+
+        config->num_items = 2;
+        config->items = items;
+    }
+}
+
+static
+int write_stream_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[2];
+    write_stream_init_config(&config, items);
+
+    int result;
+    write_mem_stream_req req;
+    memset(&req, 0, sizeof(req));
+
+    result = read_request_data(req_fd, &config, &req, errmsg);
     if (result != RESULT_SUCCESS) {
         return result;
     }
 
-    result = delete_breakpoint(bp, errmsg);
-    if (result != 0) {
+    if ( req.failed ) {
+        udi_log("failed memory stream write: %s", errmsg->msg);
         return RESULT_FAILURE;
     }
 
-    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_REMOVE_BREAKPOINT, errmsg);
+    udi_log("streamed %l bytes to %a", req.offset, req.addr);
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_WRITE_MEM_STREAM, errmsg);
 }
 
+// search request handling
+
+/** The upper bound on the number of matches reported by a single search */
+static const uint32_t MAX_SEARCH_HITS = 65536;
+
 static
-int invalid_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
-    USE(req_fd);
-    USE(resp_fd);
+void search_addr_callback(void *ctx, uint64_t value) {
+    search_mem_req *req = (search_mem_req *)req_state(ctx)->data;
+    req->addr = value;
 
-    udi_set_errmsg(errmsg, "invalid request for process");
-    return RESULT_ERROR;
+    complete_item(ctx);
 }
 
-typedef int (*request_handler)(udirt_fd, udirt_fd, udi_errmsg *);
+static
+void search_addr_uint32_callback(void *ctx, uint32_t value) {
+    search_addr_callback(ctx, value);
+}
 
 static
-request_handler request_handlers[] = {
-    invalid_handler, // invalid
-    continue_handler, // continue
-    read_handler, // read memory
-    write_handler, // write memory
-    invalid_handler, // read register
-    invalid_handler, // write register
-    state_handler, // state
-    invalid_handler, // init
-    breakpoint_create_handler, // create breakpoint
-    breakpoint_install_handler, // install breakpoint
-    breakpoint_remove_handler, // remove breakpoint
-    breakpoint_delete_handler, // delete breakpoint
-    invalid_handler, // thread suspend
-    invalid_handler, // thread resume
-    invalid_handler, // next instruction
-    invalid_handler // single step
-};
+void search_addr_uint16_callback(void *ctx, uint16_t value) {
+    search_addr_callback(ctx, value);
+}
 
 static
-void request_type_callback(void *ctx, uint16_t value) {
-    struct cbor_read_state *state = (struct cbor_read_state *)ctx;
-    struct req_data_state *data_state = (struct req_data_state *)state->ctx;
-    udi_request_type_e *type = (udi_request_type_e *)data_state->data;
+void search_addr_uint8_callback(void *ctx, uint8_t value) {
+    search_addr_callback(ctx, value);
+}
 
-    *type = value;
+static
+void search_len_callback(void *ctx, uint64_t value) {
+    search_mem_req *req = (search_mem_req *)req_state(ctx)->data;
+    req->len = value;
 
-    state->done = 1;
+    complete_item(ctx);
 }
 
 static
-void request_type_uint8_callback(void *ctx, uint8_t value) {
-    request_type_callback(ctx, value);
+void search_len_uint32_callback(void *ctx, uint32_t value) {
+    search_len_callback(ctx, value);
 }
 
 static
-int read_request_type(udirt_fd req_fd, udi_request_type_e *type, udi_errmsg *errmsg) {
+void search_len_uint16_callback(void *ctx, uint16_t value) {
+    search_len_callback(ctx, value);
+}
 
-    struct cbor_callbacks callbacks = invalid_callbacks;
-    callbacks.uint16 = request_type_callback;
-    callbacks.uint8 = request_type_uint8_callback;
+static
+void search_len_uint8_callback(void *ctx, uint8_t value) {
+    search_len_callback(ctx, value);
+}
 
-    struct req_data_state data_state;
-    memset(&data_state, 0, sizeof(data_state));
-    data_state.data = type;
-    data_state.errmsg = errmsg;
+static
+void search_max_callback(void *ctx, uint32_t value) {
+    search_mem_req *req = (search_mem_req *)req_state(ctx)->data;
+    req->max_hits = value;
 
-    int result = read_cbor_items(req_fd, &data_state, &callbacks, errmsg);
-    if (result != 0) {
-        return RESULT_ERROR;
-    }
+    complete_item(ctx);
+}
 
-    if (data_state.error) {
-        return RESULT_FAILURE;
+static
+void search_max_uint16_callback(void *ctx, uint16_t value) {
+    search_max_callback(ctx, value);
+}
+
+static
+void search_max_uint8_callback(void *ctx, uint8_t value) {
+    search_max_callback(ctx, value);
+}
+
+static
+void search_pattern_callback(void *ctx, cbor_data data, uint64_t len) {
+    search_mem_req *req = (search_mem_req *)req_state(ctx)->data;
+
+    // the length is kept when the allocation fails so the handler can report it
+    req->pattern_len = len;
+    if (len > 0) {
+        req->pattern = (uint8_t *)udi_malloc(len);
+        if (req->pattern != NULL) {
+            memcpy((void *)req->pattern, data, len);
+        }
     }
 
-    return RESULT_SUCCESS;
+    complete_item(ctx);
 }
 
 static
-int write_error_response(udirt_fd resp_fd, udi_request_type_e req_type, udi_errmsg *errmsg) {
-    udi_errmsg local_errmsg;
-    local_errmsg.size = ERRMSG_SIZE;
-    local_errmsg.msg[ERRMSG_SIZE-1] = '\0';
+void search_mask_callback(void *ctx, cbor_data data, uint64_t len) {
+    search_mem_req *req = (search_mem_req *)req_state(ctx)->data;
+
+    // the length is kept when the allocation fails so the handler can report it
+    req->mask_len = len;
+    if (len > 0) {
+        req->mask = (uint8_t *)udi_malloc(len);
+        if (req->mask != NULL) {
+            memcpy((void *)req->mask, data, len);
+        }
+    }
 
-    cbor_item_t *map = cbor_new_definite_map(1);
+    complete_item(ctx);
+}
 
-    struct cbor_pair msg_pair;
-    msg_pair.key = cbor_move(cbor_build_string("msg"));
-    msg_pair.value = cbor_move(cbor_build_string(errmsg->msg));
-    bool add_result = cbor_map_add(map, msg_pair);
-    assert(add_result);
+static
+void search_init_config(struct msg_config *config,
+                        struct msg_item *items)
+{
+    if (config->items == NULL) {
+        items[0].key = "addr";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.uint64 = search_addr_callback;
+        items[0].callbacks.uint32 = search_addr_uint32_callback;
+        items[0].callbacks.uint16 = search_addr_uint16_callback;
+        items[0].callbacks.uint8 = search_addr_uint8_callback;
 
-    int result = write_response(resp_fd, UDI_RESP_ERROR, req_type, map, &local_errmsg);
-    if (result != RESULT_SUCCESS) {
-        udi_log("failed to write error response: %s",
-                local_errmsg.msg);
+        items[1].key = "len";
+        items[1].callbacks = invalid_callbacks;
+        items[1].callbacks.uint64 = search_len_callback;
+        items[1].callbacks.uint32 = search_len_uint32_callback;
+        items[1].callbacks.uint16 = search_len_uint16_callback;
+        items[1].callbacks.uint8 = search_len_uint8_callback;
+
+        items[2].key = "pattern";
+        items[2].callbacks = invalid_callbacks;
+        items[2].callbacks.byte_string = search_pattern_callback;
+
+        items[3].key = "mask";
+        items[3].callbacks = invalid_callbacks;
+        items[3].callbacks.byte_string = search_mask_callback;
+
+        items[4].key = "max";
+        items[4].callbacks = invalid_callbacks;
+        items[4].callbacks.uint32 = search_max_callback;
+        items[4].callbacks.uint16 = search_max_uint16_callback;
+        items[4].callbacks.uint8 = search_max_uint8_callback;
+
+        config->num_items = 5;
+        config->items = items;
     }
+}
 
-    return result;
+static
+void search_hit(void *ctx, uint64_t addr) {
+    cbor_item_t *array = (cbor_item_t *)ctx;
+
+    bool add_result = cbor_array_push(array, cbor_move(cbor_build_uint64(addr)));
+    assert(add_result);
 }
 
-int handle_process_request(udirt_fd req_fd,
-                           udirt_fd resp_fd,
-                           udi_request_type_e *type,
-                           udi_errmsg *errmsg) {
+static
+int search_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[5];
+    search_init_config(&config, items);
 
     int result;
+    search_mem_req req;
+    memset(&req, 0, sizeof(req));
+
     do {
-        result = read_request_type(req_fd, type, errmsg);
+        result = read_request_data(req_fd, &config, &req, errmsg);
         if (result != RESULT_SUCCESS) {
-            *type = UDI_REQ_INVALID;
             break;
         }
 
-        result = request_handlers[*type](req_fd, resp_fd, errmsg);
-    }while (0);
+        if (req.pattern_len == 0) {
+            udi_set_errmsg(errmsg, "search pattern must not be empty");
+            result = RESULT_FAILURE;
+            break;
+        }
 
-    if (result != RESULT_SUCCESS) {
-        int error_result = write_error_response(resp_fd, *type, errmsg);
-        if (result != RESULT_ERROR && error_result == RESULT_ERROR) {
-            return RESULT_ERROR;
+        if (req.pattern == NULL || (req.mask_len != 0 && req.mask == NULL)) {
+            udi_set_errmsg(errmsg, "failed to allocate memory for search pattern");
+            result = RESULT_ERROR;
+            break;
         }
 
-    }
+        if (req.mask != NULL && req.mask_len != req.pattern_len) {
+            udi_set_errmsg(errmsg,
+                           "search mask length (%d) does not match pattern length (%d)",
+                           req.mask_len,
+                           req.pattern_len);
+            result = RESULT_FAILURE;
+            break;
+        }
 
-    return result;
-}
+        if (req.max_hits == 0 || req.max_hits > MAX_SEARCH_HITS) {
+            req.max_hits = MAX_SEARCH_HITS;
+        }
 
-// init request handling
+        cbor_item_t *array = cbor_new_indefinite_array();
 
-static
-int init_handler(uint64_t tid, udirt_fd resp_fd, udi_errmsg *errmsg) {
+        int num_hits = search_memory(req.addr,
+                                     req.len,
+                                     req.pattern,
+                                     req.mask,
+                                     req.pattern_len,
+                                     req.max_hits,
+                                     search_hit,
+                                     array,
+                                     errmsg);
+        if (num_hits < 0) {
+            cbor_decref(&array);
+            result = RESULT_ERROR;
+            break;
+        }
 
-    cbor_item_t *map = cbor_new_definite_map(4);
+        udi_log("found %d matches in [%a, %a)", num_hits, req.addr, req.addr + req.len);
 
-    struct cbor_pair v_pair;
-    v_pair.key = cbor_move(cbor_build_string("v"));
-    v_pair.value = cbor_move(cbor_build_uint32(get_protocol_version()));
-    bool add_result = cbor_map_add(map, v_pair);
-    assert(add_result);
+        cbor_item_t *map = cbor_new_definite_map(1);
 
-    struct cbor_pair arch_pair;
-    arch_pair.key = cbor_move(cbor_build_string("arch"));
-    arch_pair.value = cbor_move(cbor_build_uint16(get_architecture()));
-    add_result = cbor_map_add(map, arch_pair);
-    assert(add_result);
+        struct cbor_pair addrs_pair;
+        addrs_pair.key = cbor_move(cbor_build_string("addrs"));
+        addrs_pair.value = cbor_move(array);
+        bool add_result = cbor_map_add(map, addrs_pair);
+        assert(add_result);
 
-    struct cbor_pair mt_pair;
-    mt_pair.key = cbor_move(cbor_build_string("mt"));
-    mt_pair.value = cbor_move(cbor_build_bool(get_multithread_capable()));
-    add_result = cbor_map_add(map, mt_pair);
-    assert(add_result);
+        result = write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_SEARCH_MEMORY, map, errmsg);
+    }while (0);
 
-    struct cbor_pair tid_pair;
-    tid_pair.key = cbor_move(cbor_build_string("tid"));
-    tid_pair.value = cbor_move(cbor_build_uint64(tid));
-    add_result = cbor_map_add(map, tid_pair);
-    assert(add_result);
+    udi_free((void *)req.pattern);
+    udi_free((void *)req.mask);
 
-    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_INIT, map, errmsg);
+    return result;
 }
 
-int perform_init_handshake(udirt_fd req_fd,
-                           response_fd_callback callback,
-                           void *ctx,
-                           uint64_t tid,
-                           udi_errmsg *errmsg)
+// hash request handling
+
+/** The upper bound on the number of ranges in a single hash request */
+static const uint32_t MAX_HASH_RANGES = 4096;
+
+/** The upper bound on the number of blocks hashed by a single request */
+static const uint64_t MAX_HASH_BLOCKS = 1 << 18;
+
+static const uint32_t DEFAULT_HASH_BLOCK_SIZE = 4096;
+static const uint32_t MIN_HASH_BLOCK_SIZE = 64;
+static const uint32_t MAX_HASH_BLOCK_SIZE = 1 << 20;
+
+/**
+ * Starts reading an array of integers, allocating space for the elements. The array
+ * is left NULL if the count is over the limit so the handler can reject it, after all
+ * of the elements were read.
+ */
+static
+void hash_array_start(void *ctx, uint64_t len, uint64_t **values, uint64_t *count) {
+    *count = len;
+    if (len > 0 && len <= MAX_HASH_RANGES) {
+        *values = (uint64_t *)udi_calloc(len, sizeof(uint64_t));
+    }
+
+    if (len == 0) {
+        complete_item(ctx);
+    }
+}
+
+static
+void hash_array_value(void *ctx, uint64_t value, uint64_t *values, uint64_t count, uint64_t *num_read) {
+    if (values != NULL) {
+        values[*num_read] = value;
+    }
+
+    (*num_read)++;
+    if (*num_read >= count) {
+        complete_item(ctx);
+    }
+}
+
+static
+void hash_addrs_start_callback(void *ctx, uint64_t len) {
+    hash_mem_req *req = (hash_mem_req *)req_state(ctx)->data;
+    hash_array_start(ctx, len, &req->addrs, &req->num_addrs);
+}
+
+static
+void hash_addrs_callback(void *ctx, uint64_t value) {
+    hash_mem_req *req = (hash_mem_req *)req_state(ctx)->data;
+    hash_array_value(ctx, value, req->addrs, req->num_addrs, &req->addrs_read);
+}
+
+static
+void hash_addrs_uint32_callback(void *ctx, uint32_t value) {
+    hash_addrs_callback(ctx, value);
+}
+
+static
+void hash_addrs_uint16_callback(void *ctx, uint16_t value) {
+    hash_addrs_callback(ctx, value);
+}
+
+static
+void hash_addrs_uint8_callback(void *ctx, uint8_t value) {
+    hash_addrs_callback(ctx, value);
+}
+
+static
+void hash_lens_start_callback(void *ctx, uint64_t len) {
+    hash_mem_req *req = (hash_mem_req *)req_state(ctx)->data;
+    hash_array_start(ctx, len, &req->lens, &req->num_lens);
+}
+
+static
+void hash_lens_callback(void *ctx, uint64_t value) {
+    hash_mem_req *req = (hash_mem_req *)req_state(ctx)->data;
+    hash_array_value(ctx, value, req->lens, req->num_lens, &req->lens_read);
+}
+
+static
+void hash_lens_uint32_callback(void *ctx, uint32_t value) {
+    hash_lens_callback(ctx, value);
+}
+
+static
+void hash_lens_uint16_callback(void *ctx, uint16_t value) {
+    hash_lens_callback(ctx, value);
+}
+
+static
+void hash_lens_uint8_callback(void *ctx, uint8_t value) {
+    hash_lens_callback(ctx, value);
+}
+
+static
+void hash_block_size_callback(void *ctx, uint32_t value) {
+    hash_mem_req *req = (hash_mem_req *)req_state(ctx)->data;
+    req->block_size = value;
+
+    complete_item(ctx);
+}
+
+static
+void hash_block_size_uint16_callback(void *ctx, uint16_t value) {
+    hash_block_size_callback(ctx, value);
+}
+
+static
+void hash_block_size_uint8_callback(void *ctx, uint8_t value) {
+    hash_block_size_callback(ctx, value);
+}
+
+static
+void hash_init_config(struct msg_config *config,
+                      struct msg_item *items)
+{
+    if (config->items == NULL) {
+        items[0].key = "addrs";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.array_start = hash_addrs_start_callback;
+        items[0].callbacks.uint64 = hash_addrs_callback;
+        items[0].callbacks.uint32 = hash_addrs_uint32_callback;
+        items[0].callbacks.uint16 = hash_addrs_uint16_callback;
+        items[0].callbacks.uint8 = hash_addrs_uint8_callback;
+
+        items[1].key = "lens";
+        items[1].callbacks = invalid_callbacks;
+        items[1].callbacks.array_start = hash_lens_start_callback;
+        items[1].callbacks.uint64 = hash_lens_callback;
+        items[1].callbacks.uint32 = hash_lens_uint32_callback;
+        items[1].callbacks.uint16 = hash_lens_uint16_callback;
+        items[1].callbacks.uint8 = hash_lens_uint8_callback;
+
+        items[2].key = "block";
+        items[2].callbacks = invalid_callbacks;
+        items[2].callbacks.uint32 = hash_block_size_callback;
+        items[2].callbacks.uint16 = hash_block_size_uint16_callback;
+        items[2].callbacks.uint8 = hash_block_size_uint8_callback;
+
+        config->num_items = 3;
+        config->items = items;
+    }
+}
+
+static
+void hash_block(void *ctx, int readable, uint64_t hash) {
+    cbor_item_t *array = (cbor_item_t *)ctx;
+
+    cbor_item_t *item = readable ? cbor_build_uint64(hash) : cbor_new_null();
+    bool add_result = cbor_array_push(array, cbor_move(item));
+    assert(add_result);
+}
+
+static
+int validate_hash_request(hash_mem_req *req, udi_errmsg *errmsg) {
+    if (req->num_addrs > MAX_HASH_RANGES || req->num_lens > MAX_HASH_RANGES) {
+        udi_set_errmsg(errmsg, "too many ranges in hash request (limit %d)", MAX_HASH_RANGES);
+        return RESULT_FAILURE;
+    }
+
+    if (req->num_addrs != req->num_lens) {
+        udi_set_errmsg(errmsg,
+                       "number of addresses (%l) does not match number of lengths (%l)",
+                       req->num_addrs,
+                       req->num_lens);
+        return RESULT_FAILURE;
+    }
+
+    if (req->num_addrs > 0 && (req->addrs == NULL || req->lens == NULL)) {
+        udi_set_errmsg(errmsg, "failed to allocate memory");
+        return RESULT_ERROR;
+    }
+
+    if (req->block_size == 0) {
+        req->block_size = DEFAULT_HASH_BLOCK_SIZE;
+    }
+
+    if (req->block_size < MIN_HASH_BLOCK_SIZE ||
+        req->block_size > MAX_HASH_BLOCK_SIZE ||
+        (req->block_size & (req->block_size - 1)) != 0)
+    {
+        udi_set_errmsg(errmsg, "invalid hash block size %d", req->block_size);
+        return RESULT_FAILURE;
+    }
+
+    uint64_t num_blocks = 0;
+    for (uint32_t i = 0; i < req->num_addrs; ++i) {
+        if (req->addrs[i] + req->lens[i] < req->addrs[i]) {
+            udi_set_errmsg(errmsg, "hash range at %a overflows the address space", req->addrs[i]);
+            return RESULT_FAILURE;
+        }
+
+        // rounding up by adding the block size would wrap for lengths near the top of the range
+        num_blocks += req->lens[i] / req->block_size + (req->lens[i] % req->block_size != 0);
+        if (num_blocks > MAX_HASH_BLOCKS) {
+            udi_set_errmsg(errmsg, "too many blocks in hash request (limit %l)", MAX_HASH_BLOCKS);
+            return RESULT_FAILURE;
+        }
+    }
+
+    return RESULT_SUCCESS;
+}
+
+static
+int hash_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[3];
+    hash_init_config(&config, items);
+
+    int result;
+    hash_mem_req req;
+    memset(&req, 0, sizeof(req));
+
+    do {
+        result = read_request_data(req_fd, &config, &req, errmsg);
+        if (result != RESULT_SUCCESS) {
+            break;
+        }
+
+        result = validate_hash_request(&req, errmsg);
+        if (result != RESULT_SUCCESS) {
+            break;
+        }
+
+        cbor_item_t *ranges = cbor_new_definite_array(req.num_addrs);
+
+        for (uint32_t i = 0; i < req.num_addrs && result == RESULT_SUCCESS; ++i) {
+            cbor_item_t *hashes = cbor_new_indefinite_array();
+
+            if (hash_memory(req.addrs[i],
+                            req.lens[i],
+                            req.block_size,
+                            hash_block,
+                            hashes,
+                            errmsg) != 0)
+            {
+                result = RESULT_ERROR;
+            }
+
+            bool add_result = cbor_array_push(ranges, cbor_move(hashes));
+            assert(add_result);
+        }
+
+        if (result != RESULT_SUCCESS) {
+            cbor_decref(&ranges);
+            break;
+        }
+
+        cbor_item_t *map = cbor_new_definite_map(1);
+
+        struct cbor_pair hashes_pair;
+        hashes_pair.key = cbor_move(cbor_build_string("hashes"));
+        hashes_pair.value = cbor_move(ranges);
+        bool add_result = cbor_map_add(map, hashes_pair);
+        assert(add_result);
+
+        result = write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_HASH_MEMORY, map, errmsg);
+    }while (0);
+
+    udi_free(req.addrs);
+    udi_free(req.lens);
+
+    return result;
+}
+
+// memory map request handling
+
+static
+void add_map_field(cbor_item_t *map, const char *key, cbor_item_t *value) {
+    struct cbor_pair pair;
+    pair.key = cbor_move(cbor_build_string(key));
+    pair.value = cbor_move(value);
+    bool add_result = cbor_map_add(map, pair);
+    assert(add_result);
+}
+
+static
+int memory_map_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    USE(req_fd);
+
+    const memory_region *regions = NULL;
+    size_t num_regions = 0;
+    if ( get_memory_map(&regions, &num_regions, errmsg) != 0 ) {
+        udi_log("failed to retrieve memory map: %s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    cbor_item_t *array = cbor_new_definite_array(num_regions);
+
+    for (size_t i = 0; i < num_regions; ++i) {
+        const memory_region *region = &regions[i];
+
+        cbor_item_t *region_map = cbor_new_definite_map(5);
+        add_map_field(region_map, "start", cbor_build_uint64(region->start));
+        add_map_field(region_map, "end", cbor_build_uint64(region->end));
+        add_map_field(region_map, "offset", cbor_build_uint64(region->offset));
+        add_map_field(region_map, "prot", cbor_build_uint32(region->prot));
+        add_map_field(region_map,
+                         "path",
+                         cbor_build_string(region->path != NULL ? region->path : ""));
+
+        bool add_result = cbor_array_push(array, cbor_move(region_map));
+        assert(add_result);
+    }
+
+    cbor_item_t *map = cbor_new_definite_map(1);
+
+    struct cbor_pair regions_pair;
+    regions_pair.key = cbor_move(cbor_build_string("regions"));
+    regions_pair.value = cbor_move(array);
+    bool add_result = cbor_map_add(map, regions_pair);
+    assert(add_result);
+
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_MEMORY_MAP, map, errmsg);
+}
+
+// state request handling
+
+static
+int state_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    USE(req_fd);
+
+    int num_threads = get_num_threads();
+
+    cbor_item_t *array = cbor_new_definite_array(num_threads);
+
+    thread *thr = get_thread_list();
+    while (thr != NULL) {
+        cbor_item_t *state_map = cbor_new_definite_map(2);
+
+        struct cbor_pair tid_pair;
+        tid_pair.key = cbor_move(cbor_build_string("tid"));
+        tid_pair.value = cbor_move(cbor_build_uint64(get_thread_id(thr)));
+        bool add_result = cbor_map_add(state_map, tid_pair);
+        assert(add_result);
+
+        struct cbor_pair state_pair;
+        state_pair.key = cbor_move(cbor_build_string("state"));
+        state_pair.value = cbor_move(cbor_build_uint16(get_thread_state(thr)));
+        add_result = cbor_map_add(state_map, state_pair);
+        assert(add_result);
+
+        add_result = cbor_array_push(array, cbor_move(state_map));
+        assert(add_result);
+
+        thr = get_next_thread(thr);
+    }
+
+    cbor_item_t *map = cbor_new_definite_map(1);
+
+    struct cbor_pair states_pair;
+    states_pair.key = cbor_move(cbor_build_string("states"));
+    states_pair.value = cbor_move(array);
+    bool add_result = cbor_map_add(map, states_pair);
+    assert(add_result);
+
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_STATE, map, errmsg);
+}
+
+// breakpoint request handling
+
+static
+void breakpoint_addr_callback(void *ctx, uint64_t value) {
+    brkpt_req *req = (brkpt_req *)req_state(ctx)->data;
+    req->addr = value;
+
+    complete_item(ctx);
+}
+
+static
+void breakpoint_addr_uint32_callback(void *ctx, uint32_t value) {
+    breakpoint_addr_callback(ctx, value);
+}
+
+static
+void breakpoint_addr_uint16_callback(void *ctx, uint16_t value) {
+    breakpoint_addr_callback(ctx, value);
+}
+
+static
+void breakpoint_addr_uint8_callback(void *ctx, uint8_t value) {
+    breakpoint_addr_callback(ctx, value);
+}
+
+static
+void breakpoint_init_config(struct msg_config *config,
+                            struct msg_item *items) {
+
+    if (config->items == NULL) {
+        items[0].key = "addr";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.uint64 = breakpoint_addr_callback;
+        items[0].callbacks.uint32 = breakpoint_addr_uint32_callback;
+        items[0].callbacks.uint16 = breakpoint_addr_uint16_callback;
+        items[0].callbacks.uint8 = breakpoint_addr_uint8_callback;
+
+        config->num_items = 1;
+        config->items = items;
+    }
+}
+
+static
+int read_breakpoint_addr(udirt_fd req_fd, uint64_t *addr, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[1];
+    breakpoint_init_config(&config, items);
+
+    brkpt_req req;
+    memset(&req, 0, sizeof(req));
+
+    int result = read_request_data(req_fd, &config, &req, errmsg);
+    if (result == RESULT_SUCCESS) {
+        *addr = req.addr;
+    }
+    return result;
+}
+
+static
+int breakpoint_create_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    uint64_t addr;
+
+    int result = read_breakpoint_addr(req_fd, &addr, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    breakpoint *bp = find_breakpoint(addr);
+
+    // A breakpoint already exists
+    if ( bp != NULL ) {
+        udi_set_errmsg(errmsg,
+                       "breakpoint already exists at %a",
+                       addr);
+        udi_log("attempt to create duplicate breakpoint at %a", addr);
+        return RESULT_FAILURE;
+    }
+
+    bp = create_breakpoint(addr);
+
+    if ( bp == NULL ) {
+        udi_set_errmsg(errmsg, "failed to create breakpoint at %a", addr);
+        udi_log("%s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_CREATE_BREAKPOINT, errmsg);
+}
+
+static
+int read_breakpoint(udirt_fd req_fd, breakpoint **bp, udi_errmsg *errmsg) {
+
+    uint64_t addr;
+
+    int result = read_breakpoint_addr(req_fd, &addr, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    *bp = find_breakpoint(addr);
+    if ( bp == NULL ) {
+        udi_set_errmsg(errmsg, "no breakpoint exists at %a", addr);
+        udi_log("%s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    return RESULT_SUCCESS;
+}
+
+static
+int breakpoint_install_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    breakpoint *bp = NULL;
+    int result = read_breakpoint(req_fd, &bp, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    result = install_breakpoint(bp, errmsg);
+    if (result != 0) {
+        return RESULT_FAILURE;
+    }
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_INSTALL_BREAKPOINT, errmsg);
+}
+
+static
+int breakpoint_remove_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    breakpoint *bp = NULL;
+    int result = read_breakpoint(req_fd, &bp, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    result = remove_breakpoint(bp, errmsg);
+    if (result != 0) {
+        return RESULT_FAILURE;
+    }
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_REMOVE_BREAKPOINT, errmsg);
+}
+
+static
+int breakpoint_delete_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    breakpoint *bp = NULL;
+    int result = read_breakpoint(req_fd, &bp, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    result = delete_breakpoint(bp, errmsg);
+    if (result != 0) {
+        return RESULT_FAILURE;
+    }
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_REMOVE_BREAKPOINT, errmsg);
+}
+
+// event payload request handling
+
+/** The registers and number of stack bytes added to breakpoint and single step events */
+static event_payload_req event_payload;
+
+/** Stack reads that fault are retried up to the end of the stack pointer's page */
+static const uint64_t EVENT_STACK_PAGE_SIZE = 4096;
+
+static
+void event_payload_regs_start_callback(void *ctx, uint64_t len) {
+    event_payload_req *req = (event_payload_req *)req_state(ctx)->data;
+
+    // the length is validated after the request is read, the registers past the limit are read
+    // and discarded
+    req->num_regs = len;
+
+    if (len == 0) {
+        complete_item(ctx);
+    }
+}
+
+static
+void event_payload_reg_callback(void *ctx, uint32_t value) {
+    event_payload_req *req = (event_payload_req *)req_state(ctx)->data;
+
+    if (req->regs_read < MAX_EVENT_PAYLOAD_REGS) {
+        req->regs[req->regs_read] = (udi_register_e)value;
+    }
+
+    req->regs_read++;
+    if (req->regs_read >= req->num_regs) {
+        complete_item(ctx);
+    }
+}
+
+static
+void event_payload_reg_uint16_callback(void *ctx, uint16_t value) {
+    event_payload_reg_callback(ctx, value);
+}
+
+static
+void event_payload_reg_uint8_callback(void *ctx, uint8_t value) {
+    event_payload_reg_callback(ctx, value);
+}
+
+static
+void event_payload_stack_callback(void *ctx, uint32_t value) {
+    event_payload_req *req = (event_payload_req *)req_state(ctx)->data;
+    req->stack = value;
+
+    complete_item(ctx);
+}
+
+static
+void event_payload_stack_uint16_callback(void *ctx, uint16_t value) {
+    event_payload_stack_callback(ctx, value);
+}
+
+static
+void event_payload_stack_uint8_callback(void *ctx, uint8_t value) {
+    event_payload_stack_callback(ctx, value);
+}
+
+static
+void event_payload_init_config(struct msg_config *config,
+                               struct msg_item *items)
+{
+    if (config->items == NULL) {
+        items[0].key = "regs";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.array_start = event_payload_regs_start_callback;
+        items[0].callbacks.uint32 = event_payload_reg_callback;
+        items[0].callbacks.uint16 = event_payload_reg_uint16_callback;
+        items[0].callbacks.uint8 = event_payload_reg_uint8_callback;
+
+        items[1].key = "stack";
+        items[1].callbacks = invalid_callbacks;
+        items[1].callbacks.uint32 = event_payload_stack_callback;
+        items[1].callbacks.uint16 = event_payload_stack_uint16_callback;
+        items[1].callbacks.uint8 = event_payload_stack_uint8_callback;
+
+        config->num_items = 2;
+        config->num_optional = 1;
+        config->items = items;
+    }
+}
+
+static
+int event_payload_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[2];
+    event_payload_init_config(&config, items);
+
+    event_payload_req req;
+    memset(&req, 0, sizeof(req));
+
+    int result = read_request_data(req_fd, &config, &req, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    if (req.num_regs > MAX_EVENT_PAYLOAD_REGS) {
+        udi_set_errmsg(errmsg,
+                       "too many registers in event payload (limit %d)",
+                       MAX_EVENT_PAYLOAD_REGS);
+        return RESULT_FAILURE;
+    }
+
+    if (req.stack > MAX_EVENT_PAYLOAD_STACK) {
+        udi_set_errmsg(errmsg,
+                       "too many stack bytes in event payload (limit %d)",
+                       MAX_EVENT_PAYLOAD_STACK);
+        return RESULT_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < req.num_regs; ++i) {
+        if (validate_register(req.regs[i], errmsg) != 0) {
+            return RESULT_FAILURE;
+        }
+
+        if (get_register_size(req.regs[i]) > sizeof(uint64_t)) {
+            udi_set_errmsg(errmsg,
+                           "register %s is wider than 64 bits",
+                           register_str(req.regs[i]));
+            return RESULT_FAILURE;
+        }
+    }
+
+    event_payload = req;
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_SET_EVENT_PAYLOAD, errmsg);
+}
+
+// event mask request handling
+
+/** The events that are not reported, by the bit for their type */
+static uint32_t event_mask = 0;
+
+/** The events that can be masked, which do not need a response from the debugger */
+static const uint32_t MASKABLE_EVENTS = UDI_EVENT_MASK_BIT(UDI_EVENT_THREAD_CREATE) |
+                                        UDI_EVENT_MASK_BIT(UDI_EVENT_THREAD_DEATH) |
+                                        UDI_EVENT_MASK_BIT(UDI_EVENT_PROCESS_FORK);
+
+int is_event_masked(udi_event_type_e event_type) {
+    return (event_mask & UDI_EVENT_MASK_BIT(event_type)) != 0;
+}
+
+static
+void event_mask_callback(void *ctx, uint32_t value) {
+    event_mask_req *req = (event_mask_req *)req_state(ctx)->data;
+    req->mask = value;
+
+    complete_item(ctx);
+}
+
+static
+void event_mask_uint16_callback(void *ctx, uint16_t value) {
+    event_mask_callback(ctx, value);
+}
+
+static
+void event_mask_uint8_callback(void *ctx, uint8_t value) {
+    event_mask_callback(ctx, value);
+}
+
+static
+void event_mask_init_config(struct msg_config *config,
+                            struct msg_item *items)
+{
+    if (config->items == NULL) {
+        items[0].key = "mask";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.uint32 = event_mask_callback;
+        items[0].callbacks.uint16 = event_mask_uint16_callback;
+        items[0].callbacks.uint8 = event_mask_uint8_callback;
+
+        config->num_items = 1;
+        config->items = items;
+    }
+}
+
+static
+int event_mask_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[1];
+    event_mask_init_config(&config, items);
+
+    event_mask_req req;
+    memset(&req, 0, sizeof(req));
+
+    int result = read_request_data(req_fd, &config, &req, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    if ((req.mask & ~MASKABLE_EVENTS) != 0) {
+        udi_set_errmsg(errmsg,
+                       "event mask %x contains events that cannot be masked",
+                       (uint64_t)req.mask);
+        return RESULT_FAILURE;
+    }
+
+    event_mask = req.mask;
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_SET_EVENT_MASK, errmsg);
+}
+
+// set signal policy request handling
+
+static
+void signal_policy_sig_callback(void *ctx, uint32_t value) {
+    signal_policy_req *req = (signal_policy_req *)req_state(ctx)->data;
+    req->sig = value;
+
+    complete_item(ctx);
+}
+
+static
+void signal_policy_sig_uint16_callback(void *ctx, uint16_t value) {
+    signal_policy_sig_callback(ctx, value);
+}
+
+static
+void signal_policy_sig_uint8_callback(void *ctx, uint8_t value) {
+    signal_policy_sig_callback(ctx, value);
+}
+
+static
+void signal_policy_policy_callback(void *ctx, uint8_t value) {
+    signal_policy_req *req = (signal_policy_req *)req_state(ctx)->data;
+    req->policy = value;
+
+    complete_item(ctx);
+}
+
+static
+void signal_policy_init_config(struct msg_config *config,
+                               struct msg_item *items)
+{
+    if (config->items == NULL) {
+        items[0].key = "sig";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.uint32 = signal_policy_sig_callback;
+        items[0].callbacks.uint16 = signal_policy_sig_uint16_callback;
+        items[0].callbacks.uint8 = signal_policy_sig_uint8_callback;
+
+        items[1].key = "policy";
+        items[1].callbacks = invalid_callbacks;
+        items[1].callbacks.uint8 = signal_policy_policy_callback;
+
+        config->num_items = 2;
+        config->items = items;
+    }
+}
+
+static
+int signal_policy_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[2];
+    signal_policy_init_config(&config, items);
+
+    signal_policy_req req;
+    memset(&req, 0, sizeof(req));
+
+    int result = read_request_data(req_fd, &config, &req, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    if (req.policy > UDI_SIGNAL_POLICY_IGNORE) {
+        udi_set_errmsg(errmsg, "invalid signal policy %d", req.policy);
+        return RESULT_FAILURE;
+    }
+
+    result = set_signal_policy(req.sig, (udi_signal_policy_e)req.policy, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_SET_SIGNAL_POLICY, errmsg);
+}
+
+// stop stats request handling
+
+static
+int stop_stats_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    USE(req_fd);
+
+    udi_stop_stats stats;
+    get_stop_stats(&stats);
+
+    cbor_item_t *map = cbor_new_definite_map(6);
+    add_map_field(map, "stops", cbor_build_uint64(stats.stops));
+    add_map_field(map, "threads", cbor_build_uint32(stats.threads));
+    add_map_field(map, "fanout_ns", cbor_build_uint64(stats.fanout_ns));
+    add_map_field(map, "arrival_ns", cbor_build_uint64(stats.arrival_ns));
+    add_map_field(map, "total_ns", cbor_build_uint64(stats.total_ns));
+    add_map_field(map, "max_total_ns", cbor_build_uint64(stats.max_total_ns));
+
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_STOP_STATS, map, errmsg);
+}
+
+// set stop mode request handling
+
+static
+void stop_mode_callback(void *ctx, uint8_t value) {
+    stop_mode_req *req = (stop_mode_req *)req_state(ctx)->data;
+    req->mode = value;
+
+    complete_item(ctx);
+}
+
+static
+void stop_mode_init_config(struct msg_config *config,
+                           struct msg_item *items)
+{
+    if (config->items == NULL) {
+        items[0].key = "mode";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.uint8 = stop_mode_callback;
+
+        config->num_items = 1;
+        config->items = items;
+    }
+}
+
+static
+int stop_mode_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[1];
+    stop_mode_init_config(&config, items);
+
+    stop_mode_req req;
+    memset(&req, 0, sizeof(req));
+
+    int result = read_request_data(req_fd, &config, &req, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    if (req.mode > UDI_STOP_MODE_NON_STOP) {
+        udi_set_errmsg(errmsg, "invalid stop mode %d", req.mode);
+        return RESULT_FAILURE;
+    }
+
+    result = set_stop_mode((udi_stop_mode_e)req.mode, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_SET_STOP_MODE, errmsg);
+}
+
+static
+int invalid_handler(udirt_fd req_fd, udirt_fd resp_fd, udi_errmsg *errmsg) {
+    USE(req_fd);
+    USE(resp_fd);
+
+    udi_set_errmsg(errmsg, "invalid request for process");
+    return RESULT_ERROR;
+}
+
+typedef int (*request_handler)(udirt_fd, udirt_fd, udi_errmsg *);
+
+static
+request_handler request_handlers[] = {
+    invalid_handler, // invalid
+    continue_handler, // continue
+    read_handler, // read memory
+    write_handler, // write memory
+    invalid_handler, // read register
+    invalid_handler, // write register
+    state_handler, // state
+    invalid_handler, // init
+    breakpoint_create_handler, // create breakpoint
+    breakpoint_install_handler, // install breakpoint
+    breakpoint_remove_handler, // remove breakpoint
+    breakpoint_delete_handler, // delete breakpoint
+    invalid_handler, // thread suspend
+    invalid_handler, // thread resume
+    invalid_handler, // next instruction
+    invalid_handler, // single step
+    search_handler, // search memory
+    memory_map_handler, // memory map
+    hash_handler, // hash memory
+    read_stream_handler, // read memory stream
+    write_stream_handler, // write memory stream
+    invalid_handler, // read registers
+    invalid_handler, // write registers
+    invalid_handler, // read vector registers
+    invalid_handler, // write vector registers
+    event_payload_handler, // set event payload
+    event_mask_handler, // set event mask
+    signal_policy_handler, // set signal policy
+    stop_stats_handler, // stop stats
+    stop_mode_handler, // set stop mode
+    invalid_handler, // step range
+    invalid_handler, // step over
+    invalid_handler, // step out
+    invalid_handler, // run instructions
+    invalid_handler // record branches
+};
+
+static
+void request_type_callback(void *ctx, uint16_t value) {
+    struct cbor_read_state *state = (struct cbor_read_state *)ctx;
+    struct req_data_state *data_state = (struct req_data_state *)state->ctx;
+    udi_request_type_e *type = (udi_request_type_e *)data_state->data;
+
+    *type = value;
+
+    state->done = 1;
+}
+
+static
+void request_type_uint8_callback(void *ctx, uint8_t value) {
+    request_type_callback(ctx, value);
+}
+
+static
+int read_request_type(udirt_fd req_fd, udi_request_type_e *type, udi_errmsg *errmsg) {
+
+    struct cbor_callbacks callbacks = invalid_callbacks;
+    callbacks.uint16 = request_type_callback;
+    callbacks.uint8 = request_type_uint8_callback;
+
+    struct req_data_state data_state;
+    memset(&data_state, 0, sizeof(data_state));
+    data_state.data = type;
+    data_state.errmsg = errmsg;
+
+    int result = read_cbor_items(req_fd, &data_state, &callbacks, errmsg);
+    if (result != 0) {
+        return RESULT_ERROR;
+    }
+
+    if (data_state.error) {
+        return RESULT_FAILURE;
+    }
+
+    return RESULT_SUCCESS;
+}
+
+static
+int write_error_response(udirt_fd resp_fd, udi_request_type_e req_type, udi_errmsg *errmsg) {
+    udi_errmsg local_errmsg;
+    local_errmsg.size = ERRMSG_SIZE;
+    local_errmsg.msg[ERRMSG_SIZE-1] = '\0';
+
+    cbor_item_t *map = cbor_new_definite_map(1);
+
+    struct cbor_pair msg_pair;
+    msg_pair.key = cbor_move(cbor_build_string("msg"));
+    msg_pair.value = cbor_move(cbor_build_string(errmsg->msg));
+    bool add_result = cbor_map_add(map, msg_pair);
+    assert(add_result);
+
+    int result = write_response(resp_fd, UDI_RESP_ERROR, req_type, map, &local_errmsg);
+    if (result != RESULT_SUCCESS) {
+        udi_log("failed to write error response: %s",
+                local_errmsg.msg);
+    }
+
+    return result;
+}
+
+int handle_process_request(udirt_fd req_fd,
+                           udirt_fd resp_fd,
+                           udi_request_type_e *type,
+                           udi_errmsg *errmsg) {
+
+    int result;
+    do {
+        result = read_request_type(req_fd, type, errmsg);
+        if (result != RESULT_SUCCESS) {
+            *type = UDI_REQ_INVALID;
+            break;
+        }
+
+        result = request_handlers[*type](req_fd, resp_fd, errmsg);
+    }while (0);
+
+    if (result != RESULT_SUCCESS) {
+        int error_result = write_error_response(resp_fd, *type, errmsg);
+        if (result != RESULT_ERROR && error_result == RESULT_ERROR) {
+            return RESULT_ERROR;
+        }
+
+    }
+
+    return result;
+}
+
+// init request handling
+
+static
+int init_handler(uint64_t tid, udirt_fd resp_fd, udi_errmsg *errmsg) {
+
+    cbor_item_t *map = cbor_new_definite_map(4);
+
+    struct cbor_pair v_pair;
+    v_pair.key = cbor_move(cbor_build_string("v"));
+    v_pair.value = cbor_move(cbor_build_uint32(get_protocol_version()));
+    bool add_result = cbor_map_add(map, v_pair);
+    assert(add_result);
+
+    struct cbor_pair arch_pair;
+    arch_pair.key = cbor_move(cbor_build_string("arch"));
+    arch_pair.value = cbor_move(cbor_build_uint16(get_architecture()));
+    add_result = cbor_map_add(map, arch_pair);
+    assert(add_result);
+
+    struct cbor_pair mt_pair;
+    mt_pair.key = cbor_move(cbor_build_string("mt"));
+    mt_pair.value = cbor_move(cbor_build_bool(get_multithread_capable()));
+    add_result = cbor_map_add(map, mt_pair);
+    assert(add_result);
+
+    struct cbor_pair tid_pair;
+    tid_pair.key = cbor_move(cbor_build_string("tid"));
+    tid_pair.value = cbor_move(cbor_build_uint64(tid));
+    add_result = cbor_map_add(map, tid_pair);
+    assert(add_result);
+
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_INIT, map, errmsg);
+}
+
+int perform_init_handshake(udirt_fd req_fd,
+                           response_fd_callback callback,
+                           void *ctx,
+                           uint64_t tid,
+                           udi_errmsg *errmsg)
+{
+    int result;
+    do {
+        udi_request_type_e type = UDI_REQ_INVALID;
+        result = read_request_type(req_fd, &type, errmsg);
+        if (result != RESULT_SUCCESS) {
+            break;
+        }
+
+        udirt_fd resp_fd;
+        result = callback(ctx, &resp_fd, errmsg);
+        if (result != RESULT_SUCCESS) {
+            break;
+        }
+
+        if (type != UDI_REQ_INIT) {
+            udi_set_errmsg(errmsg,
+                           "received invalid request type(%s) as init request",
+                           request_type_str(type));
+            write_error_response(resp_fd, type, errmsg);
+            result = RESULT_ERROR;
+        } else {
+            result = init_handler(tid, resp_fd, errmsg);
+        }
+    }while(0);
+
+    return result;
+}
+
+static
+void read_reg_callback(void *ctx, uint16_t value) {
+    read_reg_req *req = (read_reg_req *)req_state(ctx)->data;
+    req->reg = value;
+
+    complete_item(ctx);
+}
+
+static
+void read_reg_uint8_callback(void *ctx, uint8_t value) {
+    read_reg_callback(ctx, value);
+}
+
+static
+void read_reg_init_config(struct msg_config *config,
+                          struct msg_item *items)
+{
+    if (config->items == NULL) {
+        items[0].key = "reg";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.uint16 = read_reg_callback;
+        items[0].callbacks.uint8 = read_reg_uint8_callback;
+
+        config->items = items;
+        config->num_items = 1;
+    }
+}
+
+static
+int read_register_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[1];
+    read_reg_init_config(&config, items);
+
+    read_reg_req req;
+    memset(&req, 0, sizeof(req));
+
+    int result = read_request_data(req_fd, &config, &req, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    if (!is_thread_context_valid(thr)) {
+        udi_set_errmsg(errmsg, "%s", "register context is unavailable");
+        udi_log("%s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    cbor_item_t *map = cbor_new_definite_map(1);
+
+    struct cbor_pair value_pair;
+    size_t size = get_register_size(req.reg);
+    if (size > sizeof(uint64_t)) {
+        // registers wider than the value are returned as bytes
+        uint8_t bytes[MAX_REGISTER_SIZE];
+        result = get_register_bytes(req.reg,
+                                    errmsg,
+                                    bytes,
+                                    get_thread_context(thr));
+        if ( result != 0 ) {
+            cbor_decref(&map);
+            return RESULT_FAILURE;
+        }
+
+        value_pair.key = cbor_move(cbor_build_string("bytes"));
+        value_pair.value = cbor_move(cbor_build_bytestring(bytes, size));
+    }else{
+        uint64_t value;
+        result = get_register(req.reg,
+                              errmsg,
+                              &value,
+                              get_thread_context(thr));
+        if ( result != 0 ) {
+            cbor_decref(&map);
+            return RESULT_FAILURE;
+        }
+
+        value_pair.key = cbor_move(cbor_build_string("value"));
+        value_pair.value = cbor_move(cbor_build_uint64(value));
+    }
+
+    bool add_result = cbor_map_add(map, value_pair);
+    assert(add_result);
+
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_READ_REGISTER, map, errmsg);
+}
+
+static
+void write_reg_callback(void *ctx, uint16_t value) {
+    write_reg_req *req = (write_reg_req *)req_state(ctx)->data;
+    req->reg = value;
+
+    complete_item(ctx);
+}
+
+static
+void write_reg_uint8_callback(void *ctx, uint8_t value) {
+    write_reg_callback(ctx, value);
+}
+
+static
+void write_reg_value_callback(void *ctx, uint64_t value) {
+    write_reg_req *req = (write_reg_req *)req_state(ctx)->data;
+    req->value = value;
+    req->has_value = 1;
+
+    complete_item(ctx);
+}
+
+static
+void write_reg_value_uint32_callback(void *ctx, uint32_t value) {
+    write_reg_value_callback(ctx, value);
+}
+
+static
+void write_reg_value_uint16_callback(void *ctx, uint16_t value) {
+    write_reg_value_callback(ctx, value);
+}
+
+static
+void write_reg_value_uint8_callback(void *ctx, uint8_t value) {
+    write_reg_value_callback(ctx, value);
+}
+
+static
+void write_reg_bytes_callback(void *ctx, cbor_data data, uint64_t len) {
+    write_reg_req *req = (write_reg_req *)req_state(ctx)->data;
+
+    // the length is validated after the request is read
+    req->bytes_len = (uint32_t)len;
+    if (len <= MAX_REGISTER_SIZE) {
+        memcpy(req->bytes, data, len);
+    }
+    req->has_bytes = 1;
+
+    complete_item(ctx);
+}
+
+static
+void write_reg_init_config(struct msg_config *config,
+                           struct msg_item *items) {
+
+    if (config->items == NULL) {
+        items[0].key = "reg";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.uint16 = write_reg_callback;
+        items[0].callbacks.uint8 = write_reg_uint8_callback;
+
+        items[1].key = "value";
+        items[1].callbacks = invalid_callbacks;
+        items[1].callbacks.uint64 = write_reg_value_callback;
+        items[1].callbacks.uint32 = write_reg_value_uint32_callback;
+        items[1].callbacks.uint16 = write_reg_value_uint16_callback;
+        items[1].callbacks.uint8 = write_reg_value_uint8_callback;
+
+        items[2].key = "bytes";
+        items[2].callbacks = invalid_callbacks;
+        items[2].callbacks.byte_string = write_reg_bytes_callback;
+
+        config->items = items;
+        config->num_items = 3;
+        config->num_optional = 2;
+    }
+}
+
+static
+int write_register_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[3];
+    write_reg_init_config(&config, items);
+
+    write_reg_req req;
+    memset(&req, 0, sizeof(req));
+
+    int result = read_request_data(req_fd, &config, &req, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    if (req.has_value == req.has_bytes) {
+        udi_set_errmsg(errmsg, "%s", "exactly one of value or bytes must be specified");
+        return RESULT_FAILURE;
+    }
+
+    if (!is_thread_context_valid(thr)) {
+        udi_set_errmsg(errmsg, "%s", "register context is unavailable");
+        udi_log("%s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    if (req.has_bytes) {
+        size_t size = get_register_size(req.reg);
+        if (size == 0 || req.bytes_len != size) {
+            udi_set_errmsg(errmsg,
+                           "expected %l bytes for register %s",
+                           size,
+                           register_str(req.reg));
+            return RESULT_FAILURE;
+        }
+
+        result = set_register_bytes(req.reg,
+                                    errmsg,
+                                    req.bytes,
+                                    get_thread_context(thr));
+    }else{
+        result = set_register(req.reg,
+                              errmsg,
+                              req.value,
+                              get_thread_context(thr));
+    }
+    if (result != 0) {
+        return RESULT_FAILURE;
+    }
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_WRITE_REGISTER, errmsg);
+}
+
+static
+int read_registers_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+    USE(req_fd);
+
+    // registers that cannot be retrieved are reported as null, so their errors are discarded
+    static udi_errmsg reg_errmsg;
+
+    if (!is_thread_context_valid(thr)) {
+        udi_set_errmsg(errmsg, "%s", "register context is unavailable");
+        udi_log("%s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    udi_register_e first, last;
+    get_register_range(get_architecture(), &first, &last);
+
+    cbor_item_t *values = cbor_new_definite_array(last - first);
+    for (udi_register_e reg = first; reg < last; ++reg) {
+        uint64_t value;
+        cbor_item_t *item;
+        if (get_register(reg, &reg_errmsg, &value, get_thread_context(thr)) == 0) {
+            item = cbor_build_uint64(value);
+        }else{
+            item = cbor_new_null();
+        }
+
+        bool add_result = cbor_array_push(values, cbor_move(item));
+        assert(add_result);
+    }
+
+    cbor_item_t *map = cbor_new_definite_map(1);
+
+    struct cbor_pair values_pair;
+    values_pair.key = cbor_move(cbor_build_string("values"));
+    values_pair.value = cbor_move(values);
+    bool add_result = cbor_map_add(map, values_pair);
+    assert(add_result);
+
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_READ_REGISTERS, map, errmsg);
+}
+
+static
+void write_regs_start_callback(void *ctx, uint64_t len) {
+    write_regs_req *req = (write_regs_req *)req_state(ctx)->data;
+
+    udi_register_e first, last;
+    get_register_range(get_architecture(), &first, &last);
+
+    // the elements of an array with the wrong length are read and discarded, the request is
+    // rejected once it is read
+    req->num_values = len;
+    if (len != (uint64_t)(last - first)) {
+        req->bad_length = 1;
+    }else if (len > 0) {
+        req->values = (uint64_t *)udi_calloc(len, sizeof(uint64_t));
+        req->present = (uint8_t *)udi_calloc(len, sizeof(uint8_t));
+    }
+
+    if (len == 0) {
+        complete_item(ctx);
+    }
+}
+
+static
+void write_regs_next(void *ctx, write_regs_req *req) {
+    req->values_read++;
+    if (req->values_read >= req->num_values) {
+        complete_item(ctx);
+    }
+}
+
+static
+void write_regs_value_callback(void *ctx, uint64_t value) {
+    write_regs_req *req = (write_regs_req *)req_state(ctx)->data;
+
+    if (req->values != NULL && req->present != NULL) {
+        req->values[req->values_read] = value;
+        req->present[req->values_read] = 1;
+    }
+
+    write_regs_next(ctx, req);
+}
+
+static
+void write_regs_value_uint32_callback(void *ctx, uint32_t value) {
+    write_regs_value_callback(ctx, value);
+}
+
+static
+void write_regs_value_uint16_callback(void *ctx, uint16_t value) {
+    write_regs_value_callback(ctx, value);
+}
+
+static
+void write_regs_value_uint8_callback(void *ctx, uint8_t value) {
+    write_regs_value_callback(ctx, value);
+}
+
+static
+void write_regs_null_callback(void *ctx) {
+    write_regs_req *req = (write_regs_req *)req_state(ctx)->data;
+
+    write_regs_next(ctx, req);
+}
+
+static
+void write_regs_init_config(struct msg_config *config,
+                            struct msg_item *items)
+{
+    if (config->items == NULL) {
+        items[0].key = "values";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.array_start = write_regs_start_callback;
+        items[0].callbacks.uint64 = write_regs_value_callback;
+        items[0].callbacks.uint32 = write_regs_value_uint32_callback;
+        items[0].callbacks.uint16 = write_regs_value_uint16_callback;
+        items[0].callbacks.uint8 = write_regs_value_uint8_callback;
+        items[0].callbacks.null = write_regs_null_callback;
+
+        config->items = items;
+        config->num_items = 1;
+    }
+}
+
+static
+int write_registers_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[1];
+    write_regs_init_config(&config, items);
+
+    write_regs_req req;
+    memset(&req, 0, sizeof(req));
+
+    int result;
+    do {
+        result = read_request_data(req_fd, &config, &req, errmsg);
+        if (result != RESULT_SUCCESS) {
+            break;
+        }
+
+        udi_register_e first, last;
+        get_register_range(get_architecture(), &first, &last);
+
+        if (req.bad_length) {
+            udi_set_errmsg(errmsg,
+                           "expected %d register values for architecture %s",
+                           last - first,
+                           arch_str(get_architecture()));
+            result = RESULT_FAILURE;
+            break;
+        }
+
+        if (req.values == NULL || req.present == NULL) {
+            udi_set_errmsg(errmsg, "failed to allocate memory");
+            result = RESULT_ERROR;
+            break;
+        }
+
+        if (!is_thread_context_valid(thr)) {
+            udi_set_errmsg(errmsg, "%s", "register context is unavailable");
+            udi_log("%s", errmsg->msg);
+            result = RESULT_FAILURE;
+            break;
+        }
+
+        // A register that can be read can be written, so checking every register first leaves
+        // the context unmodified when the request fails
+        void *context = get_thread_context(thr);
+        for (uint64_t i = 0; i < req.num_values; ++i) {
+            uint64_t current;
+            if (req.present[i] && get_register(first + i, errmsg, &current, context) != 0) {
+                result = RESULT_FAILURE;
+                break;
+            }
+        }
+        if (result != RESULT_SUCCESS) {
+            break;
+        }
+
+        for (uint64_t i = 0; i < req.num_values; ++i) {
+            if (!req.present[i]) {
+                continue;
+            }
+
+            if (set_register(first + i, errmsg, req.values[i], context) != 0) {
+                result = RESULT_FAILURE;
+                break;
+            }
+        }
+        if (result != RESULT_SUCCESS) {
+            break;
+        }
+
+        result = write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_WRITE_REGISTERS, errmsg);
+    }while (0);
+
+    udi_free(req.values);
+    udi_free(req.present);
+
+    return result;
+}
+
+static
+int read_vector_registers_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+    USE(req_fd);
+
+    if (!is_thread_context_valid(thr)) {
+        udi_set_errmsg(errmsg, "%s", "register context is unavailable");
+        udi_log("%s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    void *context = get_thread_context(thr);
+
+    size_t width = get_vector_register_width(errmsg, context);
+    if (width == 0) {
+        return RESULT_FAILURE;
+    }
+
+    udi_register_e first, last;
+    if (get_vector_register_range(width, &first, &last) != 0) {
+        udi_set_errmsg(errmsg, "%s", "vector registers are not available");
+        return RESULT_FAILURE;
+    }
+
+    size_t len = (last - first) * width;
+    uint8_t *data = (uint8_t *)udi_malloc(len);
+    if (data == NULL) {
+        udi_set_errmsg(errmsg, "failed to allocate memory");
+        return RESULT_ERROR;
+    }
+
+    for (udi_register_e reg = first; reg < last; ++reg) {
+        if (get_register_bytes(reg, errmsg, data + (reg - first) * width, context) != 0) {
+            udi_free(data);
+            return RESULT_FAILURE;
+        }
+    }
+
+    cbor_item_t *map = cbor_new_definite_map(2);
+
+    struct cbor_pair width_pair;
+    width_pair.key = cbor_move(cbor_build_string("width"));
+    width_pair.value = cbor_move(cbor_build_uint8((uint8_t)width));
+    bool add_result = cbor_map_add(map, width_pair);
+    assert(add_result);
+
+    struct cbor_pair data_pair;
+    data_pair.key = cbor_move(cbor_build_string("data"));
+    data_pair.value = cbor_move(cbor_build_bytestring(data, len));
+    add_result = cbor_map_add(map, data_pair);
+    assert(add_result);
+
+    udi_free(data);
+
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_READ_VECTOR_REGISTERS, map, errmsg);
+}
+
+static
+void write_vector_regs_width_callback(void *ctx, uint32_t value) {
+    write_vector_regs_req *req = (write_vector_regs_req *)req_state(ctx)->data;
+    req->width = value;
+
+    complete_item(ctx);
+}
+
+static
+void write_vector_regs_width_uint16_callback(void *ctx, uint16_t value) {
+    write_vector_regs_width_callback(ctx, value);
+}
+
+static
+void write_vector_regs_width_uint8_callback(void *ctx, uint8_t value) {
+    write_vector_regs_width_callback(ctx, value);
+}
+
+static
+void write_vector_regs_data_callback(void *ctx, cbor_data data, uint64_t len) {
+    write_vector_regs_req *req = (write_vector_regs_req *)req_state(ctx)->data;
+
+    req->data = (uint8_t *)udi_malloc(len);
+    if (req->data != NULL) {
+        memcpy(req->data, data, len);
+        req->len = len;
+    }
+
+    complete_item(ctx);
+}
+
+static
+void write_vector_regs_init_config(struct msg_config *config,
+                                   struct msg_item *items)
 {
+    if (config->items == NULL) {
+        items[0].key = "width";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.uint32 = write_vector_regs_width_callback;
+        items[0].callbacks.uint16 = write_vector_regs_width_uint16_callback;
+        items[0].callbacks.uint8 = write_vector_regs_width_uint8_callback;
+
+        items[1].key = "data";
+        items[1].callbacks = invalid_callbacks;
+        items[1].callbacks.byte_string = write_vector_regs_data_callback;
+
+        config->items = items;
+        config->num_items = 2;
+    }
+}
+
+static
+int write_vector_registers_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[2];
+    write_vector_regs_init_config(&config, items);
+
+    write_vector_regs_req req;
+    memset(&req, 0, sizeof(req));
+
     int result;
     do {
-        udi_request_type_e type = UDI_REQ_INVALID;
-        result = read_request_type(req_fd, &type, errmsg);
+        result = read_request_data(req_fd, &config, &req, errmsg);
         if (result != RESULT_SUCCESS) {
             break;
         }
 
-        udirt_fd resp_fd;
-        result = callback(ctx, &resp_fd, errmsg);
+        if (req.data == NULL) {
+            udi_set_errmsg(errmsg, "failed to allocate memory");
+            result = RESULT_ERROR;
+            break;
+        }
+
+        if (!is_thread_context_valid(thr)) {
+            udi_set_errmsg(errmsg, "%s", "register context is unavailable");
+            udi_log("%s", errmsg->msg);
+            result = RESULT_FAILURE;
+            break;
+        }
+
+        void *context = get_thread_context(thr);
+
+        size_t width = get_vector_register_width(errmsg, context);
+        if (width == 0) {
+            result = RESULT_FAILURE;
+            break;
+        }
+
+        udi_register_e first, last;
+        if (req.width > width || get_vector_register_range(req.width, &first, &last) != 0)
+        {
+            udi_set_errmsg(errmsg, "vector registers with width %d are not available", req.width);
+            result = RESULT_FAILURE;
+            break;
+        }
+
+        if (req.len != (last - first) * req.width) {
+            udi_set_errmsg(errmsg,
+                           "expected %d bytes of vector register data, received %d",
+                           (last - first) * req.width,
+                           req.len);
+            result = RESULT_FAILURE;
+            break;
+        }
+
+        for (udi_register_e reg = first; reg < last; ++reg) {
+            if (set_register_bytes(reg, errmsg, req.data + (reg - first) * req.width, context) != 0) {
+                result = RESULT_FAILURE;
+                break;
+            }
+        }
         if (result != RESULT_SUCCESS) {
             break;
         }
 
-        if (type != UDI_REQ_INIT) {
-            udi_set_errmsg(errmsg,
-                           "received invalid request type(%s) as init request",
-                           request_type_str(type));
-            write_error_response(resp_fd, type, errmsg);
-            result = RESULT_ERROR;
-        } else {
-            result = init_handler(tid, resp_fd, errmsg);
+        result = write_response_no_data(resp_fd,
+                                        UDI_RESP_VALID,
+                                        UDI_REQ_WRITE_VECTOR_REGISTERS,
+                                        errmsg);
+    }while (0);
+
+    udi_free(req.data);
+
+    return result;
+}
+
+static
+int thr_state_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+    USE(req_fd);
+
+    cbor_item_t *map = cbor_new_definite_map(2);
+
+    struct cbor_pair tid_pair;
+    tid_pair.key = cbor_move(cbor_build_string("tid"));
+    tid_pair.value = cbor_move(cbor_build_uint64(get_thread_id(thr)));
+    bool add_result = cbor_map_add(map, tid_pair);
+    assert(add_result);
+
+    struct cbor_pair state_pair;
+    state_pair.key = cbor_move(cbor_build_string("state"));
+    state_pair.value = cbor_move(cbor_build_uint16(get_thread_state(thr)));
+    add_result = cbor_map_add(map, state_pair);
+    assert(add_result);
+
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_STATE, map, errmsg);
+}
+
+static
+int next_instr_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+
+    USE(req_fd);
+
+    if (!is_thread_context_valid(thr)) {
+        udi_set_errmsg(errmsg, "register context unavailable");
+        udi_log("%s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    const void *context = get_thread_context(thr);
+
+    uint64_t pc = get_pc(context);
+    uint64_t address = get_ctf_successor(pc, errmsg, context);
+    if (address == 0) {
+        udi_set_errmsg(errmsg,
+                       "failed to determine successor instruction from %a", pc);
+        udi_log("%s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    cbor_item_t *map = cbor_new_definite_map(1);
+
+    struct cbor_pair addr_pair;
+    addr_pair.key = cbor_move(cbor_build_string("addr"));
+    addr_pair.value = cbor_move(cbor_build_uint64(address));
+    bool add_result = cbor_map_add(map, addr_pair);
+    assert(add_result);
+
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_NEXT_INSTRUCTION, map, errmsg);
+}
+
+static
+int thr_continue_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[1];
+    continue_init_config(&config, items);
+
+    continue_req data;
+    memset(&data, 0, sizeof(data));
+
+    int result = read_request_data(req_fd, &config, &data, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    if (!is_non_stop_mode()) {
+        udi_set_errmsg(errmsg, "threads can only be continued individually in non-stop mode");
+        return RESULT_FAILURE;
+    }
+
+    if (!is_thread_stopped(thr)) {
+        udi_set_errmsg(errmsg, "thread %a is not stopped", get_thread_id(thr));
+        return RESULT_FAILURE;
+    }
+
+    if (get_thread_state(thr) == UDI_TS_SUSPENDED) {
+        udi_set_errmsg(errmsg, "cannot continue thread %a, it is suspended", get_thread_id(thr));
+        return RESULT_FAILURE;
+    }
+
+    result = write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_CONTINUE, errmsg);
+
+    if ( result == RESULT_SUCCESS ) {
+        // the mappings can change once the thread is running
+        invalidate_memory_map();
+
+        continue_thread(thr, data.sig);
+    }
+
+    return result;
+}
+
+static
+int thr_suspend_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+
+    USE(req_fd);
+
+    // a running thread is only stopped by an event in non-stop mode
+    if (is_non_stop_mode() && !is_thread_stopped(thr)) {
+        udi_set_errmsg(errmsg, "cannot suspend running thread %a", get_thread_id(thr));
+        return RESULT_FAILURE;
+    }
+
+    udi_log("suspended thread %a", get_thread_id(thr));
+    set_thread_state(thr, UDI_TS_SUSPENDED);
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_THREAD_SUSPEND, errmsg);
+}
+
+static
+int thr_resume_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+
+    USE(req_fd);
+
+    udi_log("resume thread %a", get_thread_id(thr));
+    set_thread_state(thr, UDI_TS_RUNNING);
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_THREAD_RESUME, errmsg);
+}
+
+// Stepping through ranges
+
+void set_step_range(thread *thr, uint64_t start, uint64_t end, int over_calls, int out) {
+    step_state *step = get_step_state(thr);
+    if (step->range_end == 0) {
+        step->prev_single_step = is_single_step(thr);
+    }
+
+    step->range_start = start;
+    step->range_end = end;
+    step->over_calls = over_calls;
+    step->out = out;
+    step->return_sp = 0;
+    step->run_count = 0;
+    step->executed = 0;
+    set_single_step(thr, 1);
+}
+
+int is_in_step_range(thread *thr, uint64_t pc) {
+    step_state *step = get_step_state(thr);
+
+    return pc >= step->range_start && pc < step->range_end;
+}
+
+int is_step_return_frame(thread *thr, const void *context) {
+    step_state *step = get_step_state(thr);
+    if (step->return_sp == 0) {
+        return 1;
+    }
+
+    udi_errmsg errmsg;
+    errmsg.size = ERRMSG_SIZE;
+    errmsg.msg[ERRMSG_SIZE-1] = '\0';
+
+    // the stack grows down, a deeper frame has a lower stack pointer
+    uint64_t sp = 0;
+    if (get_register(get_stack_pointer_register(get_architecture()), &errmsg, &sp, context) != 0) {
+        return 1;
+    }
+
+    return sp >= step->return_sp;
+}
+
+void end_step_range(thread *thr) {
+    step_state *step = get_step_state(thr);
+    if (step->range_end == 0) return;
+
+    // the thread stopped inside a call that was stepped over
+    breakpoint *return_bp = get_single_step_breakpoint(thr);
+    if (step->return_sp != 0 && return_bp != NULL) {
+        udi_errmsg errmsg;
+        errmsg.size = ERRMSG_SIZE;
+        errmsg.msg[ERRMSG_SIZE-1] = '\0';
+
+        if (delete_breakpoint(return_bp, &errmsg) != 0) {
+            udi_log("failed to delete return breakpoint: %s", errmsg.msg);
+        }
+        set_single_step_breakpoint(thr, NULL);
+    }
+
+    set_single_step(thr, step->prev_single_step);
+
+    // a trace trap still arrives if the trap flag is already set for the thread
+    step_trace_e trace = step->trace;
+    memset(step, 0, sizeof(step_state));
+    step->trace = trace;
+}
+
+int install_step_breakpoint(thread *thr, const void *context, udi_errmsg *errmsg) {
+    step_state *step = get_step_state(thr);
+    uint64_t pc = get_pc(context);
+
+    ctf_kind_e kind;
+    unsigned int len;
+    if (get_ctf_kind(pc, &kind, &len, errmsg) != 0) {
+        return -1;
+    }
+
+    // a step that does not complete at the next instruction took a branch
+    get_branch_trace(thr)->fallthrough = pc + len;
+
+    uint64_t successor = 0;
+    uint64_t return_sp = 0;
+    if (step->range_end != 0 && step->over_calls) {
+        if (kind == CTF_CALL) {
+            // run the called function and stop once it returns to this frame
+            successor = pc + len;
+            if (get_register(get_stack_pointer_register(get_architecture()),
+                             errmsg,
+                             &return_sp,
+                             context) != 0)
+            {
+                return -1;
+            }
+        }else if (kind == CTF_RETURN && step->out) {
+            // the range ends after the return from the function being stepped out of
+            step->range_start = pc;
+            step->range_end = pc + len;
+        }
+    }
+
+    if (successor == 0) {
+        successor = get_ctf_successor(pc, errmsg, context);
+        if (successor == 0) {
+            udi_log("failed to determine successor for instruction at %a", pc);
+            return -1;
+        }
+    }
+
+    // If it is a continue breakpoint, it will be used as a single step breakpoint. If it is an
+    // event breakpoint or user breakpoint, no single step event will be generated
+    if (find_breakpoint(successor) != NULL) {
+        return 0;
+    }
+
+    // Unless the thread steps off a breakpoint or over a call, it traps after the instruction
+    // with the trap flag, which leaves the text untouched
+    if (return_sp == 0 && kind != CTF_NO_TRACE && find_breakpoint(pc) == NULL) {
+        step->trace = STEP_TRACE_PENDING;
+        return 0;
+    }
+
+    breakpoint *step_bp = create_breakpoint(successor);
+    if (step_bp == NULL) {
+        udi_set_errmsg(errmsg, "failed to create single step breakpoint at %a", successor);
+        return -1;
+    }
+
+    step_bp->thread = thr;
+    if (install_breakpoint(step_bp, errmsg) != 0) {
+        udi_log("failed to install single step breakpoint at %a", successor);
+        delete_breakpoint(step_bp, errmsg);
+        return -1;
+    }
+    set_single_step_breakpoint(thr, step_bp);
+
+    if (return_sp != 0) {
+        // the thread runs freely until the call returns
+        step->return_sp = return_sp;
+        set_single_step(thr, 0);
+    }
+
+    return 0;
+}
+
+/**
+ * Starts stepping the thread through a range once it is continued
+ */
+static
+int begin_step_range(thread *thr,
+                     uint64_t start,
+                     uint64_t end,
+                     int over_calls,
+                     int out,
+                     udi_errmsg *errmsg)
+{
+    if (!is_thread_context_valid(thr)) {
+        udi_set_errmsg(errmsg, "register context unavailable");
+        udi_log("%s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    end_step_range(thr);
+
+    // The breakpoint installed for the next single step depends on how calls are stepped
+    breakpoint *single_step_bp = get_single_step_breakpoint(thr);
+    if (single_step_bp != NULL) {
+        if (delete_breakpoint(single_step_bp, errmsg) != 0) {
+            udi_log("failed to delete existing single step breakpoint: %s", errmsg->msg);
+            return RESULT_FAILURE;
         }
-    }while(0);
+        set_single_step_breakpoint(thr, NULL);
+    }
 
-    return result;
-}
+    set_step_range(thr, start, end, over_calls, out);
 
-static
-void read_reg_callback(void *ctx, uint16_t value) {
-    read_reg_req *req = (read_reg_req *)req_state(ctx)->data;
-    req->reg = value;
+    // The first step needs its own trap unless the thread steps over the breakpoint it stopped at
+    // with a continue breakpoint
+    if (install_step_breakpoint(thr, get_thread_context(thr), errmsg) != 0) {
+        end_step_range(thr);
+        return RESULT_FAILURE;
+    }
 
-    complete_item(ctx);
+    return RESULT_SUCCESS;
 }
 
 static
-void read_reg_uint8_callback(void *ctx, uint8_t value) {
-    read_reg_callback(ctx, value);
+void single_step_callback(void *ctx, bool value) {
+    single_step_req *req = (single_step_req *)req_state(ctx)->data;
+    req->setting = value;
+
+    complete_item(ctx);
 }
 
 static
-void read_reg_init_config(struct msg_config *config,
-                          struct msg_item *items)
+void single_step_init_config(struct msg_config *config,
+                             struct msg_item *items)
 {
     if (config->items == NULL) {
-        items[0].key = "reg";
+        items[0].key = "value";
         items[0].callbacks = invalid_callbacks;
-        items[0].callbacks.uint16 = read_reg_callback;
-        items[0].callbacks.uint8 = read_reg_uint8_callback;
+        items[0].callbacks.boolean = single_step_callback;
 
         config->items = items;
         config->num_items = 1;
@@ -1217,13 +3615,13 @@ void read_reg_init_config(struct msg_config *config,
 }
 
 static
-int read_register_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+int single_step_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
 
     static struct msg_config config;
     static struct msg_item items[1];
-    read_reg_init_config(&config, items);
+    single_step_init_config(&config, items);
 
-    read_reg_req req;
+    single_step_req req;
     memset(&req, 0, sizeof(req));
 
     int result = read_request_data(req_fd, &config, &req, errmsg);
@@ -1231,98 +3629,121 @@ int read_register_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_er
         return result;
     }
 
-    if (!is_thread_context_valid(thr)) {
-        udi_set_errmsg(errmsg, "%s", "register context is unavailable");
-        udi_log("%s", errmsg->msg);
-        return RESULT_FAILURE;
+    // an explicit setting replaces stepping through a range
+    end_step_range(thr);
+
+    // a thread that records its branches keeps stepping, only its events follow the setting
+    bool prev_setting;
+    if (is_recording_branches(thr)) {
+        prev_setting = get_branch_trace(thr)->user_single_step;
+        get_branch_trace(thr)->user_single_step = req.setting;
+    }else{
+        prev_setting = is_single_step(thr);
+        set_single_step(thr, req.setting);
     }
 
-    uint64_t value;
-    result = get_register(req.reg,
-                          errmsg,
-                          &value,
-                          get_thread_context(thr));
-    if ( result != 0 ) {
-        return RESULT_FAILURE;
+    // Need to remove an existing single step breakpoint if it already exists
+    breakpoint *single_step_bp = get_single_step_breakpoint(thr);
+    if ( !is_single_step(thr) && single_step_bp != NULL) {
+        if ( delete_breakpoint(single_step_bp, errmsg) ) {
+            udi_log("failed to delete existing single step breakpoint: %s",
+                    errmsg->msg);
+            return RESULT_FAILURE;
+        }
+        set_single_step_breakpoint(thr, NULL);
     }
 
     cbor_item_t *map = cbor_new_definite_map(1);
 
     struct cbor_pair value_pair;
     value_pair.key = cbor_move(cbor_build_string("value"));
-    value_pair.value = cbor_move(cbor_build_uint64(value));
+    value_pair.value = cbor_move(cbor_build_bool(prev_setting));
     bool add_result = cbor_map_add(map, value_pair);
     assert(add_result);
 
-    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_READ_REGISTER, map, errmsg);
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_SINGLE_STEP, map, errmsg);
 }
 
+// step range request handling
+
 static
-void write_reg_callback(void *ctx, uint16_t value) {
-    write_reg_req *req = (write_reg_req *)req_state(ctx)->data;
-    req->reg = value;
+void step_range_start_callback(void *ctx, uint64_t value) {
+    step_range_req *req = (step_range_req *)req_state(ctx)->data;
+    req->start = value;
 
     complete_item(ctx);
 }
 
 static
-void write_reg_uint8_callback(void *ctx, uint8_t value) {
-    write_reg_callback(ctx, value);
+void step_range_start_uint32_callback(void *ctx, uint32_t value) {
+    step_range_start_callback(ctx, value);
 }
 
 static
-void write_reg_value_callback(void *ctx, uint64_t value) {
-    write_reg_req *req = (write_reg_req *)req_state(ctx)->data;
-    req->value = value;
+void step_range_start_uint16_callback(void *ctx, uint16_t value) {
+    step_range_start_callback(ctx, value);
+}
 
-    complete_item(ctx);
+static
+void step_range_start_uint8_callback(void *ctx, uint8_t value) {
+    step_range_start_callback(ctx, value);
 }
 
 static
-void write_reg_value_uint32_callback(void *ctx, uint32_t value) {
-    write_reg_value_callback(ctx, value);
+void step_range_end_callback(void *ctx, uint64_t value) {
+    step_range_req *req = (step_range_req *)req_state(ctx)->data;
+    req->end = value;
+
+    complete_item(ctx);
 }
 
 static
-void write_reg_value_uint16_callback(void *ctx, uint16_t value) {
-    write_reg_value_callback(ctx, value);
+void step_range_end_uint32_callback(void *ctx, uint32_t value) {
+    step_range_end_callback(ctx, value);
 }
 
 static
-void write_reg_value_uint8_callback(void *ctx, uint8_t value) {
-    write_reg_value_callback(ctx, value);
+void step_range_end_uint16_callback(void *ctx, uint16_t value) {
+    step_range_end_callback(ctx, value);
 }
 
 static
-void write_reg_init_config(struct msg_config *config,
-                           struct msg_item *items) {
+void step_range_end_uint8_callback(void *ctx, uint8_t value) {
+    step_range_end_callback(ctx, value);
+}
 
+static
+void step_range_init_config(struct msg_config *config,
+                            struct msg_item *items)
+{
     if (config->items == NULL) {
-        items[0].key = "reg";
+        items[0].key = "start";
         items[0].callbacks = invalid_callbacks;
-        items[0].callbacks.uint16 = write_reg_callback;
-        items[0].callbacks.uint8 = write_reg_uint8_callback;
+        items[0].callbacks.uint64 = step_range_start_callback;
+        items[0].callbacks.uint32 = step_range_start_uint32_callback;
+        items[0].callbacks.uint16 = step_range_start_uint16_callback;
+        items[0].callbacks.uint8 = step_range_start_uint8_callback;
 
-        items[1].key = "value";
+        items[1].key = "end";
         items[1].callbacks = invalid_callbacks;
-        items[1].callbacks.uint64 = write_reg_value_callback;
-        items[1].callbacks.uint32 = write_reg_value_uint32_callback;
-        items[1].callbacks.uint16 = write_reg_value_uint16_callback;
-        items[1].callbacks.uint8 = write_reg_value_uint8_callback;
+        items[1].callbacks.uint64 = step_range_end_callback;
+        items[1].callbacks.uint32 = step_range_end_uint32_callback;
+        items[1].callbacks.uint16 = step_range_end_uint16_callback;
+        items[1].callbacks.uint8 = step_range_end_uint8_callback;
 
-        config->items = items;
         config->num_items = 2;
+        config->items = items;
     }
 }
 
 static
-int write_register_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+int step_range_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
 
     static struct msg_config config;
     static struct msg_item items[2];
-    write_reg_init_config(&config, items);
+    step_range_init_config(&config, items);
 
-    write_reg_req req;
+    step_range_req req;
     memset(&req, 0, sizeof(req));
 
     int result = read_request_data(req_fd, &config, &req, errmsg);
@@ -1330,129 +3751,278 @@ int write_register_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_e
         return result;
     }
 
-    if (!is_thread_context_valid(thr)) {
-        udi_set_errmsg(errmsg, "%s", "register context is unavailable");
-        udi_log("%s", errmsg->msg);
+    if (req.start >= req.end) {
+        udi_set_errmsg(errmsg, "invalid step range [%a, %a)", req.start, req.end);
         return RESULT_FAILURE;
     }
 
-    result = set_register(req.reg,
-                          errmsg,
-                          req.value,
-                          get_thread_context(thr));
-    if (result != 0) {
+    result = begin_step_range(thr, req.start, req.end, 0, 0, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_STEP_RANGE, errmsg);
+}
+
+static
+int step_over_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+
+    static struct msg_config config;
+    static struct msg_item items[2];
+    step_range_init_config(&config, items);
+
+    step_range_req req;
+    memset(&req, 0, sizeof(req));
+
+    int result = read_request_data(req_fd, &config, &req, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    if (req.start >= req.end) {
+        udi_set_errmsg(errmsg, "invalid step range [%a, %a)", req.start, req.end);
         return RESULT_FAILURE;
     }
 
-    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_WRITE_REGISTER, errmsg);
+    result = begin_step_range(thr, req.start, req.end, 1, 0, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_STEP_OVER, errmsg);
 }
 
 static
-int thr_state_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+int step_out_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+
     USE(req_fd);
 
-    cbor_item_t *map = cbor_new_definite_map(2);
+    // the range covers everything until the return of the current function is stepped
+    int result = begin_step_range(thr, 0, UINT64_MAX, 1, 1, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
 
-    struct cbor_pair tid_pair;
-    tid_pair.key = cbor_move(cbor_build_string("tid"));
-    tid_pair.value = cbor_move(cbor_build_uint64(get_thread_id(thr)));
-    bool add_result = cbor_map_add(map, tid_pair);
-    assert(add_result);
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_STEP_OUT, errmsg);
+}
 
-    struct cbor_pair state_pair;
-    state_pair.key = cbor_move(cbor_build_string("state"));
-    state_pair.value = cbor_move(cbor_build_uint16(get_thread_state(thr)));
-    add_result = cbor_map_add(map, state_pair);
-    assert(add_result);
+// run instructions request handling
 
-    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_STATE, map, errmsg);
+static
+void run_instructions_count_callback(void *ctx, uint64_t value) {
+    run_instructions_req *req = (run_instructions_req *)req_state(ctx)->data;
+    req->count = value;
+
+    complete_item(ctx);
 }
 
 static
-int next_instr_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+void run_instructions_count_uint32_callback(void *ctx, uint32_t value) {
+    run_instructions_count_callback(ctx, value);
+}
 
-    USE(req_fd);
+static
+void run_instructions_count_uint16_callback(void *ctx, uint16_t value) {
+    run_instructions_count_callback(ctx, value);
+}
 
-    if (!is_thread_context_valid(thr)) {
-        udi_set_errmsg(errmsg, "register context unavailable");
-        udi_log("%s", errmsg->msg);
-        return RESULT_FAILURE;
+static
+void run_instructions_count_uint8_callback(void *ctx, uint8_t value) {
+    run_instructions_count_callback(ctx, value);
+}
+
+static
+void run_instructions_init_config(struct msg_config *config,
+                                  struct msg_item *items)
+{
+    if (config->items == NULL) {
+        items[0].key = "count";
+        items[0].callbacks = invalid_callbacks;
+        items[0].callbacks.uint64 = run_instructions_count_callback;
+        items[0].callbacks.uint32 = run_instructions_count_uint32_callback;
+        items[0].callbacks.uint16 = run_instructions_count_uint16_callback;
+        items[0].callbacks.uint8 = run_instructions_count_uint8_callback;
+
+        config->num_items = 1;
+        config->items = items;
     }
+}
 
-    const void *context = get_thread_context(thr);
+static
+int run_instructions_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
 
-    uint64_t pc = get_pc(context);
-    uint64_t address = get_ctf_successor(pc, errmsg, context);
-    if (address == 0) {
-        udi_set_errmsg(errmsg,
-                       "failed to determine successor instruction from %a", pc);
-        udi_log("%s", errmsg->msg);
+    static struct msg_config config;
+    static struct msg_item items[1];
+    run_instructions_init_config(&config, items);
+
+    run_instructions_req req;
+    memset(&req, 0, sizeof(req));
+
+    int result = read_request_data(req_fd, &config, &req, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+
+    if (req.count == 0) {
+        udi_set_errmsg(errmsg, "instruction count must be non-zero");
         return RESULT_FAILURE;
     }
 
-    cbor_item_t *map = cbor_new_definite_map(1);
+    // every instruction is in the range, the run ends once the count is reached
+    result = begin_step_range(thr, 0, UINT64_MAX, 0, 0, errmsg);
+    if (result != RESULT_SUCCESS) {
+        return result;
+    }
+    get_step_state(thr)->run_count = req.count;
 
-    struct cbor_pair addr_pair;
-    addr_pair.key = cbor_move(cbor_build_string("addr"));
-    addr_pair.value = cbor_move(cbor_build_uint64(address));
-    bool add_result = cbor_map_add(map, addr_pair);
-    assert(add_result);
+    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_RUN_INSTRUCTIONS, errmsg);
+}
 
-    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_NEXT_INSTRUCTION, map, errmsg);
+// Branch recording
+
+// the longest LEB128 encoding of a 64-bit value
+#define MAX_BRANCH_RECORD_SIZE 10
+
+int is_recording_branches(thread *thr) {
+    return get_branch_trace(thr)->header != NULL;
 }
 
+/**
+ * Appends a branch target to the ring buffer of the thread. The target is encoded as one more than
+ * the zigzag encoded difference from the previous target, in LEB128. The target is dropped when
+ * the ring buffer is full.
+ */
 static
-int thr_suspend_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+void record_branch(thread *thr, uint64_t target) {
+    branch_trace *trace = get_branch_trace(thr);
+    branch_trace_header *header = trace->header;
 
-    USE(req_fd);
+    int64_t delta = (int64_t)(target - trace->last_target);
+    uint64_t value = (((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63)) + 1;
 
-    udi_log("suspended thread %a", get_thread_id(thr));
-    set_thread_state(thr, UDI_TS_SUSPENDED);
+    uint8_t record[MAX_BRANCH_RECORD_SIZE];
+    size_t len = 0;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value != 0) {
+            byte |= 0x80;
+        }
+        record[len++] = byte;
+    }while (value != 0);
+
+    // the debugger advances the tail concurrently
+    __sync_synchronize();
+    uint64_t tail = *(volatile uint64_t *)&header->tail;
+    uint64_t head = header->head;
+    if (header->size - (head - tail) < len) {
+        header->dropped++;
+        return;
+    }
 
-    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_THREAD_SUSPEND, errmsg);
+    for (size_t i = 0; i < len; ++i) {
+        trace->data[(head + i) % header->size] = record[i];
+    }
+
+    // publish the record once it is complete
+    __sync_synchronize();
+    header->head = head + len;
+    trace->last_target = target;
 }
 
+/**
+ * Records the step of the thread that completed at the specified pc, if it took a branch
+ */
 static
-int thr_resume_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+void record_step(thread *thr, uint64_t pc) {
+    if (!is_recording_branches(thr)) {
+        return;
+    }
 
-    USE(req_fd);
+    branch_trace *trace = get_branch_trace(thr);
+    if (pc != trace->fallthrough) {
+        record_branch(thr, pc);
+    }
+    trace->fallthrough = 0;
+}
 
-    udi_log("resume thread %a", get_thread_id(thr));
-    set_thread_state(thr, UDI_TS_RUNNING);
+/**
+ * Stops recording the branches of the thread and restores the single step setting of the debugger
+ */
+static
+int stop_branch_recording(thread *thr, udi_errmsg *errmsg) {
+    if (!is_recording_branches(thr)) {
+        return RESULT_SUCCESS;
+    }
 
-    return write_response_no_data(resp_fd, UDI_RESP_VALID, UDI_REQ_THREAD_RESUME, errmsg);
+    int user_single_step = get_branch_trace(thr)->user_single_step;
+    unmap_branch_trace(thr);
+
+    step_state *step = get_step_state(thr);
+    if (step->range_end != 0) {
+        // the setting is restored once the range ends
+        step->prev_single_step = user_single_step;
+        return RESULT_SUCCESS;
+    }
+
+    set_single_step(thr, user_single_step);
+
+    breakpoint *single_step_bp = get_single_step_breakpoint(thr);
+    if (!user_single_step && single_step_bp != NULL) {
+        if (delete_breakpoint(single_step_bp, errmsg) != 0) {
+            udi_log("failed to delete existing single step breakpoint: %s", errmsg->msg);
+            return RESULT_FAILURE;
+        }
+        set_single_step_breakpoint(thr, NULL);
+    }
+
+    return RESULT_SUCCESS;
 }
 
+// record branches request handling
+
 static
-void single_step_callback(void *ctx, bool value) {
-    single_step_req *req = (single_step_req *)req_state(ctx)->data;
-    req->setting = value;
+void record_branches_size_callback(void *ctx, uint32_t value) {
+    record_branches_req *req = (record_branches_req *)req_state(ctx)->data;
+    req->size = value;
 
     complete_item(ctx);
 }
 
 static
-void single_step_init_config(struct msg_config *config,
-                             struct msg_item *items)
+void record_branches_size_uint16_callback(void *ctx, uint16_t value) {
+    record_branches_size_callback(ctx, value);
+}
+
+static
+void record_branches_size_uint8_callback(void *ctx, uint8_t value) {
+    record_branches_size_callback(ctx, value);
+}
+
+static
+void record_branches_init_config(struct msg_config *config,
+                                 struct msg_item *items)
 {
     if (config->items == NULL) {
-        items[0].key = "value";
+        items[0].key = "size";
         items[0].callbacks = invalid_callbacks;
-        items[0].callbacks.boolean = single_step_callback;
+        items[0].callbacks.uint32 = record_branches_size_callback;
+        items[0].callbacks.uint16 = record_branches_size_uint16_callback;
+        items[0].callbacks.uint8 = record_branches_size_uint8_callback;
 
-        config->items = items;
         config->num_items = 1;
+        config->items = items;
     }
 }
 
 static
-int single_step_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
+int record_branches_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
 
     static struct msg_config config;
     static struct msg_item items[1];
-    single_step_init_config(&config, items);
+    record_branches_init_config(&config, items);
 
-    single_step_req req;
+    record_branches_req req;
     memset(&req, 0, sizeof(req));
 
     int result = read_request_data(req_fd, &config, &req, errmsg);
@@ -1460,29 +4030,73 @@ int single_step_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errm
         return result;
     }
 
-    bool prev_setting = is_single_step(thr);
-    set_single_step(thr, req.setting);
+    if (req.size != 0 && req.size < MAX_BRANCH_RECORD_SIZE) {
+        udi_set_errmsg(errmsg, "branch trace size must be at least %d", MAX_BRANCH_RECORD_SIZE);
+        return RESULT_FAILURE;
+    }
 
-    // Need to remove an existing single step breakpoint if it already exists
-    breakpoint *single_step_bp = get_single_step_breakpoint(thr);
-    if ( !req.setting && single_step_bp != NULL) {
-        if ( delete_breakpoint(single_step_bp, errmsg) ) {
-            udi_log("failed to delete existing single step breakpoint: %s",
-                    errmsg->msg);
-            return RESULT_FAILURE;
+    if (req.size != 0 && !is_thread_context_valid(thr)) {
+        udi_set_errmsg(errmsg, "register context unavailable");
+        udi_log("%s", errmsg->msg);
+        return RESULT_FAILURE;
+    }
+
+    // a new recording replaces the current one
+    result = stop_branch_recording(thr, errmsg);
+    if (result != RESULT_SUCCESS || req.size == 0) {
+        if (result == RESULT_SUCCESS) {
+            result = write_response_no_data(resp_fd,
+                                            UDI_RESP_VALID,
+                                            UDI_REQ_RECORD_BRANCHES,
+                                            errmsg);
+        }
+        return result;
+    }
+
+    char *branches_file = get_branch_trace_path(thr);
+    if (branches_file == NULL) {
+        udi_set_errmsg(errmsg, "failed to allocate branch trace path");
+        return RESULT_ERROR;
+    }
+
+    if (map_branch_trace(thr, req.size, errmsg) != 0) {
+        udi_free(branches_file);
+        return RESULT_FAILURE;
+    }
+
+    // the first record is the address the thread is at when recording starts
+    record_branch(thr, get_pc(get_thread_context(thr)));
+
+    // The thread single steps from now on. Unless it already did, its first step needs its own
+    // trap
+    step_state *step = get_step_state(thr);
+    branch_trace *trace = get_branch_trace(thr);
+    if (step->range_end != 0) {
+        trace->user_single_step = step->prev_single_step;
+        step->prev_single_step = 1;
+    }else{
+        trace->user_single_step = is_single_step(thr);
+        if (!is_single_step(thr)) {
+            set_single_step(thr, 1);
+            if (install_step_breakpoint(thr, get_thread_context(thr), errmsg) != 0) {
+                udi_free(branches_file);
+                stop_branch_recording(thr, errmsg);
+                return RESULT_FAILURE;
+            }
         }
-        set_single_step_breakpoint(thr, NULL);
     }
 
     cbor_item_t *map = cbor_new_definite_map(1);
 
-    struct cbor_pair value_pair;
-    value_pair.key = cbor_move(cbor_build_string("value"));
-    value_pair.value = cbor_move(cbor_build_bool(prev_setting));
-    bool add_result = cbor_map_add(map, value_pair);
+    struct cbor_pair path_pair;
+    path_pair.key = cbor_move(cbor_build_string("path"));
+    path_pair.value = cbor_move(cbor_build_string(branches_file));
+    bool add_result = cbor_map_add(map, path_pair);
     assert(add_result);
 
-    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_SINGLE_STEP, map, errmsg);
+    udi_free(branches_file);
+
+    return write_response(resp_fd, UDI_RESP_VALID, UDI_REQ_RECORD_BRANCHES, map, errmsg);
 }
 
 int thr_invalid_handler(udirt_fd req_fd, udirt_fd resp_fd, thread *thr, udi_errmsg *errmsg) {
@@ -1500,7 +4114,7 @@ typedef int (*thr_request_handler)(udirt_fd, udirt_fd, thread *, udi_errmsg *err
 static
 thr_request_handler thr_request_handlers[] = {
     thr_invalid_handler, // invalid
-    thr_invalid_handler, // continue
+    thr_continue_handler, // continue
     thr_invalid_handler, // read memory
     thr_invalid_handler, // write memory
     read_register_handler, // read register
@@ -1514,7 +4128,26 @@ thr_request_handler thr_request_handlers[] = {
     thr_suspend_handler, // thread suspend
     thr_resume_handler, // thread resume
     next_instr_handler, // next instruction
-    single_step_handler // single step
+    single_step_handler, // single step
+    thr_invalid_handler, // search memory
+    thr_invalid_handler, // memory map
+    thr_invalid_handler, // hash memory
+    thr_invalid_handler, // read memory stream
+    thr_invalid_handler, // write memory stream
+    read_registers_handler, // read registers
+    write_registers_handler, // write registers
+    read_vector_registers_handler, // read vector registers
+    write_vector_registers_handler, // write vector registers
+    thr_invalid_handler, // set event payload
+    thr_invalid_handler, // set event mask
+    thr_invalid_handler, // set signal policy
+    thr_invalid_handler, // stop stats
+    thr_invalid_handler, // set stop mode
+    step_range_handler, // step range
+    step_over_handler, // step over
+    step_out_handler, // step out
+    run_instructions_handler, // run instructions
+    record_branches_handler // record branches
 };
 
 int handle_thread_request(udirt_fd req_fd,
@@ -1544,6 +4177,90 @@ int handle_thread_request(udirt_fd req_fd,
     return result;
 }
 
+// Event batching
+static int event_batch_active = 0;
+static uint32_t event_batch_size = 0;
+static uint8_t *event_batch_buffer = NULL;
+static size_t event_batch_length = 0;
+static size_t event_batch_capacity = 0;
+
+#define EVENT_BATCH_INITIAL_CAPACITY 4096
+
+void begin_event_batch() {
+    if (!event_batch_active) {
+        udi_log("collecting events into a batch");
+
+        event_batch_active = 1;
+        event_batch_size = 0;
+        event_batch_length = 0;
+    }
+}
+
+int is_event_batch_active() {
+    return event_batch_active;
+}
+
+uint32_t get_event_batch_size() {
+    return event_batch_size;
+}
+
+/**
+ * Serializes the item into the event batch buffer
+ */
+static
+int append_event_batch_item(cbor_item_t *item, const char *name, udi_errmsg *errmsg) {
+    cbor_mutable_data buffer = NULL;
+    size_t buffer_size = 0;
+    size_t length = cbor_serialize_alloc(item, &buffer, &buffer_size);
+    cbor_decref(&item);
+    if (length == 0) {
+        udi_set_errmsg(errmsg,
+                       "failed to serialize %s",
+                       name);
+        return RESULT_ERROR;
+    }
+
+    if (event_batch_length + length > event_batch_capacity) {
+        size_t capacity = event_batch_capacity;
+        if (capacity == 0) {
+            capacity = EVENT_BATCH_INITIAL_CAPACITY;
+        }
+        while (capacity < event_batch_length + length) {
+            capacity *= 2;
+        }
+
+        uint8_t *batch_buffer = (uint8_t *)udi_realloc(event_batch_buffer, capacity);
+        if (batch_buffer == NULL) {
+            udi_free(buffer);
+            udi_set_errmsg(errmsg,
+                           "failed to allocate event batch of %l bytes",
+                           capacity);
+            return RESULT_ERROR;
+        }
+        event_batch_buffer = batch_buffer;
+        event_batch_capacity = capacity;
+    }
+
+    memcpy(event_batch_buffer + event_batch_length, buffer, length);
+    event_batch_length += length;
+
+    udi_free(buffer);
+    return RESULT_SUCCESS;
+}
+
+static
+int write_event_item(udirt_fd fd,
+                     cbor_item_t *item,
+                     const char *name,
+                     udi_errmsg *errmsg)
+{
+    if (event_batch_active) {
+        return append_event_batch_item(item, name, errmsg);
+    }
+
+    return write_cbor_item(fd, item, name, errmsg);
+}
+
 static
 int write_event(udirt_fd fd,
                 udi_event_type_e event_type,
@@ -1551,20 +4268,76 @@ int write_event(udirt_fd fd,
                 cbor_item_t *data,
                 udi_errmsg *errmsg)
 {
+    // the threads created or destroyed while their events were masked are reported along with
+    // the next event
+    if (has_deferred_thread_events()) {
+        begin_event_batch();
+
+        int deferred_result = write_deferred_thread_events(errmsg);
+        if (deferred_result != RESULT_SUCCESS) {
+            return deferred_result;
+        }
+    }
+
     cbor_item_t *type_item = cbor_build_uint16(event_type);
-    int result = write_cbor_item(fd, type_item, "event type", errmsg);
+    int result = write_event_item(fd, type_item, "event type", errmsg);
     if (result != RESULT_SUCCESS) {
         return result;
     }
 
     cbor_item_t *tid_item = cbor_build_uint64(tid);
-    result = write_cbor_item(fd, tid_item, "tid", errmsg);
+    result = write_event_item(fd, tid_item, "tid", errmsg);
     if (result != RESULT_SUCCESS) {
         return result;
     }
 
     if (data != NULL) {
-        return write_cbor_item(fd, data, "event data", errmsg);
+        result = write_event_item(fd, data, "event data", errmsg);
+    }
+
+    if (result == RESULT_SUCCESS && event_batch_active) {
+        udi_log("added %s for thread %a to event batch", event_type_str(event_type), tid);
+        event_batch_size++;
+    }
+
+    return result;
+}
+
+int flush_event_batch(uint64_t tid, udi_errmsg *errmsg) {
+    if (!event_batch_active) {
+        return RESULT_SUCCESS;
+    }
+
+    event_batch_active = 0;
+
+    if (event_batch_size == 0) {
+        return RESULT_SUCCESS;
+    }
+
+    udi_log("reporting batch of %d events", event_batch_size);
+
+    // a single event does not need the batch event around it
+    if (event_batch_size > 1) {
+        cbor_item_t *map = cbor_new_definite_map(1);
+
+        struct cbor_pair count_pair;
+        count_pair.key = cbor_move(cbor_build_string("count"));
+        count_pair.value = cbor_move(cbor_build_uint32(event_batch_size));
+        bool add_result = cbor_map_add(map, count_pair);
+        assert(add_result);
+
+        int result = write_event(events_handle, UDI_EVENT_BATCH, tid, map, errmsg);
+        if (result != RESULT_SUCCESS) {
+            return result;
+        }
+    }
+
+    int write_result = write_to(events_handle, event_batch_buffer, event_batch_length);
+    if (write_result != 0) {
+        udi_set_errmsg(errmsg,
+                       "failed to write event batch: %e",
+                       write_result);
+        return RESULT_ERROR;
     }
 
     return RESULT_SUCCESS;
@@ -1579,6 +4352,226 @@ int write_event_no_data(udirt_fd fd,
     return write_event(fd, event_type, tid, NULL, errmsg);
 }
 
+/**
+ * @return the number of pairs add_event_payload adds to an event map
+ */
+static
+size_t get_event_payload_size() {
+    size_t size = 0;
+    if (event_payload.num_regs > 0) {
+        size++;
+    }
+
+    if (event_payload.stack > 0) {
+        size += 2;
+    }
+
+    return size;
+}
+
+/**
+ * Adds the configured registers and stack bytes to the event map. Registers that cannot be
+ * read are null and the stack is truncated when it cannot be read in full.
+ */
+static
+void add_event_payload(cbor_item_t *map, const void *context) {
+
+    // the payload is best effort, so errors are discarded
+    static udi_errmsg payload_errmsg;
+    static uint8_t stack[MAX_EVENT_PAYLOAD_STACK];
+
+    if (event_payload.num_regs > 0) {
+        cbor_item_t *regs = cbor_new_definite_array(event_payload.num_regs);
+        for (uint32_t i = 0; i < event_payload.num_regs; ++i) {
+            uint64_t value;
+            cbor_item_t *item;
+            if (get_register(event_payload.regs[i], &payload_errmsg, &value, context) == 0) {
+                item = cbor_build_uint64(value);
+            }else{
+                item = cbor_new_null();
+            }
+
+            bool add_result = cbor_array_push(regs, cbor_move(item));
+            assert(add_result);
+        }
+
+        struct cbor_pair regs_pair;
+        regs_pair.key = cbor_move(cbor_build_string("regs"));
+        regs_pair.value = cbor_move(regs);
+        bool add_result = cbor_map_add(map, regs_pair);
+        assert(add_result);
+    }
+
+    if (event_payload.stack > 0) {
+        uint64_t sp = 0;
+        get_register(get_stack_pointer_register(get_architecture()), &payload_errmsg, &sp, context);
+
+        size_t len = event_payload.stack;
+        if (read_memory(stack, (const uint8_t *)(uintptr_t)sp, len, &payload_errmsg) != 0) {
+            uint64_t page_end = (sp & ~(EVENT_STACK_PAGE_SIZE - 1)) + EVENT_STACK_PAGE_SIZE;
+            if (page_end - sp < len) {
+                len = page_end - sp;
+            }
+
+            if (read_memory(stack, (const uint8_t *)(uintptr_t)sp, len, &payload_errmsg) != 0) {
+                len = 0;
+            }
+        }
+
+        struct cbor_pair sp_pair;
+        sp_pair.key = cbor_move(cbor_build_string("sp"));
+        sp_pair.value = cbor_move(cbor_build_uint64(sp));
+        bool add_result = cbor_map_add(map, sp_pair);
+        assert(add_result);
+
+        struct cbor_pair stack_pair;
+        stack_pair.key = cbor_move(cbor_build_string("stack"));
+        stack_pair.value = cbor_move(cbor_build_bytestring(stack, len));
+        add_result = cbor_map_add(map, stack_pair);
+        assert(add_result);
+    }
+}
+
+/**
+ * @return the number of items added to an event that ends a run of instructions of the thread
+ */
+static
+size_t get_run_result_size(thread *thr) {
+    if (thr == NULL || get_step_state(thr)->run_count == 0) {
+        return 0;
+    }
+
+    return 2;
+}
+
+/**
+ * Adds the pc and the number of instructions executed to an event that ends a run of
+ * instructions of the thread
+ */
+static
+void add_run_result(cbor_item_t *map, thread *thr, uint64_t pc) {
+    if (get_run_result_size(thr) == 0) {
+        return;
+    }
+
+    struct cbor_pair pc_pair;
+    pc_pair.key = cbor_move(cbor_build_string("pc"));
+    pc_pair.value = cbor_move(cbor_build_uint64(pc));
+    bool add_result = cbor_map_add(map, pc_pair);
+    assert(add_result);
+
+    struct cbor_pair executed_pair;
+    executed_pair.key = cbor_move(cbor_build_string("executed"));
+    executed_pair.value = cbor_move(cbor_build_uint64(get_step_state(thr)->executed));
+    add_result = cbor_map_add(map, executed_pair);
+    assert(add_result);
+}
+
+/**
+ * Accounts for a step of the thread that completed at the specified pc
+ *
+ * @return non-zero if the thread stops after the step; zero if it continues through its range or
+ * the instructions it runs
+ */
+static
+int is_step_done(thread *thr, uint64_t pc) {
+    record_step(thr, pc);
+
+    step_state *step = get_step_state(thr);
+    if (step->run_count != 0) {
+        step->executed++;
+        return step->executed >= step->run_count;
+    }
+
+    // outside of a range, a thread recording its branches only reports the steps the debugger
+    // asked for
+    if (step->range_end == 0 && is_recording_branches(thr)) {
+        return get_branch_trace(thr)->user_single_step;
+    }
+
+    return !is_in_step_range(thr, pc);
+}
+
+/**
+ * Reports a single step event, with the configured event payload
+ */
+static
+int write_single_step_event(thread *thr, const void *context, udi_errmsg *errmsg) {
+
+    cbor_item_t *map = cbor_new_definite_map(get_event_payload_size() +
+                                             get_run_result_size(thr));
+    add_event_payload(map, context);
+    add_run_result(map, thr, get_pc(context));
+
+    return write_event(events_handle,
+                       UDI_EVENT_SINGLE_STEP,
+                       get_thread_id(thr),
+                       map,
+                       errmsg);
+}
+
+/**
+ * Reports the single step event of the thread, unless the step stays in the range the thread is
+ * stepping through
+ */
+static
+int finish_single_step(thread *thr,
+                       uint64_t pc,
+                       const void *context,
+                       int *wait_for_request,
+                       udi_errmsg *errmsg)
+{
+    if (!is_step_done(thr, pc)) {
+        udi_log("stepping through range at %a", pc);
+        *wait_for_request = 0;
+        return RESULT_SUCCESS;
+    }
+
+    int result = write_single_step_event(thr, context, errmsg);
+    end_step_range(thr);
+
+    return result;
+}
+
+/**
+ * Reports that the thread hit the user breakpoint
+ */
+static
+int write_breakpoint_event(thread *thr, breakpoint *bp, void *context, udi_errmsg *errmsg) {
+    udi_log("user breakpoint at %a", bp->address);
+
+    // the breakpoint is hit after the instruction that preceded it completed
+    if (thr != NULL && get_step_state(thr)->run_count != 0) {
+        get_step_state(thr)->executed++;
+    }
+    if (thr != NULL) {
+        record_step(thr, bp->address);
+    }
+
+    cbor_item_t *map = cbor_new_definite_map(1 + get_event_payload_size() +
+                                             get_run_result_size(thr));
+
+    struct cbor_pair addr_pair;
+    addr_pair.key = cbor_move(cbor_build_string("addr"));
+    addr_pair.value = cbor_move(cbor_build_uint64(bp->address));
+    bool add_result = cbor_map_add(map, addr_pair);
+    assert(add_result);
+
+    add_event_payload(map, context);
+    add_run_result(map, thr, bp->address);
+
+    int result = write_event(events_handle,
+                             UDI_EVENT_BREAKPOINT,
+                             get_thread_id(thr),
+                             map,
+                             errmsg);
+    if (result != RESULT_SUCCESS) {
+        udi_log("failed to report breakpoint at %a", bp->address);
+    }
+
+    return result;
+}
+
 int decode_breakpoint(thread *thr,
                       breakpoint *bp,
                       void *context,
@@ -1593,8 +4586,13 @@ int decode_breakpoint(thread *thr,
         rewind_pc(get_thread_context(thr));
     }
 
+    // A thread-specific breakpoint is stepped over silently when it is hit by another thread, or
+    // by a deeper frame than the call the thread is stepping over
+    int skip = bp->thread != NULL &&
+               (bp->thread != thr || !is_step_return_frame(thr, context));
+
     // Handle single step breakpoints
-    if (thr != NULL && get_single_step_breakpoint(thr) == bp) {
+    if (!skip && thr != NULL && get_single_step_breakpoint(thr) == bp) {
         udi_log("single step breakpoint at %a", bp->address);
 
         int delete_result = delete_breakpoint(bp, errmsg);
@@ -1605,14 +4603,35 @@ int decode_breakpoint(thread *thr,
             return RESULT_ERROR;
         }
 
-        result = write_event_no_data(events_handle,
-                                     UDI_EVENT_SINGLE_STEP,
-                                     get_thread_id(thr),
-                                     errmsg);
-
         set_single_step_breakpoint(thr, NULL);
 
-        return result;
+        step_state *step = get_step_state(thr);
+        if (step->return_sp != 0) {
+            udi_log("returned from call stepped over at %a", bp->address);
+            step->return_sp = 0;
+            set_single_step(thr, 1);
+        }
+
+        return finish_single_step(thr, bp->address, context, wait_for_request, errmsg);
+    }
+
+    // In non-stop mode, breakpoints stay in memory and the thread steps over them when it
+    // continues
+    if ( is_non_stop_mode() ) {
+        if ( is_event_breakpoint(bp) ) {
+            udi_log("handling event breakpoint at %a", bp->address);
+            return handle_event_breakpoint(bp, context, errmsg);
+        }
+
+        if ( skip ) {
+            udi_log("thread %a stepping over breakpoint for thread %a",
+                    get_thread_id(thr),
+                    get_thread_id(bp->thread));
+            *wait_for_request = 0;
+            return RESULT_SUCCESS;
+        }
+
+        return write_breakpoint_event(thr, bp, context, errmsg);
     }
 
     // Before creating the event, need to remove the breakpoint and indicate
@@ -1623,23 +4642,38 @@ int decode_breakpoint(thread *thr,
         return RESULT_ERROR;
     }
 
-    if ( continue_bp == bp ) {
+    continue_bp_entry *continue_entry = find_continue_bp(bp, thr);
+    if ( continue_entry != NULL ) {
         udi_log("continue breakpoint at %a", bp->address);
 
         *wait_for_request = 0;
-        continue_bp = NULL;
 
-        int delete_result = delete_breakpoint(bp, errmsg);
-        if ( delete_result != 0 ) {
-            udi_log("failed to delete breakpoint at %a", bp->address);
-            result = RESULT_ERROR;
+        uint64_t last_bp_address = continue_entry->last_bp_address;
+        remove_continue_bp(continue_entry);
+
+        if ( is_continue_breakpoint(bp) ) {
+            // Another thread stepping over the same breakpoint still needs to hit this one
+            bp->in_memory = 0;
+            int install_result = install_breakpoint(bp, errmsg);
+            if ( install_result != 0 ) {
+                udi_log("failed to install breakpoint at %a", bp->address);
+                result = RESULT_ERROR;
+            }
+        }else{
+            int delete_result = delete_breakpoint(bp, errmsg);
+            if ( delete_result != 0 ) {
+                udi_log("failed to delete breakpoint at %a", bp->address);
+                result = RESULT_ERROR;
+            }
         }
 
-        // Need to re-install original breakpoint if it still should be in memory
+        // Need to re-install original breakpoint if it still should be in memory, once all
+        // threads stopped at it have stepped over it
         breakpoint *original_bp = find_breakpoint(last_bp_address);
-        if ( original_bp != NULL ) {
-            last_bp_address = 0;
-
+        if ( original_bp != NULL && is_continuing_from(last_bp_address) ) {
+            udi_log("Not re-installing breakpoint at %a until all threads step over it",
+                    last_bp_address);
+        }else if ( original_bp != NULL ) {
             if ( original_bp->in_memory ) {
                 // Temporarily reset the memory value
                 original_bp->in_memory = 0;
@@ -1657,13 +4691,14 @@ int decode_breakpoint(thread *thr,
             udi_log("Not re-installing breakpoint at %a", last_bp_address);
         }
 
-        // Need to report single step event if this continue_bp was used for single stepping
-        if (result == RESULT_SUCCESS && thr != NULL && is_single_step(thr)) {
+        // Need to report single step event if this continue breakpoint was used for single
+        // stepping
+        if (result == RESULT_SUCCESS && thr != NULL && is_single_step(thr) &&
+            is_step_done(thr, bp->address))
+        {
             udi_log("Using continue breakpoint as single step breakpoint");
-            result = write_event_no_data(events_handle,
-                                         UDI_EVENT_SINGLE_STEP,
-                                         get_thread_id(thr),
-                                         errmsg);
+            result = write_single_step_event(thr, context, errmsg);
+            end_step_range(thr);
             *wait_for_request = 1;
         }
 
@@ -1676,49 +4711,47 @@ int decode_breakpoint(thread *thr,
         return RESULT_ERROR;
     }
 
-    continue_bp = create_breakpoint(successor);
-    if (continue_bp == NULL) {
-        udi_log("failed to create continue breakpoint");
+    if (add_continue_bp(thr, bp, successor) != RESULT_SUCCESS) {
         return RESULT_ERROR;
     }
 
-    last_bp_address = bp->address;
-
     if ( is_event_breakpoint(bp) ) {
         udi_log("handling event breakpoint at %a", bp->address);
         return handle_event_breakpoint(bp, context, errmsg);
     }
 
-    // Handle the case where this thread hit another thread-specific breakpoint
-    // The thread should just be continued silently
-    if ( bp->thread != NULL && bp->thread != thr ) {
-        udi_log("thread %a hit breakpoint for thread %a",
-                get_thread_id(bp->thread),
-                get_thread_id(thr));
+    // Handle the case where this thread hit a thread-specific breakpoint that it could not step
+    // over without stopping the other threads. The thread steps over it silently, without waiting
+    // for a continue request
+    if ( skip ) {
+        udi_log("thread %a stepping over breakpoint for thread %a",
+                get_thread_id(thr),
+                get_thread_id(bp->thread));
         *wait_for_request = 0;
-        return RESULT_ERROR;
+        return install_continue_bps(thr, errmsg);
     }
 
-    udi_log("user breakpoint at %a", bp->address);
+    return write_breakpoint_event(thr, bp, context, errmsg);
+}
 
-    cbor_item_t *map = cbor_new_definite_map(1);
+int decode_trace_trap(thread *thr,
+                      void *context,
+                      int *wait_for_request,
+                      udi_errmsg *errmsg)
+{
+    uint64_t pc = get_pc(context);
 
-    struct cbor_pair addr_pair;
-    addr_pair.key = cbor_move(cbor_build_string("addr"));
-    addr_pair.value = cbor_move(cbor_build_uint64(bp->address));
-    bool add_result = cbor_map_add(map, addr_pair);
-    assert(add_result);
+    get_step_state(thr)->trace = STEP_TRACE_NONE;
 
-    result = write_event(events_handle,
-                         UDI_EVENT_BREAKPOINT,
-                         get_thread_id(thr),
-                         map,
-                         errmsg);
-    if (result != RESULT_SUCCESS) {
-        udi_log("failed to report breakpoint at %a", bp->address);
+    if (!is_single_step(thr)) {
+        udi_log("ignoring trace trap at %a, single stepping was disabled", pc);
+        *wait_for_request = 0;
+        return RESULT_SUCCESS;
     }
 
-    return result;
+    udi_log("single step trap at %a", pc);
+
+    return finish_single_step(thr, pc, context, wait_for_request, errmsg);
 }
 
 int handle_thread_death_event(uint64_t tid,
@@ -1776,6 +4809,28 @@ int handle_thread_create_event(uint64_t creator_tid,
     return write_event(events_handle, UDI_EVENT_THREAD_CREATE, creator_tid, map, errmsg);
 }
 
+int handle_signal_event(uint64_t tid, uint64_t addr, uint32_t sig, udi_errmsg *errmsg) {
+    thread *thr = get_current_thread();
+
+    cbor_item_t *map = cbor_new_definite_map(2 + get_run_result_size(thr));
+
+    struct cbor_pair addr_pair;
+    addr_pair.key = cbor_move(cbor_build_string("addr"));
+    addr_pair.value = cbor_move(cbor_build_uint64(addr));
+    bool add_result = cbor_map_add(map, addr_pair);
+    assert(add_result);
+
+    struct cbor_pair sig_pair;
+    sig_pair.key = cbor_move(cbor_build_string("sig"));
+    sig_pair.value = cbor_move(cbor_build_uint32(sig));
+    add_result = cbor_map_add(map, sig_pair);
+    assert(add_result);
+
+    add_run_result(map, thr, addr);
+
+    return write_event(events_handle, UDI_EVENT_SIGNAL, tid, map, errmsg);
+}
+
 int handle_unknown_event(uint64_t tid, udi_errmsg *errmsg) {
     return write_event_no_data(events_handle, UDI_EVENT_UNKNOWN, tid, errmsg);
 }
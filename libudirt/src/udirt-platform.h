@@ -27,6 +27,10 @@ typedef int udirt_fd;
 #define UDI_CONSTRUCTOR __attribute__((constructor))
 #define UDI_WEAK __attribute__((weak))
 
+// the runtime is preloaded, so its TLS is in the static block and can be accessed in a
+// signal handler without an allocation
+#define UDI_THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+
 #ifndef _GNU_SOURCE
 #define _GNU_SOURCE 1
 #endif
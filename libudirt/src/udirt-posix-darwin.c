@@ -27,3 +27,12 @@ void udi_log_error(format_cb cb, void *ctx, int error) {
 
     udi_log_string(cb, ctx, buf);
 }
+
+int load_memory_map(memory_region **regions, size_t *num_regions, udi_errmsg *errmsg) {
+    USE(regions);
+    USE(num_regions);
+
+    udi_set_errmsg(errmsg, "memory map not supported");
+
+    return MEMORY_MAP_UNSUPPORTED;
+}
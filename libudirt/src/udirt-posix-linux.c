@@ -9,6 +9,8 @@
 
 #include "udirt-platform.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/syscall.h>
 
@@ -26,3 +28,195 @@ void udi_log_error(format_cb cb, void *ctx, int error) {
 
     udi_log_string(cb, ctx, result);
 }
+
+/**
+ * Parses a hexadecimal number
+ *
+ * @param str the string, advanced past the number
+ * @param end the end of the string
+ *
+ * @return the number
+ */
+static
+uint64_t parse_hex(const char **str, const char *end) {
+    uint64_t value = 0;
+
+    const char *cur = *str;
+    for (; cur < end; ++cur) {
+        char c = *cur;
+        if ( c >= '0' && c <= '9' ) {
+            value = (value << 4) | (uint64_t)(c - '0');
+        }else if ( c >= 'a' && c <= 'f' ) {
+            value = (value << 4) | (uint64_t)(c - 'a' + 10);
+        }else{
+            break;
+        }
+    }
+    *str = cur;
+
+    return value;
+}
+
+/**
+ * Skips to the next space delimited field
+ *
+ * @param str the string
+ * @param end the end of the string
+ *
+ * @return the start of the next field
+ */
+static
+const char *next_field(const char *str, const char *end) {
+    while ( str < end && *str != ' ' ) {
+        str++;
+    }
+
+    while ( str < end && *str == ' ' ) {
+        str++;
+    }
+
+    return str;
+}
+
+/**
+ * Parses a line from /proc/self/maps of the form
+ *
+ * start-end perms offset dev inode path
+ *
+ * @param line the line
+ * @param end the end of the line
+ * @param region the region to populate
+ *
+ * @return 0 on success; non-zero on failure
+ */
+static
+int parse_maps_line(const char *line, const char *end, memory_region *region) {
+    const char *cur = line;
+
+    region->start = parse_hex(&cur, end);
+    if ( cur >= end || *cur != '-' ) {
+        return -1;
+    }
+    cur++;
+    region->end = parse_hex(&cur, end);
+
+    cur = next_field(cur, end);
+    if ( end - cur < 4 ) {
+        return -1;
+    }
+
+    region->prot = 0;
+    if ( cur[0] == 'r' ) region->prot |= UDI_MEM_PROT_READ;
+    if ( cur[1] == 'w' ) region->prot |= UDI_MEM_PROT_WRITE;
+    if ( cur[2] == 'x' ) region->prot |= UDI_MEM_PROT_EXEC;
+
+    cur = next_field(cur, end);
+    region->offset = parse_hex(&cur, end);
+
+    // skip the offset, dev and inode fields
+    cur = next_field(cur, end);
+    cur = next_field(cur, end);
+    cur = next_field(cur, end);
+
+    region->path = NULL;
+    if ( cur < end ) {
+        size_t path_len = end - cur;
+        char *path = (char *)udi_malloc(path_len + 1);
+        if ( path == NULL ) {
+            return -1;
+        }
+        memcpy(path, cur, path_len);
+        path[path_len] = '\0';
+        region->path = path;
+    }
+
+    return 0;
+}
+
+int load_memory_map(memory_region **regions, size_t *num_regions, udi_errmsg *errmsg) {
+    int fd = open("/proc/self/maps", O_RDONLY);
+    if ( fd == -1 ) {
+        udi_set_errmsg(errmsg, "failed to open /proc/self/maps: %e", errno);
+        return -1;
+    }
+
+    // the file needs to be read in full before parsing as the contents are generated on read
+    char *buffer = NULL;
+    size_t size = 0, capacity = 0;
+    int result = 0;
+    while ( 1 ) {
+        if ( size == capacity ) {
+            capacity = (capacity == 0) ? 16384 : capacity * 2;
+
+            char *new_buffer = (char *)udi_realloc(buffer, capacity);
+            if ( new_buffer == NULL ) {
+                udi_set_errmsg(errmsg, "failed to allocate memory");
+                result = -1;
+                break;
+            }
+            buffer = new_buffer;
+        }
+
+        ssize_t num_read = read(fd, buffer + size, capacity - size);
+        if ( num_read < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+
+            udi_set_errmsg(errmsg, "failed to read /proc/self/maps: %e", errno);
+            result = -1;
+            break;
+        }
+
+        if ( num_read == 0 ) {
+            break;
+        }
+
+        size += num_read;
+    }
+    close(fd);
+
+    if ( result != 0 ) {
+        udi_free(buffer);
+        return result;
+    }
+
+    size_t num_lines = 0;
+    for (size_t i = 0; i < size; ++i) {
+        if ( buffer[i] == '\n' ) {
+            num_lines++;
+        }
+    }
+
+    memory_region *output = (memory_region *)udi_calloc(num_lines + 1, sizeof(memory_region));
+    if ( output == NULL ) {
+        udi_free(buffer);
+        udi_set_errmsg(errmsg, "failed to allocate memory");
+        return -1;
+    }
+
+    size_t count = 0;
+    const char *line = buffer;
+    const char *buffer_end = buffer + size;
+    while ( line < buffer_end && count <= num_lines ) {
+        const char *line_end = memchr(line, '\n', buffer_end - line);
+        if ( line_end == NULL ) {
+            line_end = buffer_end;
+        }
+
+        if ( parse_maps_line(line, line_end, &output[count]) == 0 ) {
+            count++;
+        }else{
+            udi_log("failed to parse memory map line");
+        }
+
+        line = line_end + 1;
+    }
+
+    udi_free(buffer);
+
+    *regions = output;
+    *num_regions = count;
+
+    return 0;
+}
@@ -30,6 +30,17 @@ extern pthread_t pthread_self() UDI_WEAK;
 // the threads list
 static int num_threads = 0;
 static thread *threads = NULL;
+static thread *threads_tail = NULL;
+
+// the threads indexed by id, an open addressing table with a power of two size
+#define INITIAL_THREAD_TABLE_SIZE 16
+static thread **thread_table = NULL;
+static unsigned int thread_table_size = 0;
+
+#if defined(UDI_THREAD_LOCAL)
+// the structure for the current thread, cleared once the thread is dead
+static UDI_THREAD_LOCAL thread *current_thread = NULL;
+#endif
 
 int THREAD_SUSPEND_SIGNAL = SIGSYS;
 
@@ -131,17 +142,32 @@ static
 thread *create_thread_struct(uint64_t tid) {
     int control_pipe[2];
 
-    thread *new_thr = (thread *)udi_malloc(sizeof(thread));
+    thread *new_thr = (thread *)udi_memalign(UDI_CACHE_LINE_SIZE, sizeof(thread));
     if (new_thr == NULL) {
         return NULL;
     }
     memset(new_thr, 0, sizeof(thread));
 
+    new_thr->event_state = (signal_state *)udi_malloc(sizeof(signal_state));
+    if (new_thr->event_state == NULL) {
+        udi_free(new_thr);
+        return NULL;
+    }
+    memset(new_thr->event_state, 0, sizeof(signal_state));
+
     if ( init_control_pipe(control_pipe) != 0 ) {
+        udi_free(new_thr->event_state);
+        udi_free(new_thr);
         return NULL;
     }
 
-    if ( allocate_context_data(&(new_thr->event_state.context_data)) != 0 ) {
+    if ( allocate_context_data(&(new_thr->event_state->context_data)) != 0 ) {
+        if ( control_pipe[0] != -1 ) {
+            close(control_pipe[0]);
+            close(control_pipe[1]);
+        }
+        udi_free(new_thr->event_state);
+        udi_free(new_thr);
         return NULL;
     }
 
@@ -161,27 +187,125 @@ thread *create_thread_struct(uint64_t tid) {
 }
 
 static
-void link_thread(thread *new_thr) {
+unsigned int thread_table_index(uint64_t tid, unsigned int size) {
+    // thread ids are usually aligned addresses, mix the bits before masking
+    return (unsigned int)((tid * 0x9e3779b97f4a7c15ULL) >> 32) & (size - 1);
+}
+
+static
+void insert_thread_entry(thread **table, unsigned int size, thread *thr) {
+    unsigned int i = thread_table_index(thr->id, size);
+    while (table[i] != NULL) {
+        i = (i + 1) & (size - 1);
+    }
+    table[i] = thr;
+}
+
+/**
+ * Ensures the thread table has room for another thread, growing it if needed
+ *
+ * @return 0 on success; non-zero on failure
+ */
+static
+int reserve_thread_entry() {
+
+    // keep the load factor at or below 3/4
+    if ( thread_table != NULL && (unsigned int)(num_threads + 1) * 4 <= thread_table_size * 3 ) {
+        return 0;
+    }
+
+    unsigned int size = thread_table_size == 0 ? INITIAL_THREAD_TABLE_SIZE
+                                               : thread_table_size * 2;
+    thread **table = (thread **)udi_malloc(sizeof(thread *) * size);
+    if (table == NULL) {
+        udi_log("failed to allocate thread table of size %d", size);
+        return -1;
+    }
+    memset(table, 0, sizeof(thread *) * size);
+
+    thread *iter = threads;
+    while (iter != NULL) {
+        insert_thread_entry(table, size, iter);
+        iter = iter->next_thread;
+    }
+
+    thread **old_table = thread_table;
+    thread_table = table;
+    thread_table_size = size;
+
+    // publish the new table before releasing the old one
+    __sync_synchronize();
+    udi_free(old_table);
+
+    return 0;
+}
+
+/**
+ * Removes the thread from the thread table, shifting back the entries that follow it in
+ * its probe sequence so no lookups are broken by the gap
+ *
+ * @param thr the thread
+ */
+static
+void remove_thread_entry(thread *thr) {
+    if (thread_table == NULL) return;
+
+    unsigned int mask = thread_table_size - 1;
+    unsigned int i = thread_table_index(thr->id, thread_table_size);
+    while (thread_table[i] != thr) {
+        if (thread_table[i] == NULL) return;
+        i = (i + 1) & mask;
+    }
 
-    // find the end of the list
-    thread *cur_thread = threads;
-    thread *last_thread = threads;
+    unsigned int j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (thread_table[j] == NULL) break;
 
-    while (cur_thread != NULL) {
-        last_thread = cur_thread;
-        cur_thread = cur_thread->next_thread;
+        // the entry can fill the gap if its home slot is not between the gap and itself
+        unsigned int home = thread_table_index(thread_table[j]->id, thread_table_size);
+        if ( ((j - home) & mask) >= ((j - i) & mask) ) {
+            thread_table[i] = thread_table[j];
+            i = j;
+        }
+    }
+    thread_table[i] = NULL;
+}
+
+static
+int link_thread(thread *new_thr) {
+
+    if ( reserve_thread_entry() != 0 ) {
+        return -1;
     }
 
     num_threads++;
 
-    if (last_thread == NULL) {
+    if (threads_tail == NULL) {
         threads = new_thr;
     }else{
-        last_thread->next_thread = new_thr;
+        threads_tail->next_thread = new_thr;
     }
+    threads_tail = new_thr;
+
+    insert_thread_entry(thread_table, thread_table_size, new_thr);
 
     // global data updated, issue full memory barrier
     __sync_synchronize();
+
+    return 0;
+}
+
+static
+void free_thread_struct(thread *thr) {
+    if (thr->control_read != -1) {
+        close(thr->control_write);
+        close(thr->control_read);
+    }
+
+    udi_free(thr->event_state->context_data);
+    udi_free(thr->event_state);
+    udi_free(thr);
 }
 
 /**
@@ -199,7 +323,16 @@ thread *create_thread(uint64_t tid) {
         return NULL;
     }
 
-    link_thread(new_thr);
+    if ( link_thread(new_thr) != 0 ) {
+        free_thread_struct(new_thr);
+        return NULL;
+    }
+
+#if defined(UDI_THREAD_LOCAL)
+    // threads are always created by themselves, so a running thread never needs to search the
+    // thread table, which can change in non-stop mode
+    current_thread = new_thr;
+#endif
 
     return new_thr;
 }
@@ -207,17 +340,25 @@ thread *create_thread(uint64_t tid) {
 /**
  * @param tid the thread id
  *
- * @return the thread or NULL if none could be found
+ * @return the thread or NULL if none could be found. A live thread is preferred over a
+ * dead thread that has not been destroyed yet and had the same id.
  */
 static
 thread *find_thread(uint64_t tid) {
-    thread *thr = threads;
-    while (thr != NULL) {
-        if (thr->id == tid) break;
-        thr = thr->next_thread;
+    if (thread_table == NULL) return NULL;
+
+    thread *dead_thr = NULL;
+    unsigned int i = thread_table_index(tid, thread_table_size);
+    while (thread_table[i] != NULL) {
+        thread *thr = thread_table[i];
+        if (thr->id == tid) {
+            if (!thr->dead) return thr;
+            if (dead_thr == NULL) dead_thr = thr;
+        }
+        i = (i + 1) & (thread_table_size - 1);
     }
 
-    return thr;
+    return dead_thr;
 }
 
 thread *get_thread_list() {
@@ -251,20 +392,34 @@ int handle_thread_create(uint64_t creator_thr)
             result = RESULT_ERROR;
             break;
         }
+        thr->creator_id = creator_thr;
 
         if ( thread_create_callback(thr, &errmsg) != 0 ) {
             result = RESULT_ERROR;
             break;
         }
 
-        result = handle_thread_create_event(creator_thr, tid, &errmsg);
-        if (result != RESULT_SUCCESS) {
-            break;
-        }
+        if ( is_event_masked(UDI_EVENT_THREAD_CREATE) ) {
+            // the thread is reported with the next event
+            udi_log("thread create event for %a masked", tid);
+        }else{
+            thr->create_reported = 1;
 
-        result = thread_create_handshake(thr, &errmsg);
-        if (result != RESULT_SUCCESS) {
-            break;
+            result = handle_thread_create_event(creator_thr, tid, &errmsg);
+            if (result != RESULT_SUCCESS) {
+                break;
+            }
+
+            if ( is_event_batch_active() ) {
+                // the event is written with the deferred thread events once the creator waits
+                // for the debugger
+                thr->handshake_pending = 1;
+            }else{
+                result = thread_create_handshake(thr, &errmsg);
+                if (result != RESULT_SUCCESS) {
+                    break;
+                }
+            }
         }
 
         if ( write(thread_barrier.write_handle, &sentinel, 1) != 1 ) {
@@ -324,6 +479,7 @@ int handle_thread_death() {
             result = RESULT_ERROR;
             break;
         }
+        thr->death_reported = 1;
 
         if ( thread_death_callback(thr, &errmsg) != 0 ) {
             result = RESULT_ERROR;
@@ -342,6 +498,37 @@ int handle_thread_death() {
     return result;
 }
 
+/**
+ * Handles the death of a thread without reporting it
+ *
+ * @param thr the dying thread
+ *
+ * @return the result
+ */
+static
+int discard_thread_death(thread *thr) {
+    udi_errmsg errmsg;
+    errmsg.size = ERRMSG_SIZE;
+    errmsg.msg[ERRMSG_SIZE-1] = '\0';
+
+    udi_log("thread death event for %a masked", thr->id);
+
+    int reported = thr->create_reported;
+    if ( thread_death_callback(thr, &errmsg) != 0 ) {
+        return RESULT_ERROR;
+    }
+
+    // a thread unknown to the debugger is cleaned up right away
+    if ( !reported ) {
+        thr->death_reported = 1;
+        if ( thread_death_handshake(thr, &errmsg) != 0 ) {
+            return RESULT_ERROR;
+        }
+    }
+
+    return RESULT_SUCCESS;
+}
+
 static
 void report_thread_death() {
 
@@ -369,6 +556,18 @@ void report_thread_death() {
     if (block_result > 0) {
         // the thread should always eventually be the control thread
         udi_abort();
+    } else if ( !thr->create_reported || is_event_masked(UDI_EVENT_THREAD_DEATH) ) {
+        thr->stack_event_pending = 0;
+
+        // the debugger does not wait for this thread's death, it is reported with the next
+        // event if the debugger knows about the thread
+        if ( discard_thread_death(thr) != RESULT_SUCCESS ) {
+            udi_log("failed to handle thread death");
+            udi_abort();
+            return;
+        }
+
+        release_other_threads();
     } else {
         thr->stack_event_pending = 0;
 
@@ -390,9 +589,20 @@ void report_thread_death() {
             udi_abort();
         }
 
+        // in non-stop mode, the thread could not complete the handshake while it was stopped
+        if ( is_non_stop_mode() && thread_death_handshake(thr, &errmsg) != 0 ) {
+            udi_log("failed to complete thread death handshake");
+            udi_abort();
+        }
+
         release_other_threads();
     }
 
+#if defined(UDI_THREAD_LOCAL)
+    // the structure can be destroyed by the debugger once signals are unblocked
+    current_thread = NULL;
+#endif
+
     setsigmask(SIG_SETMASK, &original_set, NULL);
 }
 
@@ -434,7 +644,7 @@ void *wrapped_start_routine(void *arg)
 }
 
 static
-int handshake_with_thread()
+int handshake_with_thread(uint64_t tid)
 {
     udi_errmsg errmsg;
     errmsg.size = ERRMSG_SIZE;
@@ -451,11 +661,26 @@ int handshake_with_thread()
         return RESULT_ERROR;
     }
 
-    thread *request_thr = NULL;
-    int result = wait_and_execute_command(&errmsg, &request_thr);
-    if (result == RESULT_ERROR) {
-        udi_log("failed to handle command after thread create");
-        udi_abort();
+    int result = RESULT_SUCCESS;
+    if ( is_event_masked(UDI_EVENT_THREAD_CREATE) ) {
+        udi_log("not waiting for debugger after masked thread create");
+    }else{
+        thread *request_thr = NULL;
+        result = wait_and_execute_command(&errmsg, &request_thr);
+        if (result == RESULT_ERROR) {
+            udi_log("failed to handle command after thread create");
+            udi_abort();
+        }
+    }
+
+    // the other threads are already running in non-stop mode
+    if ( is_non_stop_mode() ) {
+        thread *thr = find_thread(tid);
+        if ( thr != NULL && write(thr->control_write, &sentinel, 1) != 1 ) {
+            udi_log("failed to write control trigger to pipe for %a: %e", tid, errno);
+            udi_abort();
+            return RESULT_ERROR;
+        }
     }
 
     release_other_threads();
@@ -490,7 +715,7 @@ int pthread_create(pthread_t *thread,
 
     int create_result = real_pthread_create(thread, attr, wrapped_start_routine, context);
     if (create_result == 0) {
-        int handshake_result = handshake_with_thread();
+        int handshake_result = handshake_with_thread((uint64_t)*thread);
         if (handshake_result != RESULT_SUCCESS) {
             return ENOMEM;
         }
@@ -510,7 +735,7 @@ int get_num_threads() {
 void destroy_thread(thread *thr) {
 
     thread *iter = threads;
-    thread *last_thread = threads;
+    thread *last_thread = NULL;
     while (iter != NULL) {
         if (iter == thr) break;
 
@@ -520,17 +745,26 @@ void destroy_thread(thread *thr) {
 
     if (iter == NULL) return;
 
-    if (iter == threads) {
-        threads = NULL;
+    if (last_thread == NULL) {
+        threads = iter->next_thread;
     }else{
         last_thread->next_thread = iter->next_thread;
     }
 
-    close(iter->control_write);
-    close(iter->control_read);
+    if (iter == threads_tail) {
+        threads_tail = last_thread;
+    }
+
+    remove_thread_entry(iter);
 
-    udi_free(iter->event_state.context_data);
-    udi_free(iter);
+#if defined(UDI_THREAD_LOCAL)
+    // a dying thread can destroy its own structure while handling the continue request
+    if (current_thread == iter) {
+        current_thread = NULL;
+    }
+#endif
+
+    free_thread_struct(iter);
     num_threads--;
 }
 
@@ -547,11 +781,11 @@ uint64_t get_thread_id(thread *thr) {
 }
 
 int is_thread_context_valid(thread *thr) {
-    return thr->event_state.context_valid;
+    return thr->event_state->context_valid;
 }
 
 void *get_thread_context(thread *thr) {
-    return &thr->event_state.context;
+    return &thr->event_state->context;
 }
 
 int is_single_step(thread *thr) {
@@ -570,20 +804,40 @@ void set_single_step_breakpoint(thread *thr, breakpoint *bp) {
     thr->single_step_bp = bp;
 }
 
+step_state *get_step_state(thread *thr) {
+    return &thr->step;
+}
+
+branch_trace *get_branch_trace(thread *thr) {
+    return &thr->branches;
+}
+
 thread *get_current_thread() {
-    uint64_t tid = get_user_thread_id();
+#if defined(UDI_THREAD_LOCAL)
+    if (current_thread != NULL) {
+        return current_thread;
+    }
+#endif
+
+    thread *thr = find_thread(get_user_thread_id());
 
-    thread *thr = threads;
-    while (thr != NULL) {
-        if (thr->id == tid) break;
-        thr = thr->next_thread;
+#if defined(UDI_THREAD_LOCAL)
+    if (thr != NULL && !thr->dead) {
+        current_thread = thr;
     }
+#endif
 
     return thr;
 }
 
 thread *create_initial_thread() {
-    return create_thread(get_user_thread_id());
+    thread *thr = create_thread(get_user_thread_id());
+    if (thr != NULL) {
+        // the initial thread is reported by the init handshake
+        thr->create_reported = 1;
+    }
+
+    return thr;
 }
 
 static pthread_mutex_t log_lock;
@@ -73,6 +73,7 @@ int signals[] = {
 struct app_sigaction {
     int signal;
     struct sigaction action;
+    udi_signal_policy_e policy;
 };
 
 static struct app_sigaction app_actions[NUM_SIGNALS];
@@ -216,6 +217,8 @@ pid_t fork() {
     pid_t child = real_fork();
     if ( child == 0 ) {
         reinit_udirt();
+    }else if ( is_event_masked(UDI_EVENT_PROCESS_FORK) ) {
+        udi_log("fork event for child %d masked", child);
     }else{
         uint64_t thread_id = get_user_thread_id();
 
@@ -376,19 +379,97 @@ int handle_event_breakpoint(breakpoint *bp, const void *in_context, udi_errmsg *
 
 
 /**
- * The entry point for passing a signal to a user signal handler
+ * @param signum the signal
  *
- * See manpage for SA_SIGINFO function.
+ * @return the application action for the signal, NULL if the library does not handle the signal
  */
-void app_signal_handler(int signum, siginfo_t *siginfo, void *v_context) {
+static
+struct app_sigaction *find_app_action(int signum) {
+    if (signum == 0) {
+        return NULL;
+    }
 
-    struct app_sigaction *app_action = NULL;
     for (int i = 0; i < NUM_SIGNALS; ++i) {
         if (app_actions[i].signal == signum) {
-            app_action = &app_actions[i];
+            return &app_actions[i];
         }
     }
 
+    return NULL;
+}
+
+/**
+ * @return non-zero if the signal is raised by the instruction that faulted, which executes again
+ * when the signal is not handled
+ */
+static
+int is_fault_signal(int signum) {
+    return signum == SIGSEGV || signum == SIGBUS || signum == SIGILL || signum == SIGFPE;
+}
+
+/**
+ * @return non-zero if the application performs the default action for the signal, which the
+ * library cannot emulate
+ */
+static
+int has_default_action(const struct app_sigaction *app_action) {
+    return (void *)app_action->action.sa_sigaction == (void *)SIG_DFL;
+}
+
+udi_signal_policy_e get_signal_policy(int signum) {
+    struct app_sigaction *app_action = find_app_action(signum);
+    if (app_action == NULL) {
+        return UDI_SIGNAL_POLICY_STOP;
+    }
+
+    // the application restored the default action after the signal was passed
+    if (app_action->policy == UDI_SIGNAL_POLICY_PASS && has_default_action(app_action)) {
+        return UDI_SIGNAL_POLICY_STOP;
+    }
+
+    return app_action->policy;
+}
+
+int set_signal_policy(uint32_t sig, udi_signal_policy_e policy, udi_errmsg *errmsg) {
+    struct app_sigaction *app_action = find_app_action((int)sig);
+    if (app_action == NULL) {
+        udi_set_errmsg(errmsg, "signal %d is not handled by the library", sig);
+        return RESULT_FAILURE;
+    }
+
+    // breakpoints and thread suspension rely on these signals stopping the process
+    if (policy != UDI_SIGNAL_POLICY_STOP &&
+        ((int)sig == SIGTRAP || (int)sig == THREAD_SUSPEND_SIGNAL))
+    {
+        udi_set_errmsg(errmsg, "signal %d is used by the library and must stop the process", sig);
+        return RESULT_FAILURE;
+    }
+
+    if (policy != UDI_SIGNAL_POLICY_STOP && is_fault_signal((int)sig)) {
+        udi_set_errmsg(errmsg, "fault signal %d must stop the process", sig);
+        return RESULT_FAILURE;
+    }
+
+    if (policy == UDI_SIGNAL_POLICY_PASS && has_default_action(app_action)) {
+        udi_set_errmsg(errmsg, "signal %d has no application handler to pass it to", sig);
+        return RESULT_FAILURE;
+    }
+
+    app_action->policy = policy;
+
+    udi_log("set policy for signal %d to %d", sig, policy);
+
+    return RESULT_SUCCESS;
+}
+
+/**
+ * The entry point for passing a signal to a user signal handler
+ *
+ * See manpage for SA_SIGINFO function.
+ */
+void app_signal_handler(int signum, siginfo_t *siginfo, void *v_context) {
+
+    struct app_sigaction *app_action = find_app_action(signum);
     if (app_action == NULL) {
         udi_log("Signal %d does not have an app action", signum);
         return;
@@ -399,18 +480,18 @@ void app_signal_handler(int signum, siginfo_t *siginfo, void *v_context) {
         return;
     }
 
-    if ( (void *)app_actions->action.sa_sigaction == (void *)SIG_DFL ) {
+    if ( has_default_action(app_action) ) {
         // TODO need to emulate the default action
         return;
     }
 
     sigset_t cur_set;
-    if ( setsigmask(SIG_SETMASK, &app_actions->action.sa_mask, &cur_set) != 0 )
+    if ( setsigmask(SIG_SETMASK, &app_action->action.sa_mask, &cur_set) != 0 )
     {
         udi_log("failed to adjust blocked signals for application handler: %e", errno);
     }
 
-    app_actions->action.sa_sigaction(signum, siginfo, v_context);
+    app_action->action.sa_sigaction(signum, siginfo, v_context);
 
     if ( setsigmask(SIG_SETMASK, &cur_set, NULL) != 0 ) {
         udi_log("failed to reset blocked signals after application handler: %e", errno);
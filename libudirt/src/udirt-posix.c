@@ -24,6 +24,7 @@
 #include <sys/mman.h>
 #include <sys/select.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include "udi.h"
 #include "udirt.h"
@@ -62,12 +63,49 @@ int pipe_write_failure = 0;
 
 // Continue handling
 static int pass_signal = 0;
+static int batch_signal_passed = 0;
+
+// Non-stop mode
+typedef struct udi_pipe_struct {
+    int read_handle;
+    int write_handle;
+} udi_pipe;
+
+static int non_stop = 0;
+static int requested_non_stop = 0;
+
+// holds a single token, taken by the thread that is handling an event or serving requests
+static udi_pipe event_lock = { -1, -1 };
+static uint64_t event_lock_owner = 0;
+
+// the stopped thread that serves the requests of the debugger
+static thread *server_thread = NULL;
+
+// written when a thread stops to make the server wait for the requests of new threads
+static udi_pipe server_wake = { -1, -1 };
 
 // Used to force threads into the library signal handler
 extern int pthread_kill(pthread_t, int) __attribute__((weak));
 
 // unexported prototypes
 static int remove_udi_filesystem();
+static thread *find_pending_event_thread(thread *thr);
+static int transfer_control(thread *thr, thread *target);
+static int holds_event_lock();
+static void acquire_event_lock();
+static void release_event_lock();
+static void drain_server_wake();
+static void apply_stop_mode();
+static int any_thread_stopped();
+static int stop_thread(udi_errmsg *errmsg, thread **thr);
+static int finish_step_in_place(thread *thr, int signal, ucontext_t *context);
+static int skip_foreign_breakpoint(thread *thr,
+                                   int signal,
+                                   const siginfo_t *siginfo,
+                                   ucontext_t *context);
+static void leave_displaced_pad(thread *thr, ucontext_t *context);
+static void resume_thread(thread *thr, int signal, siginfo_t *siginfo, ucontext_t *context);
+static int handle_resume_signal(thread *thr, int signal, siginfo_t *siginfo, ucontext_t *context);
 
 /**
  * Disables this library
@@ -84,7 +122,7 @@ static void disable_debugging() {
 }
 
 int single_thread_executing() {
-    return (is_performing_mem_access() || continue_bp != NULL);
+    return (is_performing_mem_access() || continue_pending());
 }
 
 /**
@@ -123,12 +161,39 @@ const char *get_mem_errstr() {
 }
 
 void post_continue_hook(uint32_t sig_val) {
-    if (!exiting) {
-        pass_signal = sig_val;
-        kill(getpid(), sig_val);
-
-        udi_log("continuing with signal %d", sig_val);
+    if ( holds_event_lock() ) {
+        // only the stopped threads are continued, the other threads are already running. The
+        // signal is delivered to the thread that handled the request.
+        thread *iter = get_thread_list();
+        while (iter != NULL) {
+            if ( is_thread_stopped(iter) && iter->ts == UDI_TS_RUNNING ) {
+                continue_thread(iter, (iter == get_current_thread() && !exiting) ? sig_val : 0);
+            }
+            iter = iter->next_thread;
+        }
     }else{
+        // the threads whose events were reported in a batch by another thread each take the
+        // signal they stopped with if the process continues with it
+        batch_signal_passed = 0;
+        thread *iter = get_thread_list();
+        while (iter != NULL) {
+            if ( !exiting && iter->batch_signal != 0 && (uint32_t)iter->batch_signal == sig_val ) {
+                batch_signal_passed = 1;
+            }else{
+                iter->batch_signal = 0;
+            }
+            iter = iter->next_thread;
+        }
+
+        if (!exiting) {
+            // the signal is delivered once the thread handling the event leaves the library
+            pass_signal = sig_val;
+
+            udi_log("continuing with signal %d", sig_val);
+        }
+    }
+
+    if (exiting) {
         int remove_result = remove_udi_filesystem();
         if (remove_result != 0) {
             if (remove_result > 0) {
@@ -203,7 +268,8 @@ int post_mem_access_hook(void *hook_arg) {
 }
 
 /**
- * Blocks for a request from all possible request handles
+ * Blocks for a request from all possible request handles. In non-stop mode, the event lock is
+ * released while waiting so other threads can report events.
  *
  * @param thr the output parameter for the thread -- set to NULL if request is for process
  *
@@ -211,48 +277,71 @@ int post_mem_access_hook(void *hook_arg) {
  */
 static
 int block_for_request(thread **thr) {
-    int max_fd = request_handle;
+    int non_stop_server = holds_event_lock();
 
-    fd_set read_set;
-    FD_ZERO(&read_set);
-    FD_SET(request_handle, &read_set);
+    do {
+        int max_fd = request_handle;
 
-    thread *iter = get_thread_list();
-    while (iter != NULL) {
-        if (!iter->dead) {
-            FD_SET(iter->request_handle, &read_set);
-            if ( iter->request_handle > max_fd ) {
-                max_fd = iter->request_handle;
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(request_handle, &read_set);
+
+        // the set is rebuilt once a thread stops, as the thread could be new
+        if ( non_stop_server ) {
+            FD_SET(server_wake.read_handle, &read_set);
+            if ( server_wake.read_handle > max_fd ) {
+                max_fd = server_wake.read_handle;
             }
         }
-        iter = iter->next_thread;
-    }
 
-    do {
-        fd_set changed_set = read_set;
-        int result = select(max_fd + 1, &changed_set, NULL, NULL, NULL);
+        thread *iter = get_thread_list();
+        while (iter != NULL) {
+            if (!iter->dead && iter->request_handle != -1) {
+                FD_SET(iter->request_handle, &read_set);
+                if ( iter->request_handle > max_fd ) {
+                    max_fd = iter->request_handle;
+                }
+            }
+            iter = iter->next_thread;
+        }
+
+        if ( non_stop_server ) {
+            release_event_lock();
+        }
+
+        int result = select(max_fd + 1, &read_set, NULL, NULL, NULL);
+        int select_errno = errno;
+
+        if ( non_stop_server ) {
+            acquire_event_lock();
+        }
 
         if ( result == -1 ) {
-            if ( errno == EINTR ) {
+            if ( select_errno == EINTR ) {
                 udi_log("select call interrupted, trying again");
                 continue;
             }
-            udi_log("failed to wait for request: %e", errno);
+            udi_log("failed to wait for request: %e", select_errno);
         }else if ( result == 0 ) {
             udi_log("select unexpectedly returned 0");
         }else{
-            if ( FD_ISSET(request_handle, &changed_set) ) {
+            if ( FD_ISSET(request_handle, &read_set) ) {
                 *thr = NULL;
                 return RESULT_SUCCESS;
             }
             iter = get_thread_list();
             while (iter != NULL) {
-                if ( FD_ISSET(iter->request_handle, &changed_set) ) {
+                if ( !iter->dead && iter->request_handle != -1 &&
+                     FD_ISSET(iter->request_handle, &read_set) ) {
                     *thr = iter;
                     return RESULT_SUCCESS;
                 }
                 iter = iter->next_thread;
             }
+            if ( non_stop_server && FD_ISSET(server_wake.read_handle, &read_set) ) {
+                drain_server_wake();
+                continue;
+            }
         }
         break;
     }while(1);
@@ -260,8 +349,159 @@ int block_for_request(thread **thr) {
     return RESULT_ERROR;
 }
 
+// Deferred thread event handling
+static int writing_deferred_events = 0;
+
+static
+int is_create_deferred(thread *thr) {
+    return !thr->dead && !thr->create_reported;
+}
+
+static
+int is_death_deferred(thread *thr) {
+    return thr->dead && thr->create_reported && !thr->death_reported;
+}
+
+int has_deferred_thread_events() {
+    if ( writing_deferred_events ) {
+        return 0;
+    }
+
+    thread *iter = get_thread_list();
+    while (iter != NULL) {
+        if ( is_create_deferred(iter) || is_death_deferred(iter) ) {
+            return 1;
+        }
+        iter = iter->next_thread;
+    }
+
+    return 0;
+}
+
+/**
+ * Determines the thread to report as the creator of a thread whose create event was deferred.
+ * The creator may have exited since it created the thread.
+ *
+ * @param thr the created thread
+ *
+ * @return the thread id
+ */
+static
+uint64_t get_reported_creator(thread *thr) {
+    thread *first_reported = NULL;
+
+    thread *iter = get_thread_list();
+    while (iter != NULL) {
+        if ( !iter->dead && iter->create_reported ) {
+            if ( iter->id == thr->creator_id ) {
+                return iter->id;
+            }
+
+            if ( first_reported == NULL ) {
+                first_reported = iter;
+            }
+        }
+        iter = iter->next_thread;
+    }
+
+    return first_reported != NULL ? first_reported->id : thr->creator_id;
+}
+
+int write_deferred_thread_events(udi_errmsg *errmsg) {
+    int result = RESULT_SUCCESS;
+
+    writing_deferred_events = 1;
+
+    thread *iter = get_thread_list();
+    while (iter != NULL && result == RESULT_SUCCESS) {
+        if ( is_create_deferred(iter) ) {
+            uint64_t creator_id = get_reported_creator(iter);
+
+            // the handshake is performed once the event has been written
+            iter->create_reported = 1;
+            iter->handshake_pending = 1;
+            result = handle_thread_create_event(creator_id, iter->id, errmsg);
+        }else if ( is_death_deferred(iter) ) {
+            iter->death_reported = 1;
+            result = handle_thread_death_event(iter->id, errmsg);
+        }
+        iter = iter->next_thread;
+    }
+
+    writing_deferred_events = 0;
+
+    return result;
+}
+
+/**
+ * Completes the handshake for the threads whose create events were deferred, in the same order
+ * as their events were reported
+ *
+ * @param errmsg the error message populated on error
+ *
+ * @return the result
+ */
+static
+int handshake_with_deferred_threads(udi_errmsg *errmsg) {
+    thread *iter = get_thread_list();
+    while (iter != NULL) {
+        if ( iter->handshake_pending ) {
+            iter->handshake_pending = 0;
+
+            int result = thread_create_handshake(iter, errmsg);
+            if ( result != RESULT_SUCCESS ) {
+                return result;
+            }
+        }
+        iter = iter->next_thread;
+    }
+
+    return RESULT_SUCCESS;
+}
+
+/**
+ * Executes the request received for the process or the specified thread
+ *
+ * @param thr the thread the request is for, NULL for a process request
+ * @param type populated with the type of the request
+ * @param errmsg the error message populated on error
+ *
+ * @return request handler return code
+ */
+static
+int execute_request(thread *thr, udi_request_type_e *type, udi_errmsg *errmsg) {
+    if ( thr == NULL ) {
+        udi_log("received process request");
+        return handle_process_request(request_handle,
+                                      response_handle,
+                                      type,
+                                      errmsg);
+    }
+
+    udi_log("received request for thread %a", thr->id);
+    return handle_thread_request(thr->request_handle,
+                                 thr->response_handle,
+                                 thr,
+                                 type,
+                                 errmsg);
+}
+
 int wait_and_execute_command(udi_errmsg *errmsg, thread **thr) {
-    int result = 0;
+    int result = flush_event_batch(get_user_thread_id(), errmsg);
+    if ( result != RESULT_SUCCESS ) {
+        udi_log("failed to report event batch: %s", errmsg->msg);
+        return RESULT_ERROR;
+    }
+
+    result = handshake_with_deferred_threads(errmsg);
+    if ( result != RESULT_SUCCESS ) {
+        udi_log("failed to complete handshake with threads: %s", errmsg->msg);
+        return RESULT_ERROR;
+    }
+
+    if ( holds_event_lock() ) {
+        return stop_thread(errmsg, thr);
+    }
 
     int more_reqs = 1;
     while(more_reqs) {
@@ -275,20 +515,7 @@ int wait_and_execute_command(udi_errmsg *errmsg, thread **thr) {
         }
 
         udi_request_type_e type = UDI_REQ_INVALID;
-        if ( *thr == NULL ) {
-            udi_log("received process request");
-            result = handle_process_request(request_handle,
-                                            response_handle,
-                                            &type,
-                                            errmsg);
-        }else{
-            udi_log("received request for thread %a", (*thr)->id);
-            result = handle_thread_request((*thr)->request_handle,
-                                           (*thr)->response_handle,
-                                           *thr,
-                                           &type,
-                                           errmsg);
-        }
+        result = execute_request(*thr, &type, errmsg);
 
         if ( result != RESULT_SUCCESS ) {
             if ( result == RESULT_FAILURE ) {
@@ -300,7 +527,8 @@ int wait_and_execute_command(udi_errmsg *errmsg, thread **thr) {
             more_reqs = 1;
         }
 
-        if ( type == UDI_REQ_CONTINUE ) {
+        // a continue request for a thread is only valid in non-stop mode
+        if ( *thr == NULL && type == UDI_REQ_CONTINUE ) {
             more_reqs = 0;
         }
     }
@@ -351,6 +579,8 @@ static int decode_memory_access_event(int sig,
                                errno);
                 udi_log("%s", errmsg->msg);
             } else {
+                // the protections reported by the cached memory map are now stale
+                invalidate_memory_map();
                 result = RESULT_SUCCESS;
             }
         }else{
@@ -382,6 +612,60 @@ static int decode_memory_access_event(int sig,
     return result;
 }
 
+/**
+ * @return non-zero if the trap occurred because the trap flag was set, instead of at a breakpoint
+ */
+static
+int is_trace_trap(int signal, const siginfo_t *siginfo) {
+    return signal == SIGTRAP && siginfo->si_code == TRAP_TRACE;
+}
+
+/**
+ * Clears the trap flag the current thread entered the handler with for its single step, so the
+ * debugger never observes it. A thread interrupted before it completed the step sets the flag again
+ * when it resumes
+ *
+ * @param thr the current thread
+ * @param signal the signal the thread entered the handler with
+ * @param siginfo the siginfo passed to the signal handler
+ * @param context the context of the current thread
+ */
+static
+void disarm_step_trace(thread *thr, int signal, const siginfo_t *siginfo, ucontext_t *context) {
+    if ( thr == NULL || is_performing_mem_access() ) return;
+
+    step_state *step = get_step_state(thr);
+    if ( step->trace != STEP_TRACE_ACTIVE ) return;
+
+    set_trace_flag(context, 0);
+    if ( !is_trace_trap(signal, siginfo) ) {
+        step->trace = STEP_TRACE_PENDING;
+    }
+}
+
+/**
+ * Sets the trap flag in the context the thread resumes with, when its next single step traps with
+ * the trap flag
+ *
+ * @param thr the current thread
+ * @param context the context of the current thread
+ */
+static
+void arm_step_trace(thread *thr, ucontext_t *context) {
+    if ( thr == NULL || is_performing_mem_access() ) return;
+
+    step_state *step = get_step_state(thr);
+    if ( step->trace != STEP_TRACE_PENDING ) return;
+
+    if ( !thr->single_step ) {
+        step->trace = STEP_TRACE_NONE;
+        return;
+    }
+
+    set_trace_flag(context, 1);
+    step->trace = STEP_TRACE_ACTIVE;
+}
+
 /**
  * Decodes the trap
  *
@@ -402,6 +686,16 @@ int decode_trap(thread *thr,
     // Check and see if it corresponds to a breakpoint
     breakpoint *bp = find_breakpoint(trap_address);
 
+    // in non-stop mode, the breakpoint can be removed while the thread waits to handle it
+    if ( is_non_stop_mode() && (bp == NULL || !bp->in_memory) &&
+         !is_breakpoint_instruction_at(trap_address) )
+    {
+        udi_log("breakpoint at %a removed before it was handled", trap_address);
+        set_pc(context, trap_address);
+        *wait_for_request = 0;
+        return RESULT_SUCCESS;
+    }
+
     int result;
     if ( bp != NULL ) {
         udi_log("breakpoint hit at %a", trap_address);
@@ -440,12 +734,17 @@ void signal_entry_impl(int signal, siginfo_t *siginfo, void *v_context) {
         return;
     }
 
-    if ( pass_signal != 0 ) {
+    if ( pass_signal != 0 && pass_signal == signal ) {
         app_signal_handler(signal, siginfo, v_context);
         pass_signal = 0;
         return;
     }
 
+    thread *thr = get_current_thread();
+    if ( handle_resume_signal(thr, signal, siginfo, context) ) {
+        return;
+    }
+
     if (!udi_enabled && !is_performing_mem_access()) {
         udi_log("UDI disabled, not handling signal %d at addr %a",
                 signal,
@@ -453,6 +752,20 @@ void signal_entry_impl(int signal, siginfo_t *siginfo, void *v_context) {
         return;
     }
 
+    // signals the debugger is not interested in are handled without stopping the process
+    if ( !is_performing_mem_access() ) {
+        udi_signal_policy_e policy = get_signal_policy(signal);
+        if ( policy == UDI_SIGNAL_POLICY_PASS ) {
+            app_signal_handler(signal, siginfo, v_context);
+            return;
+        }
+
+        if ( policy == UDI_SIGNAL_POLICY_IGNORE ) {
+            udi_log("ignoring signal %d at addr %a", signal, (uint64_t)siginfo->si_addr);
+            return;
+        }
+    }
+
     udi_log(">>> signal entry for %a/%a with %d at %a",
                get_user_thread_id(),
                get_kernel_thread_id(),
@@ -463,8 +776,6 @@ void signal_entry_impl(int signal, siginfo_t *siginfo, void *v_context) {
         udi_log("memory access at %a in progress", (uint64_t)get_mem_access_addr());
     }
 
-    thread *thr = get_current_thread();
-
     if ( signal == THREAD_SUSPEND_SIGNAL && (thr == NULL || thr->suspend_pending == 1) ) {
         udi_log("ignoring extraneous suspend signal for %a/%a",
                 get_user_thread_id(),
@@ -474,13 +785,29 @@ void signal_entry_impl(int signal, siginfo_t *siginfo, void *v_context) {
         return;
     }
 
+    disarm_step_trace(thr, signal, siginfo, context);
+
+    if ( skip_foreign_breakpoint(thr, signal, siginfo, context) ) {
+        arm_step_trace(thr, context);
+
+        udi_log("<<< signal exit for %a/%a with %d at %a",
+                get_user_thread_id(),
+                get_kernel_thread_id(),
+                signal,
+                get_pc(context));
+        return;
+    }
+
+    leave_displaced_pad(thr, context);
+
+    int stepped_in_place = 0;
     if ( !single_thread_executing() ) {
         // save this signal event state to allow another thread to pass control to this
         // thread later on
-        thr->event_state.signal = signal;
-        thr->event_state.siginfo = *siginfo;
-        copy_context(context, &(thr->event_state));
-        thr->event_state.context_valid = 1;
+        thr->event_state->signal = signal;
+        thr->event_state->siginfo = *siginfo;
+        copy_context(context, thr->event_state);
+        thr->event_state->context_valid = 1;
 
         int block_result = block_other_threads();
         if ( block_result == -1 ) {
@@ -490,16 +817,24 @@ void signal_entry_impl(int signal, siginfo_t *siginfo, void *v_context) {
         }
 
         if ( block_result > 0 ) {
-            thr->event_state.context_valid = 0;
+            thr->event_state->context_valid = 0;
+            arm_step_trace(thr, context);
 
             udi_log("<<< waiting thread %a exiting signal handler",
                     get_user_thread_id());
             return;
         }
-    }else if (continue_bp != NULL) {
+
+        if ( finish_step_in_place(thr, signal, context) ) {
+            stepped_in_place = 1;
+        }else if ( !holds_event_lock() && find_pending_event_thread(thr) != NULL ) {
+            // report the events of the other threads stopped with this thread together
+            begin_event_batch();
+        }
+    }else if (continue_pending()) {
         if (thr != NULL ) {
-            copy_context(context, &(thr->event_state));
-            thr->event_state.context_valid = 1;
+            copy_context(context, thr->event_state);
+            thr->event_state->context_valid = 1;
         }
     }
 
@@ -508,15 +843,23 @@ void signal_entry_impl(int signal, siginfo_t *siginfo, void *v_context) {
             get_kernel_thread_id(),
             signal);
     if ( thr != NULL ) {
-        thr->event_state.signal = 0;
+        thr->event_state->signal = 0;
     }
 
     // handle the event
     int wait_for_request = 1;
     int request_error = 0;
+    int batched = 0;
     thread *request_thr = NULL;
     int result;
     do {
+        if ( stepped_in_place ) {
+            // the thread stepped over a breakpoint and continues without an event
+            wait_for_request = 0;
+            result = RESULT_SUCCESS;
+            break;
+        }
+
         switch(signal) {
             case SIGBUS:
             case SIGSEGV:
@@ -527,42 +870,37 @@ void signal_entry_impl(int signal, siginfo_t *siginfo, void *v_context) {
                                                     &errmsg);
                 break;
             case SIGTRAP:
-                result = decode_trap(thr, siginfo, context, &wait_for_request, &errmsg);
+                if ( is_trace_trap(signal, siginfo) && thr != NULL &&
+                     get_step_state(thr)->trace == STEP_TRACE_ACTIVE )
+                {
+                    result = decode_trace_trap(thr, context, &wait_for_request, &errmsg);
+                }else if ( is_trace_trap(signal, siginfo) ) {
+                    // the application set the trap flag itself
+                    result = handle_signal_event(get_user_thread_id(),
+                                                 get_pc(context),
+                                                 signal,
+                                                 &errmsg);
+                }else{
+                    result = decode_trap(thr, siginfo, context, &wait_for_request, &errmsg);
+                }
                 break;
             default:
-                result = handle_unknown_event(get_user_thread_id(), &errmsg);
+                result = handle_signal_event(get_user_thread_id(),
+                                             get_pc(context),
+                                             signal,
+                                             &errmsg);
                 break;
         }
 
+        // reporting any other event ends stepping through a range
+        if ( thr != NULL && wait_for_request ) {
+            end_step_range(thr);
+        }
+
         if ( thr != NULL && thr->single_step ) {
-            uint64_t pc = get_pc(context);
-            uint64_t successor = get_ctf_successor(pc, &errmsg, context);
-            if (successor == 0) {
-                udi_log("failed to determine successor for instruction at %a",
-                        pc);
+            if ( install_step_breakpoint(thr, context, &errmsg) != 0 ) {
+                udi_log("failed to install single step breakpoint: %s", errmsg.msg);
                 result = RESULT_ERROR;
-            }else{
-                breakpoint *existing_bp = find_breakpoint(successor);
-
-                // If it is a continue breakpoint, it will be used as a single step breakpoint. If it
-                // is an event breakpoint or user breakpoint, no single step event will be
-                // generated
-                if ( existing_bp == NULL ) {
-                    thr->single_step_bp = create_breakpoint(successor);
-                    if (thr->single_step_bp == NULL) {
-                        udi_log("failed to create single step breakpoint at %a",
-                                successor);
-                        result = RESULT_ERROR;
-                    }else{
-                        thr->single_step_bp->thread = thr;
-                        int install_result = install_breakpoint(thr->single_step_bp, &errmsg);
-                        if (install_result != 0) {
-                            udi_log("failed to install single step breakpoint at %a",
-                                    successor);
-                            result = RESULT_ERROR;
-                        }
-                    }
-                }
             }
         }
 
@@ -578,6 +916,28 @@ void signal_entry_impl(int signal, siginfo_t *siginfo, void *v_context) {
             }
         }
 
+        // hand control to the next thread with a pending event to add its event to the batch,
+        // the last thread to add its event reports the batch and waits for the debugger
+        if ( is_event_batch_active() ) {
+            thread *pending_thr = find_pending_event_thread(thr);
+            if ( pending_thr != NULL ) {
+                wait_for_request = 0;
+                batched = 1;
+                if ( thr != NULL ) {
+                    thr->batch_signal = signal;
+                }
+
+                if ( transfer_control(thr, pending_thr) != 0 ) {
+                    udi_log("failed to transfer control to thread %a", pending_thr->id);
+                    udi_abort();
+                }
+            }else if ( get_event_batch_size() > 0 ) {
+                wait_for_request = 1;
+            }else{
+                result = flush_event_batch(get_user_thread_id(), &errmsg);
+            }
+        }
+
         // wait for command
         if ( wait_for_request ) {
             result = wait_and_execute_command(&errmsg, &request_thr);
@@ -596,13 +956,38 @@ void signal_entry_impl(int signal, siginfo_t *siginfo, void *v_context) {
             udi_log("Aborting due to request failure: %s", errmsg.msg);
             udi_abort();
         }
-    }else{
+    }else if ( !batched ) {
         // Cleanup before returning to user code
-        if ( !single_thread_executing() ) {
-            release_other_threads();
+        if ( !is_performing_mem_access() ) {
+            if ( holds_event_lock() ) {
+                resume_thread(thr, signal, siginfo, context);
+            }else{
+                release_other_threads();
+
+                // the signal this thread stopped with is passed to the application directly,
+                // any other signal is raised so it is delivered with the process running, unless
+                // a thread in the batch stopped with it
+                if ( pass_signal == signal ) {
+                    pass_signal = 0;
+                    app_signal_handler(signal, siginfo, v_context);
+                }else if ( pass_signal != 0 && batch_signal_passed ) {
+                    pass_signal = 0;
+                }else if ( pass_signal != 0 ) {
+                    kill(getpid(), pass_signal);
+                }
+            }
+        }
+    }else if ( thr != NULL && thr->batch_signal != 0 ) {
+        // the thread was released by the thread that reported the batch, and the process
+        // continued with the signal this thread stopped with
+        thr->batch_signal = 0;
+        if ( !is_performing_mem_access() ) {
+            app_signal_handler(signal, siginfo, v_context);
         }
     }
 
+    arm_step_trace(thr, context);
+
     udi_log("<<< signal exit for %a/%a with %d at %a",
             get_user_thread_id(),
             get_kernel_thread_id(),
@@ -610,7 +995,7 @@ void signal_entry_impl(int signal, siginfo_t *siginfo, void *v_context) {
             get_pc(context));
 
     if (thr != NULL) {
-        thr->event_state.context_valid = 0;
+        thr->event_state->context_valid = 0;
     }
 }
 
@@ -753,10 +1138,22 @@ static int create_udi_filesystem() {
     return errnum;
 }
 
-udi_barrier thread_barrier = { 0, -1, -1 };
+udi_barrier thread_barrier = { 0, -1, -1, 0, 0, 0, 0 };
+
+static udi_stop_stats stop_stats;
+static uint64_t last_arrival_ns = 0;
+
+static
+void reset_barrier_counters() {
+    thread_barrier.num_signaled = 0;
+    thread_barrier.signaling_complete = 0;
+    thread_barrier.num_arrived = 0;
+    thread_barrier.control_woken = 0;
+}
 
 int initialize_thread_sync() {
     thread_barrier.sync_var = 0;
+    reset_barrier_counters();
 
     if ( get_multithread_capable() ) {
         int control_pipe[2];
@@ -767,6 +1164,34 @@ int initialize_thread_sync() {
 
         thread_barrier.read_handle = control_pipe[0];
         thread_barrier.write_handle = control_pipe[1];
+
+        int lock_pipe[2];
+        if ( pipe(lock_pipe) != 0 ) {
+            udi_log("failed to create sync pipe for event lock: %e", errno);
+            return -1;
+        }
+
+        event_lock.read_handle = lock_pipe[0];
+        event_lock.write_handle = lock_pipe[1];
+        if ( write(event_lock.write_handle, &sentinel, 1) != 1 ) {
+            udi_log("failed to initialize event lock: %e", errno);
+            return -1;
+        }
+
+        int wake_pipe[2];
+        if ( pipe(wake_pipe) != 0 ) {
+            udi_log("failed to create sync pipe for server wake up: %e", errno);
+            return -1;
+        }
+
+        server_wake.read_handle = wake_pipe[0];
+        server_wake.write_handle = wake_pipe[1];
+        if ( fcntl(server_wake.read_handle, F_SETFL, O_NONBLOCK) != 0 ||
+             fcntl(server_wake.write_handle, F_SETFL, O_NONBLOCK) != 0 )
+        {
+            udi_log("failed to configure sync pipe for server wake up: %e", errno);
+            return -1;
+        }
     }else{
         thread_barrier.read_handle = -1;
         thread_barrier.write_handle = -1;
@@ -802,9 +1227,63 @@ void read_sentinel(int fd) {
     }
 }
 
+static
+uint64_t get_monotonic_ns() {
+    struct timespec ts;
+    if ( clock_gettime(CLOCK_MONOTONIC, &ts) != 0 ) {
+        return 0;
+    }
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void get_stop_stats(udi_stop_stats *stats) {
+    *stats = stop_stats;
+}
+
+/**
+ * Wakes the control thread if all the threads it signaled have reached the barrier. Only one
+ * thread, possibly the control thread itself, observes the last arrival.
+ *
+ * @return non-zero if the calling thread observed the last arrival
+ */
+static
+int complete_barrier_arrival() {
+    // the count is published before the flag, so it is current once the flag is seen
+    if ( !__atomic_load_n(&(thread_barrier.signaling_complete), __ATOMIC_ACQUIRE) ||
+         __atomic_load_n(&(thread_barrier.num_arrived), __ATOMIC_ACQUIRE) <
+         __atomic_load_n(&(thread_barrier.num_signaled), __ATOMIC_ACQUIRE) )
+    {
+        return 0;
+    }
+
+    if ( __sync_val_compare_and_swap(&(thread_barrier.control_woken), 0, 1) != 0 ) {
+        return 0;
+    }
+
+    last_arrival_ns = get_monotonic_ns();
+    return 1;
+}
+
 int block_other_threads() {
     int result = 0;
 
+    // in non-stop mode, only the thread handling the event stops
+    if ( is_non_stop_mode() ) {
+        if ( get_current_thread() == NULL ) {
+            udi_log("found unknown thread %a", get_user_thread_id());
+            return -1;
+        }
+
+        acquire_event_lock();
+        if ( is_non_stop_mode() ) {
+            return 0;
+        }
+
+        // the process switched to all-stop mode while this thread waited for the lock
+        release_event_lock();
+    }
+
     if (get_multithreaded()) {
         thread *thr = get_current_thread();
         if ( thr == NULL ) {
@@ -814,61 +1293,90 @@ int block_other_threads() {
 
         // Determine whether this is the first thread or not
         unsigned int sync_var = __sync_val_compare_and_swap(&(thread_barrier.sync_var), 0, 1);
+        if (sync_var == 0 && is_non_stop_mode()) {
+            // the process switched to non-stop mode when the last stop released the threads
+            __sync_val_compare_and_swap(&(thread_barrier.sync_var), 1, 0);
+            return block_other_threads();
+        }
+
         if (sync_var == 0) {
             thr->control_thread = 1;
             udi_log("thread %a is the control thread", thr->id);
 
-            int num_suspended = 0;
+            uint64_t start_ns = get_monotonic_ns();
+
+            // the signals are sent without any logging in between so the threads are stopped as
+            // close together as possible, and the threads that already stopped keep running their
+            // handlers while the rest are signaled
+            unsigned int num_suspended = 0;
             thread *iter = get_thread_list();
             while (iter != NULL) {
                 if ( iter != thr ) {
                     iter->control_thread = 0;
 
                     // only force running threads into the signal handler, suspended threads are
-                    // already in the signal handler
-                    if (iter->ts != UDI_TS_SUSPENDED) {
+                    // already in the signal handler and dead threads have exited
+                    if (iter->ts != UDI_TS_SUSPENDED && !iter->dead) {
                         int kill_result = pthread_kill((pthread_t)iter->id, THREAD_SUSPEND_SIGNAL);
                         if ( kill_result != 0 ) {
                             udi_log("failed to send signal to %a: %e", iter->id, kill_result);
                             udi_abort();
                             return -1;
                         }
-                        udi_log("thread %a sent suspend signal %d to thread %a",
-                                thr->id,
-                                THREAD_SUSPEND_SIGNAL,
-                                iter->id);
                         num_suspended++;
-                    }else{
-                        udi_log("thread %a already suspended, not signaling",
-                                iter->id);
                     }
                 }
                 iter = iter->next_thread;
             }
 
+            uint64_t fanout_ns = get_monotonic_ns();
+
+            // arriving threads rely on the count once they see the flag, so it is stored first
+            __atomic_store_n(&(thread_barrier.num_signaled), num_suspended, __ATOMIC_RELEASE);
+            __atomic_store_n(&(thread_barrier.signaling_complete), 1, __ATOMIC_RELEASE);
             __sync_synchronize(); // global state updated, issue full memory barrier
 
-            // wait for the other threads to reach this function
-            int i;
-            for (i = 0; i < num_suspended; ++i) {
-                read_sentinel(thread_barrier.read_handle);
+            udi_log("thread %a sent suspend signal %d to %d threads",
+                    thr->id,
+                    THREAD_SUSPEND_SIGNAL,
+                    num_suspended);
+
+            // wait for the other threads to reach this function, unless they all already did
+            if ( !complete_barrier_arrival() ) {
+                read_sentinel(thread_barrier.read_handle);
             }
+
+            uint64_t end_ns = get_monotonic_ns();
+
+            stop_stats.stops++;
+            stop_stats.threads = num_suspended;
+            stop_stats.fanout_ns = fanout_ns - start_ns;
+            stop_stats.arrival_ns = last_arrival_ns - start_ns;
+            stop_stats.total_ns = end_ns - start_ns;
+            if ( stop_stats.total_ns > stop_stats.max_total_ns ) {
+                stop_stats.max_total_ns = stop_stats.total_ns;
+            }
+
             udi_log("thread %a blocked other threads", thr->id);
         }else{
-            // signal that thread is now waiting to be released
-            if ( write(thread_barrier.write_handle, &sentinel, 1) != 1 ) {
-                udi_log("failed to write trigger to pipe: %a", errno);
-                udi_abort();
-                return -1;
+            // signal that thread is now waiting to be released, the last thread to arrive wakes
+            // the control thread
+            __sync_add_and_fetch(&(thread_barrier.num_arrived), 1);
+            if ( complete_barrier_arrival() ) {
+                if ( write(thread_barrier.write_handle, &sentinel, 1) != 1 ) {
+                    udi_log("failed to write trigger to pipe: %a", errno);
+                    udi_abort();
+                    return -1;
+                }
             }
 
             udi_log("thread %a waiting to be released (pending signal = %d)",
                     thr->id,
-                    thr->event_state.signal);
+                    thr->event_state->signal);
 
             // Indicate that another suspend signal is pending if the reason for the thread
             // to enter the handler was not triggered by the library
-            if ( thr->event_state.signal != THREAD_SUSPEND_SIGNAL ) {
+            if ( thr->event_state->signal != THREAD_SUSPEND_SIGNAL ) {
                 thr->suspend_pending = 1;
                 udi_log("thread %a has a suspend signal pending", thr->id);
             }else{
@@ -885,91 +1393,690 @@ int block_other_threads() {
     return result;
 }
 
+/**
+ * Finds another thread with an event that has not been reported yet
+ *
+ * @param thr the current thread, can be NULL
+ *
+ * @return the thread or NULL if there are no pending events
+ */
+static
+thread *find_pending_event_thread(thread *thr) {
+    thread *iter = get_thread_list();
+    while (iter != NULL) {
+        // XXX: there is a known race here where a thread is sent a THREAD_SUSPEND_SIGNAL by
+        // another source external to the library but at the same time, the library sends the same
+        // signal to the thread. The result is that there is no way to handle the externally
+        // sourced signal.
+        if ( iter != thr &&
+             ( (iter->event_state->signal != THREAD_SUSPEND_SIGNAL &&
+                iter->event_state->signal != 0) ||
+               iter->stack_event_pending) )
+        {
+            return iter;
+        }
+        iter = iter->next_thread;
+    }
+
+    return NULL;
+}
+
+/**
+ * Makes the target thread the control thread and blocks the current thread until it is released
+ *
+ * @param thr the current thread, can be NULL
+ * @param target the new control thread
+ *
+ * @return 0 on success
+ * @return non-zero on failure
+ */
+static
+int transfer_control(thread *thr, thread *target) {
+    if ( thr != NULL ) {
+        __sync_val_compare_and_swap(&(thr->control_thread), 1, 0);
+    }
+
+    __sync_val_compare_and_swap(&(target->control_thread), 0, 1);
+
+    if ( write(target->control_write, &sentinel, 1) != 1 ) {
+        udi_log("failed to write control trigger to pipe for %a: %e",
+                target->id,
+                errno);
+        udi_abort();
+        return -1;
+    }
+
+    if ( thr != NULL ) {
+        udi_log("thread %a waiting to be released after transferring control to thread %a",
+                thr->id, target->id);
+        unsigned char trigger;
+        if ( read(thr->control_read, &trigger, 1) != 1 ) {
+            udi_log("failed to read control trigger from pipe: %a", errno);
+            udi_abort();
+            return -1;
+        }
+
+        if ( trigger != sentinel ) {
+            udi_abort();
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 int release_other_threads() {
+    if ( holds_event_lock() ) {
+        // the mode only changes once no thread is stopped
+        if ( server_thread == NULL && !any_thread_stopped() ) {
+            apply_stop_mode();
+        }
+
+        release_event_lock();
+        return 0;
+    }
+
     if (get_multithread_capable()) {
         thread *thr = get_current_thread();
         // it is okay if this thr is NULL -- this occurs when a thread hits the death breakpoint
 
-        thread *iter = get_thread_list();
         // determine if an event for another thread is pending
-        while (iter != NULL) {
-            // XXX: there is a known race here where a thread is sent a THREAD_SUSPEND_SIGNAL by
-            // another source external to the library but at the same time, the library sends the same
-            // signal to the thread. The result is that there is no way to handle the externally
-            // sourced signal.
-            if ( iter != thr &&
-                 ( (iter->event_state.signal != THREAD_SUSPEND_SIGNAL &&
-                    iter->event_state.signal != 0) ||
-                   iter->stack_event_pending) )
-            {
-                break;
-            }
-            iter = iter->next_thread;
-        }
-
-        if ( iter != thr && iter != NULL ) {
+        thread *pending_thr = find_pending_event_thread(thr);
+        if ( pending_thr != NULL ) {
             // Found another event that needs to be handled
+            return transfer_control(thr, pending_thr);
+        }
 
-            if ( thr != NULL ) {
-                __sync_val_compare_and_swap(&(thr->control_thread), 1, 0);
+        if ( continue_pending() ) {
+            // The threads stopped at breakpoints step over them one at a time, the other threads
+            // are released once the last one has stepped over its breakpoint
+            thread *continue_thr = get_continue_thread();
+            if ( continue_thr != NULL && continue_thr != thr ) {
+                udi_log("thread %a stepping over breakpoint", continue_thr->id);
+                return transfer_control(thr, continue_thr);
             }
+            return 0;
+        }
 
-            __sync_val_compare_and_swap(&(iter->control_thread), 0, 1);
+        // all threads are stopped, so it is safe to switch modes
+        apply_stop_mode();
 
-            if ( write(iter->control_write, &sentinel, 1) != 1 ) {
-                udi_log("failed to write control trigger to pipe for %a: %e",
-                        iter->id,
-                        errno);
-                udi_abort();
-                return -1;
-            }
+        // clear "lock" for future entrances to block_other_threads
+        //
+        // Note: it's possible that the sync var is already 0 when the first thread was created
+        // -- just ignore this case as the below code handles this case correctly
+        reset_barrier_counters();
+        __sync_val_compare_and_swap(&(thread_barrier.sync_var), 1, 0);
 
-            if ( thr != NULL ) {
-                udi_log("thread %a waiting to be released after transferring control to thread %a",
-                        thr->id, iter->id);
-                unsigned char trigger;
-                if ( read(thr->control_read, &trigger, 1) != 1 ) {
-                    udi_log("failed to read control trigger from pipe: %a", errno);
+        // release the other threads, if they should be running
+        thread *iter = get_thread_list();
+        while ( iter != NULL ) {
+            if ( iter != thr && iter->ts == UDI_TS_RUNNING ) {
+                if ( write(iter->control_write, &sentinel, 1) != 1 ) {
+                    udi_log("failed to write control trigger to pipe for %a: %e",
+                            iter->id,
+                            errno);
                     udi_abort();
                     return -1;
                 }
+            }
+            iter = iter->next_thread;
+        }
 
-                if ( trigger != sentinel ) {
-                    udi_abort();
-                    return -1;
-                }
+        udi_log("thread %a released other threads", get_user_thread_id());
+
+        if ( thr != NULL && thr->ts == UDI_TS_SUSPENDED ) {
+            // If the current thread was suspended in this signal handler call, block here
+            udi_log("thread %a waiting to be released after releasing threads", thr->id);
+
+            read_sentinel(thr->control_read);
+        }
+    }
+
+    return 0;
+}
+
+// non-stop mode
+
+int is_non_stop_mode() {
+    return non_stop;
+}
+
+int set_stop_mode(udi_stop_mode_e mode, udi_errmsg *errmsg) {
+    if ( mode == UDI_STOP_MODE_NON_STOP ) {
+#if defined(UDI_THREAD_LOCAL)
+        int supported = get_multithread_capable();
+#else
+        // running threads need to find their structure without searching the thread table
+        int supported = 0;
+#endif
+        if ( !supported ) {
+            udi_set_errmsg(errmsg, "non-stop mode is not supported for this process");
+            return RESULT_FAILURE;
+        }
+    }
+
+    requested_non_stop = (mode == UDI_STOP_MODE_NON_STOP);
+    udi_log("requested stop mode %d", mode);
+
+    return RESULT_SUCCESS;
+}
+
+/**
+ * Switches to the requested stop mode. Called once no thread is stopped.
+ */
+static
+void apply_stop_mode() {
+    if ( non_stop == requested_non_stop ) return;
+
+    if ( requested_non_stop ) {
+        // a suspended thread is only released by a continue of the process in all-stop mode
+        thread *iter = get_thread_list();
+        while (iter != NULL) {
+            if ( iter->ts == UDI_TS_SUSPENDED ) {
+                udi_log("not entering non-stop mode while thread %a is suspended", iter->id);
+                return;
             }
-        }else{
-            // clear "lock" for future entrances to block_other_threads
-            //
-            // Note: it's possible that the sync var is already 0 when the first thread was created
-            // -- just ignore this case as the below code handles this case correctly
-            __sync_val_compare_and_swap(&(thread_barrier.sync_var), 1, 0);
+            iter = iter->next_thread;
+        }
+    }
 
-            // release the other threads, if they should be running
-            iter = get_thread_list();
-            while ( iter != NULL ) {
-                if ( iter != thr && iter->ts == UDI_TS_RUNNING ) {
-                    if ( write(iter->control_write, &sentinel, 1) != 1 ) {
-                        udi_log("failed to write control trigger to pipe for %a: %e",
-                                iter->id,
-                                errno);
-                        udi_abort();
-                        return -1;
-                    }
-                }
-                iter = iter->next_thread;
+    non_stop = requested_non_stop;
+    __sync_synchronize();
+
+    udi_log("entered %s mode", non_stop ? "non-stop" : "all-stop");
+}
+
+static
+int holds_event_lock() {
+    return event_lock_owner != 0 && event_lock_owner == get_user_thread_id();
+}
+
+static
+void acquire_event_lock() {
+    read_sentinel(event_lock.read_handle);
+    event_lock_owner = get_user_thread_id();
+}
+
+static
+void release_event_lock() {
+    event_lock_owner = 0;
+    if ( write(event_lock.write_handle, &sentinel, 1) != 1 ) {
+        udi_log("failed to release event lock: %e", errno);
+        udi_abort();
+    }
+}
+
+/**
+ * Wakes the thread serving requests so it also waits for the requests of a newly stopped thread
+ */
+static
+void notify_server() {
+    // the pipe is non-blocking, a full pipe already has a wake up pending
+    if ( write(server_wake.write_handle, &sentinel, 1) != 1 && errno != EAGAIN ) {
+        udi_log("failed to wake server thread: %e", errno);
+    }
+}
+
+static
+void drain_server_wake() {
+    unsigned char buffer[16];
+    while ( read(server_wake.read_handle, buffer, sizeof(buffer)) > 0 );
+}
+
+static
+void wake_thread(thread *thr) {
+    if ( write(thr->control_write, &sentinel, 1) != 1 ) {
+        udi_log("failed to write control trigger to pipe for %a: %e", thr->id, errno);
+        udi_abort();
+    }
+}
+
+static
+int any_thread_stopped() {
+    thread *iter = get_thread_list();
+    while (iter != NULL) {
+        if ( iter->stopped ) return 1;
+        iter = iter->next_thread;
+    }
+
+    return 0;
+}
+
+int is_thread_stopped(thread *thr) {
+    return thr->stopped && !thr->resuming;
+}
+
+void continue_thread(thread *thr, uint32_t sig_val) {
+    udi_log("continuing thread %a with signal %d", thr->id, sig_val);
+
+    thr->resuming = 1;
+    thr->continue_sig = sig_val;
+
+    if ( thr != server_thread ) {
+        wake_thread(thr);
+        return;
+    }
+
+    // another stopped thread takes over serving requests
+    server_thread = NULL;
+    thread *iter = get_thread_list();
+    while (iter != NULL) {
+        if ( is_thread_stopped(iter) ) {
+            server_thread = iter;
+            wake_thread(iter);
+            break;
+        }
+        iter = iter->next_thread;
+    }
+}
+
+/**
+ * Handles requests until the current thread stops serving requests
+ *
+ * @param cur_thr the current thread
+ * @param errmsg the error message populated on error
+ * @param thr populated by the thread that received the last request
+ *
+ * @return the result of the last request
+ */
+static
+int serve_requests(thread *cur_thr, udi_errmsg *errmsg, thread **thr) {
+    int result = RESULT_SUCCESS;
+    while ( server_thread == cur_thr ) {
+        // the other threads keep running while requests are handled
+        invalidate_memory_map();
+
+        udi_log("waiting for request");
+        if ( block_for_request(thr) != 0 ) {
+            udi_set_errmsg(errmsg, "failed to wait for request");
+            udi_log("failed to wait for request");
+            return RESULT_ERROR;
+        }
+
+        udi_request_type_e type = UDI_REQ_INVALID;
+        result = execute_request(*thr, &type, errmsg);
+        if ( result == RESULT_ERROR ) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Stops the current thread in non-stop mode until it is continued. The first thread to stop
+ * serves the requests for the process and all threads, the other stopped threads wait to be
+ * continued or to take over serving requests.
+ *
+ * Called with the event lock held and returns with it held.
+ *
+ * @param errmsg the error message populated on error
+ * @param thr populated by the thread that received the last request
+ *
+ * @return request handler return code
+ */
+static
+int stop_thread(udi_errmsg *errmsg, thread **thr) {
+    thread *cur_thr = get_current_thread();
+    cur_thr->stopped = 1;
+    cur_thr->resuming = 0;
+
+    if ( server_thread != NULL ) {
+        notify_server();
+    }
+
+    int result = RESULT_SUCCESS;
+    while ( !cur_thr->resuming ) {
+        if ( server_thread == NULL ) {
+            server_thread = cur_thr;
+            udi_log("thread %a serving requests", cur_thr->id);
+        }
+
+        if ( server_thread == cur_thr ) {
+            result = serve_requests(cur_thr, errmsg, thr);
+            if ( result == RESULT_ERROR ) {
+                server_thread = NULL;
+                break;
             }
+            continue;
+        }
 
-            udi_log("thread %a released other threads", get_user_thread_id());
+        udi_log("thread %a waiting to be continued", cur_thr->id);
+
+        release_event_lock();
+        read_sentinel(cur_thr->control_read);
+        acquire_event_lock();
+    }
 
-            if ( thr != NULL && thr->ts == UDI_TS_SUSPENDED ) {
-                // If the current thread was suspended in this signal handler call, block here
-                udi_log("thread %a waiting to be released after releasing threads", thr->id);
+    cur_thr->stopped = 0;
+    cur_thr->resuming = 0;
+
+    return result;
+}
 
-                read_sentinel(thr->control_read);
+/**
+ * Executes the instruction at the pc of the current thread at its own address, with the
+ * breakpoint at the pc removed until the thread reaches the successor of the instruction. Other
+ * threads do not stop at the breakpoint while it is removed.
+ *
+ * @param thr the current thread
+ * @param bp the breakpoint at the pc
+ * @param context the context of the current thread
+ * @param errmsg the error message populated on error
+ *
+ * @return 0 on success; non-zero on failure
+ */
+static
+int step_in_place(thread *thr, breakpoint *bp, const ucontext_t *context, udi_errmsg *errmsg) {
+    uint64_t successor = get_ctf_successor(bp->address, errmsg, context);
+    if ( successor == 0 ) {
+        return -1;
+    }
+
+    breakpoint *step_bp = find_breakpoint(successor);
+    int created = 0;
+    if ( step_bp != NULL && step_bp->in_memory ) {
+        // the thread stops at the existing breakpoint
+        step_bp = NULL;
+    }else{
+        if ( step_bp == NULL ) {
+            step_bp = create_breakpoint(successor);
+            if ( step_bp == NULL ) {
+                udi_set_errmsg(errmsg, "failed to create breakpoint at %a", successor);
+                return -1;
             }
+            created = 1;
         }
+
+        step_bp->thread = thr;
+        if ( install_breakpoint(step_bp, errmsg) != 0 ) {
+            return -1;
+        }
+    }
+
+    if ( remove_breakpoint_for_continue(bp, errmsg) != 0 ) {
+        return -1;
+    }
+
+    udi_log("thread %a stepping over breakpoint at %a in place", thr->id, bp->address);
+
+    thr->step_in_place_addr = bp->address;
+    thr->step_in_place_bp = step_bp;
+    thr->step_in_place_created = created;
+
+    return 0;
+}
+
+/**
+ * Re-installs the breakpoint the current thread stepped over in place
+ *
+ * @param thr the current thread
+ * @param signal the signal the thread entered the handler with
+ * @param context the context of the current thread
+ *
+ * @return non-zero if the thread stopped at the successor of the breakpoint and should continue
+ * without reporting an event
+ */
+static
+int finish_step_in_place(thread *thr, int signal, ucontext_t *context) {
+    if ( thr == NULL || thr->step_in_place_addr == 0 ) return 0;
+
+    udi_errmsg errmsg;
+    errmsg.size = ERRMSG_SIZE;
+    errmsg.msg[ERRMSG_SIZE-1] = '\0';
+
+    int hit = 0;
+    breakpoint *step_bp = thr->step_in_place_bp;
+    if ( step_bp != NULL ) {
+        uint64_t step_addr = step_bp->address;
+        hit = (signal == SIGTRAP && get_trap_address(context) == step_addr);
+
+        int result;
+        if ( thr->step_in_place_created ) {
+            result = delete_breakpoint(step_bp, &errmsg);
+        }else{
+            result = remove_breakpoint(step_bp, &errmsg);
+            step_bp->thread = NULL;
+        }
+        if ( result != 0 ) {
+            udi_log("failed to remove breakpoint at %a: %s", step_addr, errmsg.msg);
+        }
+
+        if ( hit ) {
+            set_pc(context, step_addr);
+        }
+    }
+
+    // the breakpoint could have been removed and installed again in the meantime
+    breakpoint *original_bp = find_breakpoint(thr->step_in_place_addr);
+    if ( original_bp != NULL && original_bp->in_memory &&
+         !is_breakpoint_instruction_at(original_bp->address) )
+    {
+        original_bp->in_memory = 0;
+        if ( install_breakpoint(original_bp, &errmsg) != 0 ) {
+            udi_log("failed to re-install breakpoint at %a: %s",
+                    original_bp->address,
+                    errmsg.msg);
+        }
+    }
+
+    thr->step_in_place_addr = 0;
+    thr->step_in_place_bp = NULL;
+    thr->step_in_place_created = 0;
+
+    return hit;
+}
+
+/**
+ * Executes the instruction under the breakpoint at the specified pc out of line, leaving the
+ * breakpoint in memory for the other threads
+ *
+ * @param thr the current thread
+ * @param pc the address of the breakpoint
+ * @param context the context of the current thread, updated to execute the instruction
+ * @param step populated with how the instruction is executed
+ * @param errmsg the error message populated on error
+ *
+ * @return 0 on success; non-zero on failure
+ */
+static
+int displace_breakpoint(thread *thr, uint64_t pc, ucontext_t *context, displaced_step *step,
+                        udi_errmsg *errmsg)
+{
+    if ( displace_instruction(pc, thr->displaced_pad, context, step, errmsg) != 0 ) {
+        return -1;
+    }
+
+    if ( step->type == DISPLACED_COPIED ) {
+        thr->displaced_addr = pc;
+        thr->displaced_trap_addr = step->trap_addr;
+        thr->displaced_resume_addr = step->resume_addr;
+    }
+
+    return 0;
+}
+
+/**
+ * Moves the pc of the current thread out of its displaced stepping pad when the thread stops
+ * before it finished the displaced instruction, so the debugger never sees a pc in the pad
+ *
+ * @param thr the current thread
+ * @param context the context of the current thread
+ */
+static
+void leave_displaced_pad(thread *thr, ucontext_t *context) {
+    if ( thr == NULL || thr->displaced_trap_addr == 0 ) return;
+
+    uint64_t pc = get_pc(context);
+    if ( pc == (uint64_t)(uintptr_t)thr->displaced_pad ) {
+        // the instruction did not execute, the thread steps over the breakpoint again when it
+        // continues
+        set_pc(context, thr->displaced_addr);
+    }else if ( pc == thr->displaced_trap_addr ) {
+        set_pc(context, thr->displaced_resume_addr);
+    }else{
+        return;
+    }
+
+    udi_log("thread %a left displaced stepping pad at %a", thr->id, pc);
+
+    thr->displaced_addr = 0;
+    thr->displaced_trap_addr = 0;
+    thr->displaced_resume_addr = 0;
+}
+
+/**
+ * Prepares the current thread to execute the instruction under the breakpoint at its pc, leaving
+ * the breakpoint in memory for the other threads
+ *
+ * @param thr the current thread
+ * @param context the context of the current thread
+ */
+static
+void step_over_breakpoint(thread *thr, ucontext_t *context) {
+    uint64_t pc = get_pc(context);
+    breakpoint *bp = find_breakpoint(pc);
+    if ( bp == NULL || !bp->in_memory ) return;
+
+    udi_errmsg errmsg;
+    errmsg.size = ERRMSG_SIZE;
+    errmsg.msg[ERRMSG_SIZE-1] = '\0';
+
+    displaced_step step;
+    int result = displace_breakpoint(thr, pc, context, &step, &errmsg);
+    if ( result == 0 && step.type == DISPLACED_IN_PLACE ) {
+        result = step_in_place(thr, bp, context, &errmsg);
+    }
+
+    if ( result != 0 ) {
+        udi_log("failed to step thread %a over breakpoint at %a: %s", thr->id, pc, errmsg.msg);
+        udi_abort();
+    }
+}
+
+/**
+ * Steps the current thread over a thread-specific breakpoint of another thread in all-stop mode,
+ * before any other thread is stopped. The same applies to the return address breakpoint of a call
+ * the thread is stepping over, when a deeper frame hits it. A thread that stops the process waits
+ * for this thread to reach block_other_threads before it changes any breakpoints, and the event
+ * lock serializes the threads stepping over breakpoints because reading the instruction under a
+ * breakpoint uses the memory access state and the heap of the library, which are not thread-safe.
+ *
+ * @param thr the current thread
+ * @param signal the signal the thread entered the handler with
+ * @param siginfo the siginfo passed to the signal handler
+ * @param context the context of the current thread
+ *
+ * @return non-zero if the thread stepped over the breakpoint and should continue without stopping
+ * the process
+ */
+static
+int skip_foreign_breakpoint(thread *thr,
+                            int signal,
+                            const siginfo_t *siginfo,
+                            ucontext_t *context)
+{
+    if ( signal != SIGTRAP || is_trace_trap(signal, siginfo) || thr == NULL ||
+         !get_multithreaded() || is_non_stop_mode() || single_thread_executing() )
+    {
+        return 0;
+    }
+
+    uint64_t trap_address = get_trap_address(context);
+    breakpoint *bp = find_breakpoint(trap_address);
+    if ( bp == NULL || !bp->in_memory || bp->thread == NULL ) {
+        return 0;
+    }
+
+    // a deeper frame of a call this thread is stepping over also steps over the breakpoint
+    if ( bp->thread == thr && is_step_return_frame(thr, context) ) {
+        return 0;
+    }
+
+    udi_errmsg errmsg;
+    errmsg.size = ERRMSG_SIZE;
+    errmsg.msg[ERRMSG_SIZE-1] = '\0';
+
+    acquire_event_lock();
+
+    // an instruction that executes at its own address needs the breakpoint removed, which is only
+    // safe with the other threads stopped
+    displaced_step step;
+    int skipped = 0;
+    if ( displace_breakpoint(thr, trap_address, context, &step, &errmsg) != 0 ) {
+        udi_log("failed to step thread %a over breakpoint at %a: %s",
+                thr->id,
+                trap_address,
+                errmsg.msg);
+    }else if ( step.type != DISPLACED_IN_PLACE ) {
+        udi_log("thread %a stepped over breakpoint at %a for thread %a",
+                thr->id,
+                trap_address,
+                bp->thread->id);
+        skipped = 1;
+    }
+
+    release_event_lock();
+
+    return skipped;
+}
+
+/**
+ * Resumes the current thread in non-stop mode and releases the event lock
+ *
+ * @param thr the current thread
+ * @param signal the signal the thread entered the handler with
+ * @param siginfo the siginfo for the signal
+ * @param context the context of the current thread
+ */
+static
+void resume_thread(thread *thr, int signal, siginfo_t *siginfo, ucontext_t *context) {
+    uint32_t continue_sig = thr->continue_sig;
+    thr->continue_sig = 0;
+
+    step_over_breakpoint(thr, context);
+
+    // the debugger cannot access the registers of a running thread
+    thr->event_state->context_valid = 0;
+
+    release_other_threads();
+
+    // the signal this thread stopped with is passed to the application directly, any other
+    // signal is raised for this thread once it leaves the handler
+    if ( continue_sig == (uint32_t)signal ) {
+        app_signal_handler(signal, siginfo, context);
+    }else if ( continue_sig != 0 ) {
+        thr->pass_signal = continue_sig;
+        pthread_kill((pthread_t)thr->id, continue_sig);
+    }
+}
+
+/**
+ * Handles the signals a thread raises while resuming in non-stop mode, without taking the event
+ * lock
+ *
+ * @return non-zero if the signal was handled
+ */
+static
+int handle_resume_signal(thread *thr, int signal, siginfo_t *siginfo, ucontext_t *context) {
+    if ( thr == NULL ) return 0;
+
+    // the breakpoint that follows a displaced instruction
+    if ( signal == SIGTRAP && thr->displaced_trap_addr != 0 &&
+         get_trap_address(context) == thr->displaced_trap_addr )
+    {
+        set_pc(context, thr->displaced_resume_addr);
+        thr->displaced_addr = 0;
+        thr->displaced_trap_addr = 0;
+        thr->displaced_resume_addr = 0;
+        return 1;
+    }
+
+    if ( thr->pass_signal != 0 && thr->pass_signal == signal ) {
+        thr->pass_signal = 0;
+        app_signal_handler(signal, siginfo, context);
+        return 1;
     }
 
     return 0;
@@ -1021,6 +2128,80 @@ char *get_thread_file(thread *thr, char *thread_dir, const char *filename) {
     return thread_file;
 }
 
+char *get_branch_trace_path(thread *thr) {
+    char *thread_dir = get_thread_dir(thr);
+    if (thread_dir == NULL) {
+        return NULL;
+    }
+
+    char *branches_file = get_thread_file(thr, thread_dir, BRANCHES_FILE_NAME);
+    udi_free(thread_dir);
+
+    return branches_file;
+}
+
+int map_branch_trace(thread *thr, uint32_t size, udi_errmsg *errmsg) {
+    char *branches_file = get_branch_trace_path(thr);
+    if (branches_file == NULL) {
+        udi_set_errmsg(errmsg, "failed to allocate branch trace path");
+        return -1;
+    }
+
+    size_t length = sizeof(branch_trace_header) + size;
+    void *mapping = MAP_FAILED;
+    int fd = -1;
+    do {
+        // the debugger may still hold the file of a previous recording, reuse it so the records
+        // it reads always come from the current mapping
+        fd = open(branches_file, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        if ( fd == -1 ) {
+            udi_set_errmsg(errmsg, "failed to open %s: %e", branches_file, errno);
+            break;
+        }
+
+        if ( ftruncate(fd, length) != 0 ) {
+            udi_set_errmsg(errmsg, "failed to size %s: %e", branches_file, errno);
+            break;
+        }
+
+        mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if ( mapping == MAP_FAILED ) {
+            udi_set_errmsg(errmsg, "failed to map %s: %e", branches_file, errno);
+            break;
+        }
+    }while(0);
+
+    if ( fd != -1 ) {
+        close(fd);
+    }
+    udi_free(branches_file);
+
+    if ( mapping == MAP_FAILED ) {
+        udi_log("%s", errmsg->msg);
+        return -1;
+    }
+
+    branch_trace *trace = get_branch_trace(thr);
+    trace->header = (branch_trace_header *)mapping;
+    trace->header->size = size;
+    trace->data = (uint8_t *)mapping + sizeof(branch_trace_header);
+    trace->last_target = 0;
+    trace->fallthrough = 0;
+
+    return 0;
+}
+
+void unmap_branch_trace(thread *thr) {
+    branch_trace *trace = get_branch_trace(thr);
+    if (trace->header == NULL) return;
+
+    if ( munmap(trace->header, sizeof(branch_trace_header) + trace->header->size) != 0 ) {
+        udi_log("failed to unmap branch trace of thread %a: %e", thr->id, errno);
+    }
+    trace->header = NULL;
+    trace->data = NULL;
+}
+
 int thread_create_callback(thread *thr, udi_errmsg *errmsg) {
 
     // create the filesystem elements
@@ -1170,8 +2351,8 @@ int thread_death_callback(thread *thr, udi_errmsg *errmsg) {
     thr->dead = 1;
     udi_log("thread %s marked dead", thr->id);
 
-    // close the response file
-    if ( close(thr->response_handle) != 0 ) {
+    // close the response file, which is not opened until the thread is reported
+    if ( thr->response_handle != -1 && close(thr->response_handle) != 0 ) {
         udi_set_errmsg(errmsg,
                        "failed to close response handle for thread %a: %s",
                        thr->id,
@@ -1193,8 +2374,14 @@ int thread_death_handshake(thread *thr, udi_errmsg *errmsg) {
         return -1;
     }
 
+    // in non-stop mode, a stopped thread completes the handshake once it is continued
+    if ( thr->stopped ) {
+        udi_log("deferring handshake for stopped thread %a", thr->id);
+        return 0;
+    }
+
     // close the request file
-    if ( close(thr->request_handle) != 0 ) {
+    if ( thr->request_handle != -1 && close(thr->request_handle) != 0 ) {
         udi_set_errmsg(errmsg,
                        "failed to close request handle for thread %a: %e",
                        thr->id,
@@ -1204,7 +2391,7 @@ int thread_death_handshake(thread *thr, udi_errmsg *errmsg) {
     }
 
     // delete the pipes and the thread directory
-    char *thread_dir = NULL, *response_file = NULL, *request_file = NULL;
+    char *thread_dir = NULL, *response_file = NULL, *request_file = NULL, *branches_file = NULL;
     int result = 0;
     do {
         thread_dir = get_thread_dir(thr);
@@ -1243,6 +2430,23 @@ int thread_death_handshake(thread *thr, udi_errmsg *errmsg) {
             break;
         }
 
+        // a debugger that still has the branch trace open can drain its remaining records
+        unmap_branch_trace(thr);
+        branches_file = get_thread_file(thr, thread_dir, BRANCHES_FILE_NAME);
+        if (branches_file == NULL) {
+            result = -1;
+            break;
+        }
+
+        if ( unlink(branches_file) != 0 && errno != ENOENT ) {
+            udi_set_errmsg(errmsg,
+                           "failed to unlink %s: %e",
+                           branches_file,
+                           errno);
+            result = -1;
+            break;
+        }
+
         if ( rmdir(thread_dir) != 0 ) {
             udi_set_errmsg(errmsg, "failed to rmdir %s: %e",
                            thread_dir,
@@ -1259,6 +2463,7 @@ int thread_death_handshake(thread *thr, udi_errmsg *errmsg) {
     udi_free(thread_dir);
     udi_free(response_file);
     udi_free(request_file);
+    udi_free(branches_file);
 
     destroy_thread(thr);
 
@@ -1432,6 +2637,8 @@ void init_udirt() {
             udi_log("failed to handle initial command");
             break;
         }
+
+        apply_stop_mode();
     } while(0);
 
     if (result != RESULT_SUCCESS ) {
@@ -110,6 +110,13 @@ void log_context(const ucontext_t *context);
 int setup_signal_handlers();
 int uninstall_signal_handlers();
 void app_signal_handler(int signal, siginfo_t *siginfo, void *v_context);
+
+/**
+ * @param signal the signal
+ *
+ * @return the policy the debugger configured for the signal
+ */
+udi_signal_policy_e get_signal_policy(int signal);
 void signal_entry_point(int signal, siginfo_t *siginfo, void *v_context);
 
 // write failure handling
@@ -120,30 +127,65 @@ extern int pipe_write_failure;
 // signal handling
 typedef struct signal_state_struct {
   int signal;
+  int context_valid;
+  void *context_data;
   siginfo_t siginfo;
   ucontext_t context;
-  void *context_data;
-  int context_valid;
 } signal_state;
 
 extern int THREAD_SUSPEND_SIGNAL;
 
+#define UDI_CACHE_LINE_SIZE 64
+
 struct thread_struct {
+  // state read while scanning the thread list and updated by other threads while stopping
+  // and releasing threads, kept together on the first cache line
   uint64_t id;
   udi_thread_state_e ts;
   int dead;
+  int control_thread;
+  int suspend_pending;
+  int stack_event_pending;
+  int create_reported;
   int request_handle;
-  int response_handle;
   int control_write;
   int control_read;
-  int control_thread;
-  int suspend_pending;
+  int stopped;
+  struct thread_struct *next_thread;
+
+  // the saved context is large and only used when the thread stops, so it is allocated
+  // separately
+  signal_state *event_state;
+
+  int response_handle __attribute__((aligned(UDI_CACHE_LINE_SIZE)));
   int single_step;
-  int stack_event_pending;
+  uint64_t creator_id;
+  int handshake_pending;
+  int death_reported;
   breakpoint *single_step_bp;
-  signal_state event_state;
-  struct thread_struct *next_thread;
-};
+  step_state step;
+  branch_trace branches;
+
+  // the signal of an event reported in a batch by another thread, cleared when the process
+  // continues unless it is the signal the process continues with
+  int batch_signal;
+
+  // non-stop mode
+  int resuming;
+  uint32_t continue_sig;
+  int pass_signal;
+  uint64_t displaced_addr;
+  uint64_t displaced_trap_addr;
+  uint64_t displaced_resume_addr;
+  uint64_t step_in_place_addr;
+  breakpoint *step_in_place_bp;
+  int step_in_place_created;
+
+  // the library heap is executable and not thread-safe, so the pad is allocated with the thread
+  // rather than when a running thread first steps over a breakpoint. It has its own cache line
+  // so writing an instruction to it does not disturb the fields other threads read.
+  uint8_t displaced_pad[DISPLACED_PAD_SIZE] __attribute__((aligned(UDI_CACHE_LINE_SIZE)));
+} __attribute__((aligned(UDI_CACHE_LINE_SIZE)));
 
 int setsigmask(int how, const sigset_t *new_set, sigset_t *old_set);
 
@@ -174,6 +216,13 @@ typedef struct udi_barrier_struct {
   unsigned int sync_var;
   int read_handle;
   int write_handle;
+
+  // the control thread waits for the threads it signaled with a single counter and is woken
+  // once by whichever thread observes that the last one arrived
+  unsigned int num_signaled;
+  unsigned int signaling_complete;
+  unsigned int num_arrived;
+  unsigned int control_woken;
 } udi_barrier;
 
 /**
@@ -212,6 +261,9 @@ int block_other_threads();
 /**
  * Releases the other threads that are blocked in block_other_threads
  *
+ * If another thread has a pending event or needs to step over the breakpoint it stopped at,
+ * control is transferred to it instead and the threads are released later
+ *
  * Marks any threads that were created during this request handling
  *
  * @return 0 on success
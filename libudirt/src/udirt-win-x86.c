@@ -23,3 +23,8 @@ uint64_t get_flags(const void *context) {
 
     return 0;
 }
+
+void set_flags(void *context, uint64_t flags) {
+    USE(context);
+    USE(flags);
+}
@@ -186,6 +186,33 @@ void set_single_step(thread *thr, int single_step) {
     USE(single_step);
 }
 
+step_state *get_step_state(thread *thr) {
+    return &thr->step;
+}
+
+branch_trace *get_branch_trace(thread *thr) {
+    return &thr->branches;
+}
+
+int map_branch_trace(thread *thr, uint32_t size, udi_errmsg *errmsg) {
+    USE(thr);
+    USE(size);
+
+    udi_set_errmsg(errmsg, "branch recording not supported");
+
+    return -1;
+}
+
+void unmap_branch_trace(thread *thr) {
+    USE(thr);
+}
+
+char *get_branch_trace_path(thread *thr) {
+    USE(thr);
+
+    return NULL;
+}
+
 int is_event_breakpoint(breakpoint *bp) {
     USE(bp);
 
@@ -236,11 +263,56 @@ int thread_death_handshake(thread *thr, udi_errmsg *errmsg) {
     return 0;
 }
 
+int has_deferred_thread_events() {
+    return 0;
+}
+
+int write_deferred_thread_events(udi_errmsg *errmsg) {
+    USE(errmsg);
+
+    return RESULT_SUCCESS;
+}
+
 void post_continue_hook(uint32_t sig_val) {
     USE(sig_val);
 
 }
 
+int set_signal_policy(uint32_t sig, udi_signal_policy_e policy, udi_errmsg *errmsg) {
+    USE(policy);
+
+    udi_set_errmsg(errmsg, "signal %d cannot be configured on this platform", sig);
+    return RESULT_FAILURE;
+}
+
+void get_stop_stats(udi_stop_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+int is_non_stop_mode() {
+    return 0;
+}
+
+int set_stop_mode(udi_stop_mode_e mode, udi_errmsg *errmsg) {
+    if (mode == UDI_STOP_MODE_ALL) {
+        return RESULT_SUCCESS;
+    }
+
+    udi_set_errmsg(errmsg, "non-stop mode is not supported on this platform");
+    return RESULT_FAILURE;
+}
+
+int is_thread_stopped(thread *thr) {
+    USE(thr);
+
+    return 0;
+}
+
+void continue_thread(thread *thr, uint32_t sig_val) {
+    USE(thr);
+    USE(sig_val);
+}
+
 int is_single_step(thread *thr) {
     USE(thr);
 
@@ -258,6 +330,15 @@ const char *get_mem_errstr() {
     return NULL;
 }
 
+int load_memory_map(memory_region **regions, size_t *num_regions, udi_errmsg *errmsg) {
+    USE(regions);
+    USE(num_regions);
+
+    udi_set_errmsg(errmsg, "memory map not supported");
+
+    return MEMORY_MAP_UNSUPPORTED;
+}
+
 int get_register(udi_register_e reg,
                  udi_errmsg *errmsg,
                  uint64_t *value,
@@ -284,6 +365,41 @@ int set_register(udi_register_e reg,
     return 0;
 }
 
+int get_register_bytes(udi_register_e reg,
+                       udi_errmsg *errmsg,
+                       uint8_t *value,
+                       const void *context)
+{
+    USE(reg);
+    USE(value);
+    USE(context);
+
+    udi_set_errmsg(errmsg, "register bytes not supported");
+
+    return -1;
+}
+
+int set_register_bytes(udi_register_e reg,
+                       udi_errmsg *errmsg,
+                       const uint8_t *value,
+                       void *context)
+{
+    USE(reg);
+    USE(value);
+    USE(context);
+
+    udi_set_errmsg(errmsg, "register bytes not supported");
+
+    return -1;
+}
+
+size_t get_vector_register_width(udi_errmsg *errmsg, const void *context) {
+    USE(context);
+
+    udi_set_errmsg(errmsg, "%s", "vector registers are not supported on this platform");
+    return 0;
+}
+
 void set_thread_state(thread *thr, udi_thread_state_e state) {
     USE(thr);
     USE(state);
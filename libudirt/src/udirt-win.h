@@ -34,6 +34,8 @@ struct thread_struct {
     udi_pipe_ctx response_pipe;
     int single_step;
     breakpoint *single_step_bp;
+    step_state step;
+    branch_trace branches;
     CONTEXT context;
     struct thread_struct *next_thread;
 };
@@ -13,11 +13,14 @@
 #include "udirt-x86.h"
 
 #include <inttypes.h>
+#include <string.h>
 
 #include <udis86.h>
 
 static const unsigned char BREAKPOINT_INSN = 0xcc;
 
+static const uint64_t TRAP_FLAG = 0x100;
+
 /**
  * Writes the breakpoint instruction for the specified breakpoint
  *
@@ -70,6 +73,24 @@ int write_saved_bytes(breakpoint *bp, udi_errmsg *errmsg) {
     return result;
 }
 
+/**
+ * @param addr the address
+ *
+ * @return non-zero if the breakpoint instruction is at the specified address
+ */
+int is_breakpoint_instruction_at(uint64_t addr) {
+    udi_errmsg errmsg;
+    errmsg.size = ERRMSG_SIZE;
+    errmsg.msg[ERRMSG_SIZE-1] = '\0';
+
+    unsigned char insn;
+    if ( read_memory(&insn, (const uint8_t *)(uintptr_t)addr, sizeof(insn), &errmsg) != 0 ) {
+        return 0;
+    }
+
+    return insn == BREAKPOINT_INSN;
+}
+
 /**
  * Gets the architecture of this process
  *
@@ -231,7 +252,10 @@ unsigned long compute_target(ud_mnemonic_code_t mnemonic,
         case UD_OP_MEM: 
         {
             unsigned long base;
-            if (op->base != UD_NONE) {
+            if (op->base == UD_R_RIP) {
+                // relative to the next instruction
+                base = effective_pc;
+            }else if (op->base != UD_NONE) {
                 base = get_register_ud_type(op->base, context);
             }else{
                 base = 0;
@@ -244,29 +268,42 @@ unsigned long compute_target(ud_mnemonic_code_t mnemonic,
                 index = 0;
             }
 
-            unsigned long displacement;
-            if (op->offset != 0) {
-                switch (op->offset) {
-                    case 8:
-                        displacement = op->lval.ubyte;
-                        break;
-                    case 16:
-                        displacement = op->lval.uword;
-                        break;
-                    case 32:
-                        displacement = op->lval.udword;
-                        break;
-                    case 64:
-                        displacement = op->lval.uqword;
-                        break;
-                    default:
-                        displacement = 0;
-                        break;
-                }
-            }else{
-                displacement = 0;
+            // the displacement is sign extended
+            long displacement;
+            switch (op->offset) {
+                case 8:
+                    displacement = op->lval.sbyte;
+                    break;
+                case 16:
+                    displacement = op->lval.sword;
+                    break;
+                case 32:
+                    displacement = op->lval.sdword;
+                    break;
+                case 64:
+                    displacement = op->lval.sqword;
+                    break;
+                default:
+                    displacement = 0;
+                    break;
             }
-            return base + (index * op->scale) + displacement;
+
+            // the target is stored at the computed address
+            uintptr_t target_addr = base + (index * op->scale) + displacement;
+
+            unsigned long target = 0;
+            udi_errmsg errmsg;
+            errmsg.size = ERRMSG_SIZE;
+            errmsg.msg[ERRMSG_SIZE-1] = '\0';
+            if ( read_memory((uint8_t *)&target,
+                             (const uint8_t *)target_addr,
+                             sizeof(target),
+                             &errmsg) != 0 )
+            {
+                udi_log("failed to read branch target at %a: %s", (uint64_t)target_addr, errmsg.msg);
+                return 0;
+            }
+            return target;
         }
         case UD_OP_JIMM:
             return compute_relative_location(op, effective_pc);
@@ -277,35 +314,99 @@ unsigned long compute_target(ud_mnemonic_code_t mnemonic,
     return 0;
 }
 
-uint64_t get_ctf_successor(uint64_t pc, udi_errmsg *errmsg, const void *context) {
+// the maximum length of an x86 instruction
+#define MAX_INSN_LEN 15
 
-    ud_t ud_obj;
+/**
+ * Reads the instruction at the specified pc, as it would be without any installed breakpoints
+ *
+ * @param pc the pc
+ * @param insn the output buffer, MAX_INSN_LEN bytes
+ * @param errmsg the error message populated on failure
+ *
+ * @return the number of bytes read, 0 on failure
+ */
+static
+size_t read_instruction(uint64_t pc, uint8_t *insn, udi_errmsg *errmsg) {
+    size_t len = MAX_INSN_LEN;
+    if ( read_memory(insn, (const uint8_t *)(uintptr_t)pc, len, errmsg) != 0 ) {
+        // the instruction could be at the end of the mapped memory
+        len = 4096 - (size_t)(pc & 4095);
+        if ( len >= MAX_INSN_LEN ||
+             read_memory(insn, (const uint8_t *)(uintptr_t)pc, len, errmsg) != 0 )
+        {
+            udi_log("failed to read instruction at %a", pc);
+            return 0;
+        }
+    }
 
-    ud_init(&ud_obj);
+    for (size_t i = 0; i < len; ++i) {
+        breakpoint *bp = find_breakpoint(pc + i);
+        if ( bp != NULL && bp->in_memory ) {
+            insn[i] = bp->saved_bytes[0];
+        }
+    }
 
-    ud_set_mode(&ud_obj, __WORDSIZE);
+    return len;
+}
 
-    ud_set_input_buffer(&ud_obj, (unsigned char *)pc, 15);
+/**
+ * Disassembles the instruction at the specified pc
+ *
+ * @param ud_obj the disassembler, populated with the instruction
+ * @param pc the pc
+ * @param insn the buffer for the instruction bytes, MAX_INSN_LEN bytes
+ * @param errmsg the error message populated on failure
+ *
+ * @return 0 on success; non-zero on failure
+ */
+static
+int disassemble_instruction(ud_t *ud_obj, uint64_t pc, uint8_t *insn, udi_errmsg *errmsg) {
+    size_t len = read_instruction(pc, insn, errmsg);
+    if ( len == 0 ) {
+        return -1;
+    }
 
-    ud_set_pc(&ud_obj, pc);
+    ud_init(ud_obj);
 
-    if ( ud_disassemble(&ud_obj) == 0 ) {
+    ud_set_mode(ud_obj, __WORDSIZE);
+
+    ud_set_input_buffer(ud_obj, insn, len);
+
+    ud_set_pc(ud_obj, pc);
+
+    if ( ud_disassemble(ud_obj) == 0 ) {
         udi_set_errmsg(errmsg, "disassembling instruction at %a failed", pc);
         udi_log("%s", errmsg->msg);
-        return 0;
+        return -1;
     }
 
-    struct ud_operand *first_op = &(ud_obj.operand[0]);
+    return 0;
+}
+
+/**
+ * Computes the control flow successor of the disassembled instruction
+ *
+ * @param ud_obj the disassembled instruction
+ * @param pc the pc of the instruction
+ * @param errmsg the error message populated on failure
+ * @param context the context from which registers can be retrieved
+ *
+ * @return the successor or 0 on failure
+ */
+static
+uint64_t compute_successor(ud_t *ud_obj, uint64_t pc, udi_errmsg *errmsg, const void *context) {
+    struct ud_operand *first_op = &(ud_obj->operand[0]);
 
     unsigned long successor = 0;
-    switch (ud_obj.mnemonic) {
+    switch (ud_obj->mnemonic) {
         case UD_Icall:
         case UD_Ijmp:
             // unconditional control transfer
-            successor = compute_target(ud_obj.mnemonic,
+            successor = compute_target(ud_obj->mnemonic,
                                        first_op,
                                        pc,
-                                       ud_obj.pc,
+                                       ud_obj->pc,
                                        context);
             break;
         case UD_Ijo:
@@ -330,14 +431,14 @@ uint64_t get_ctf_successor(uint64_t pc, udi_errmsg *errmsg, const void *context)
         case UD_Iloopne:
         case UD_Iloope:
         case UD_Iloop:
-            if ( ctf_condition_met(ud_obj.mnemonic, context) ) {
-                successor = compute_target(ud_obj.mnemonic,
+            if ( ctf_condition_met(ud_obj->mnemonic, context) ) {
+                successor = compute_target(ud_obj->mnemonic,
                                            first_op,
                                            pc,
-                                           ud_obj.pc,
+                                           ud_obj->pc,
                                            context);
             }else{
-                successor = pc + ud_insn_len(&ud_obj);
+                successor = pc + ud_insn_len(ud_obj);
             }
             break;
         case UD_Iret:
@@ -358,7 +459,7 @@ uint64_t get_ctf_successor(uint64_t pc, udi_errmsg *errmsg, const void *context)
         }
         default:
             // the easy case, just the next instruction
-            successor = pc + ud_insn_len(&ud_obj);
+            successor = pc + ud_insn_len(ud_obj);
             break;
     }
 
@@ -372,6 +473,268 @@ uint64_t get_ctf_successor(uint64_t pc, udi_errmsg *errmsg, const void *context)
     return successor;
 }
 
+uint64_t get_ctf_successor(uint64_t pc, udi_errmsg *errmsg, const void *context) {
+
+    ud_t ud_obj;
+    uint8_t insn[MAX_INSN_LEN];
+
+    if ( disassemble_instruction(&ud_obj, pc, insn, errmsg) != 0 ) {
+        return 0;
+    }
+
+    return compute_successor(&ud_obj, pc, errmsg, context);
+}
+
+int get_ctf_kind(uint64_t pc, ctf_kind_e *kind, unsigned int *len, udi_errmsg *errmsg) {
+
+    ud_t ud_obj;
+    uint8_t insn[MAX_INSN_LEN];
+
+    if ( disassemble_instruction(&ud_obj, pc, insn, errmsg) != 0 ) {
+        return -1;
+    }
+
+    switch (ud_obj.mnemonic) {
+        case UD_Icall:
+            *kind = CTF_CALL;
+            break;
+        case UD_Iret:
+            *kind = CTF_RETURN;
+            break;
+        case UD_Ipushfw:
+        case UD_Ipushfd:
+        case UD_Ipushfq:
+        case UD_Ipopfw:
+        case UD_Ipopfd:
+        case UD_Ipopfq:
+        case UD_Iiretw:
+        case UD_Iiretd:
+        case UD_Iiretq:
+            // the trap flag would be exposed to or replaced by the flags on the stack
+        case UD_Isyscall:
+        case UD_Isysenter:
+        case UD_Iint:
+        case UD_Iint1:
+        case UD_Iint3:
+        case UD_Iinto:
+            // the kernel does not reliably trap after the instruction
+            *kind = CTF_NO_TRACE;
+            break;
+        default:
+            *kind = CTF_OTHER;
+            break;
+    }
+    *len = ud_insn_len(&ud_obj);
+
+    return 0;
+}
+
+void set_trace_flag(void *context, int enabled) {
+    uint64_t flags = get_flags(context);
+    if (enabled) {
+        flags |= TRAP_FLAG;
+    }else{
+        flags &= ~TRAP_FLAG;
+    }
+
+    set_flags(context, flags);
+}
+
+/**
+ * Finds the RIP-relative memory operand of the disassembled instruction
+ *
+ * @param ud_obj the disassembled instruction
+ *
+ * @return the operand or NULL if the instruction does not have one
+ */
+static
+struct ud_operand *find_rip_relative_operand(ud_t *ud_obj) {
+    for (int i = 0; i < 4; ++i) {
+        struct ud_operand *op = &(ud_obj->operand[i]);
+        if ( op->type == UD_OP_MEM && op->base == UD_R_RIP ) {
+            return op;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @return the size in bytes of the immediate operands of the disassembled instruction, which
+ * follow the displacement in the encoding
+ */
+static
+size_t get_immediate_size(ud_t *ud_obj) {
+    size_t size = 0;
+    for (int i = 0; i < 4; ++i) {
+        struct ud_operand *op = &(ud_obj->operand[i]);
+        if ( op->type == UD_OP_IMM ) {
+            size += op->size / 8;
+        }
+    }
+
+    return size;
+}
+
+/**
+ * Sets a register of the architecture this library was compiled for
+ */
+static
+int set_native_register(udi_register_e reg_64, udi_register_e reg_32, uint64_t value,
+                        void *context, udi_errmsg *errmsg)
+{
+    return set_register((__WORDSIZE == 64) ? reg_64 : reg_32, errmsg, value, context);
+}
+
+int displace_instruction(uint64_t pc,
+                         uint8_t *pad,
+                         void *context,
+                         displaced_step *step,
+                         udi_errmsg *errmsg)
+{
+    ud_t ud_obj;
+    uint8_t insn[MAX_INSN_LEN];
+
+    if ( disassemble_instruction(&ud_obj, pc, insn, errmsg) != 0 ) {
+        return -1;
+    }
+
+    const size_t word_size = __WORDSIZE / 8;
+    unsigned int len = ud_insn_len(&ud_obj);
+    uint64_t sp = get_register_ud_type((__WORDSIZE == 64) ? UD_R_RSP : UD_R_ESP, context);
+
+    step->trap_addr = 0;
+    step->resume_addr = 0;
+
+    switch (ud_obj.mnemonic) {
+        case UD_Iloop:
+        case UD_Iloope:
+        case UD_Iloopne:
+            // the counter is decremented with the width of the address size, which is not
+            // emulated
+            step->type = DISPLACED_IN_PLACE;
+            return 0;
+        case UD_Iret:
+        {
+            uint64_t successor = compute_successor(&ud_obj, pc, errmsg, context);
+            if ( successor == 0 ) {
+                return -1;
+            }
+
+            uint64_t popped = word_size;
+            if ( ud_obj.operand[0].type == UD_OP_IMM ) {
+                popped += ud_obj.operand[0].lval.uword;
+            }
+
+            if ( set_native_register(UDI_X86_64_RSP, UDI_X86_ESP, sp + popped, context, errmsg) ||
+                 set_native_register(UDI_X86_64_RIP, UDI_X86_EIP, successor, context, errmsg) )
+            {
+                return -1;
+            }
+
+            step->type = DISPLACED_EMULATED;
+            return 0;
+        }
+        case UD_Icall:
+        {
+            // the target is computed before the return address is pushed
+            uint64_t successor = compute_successor(&ud_obj, pc, errmsg, context);
+            if ( successor == 0 ) {
+                return -1;
+            }
+
+            unsigned long return_addr = pc + len;
+            sp -= word_size;
+            if ( write_memory((uint8_t *)(uintptr_t)sp,
+                              (const uint8_t *)&return_addr,
+                              word_size,
+                              errmsg) != 0 )
+            {
+                return -1;
+            }
+
+            if ( set_native_register(UDI_X86_64_RSP, UDI_X86_ESP, sp, context, errmsg) ||
+                 set_native_register(UDI_X86_64_RIP, UDI_X86_EIP, successor, context, errmsg) )
+            {
+                return -1;
+            }
+
+            step->type = DISPLACED_EMULATED;
+            return 0;
+        }
+        case UD_Ijmp:
+        case UD_Ijo:
+        case UD_Ijno:
+        case UD_Ijb:
+        case UD_Ijae:
+        case UD_Ijz:
+        case UD_Ijnz:
+        case UD_Ijbe:
+        case UD_Ija:
+        case UD_Ijs:
+        case UD_Ijns:
+        case UD_Ijp:
+        case UD_Ijnp:
+        case UD_Ijl:
+        case UD_Ijge:
+        case UD_Ijle:
+        case UD_Ijg:
+        case UD_Ijcxz:
+        case UD_Ijecxz:
+        case UD_Ijrcxz:
+        {
+            uint64_t successor = compute_successor(&ud_obj, pc, errmsg, context);
+            if ( successor == 0 ) {
+                return -1;
+            }
+
+            if ( set_native_register(UDI_X86_64_RIP, UDI_X86_EIP, successor, context, errmsg) ) {
+                return -1;
+            }
+
+            step->type = DISPLACED_EMULATED;
+            return 0;
+        }
+        default:
+            break;
+    }
+
+    if ( len + sizeof(BREAKPOINT_INSN) > DISPLACED_PAD_SIZE ) {
+        step->type = DISPLACED_IN_PLACE;
+        return 0;
+    }
+
+    memcpy(pad, insn, len);
+
+    struct ud_operand *rip_op = find_rip_relative_operand(&ud_obj);
+    if ( rip_op != NULL ) {
+        // the displacement is relative to the next instruction, rebase it on the pad when the
+        // target stays reachable
+        int64_t target = (int64_t)(pc + len) + rip_op->lval.sdword;
+        int64_t displacement = target - (int64_t)((uintptr_t)pad + len);
+        if ( rip_op->offset != 32 || displacement > INT32_MAX || displacement < INT32_MIN ) {
+            step->type = DISPLACED_IN_PLACE;
+            return 0;
+        }
+
+        int32_t pad_displacement = (int32_t)displacement;
+        size_t offset = len - get_immediate_size(&ud_obj) - sizeof(pad_displacement);
+        memcpy(pad + offset, &pad_displacement, sizeof(pad_displacement));
+    }
+
+    pad[len] = BREAKPOINT_INSN;
+
+    if ( set_native_register(UDI_X86_64_RIP, UDI_X86_EIP, (uintptr_t)pad, context, errmsg) ) {
+        return -1;
+    }
+
+    step->type = DISPLACED_COPIED;
+    step->trap_addr = (uintptr_t)pad + len;
+    step->resume_addr = pc + len;
+
+    return 0;
+}
+
 int is_gp_register(udi_register_e reg) {
     switch (reg) {
         case UDI_X86_GS:
@@ -416,41 +779,72 @@ int is_gp_register(udi_register_e reg) {
 }
 
 int is_fp_register(udi_register_e reg) {
-    switch (reg) {
-        case UDI_X86_ST0:
-        case UDI_X86_ST1:
-        case UDI_X86_ST2:
-        case UDI_X86_ST3:
-        case UDI_X86_ST4:
-        case UDI_X86_ST5:
-        case UDI_X86_ST6:
-        case UDI_X86_ST7:
-        case UDI_X86_64_ST0:
-        case UDI_X86_64_ST1:
-        case UDI_X86_64_ST2:
-        case UDI_X86_64_ST3:
-        case UDI_X86_64_ST4:
-        case UDI_X86_64_ST5:
-        case UDI_X86_64_ST6:
-        case UDI_X86_64_ST7:
-        case UDI_X86_64_XMM0:
-        case UDI_X86_64_XMM1:
-        case UDI_X86_64_XMM2:
-        case UDI_X86_64_XMM3:
-        case UDI_X86_64_XMM4:
-        case UDI_X86_64_XMM5:
-        case UDI_X86_64_XMM6:
-        case UDI_X86_64_XMM7:
-        case UDI_X86_64_XMM8:
-        case UDI_X86_64_XMM9:
-        case UDI_X86_64_XMM10:
-        case UDI_X86_64_XMM11:
-        case UDI_X86_64_XMM12:
-        case UDI_X86_64_XMM13:
-        case UDI_X86_64_XMM14:
-        case UDI_X86_64_XMM15:
-            return 1;
-        default:
+    if (reg >= UDI_X86_ST0 && reg <= UDI_X86_ST7) {
+        return 1;
+    }
+
+    return reg >= UDI_X86_64_ST0 && reg <= UDI_X86_64_MXCSR;
+}
+
+size_t get_register_size(udi_register_e reg) {
+    if (reg > UDI_X86_MIN && reg < UDI_X86_ST0) {
+        return 4;
+    }
+
+    if (reg >= UDI_X86_ST0 && reg <= UDI_X86_ST7) {
+        return 10;
+    }
+
+    if (reg > UDI_X86_64_MIN && reg < UDI_X86_64_ST0) {
+        return 8;
+    }
+
+    if (reg >= UDI_X86_64_ST0 && reg <= UDI_X86_64_ST7) {
+        return 10;
+    }
+
+    if (reg >= UDI_X86_64_XMM0 && reg <= UDI_X86_64_XMM15) {
+        return 16;
+    }
+
+    if (reg >= UDI_X86_64_YMM0 && reg <= UDI_X86_64_YMM15) {
+        return 32;
+    }
+
+    if (reg >= UDI_X86_64_ZMM0 && reg <= UDI_X86_64_ZMM31) {
+        return 64;
+    }
+
+    if (reg >= UDI_X86_64_K0 && reg <= UDI_X86_64_K7) {
+        return 8;
+    }
+
+    if (reg == UDI_X86_64_MXCSR) {
+        return 4;
+    }
+
+    return 0;
+}
+
+int get_vector_register_range(size_t width, udi_register_e *first, udi_register_e *last) {
+    if (get_architecture() != UDI_ARCH_X86_64) {
+        return -1;
+    }
+
+    switch (width) {
+        case 16:
+            *first = UDI_X86_64_XMM0;
+            *last = UDI_X86_64_XMM15 + 1;
+            return 0;
+        case 32:
+            *first = UDI_X86_64_YMM0;
+            *last = UDI_X86_64_YMM15 + 1;
             return 0;
+        case 64:
+            *first = UDI_X86_64_ZMM0;
+            *last = UDI_X86_64_ZMM31 + 1;
+            return 0;
+        default:
+            return -1;
     }
 }
@@ -48,6 +48,14 @@ int is_accessible_register(ud_type_t reg);
  */
 uint64_t get_flags(const void *context);
 
+/**
+ * Given the context, sets the flags register
+ *
+ * @param context the context containing the flags register
+ * @param flags the new flags register value
+ */
+void set_flags(void *context, uint64_t flags);
+
 #ifdef __cplusplus
 } // extern C
 #endif
@@ -18,12 +18,29 @@
 
 // constants
 enum { BREAKPOINT_HASH_SIZE = 256 };
+enum { SEARCH_CHUNK_SIZE = 4096 };
+
+enum {
+    LZ4_HASH_BITS = 12,
+    LZ4_MIN_MATCH = 4,
+    LZ4_LAST_LITERALS = 5,
+    LZ4_MATCH_FIND_LIMIT = 12,
+    LZ4_MAX_OFFSET = 65535
+};
+
+// xxHash64 primes
+static const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
 
 const uint64_t UDI_SINGLE_THREAD_ID = 0xC0FFEEABC;
 
 const char * const REQUEST_FILE_NAME = "request";
 const char * const RESPONSE_FILE_NAME = "response";
 const char * const EVENTS_FILE_NAME = "events";
+const char * const BRANCHES_FILE_NAME = "branches";
 const char * const UDI_DEBUG_ENV = "UDI_DEBUG";
 
 const int RESULT_SUCCESS = 0;
@@ -41,6 +58,10 @@ static size_t mem_access_size = 0;
 static int aborting_mem_access = 0;
 static int performing_mem_access = 0;
 
+// in non-stop mode, other threads keep running during a memory access and their faults must not
+// be mistaken for a fault of the access
+static uint64_t mem_access_tid = 0;
+
 static void *mem_abort_label = NULL;
 
 const uint8_t *get_mem_access_addr() {
@@ -58,7 +79,7 @@ unsigned long abort_mem_access() {
 }
 
 int is_performing_mem_access() {
-    return performing_mem_access;
+    return performing_mem_access && mem_access_tid == get_user_thread_id();
 }
 
 /**
@@ -118,6 +139,7 @@ int udi_memcpy(uint8_t *dest, const uint8_t *src, size_t num_bytes, udi_errmsg *
         return -1;
     }
 
+    mem_access_tid = get_user_thread_id();
     performing_mem_access = 1;
     mem_result = abortable_memcpy(dest, src, num_bytes);
     performing_mem_access = 0;
@@ -164,6 +186,549 @@ int write_memory(uint8_t *dest, const uint8_t *src, size_t num_bytes, udi_errmsg
     return udi_memcpy(dest, src, num_bytes, errmsg);
 }
 
+// memory map cache
+
+const int MEMORY_MAP_UNSUPPORTED = 1;
+
+static memory_region *memory_map = NULL;
+static size_t memory_map_len = 0;
+static int memory_map_supported = 1;
+static uint64_t memory_map_generation = 0;
+static uint64_t mapping_generation = 1;
+
+void invalidate_memory_map() {
+    mapping_generation++;
+}
+
+static
+void free_memory_map() {
+    if ( memory_map != NULL ) {
+        for (size_t i = 0; i < memory_map_len; ++i) {
+            udi_free((void *)memory_map[i].path);
+        }
+        udi_free(memory_map);
+    }
+
+    memory_map = NULL;
+    memory_map_len = 0;
+}
+
+int get_memory_map(const memory_region **regions, size_t *num_regions, udi_errmsg *errmsg) {
+    if ( !memory_map_supported ) {
+        udi_set_errmsg(errmsg, "memory map not supported");
+        return MEMORY_MAP_UNSUPPORTED;
+    }
+
+    if ( memory_map == NULL || memory_map_generation != mapping_generation ) {
+        free_memory_map();
+
+        int result = load_memory_map(&memory_map, &memory_map_len, errmsg);
+        if ( result == MEMORY_MAP_UNSUPPORTED ) {
+            // the platform will not support it on a later attempt either
+            memory_map_supported = 0;
+        }
+        if ( result != 0 ) {
+            return result;
+        }
+
+        udi_log("loaded %l memory regions", memory_map_len);
+        memory_map_generation = mapping_generation;
+    }
+
+    *regions = memory_map;
+    *num_regions = memory_map_len;
+
+    return 0;
+}
+
+/**
+ * @return the index of the first region that ends after the specified address
+ */
+static
+size_t find_region_index(const memory_region *regions, size_t num_regions, uint64_t addr) {
+    size_t low = 0, high = num_regions;
+    while ( low < high ) {
+        size_t mid = low + (high - low) / 2;
+        if ( regions[mid].end <= addr ) {
+            low = mid + 1;
+        }else{
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+int is_range_mapped(uint64_t addr, uint64_t len) {
+    udi_errmsg errmsg;
+    errmsg.size = ERRMSG_SIZE;
+    errmsg.msg[ERRMSG_SIZE-1] = '\0';
+
+    const memory_region *regions;
+    size_t num_regions;
+    int map_result = get_memory_map(&regions, &num_regions, &errmsg);
+    if ( map_result != 0 ) {
+        // without a map, let the memory access determine whether the range is valid
+        if ( map_result != MEMORY_MAP_UNSUPPORTED ) {
+            udi_log("memory map unavailable: %s", errmsg.msg);
+        }
+        return 1;
+    }
+
+    uint64_t end = addr + len;
+    if ( end < addr ) {
+        return 0;
+    }
+
+    uint64_t cur = addr;
+    for (size_t i = find_region_index(regions, num_regions, addr);
+         i < num_regions && cur < end;
+         ++i)
+    {
+        if ( regions[i].start > cur ) {
+            return 0;
+        }
+        cur = regions[i].end;
+    }
+
+    return cur >= end;
+}
+
+/**
+ * Compares the pattern against the data, ignoring bits not set in the mask
+ *
+ * @param data the data
+ * @param pattern the pattern
+ * @param mask the mask (NULL to compare all bits)
+ * @param pattern_len the length of the pattern and mask
+ *
+ * @return non-zero if the data matches the pattern
+ */
+static
+int pattern_matches(const uint8_t *data,
+                    const uint8_t *pattern,
+                    const uint8_t *mask,
+                    size_t pattern_len)
+{
+    if ( mask == NULL ) {
+        return memcmp(data, pattern, pattern_len) == 0;
+    }
+
+    for (size_t i = 0; i < pattern_len; ++i) {
+        if ( (data[i] & mask[i]) != (pattern[i] & mask[i]) ) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Searches the specified range of memory for a pattern.
+ *
+ * The range is copied a chunk at a time into a bounce buffer with read_memory so
+ * chunks that cannot be read are skipped instead of aborting the search. Holes in
+ * the memory map are skipped without being touched. The tail of each chunk is
+ * carried over to the next to find matches that span chunks.
+ *
+ * @param addr the start of the range
+ * @param len the length of the range
+ * @param pattern the pattern
+ * @param mask the mask applied to the memory and pattern before comparison (NULL for no mask)
+ * @param pattern_len the length of the pattern and mask
+ * @param max_hits the maximum number of matches to report
+ * @param callback called with the address of each match
+ * @param ctx the context passed to the callback
+ * @param errmsg the error message populated on error
+ *
+ * @return the number of matches on success; less than zero on error
+ */
+int search_memory(uint64_t addr,
+                  uint64_t len,
+                  const uint8_t *pattern,
+                  const uint8_t *mask,
+                  size_t pattern_len,
+                  uint32_t max_hits,
+                  search_hit_callback callback,
+                  void *ctx,
+                  udi_errmsg *errmsg)
+{
+    if ( pattern_len == 0 || len < pattern_len ) {
+        return 0;
+    }
+
+    uint8_t *buffer = (uint8_t *)udi_malloc(SEARCH_CHUNK_SIZE + pattern_len - 1);
+    if ( buffer == NULL ) {
+        udi_set_errmsg(errmsg, "failed to allocate memory");
+        return -1;
+    }
+
+    // when the first byte is not masked, libc can locate candidates
+    int use_memchr = (mask == NULL || mask[0] == 0xff);
+
+    uint64_t end = addr + len;
+    if ( end < addr ) {
+        end = UINT64_MAX;
+    }
+
+    // unmapped holes are skipped using the memory map, when it is available
+    const memory_region *regions = NULL;
+    size_t num_regions = 0;
+    int map_result = get_memory_map(&regions, &num_regions, errmsg);
+    if ( map_result != 0 ) {
+        if ( map_result != MEMORY_MAP_UNSUPPORTED ) {
+            udi_log("searching without memory map: %s", errmsg->msg);
+        }
+        regions = NULL;
+    }
+
+    uint32_t num_hits = 0;
+    size_t carry = 0;
+    uint64_t cur = addr;
+    while ( cur < end && num_hits < max_hits ) {
+        if ( regions != NULL ) {
+            size_t index = find_region_index(regions, num_regions, cur);
+            if ( index == num_regions ) {
+                break;
+            }
+
+            if ( regions[index].start > cur ) {
+                carry = 0;
+                cur = regions[index].start;
+                continue;
+            }
+        }
+
+        uint64_t chunk_end = (cur & ~((uint64_t)SEARCH_CHUNK_SIZE - 1)) + SEARCH_CHUNK_SIZE;
+        if ( chunk_end > end || chunk_end < cur ) {
+            chunk_end = end;
+        }
+        size_t chunk_len = (size_t)(chunk_end - cur);
+
+        if ( read_memory(buffer + carry, (const uint8_t *)(uintptr_t)cur, chunk_len, errmsg) != 0 ) {
+            udi_log("skipping unreadable memory at %a: %s", cur, get_mem_errstr());
+            carry = 0;
+            cur = chunk_end;
+            continue;
+        }
+
+        size_t avail = carry + chunk_len;
+        uint64_t base = cur - carry;
+        size_t pos = 0;
+        while ( pos + pattern_len <= avail && num_hits < max_hits ) {
+            if ( use_memchr ) {
+                const uint8_t *next = (const uint8_t *)memchr(buffer + pos,
+                                                              pattern[0],
+                                                              avail - pattern_len + 1 - pos);
+                if ( next == NULL ) {
+                    break;
+                }
+                pos = (size_t)(next - buffer);
+            }
+
+            if ( pattern_matches(buffer + pos, pattern, mask, pattern_len) ) {
+                callback(ctx, base + pos);
+                num_hits++;
+            }
+            pos++;
+        }
+
+        carry = pattern_len - 1;
+        if ( carry > avail ) {
+            carry = avail;
+        }
+        memmove(buffer, buffer + avail - carry, carry);
+
+        cur = chunk_end;
+    }
+
+    udi_free(buffer);
+
+    return (int)num_hits;
+}
+
+static inline
+uint64_t xxh_rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline
+uint64_t load_u64(const uint8_t *data) {
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline
+uint32_t load_u32(const uint8_t *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline
+uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = xxh_rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline
+uint64_t xxh_merge_round(uint64_t acc, uint64_t value) {
+    acc ^= xxh_round(0, value);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/**
+ * Computes the xxHash64 (seed 0) of the specified data
+ *
+ * @param data the data
+ * @param len the length of the data
+ *
+ * @return the hash
+ */
+static
+uint64_t xxhash64(const uint8_t *data, size_t len) {
+    const uint8_t *end = data + len;
+    uint64_t hash;
+
+    if ( len >= 32 ) {
+        uint64_t v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = XXH_PRIME64_2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -XXH_PRIME64_1;
+
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, load_u64(data));
+            v2 = xxh_round(v2, load_u64(data + 8));
+            v3 = xxh_round(v3, load_u64(data + 16));
+            v4 = xxh_round(v4, load_u64(data + 24));
+            data += 32;
+        }while ( data <= limit );
+
+        hash = xxh_rotl64(v1, 1) + xxh_rotl64(v2, 7) + xxh_rotl64(v3, 12) + xxh_rotl64(v4, 18);
+        hash = xxh_merge_round(hash, v1);
+        hash = xxh_merge_round(hash, v2);
+        hash = xxh_merge_round(hash, v3);
+        hash = xxh_merge_round(hash, v4);
+    }else{
+        hash = XXH_PRIME64_5;
+    }
+
+    hash += (uint64_t)len;
+
+    while ( data + 8 <= end ) {
+        hash ^= xxh_round(0, load_u64(data));
+        hash = xxh_rotl64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        data += 8;
+    }
+
+    if ( data + 4 <= end ) {
+        hash ^= (uint64_t)load_u32(data) * XXH_PRIME64_1;
+        hash = xxh_rotl64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        data += 4;
+    }
+
+    while ( data < end ) {
+        hash ^= (*data) * XXH_PRIME64_5;
+        hash = xxh_rotl64(hash, 11) * XXH_PRIME64_1;
+        data++;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+size_t compress_bound(size_t len) {
+    return len + len / 255 + 16;
+}
+
+static inline
+uint32_t lz4_hash(uint32_t value) {
+    return (value * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+static
+size_t lz4_write_length(uint8_t *output, size_t len) {
+    size_t count = 0;
+    while ( len >= 255 ) {
+        output[count++] = 255;
+        len -= 255;
+    }
+    output[count++] = (uint8_t)len;
+
+    return count;
+}
+
+/**
+ * Writes a LZ4 sequence. The match is omitted when match_len is 0, which is only
+ * valid for the last sequence.
+ *
+ * @return the position after the sequence
+ */
+static
+uint8_t *lz4_write_sequence(uint8_t *output,
+                            const uint8_t *literals,
+                            size_t num_literals,
+                            size_t offset,
+                            size_t match_len)
+{
+    uint8_t *token = output++;
+
+    *token = (uint8_t)((num_literals < 15 ? num_literals : 15) << 4);
+    if ( num_literals >= 15 ) {
+        output += lz4_write_length(output, num_literals - 15);
+    }
+
+    memcpy(output, literals, num_literals);
+    output += num_literals;
+
+    if ( match_len > 0 ) {
+        output[0] = (uint8_t)(offset & 0xff);
+        output[1] = (uint8_t)(offset >> 8);
+        output += 2;
+
+        size_t code = match_len - LZ4_MIN_MATCH;
+        *token |= (uint8_t)(code < 15 ? code : 15);
+        if ( code >= 15 ) {
+            output += lz4_write_length(output, code - 15);
+        }
+    }
+
+    return output;
+}
+
+/**
+ * Compresses the specified data into the LZ4 block format, using a greedy
+ * single-probe match finder. This favors speed over ratio; the common cases in
+ * debuggee memory are zero pages and short repeated patterns, both of which are
+ * found by the first probe.
+ *
+ * @param src the data to compress
+ * @param len the length of the data, at most UINT32_MAX
+ * @param dst the output buffer, at least compress_bound(len) bytes
+ * @param dst_len populated with the length of the compressed data
+ * @param errmsg the error message populated on error
+ *
+ * @return 0 on success; non-zero on failure
+ */
+int compress_lz4(const uint8_t *src,
+                 size_t len,
+                 uint8_t *dst,
+                 size_t *dst_len,
+                 udi_errmsg *errmsg)
+{
+    uint8_t *output = dst;
+    size_t anchor = 0;
+
+    if ( len > LZ4_MATCH_FIND_LIMIT ) {
+        uint32_t *table = (uint32_t *)udi_calloc(1 << LZ4_HASH_BITS, sizeof(uint32_t));
+        if ( table == NULL ) {
+            udi_set_errmsg(errmsg, "failed to allocate memory");
+            return -1;
+        }
+
+        // the format requires the block end with literals
+        size_t match_limit = len - LZ4_LAST_LITERALS;
+        size_t find_limit = len - LZ4_MATCH_FIND_LIMIT;
+
+        size_t pos = 0;
+        while ( pos < find_limit ) {
+            uint32_t sequence = load_u32(src + pos);
+            uint32_t hash = lz4_hash(sequence);
+            size_t ref = table[hash];
+            table[hash] = (uint32_t)pos;
+
+            if ( ref < pos &&
+                 pos - ref <= LZ4_MAX_OFFSET &&
+                 load_u32(src + ref) == sequence )
+            {
+                size_t match_len = LZ4_MIN_MATCH;
+                while ( pos + match_len < match_limit && src[ref + match_len] == src[pos + match_len] ) {
+                    match_len++;
+                }
+
+                output = lz4_write_sequence(output,
+                                            src + anchor,
+                                            pos - anchor,
+                                            pos - ref,
+                                            match_len);
+                pos += match_len;
+                anchor = pos;
+            }else{
+                pos++;
+            }
+        }
+
+        udi_free(table);
+    }
+
+    output = lz4_write_sequence(output, src + anchor, len - anchor, 0, 0);
+    *dst_len = (size_t)(output - dst);
+
+    return 0;
+}
+
+/**
+ * Hashes the specified range of memory in fixed-size blocks, starting at the
+ * start of the range. The last block is truncated to the end of the range.
+ *
+ * Each block is copied into a bounce buffer with read_memory so that blocks that
+ * cannot be read are reported as such instead of failing the whole range.
+ *
+ * @param addr the start of the range
+ * @param len the length of the range
+ * @param block_size the size of the blocks
+ * @param callback called with the hash of each block, in order
+ * @param ctx the context passed to the callback
+ * @param errmsg the error message populated on error
+ *
+ * @return 0 on success; non-zero on error
+ */
+int hash_memory(uint64_t addr,
+                uint64_t len,
+                uint32_t block_size,
+                hash_block_callback callback,
+                void *ctx,
+                udi_errmsg *errmsg)
+{
+    uint8_t *buffer = (uint8_t *)udi_malloc(block_size);
+    if ( buffer == NULL ) {
+        udi_set_errmsg(errmsg, "failed to allocate memory");
+        return -1;
+    }
+
+    uint64_t offset = 0;
+    while ( offset < len ) {
+        uint64_t cur = addr + offset;
+        size_t block_len = block_size;
+        if ( len - offset < block_len ) {
+            block_len = (size_t)(len - offset);
+        }
+
+        if ( !is_range_mapped(cur, block_len) ) {
+            callback(ctx, 0, 0);
+        }else if ( read_memory(buffer, (const uint8_t *)(uintptr_t)cur, block_len, errmsg) != 0 ) {
+            udi_log("failed to hash memory at %a: %s", cur, get_mem_errstr());
+            callback(ctx, 0, 0);
+        }else{
+            callback(ctx, 1, xxhash64(buffer, block_len));
+        }
+
+        offset += block_len;
+    }
+
+    udi_free(buffer);
+
+    return 0;
+}
+
 // breakpoint implementation
 
 static breakpoint *breakpoints[BREAKPOINT_HASH_SIZE];
@@ -365,6 +930,25 @@ const char *request_type_str(udi_request_type_e req_type) {
         CASE_TO_STR(UDI_REQ_WRITE_REGISTER);
         CASE_TO_STR(UDI_REQ_NEXT_INSTRUCTION);
         CASE_TO_STR(UDI_REQ_SINGLE_STEP);
+        CASE_TO_STR(UDI_REQ_SEARCH_MEMORY);
+        CASE_TO_STR(UDI_REQ_MEMORY_MAP);
+        CASE_TO_STR(UDI_REQ_HASH_MEMORY);
+        CASE_TO_STR(UDI_REQ_READ_MEM_STREAM);
+        CASE_TO_STR(UDI_REQ_WRITE_MEM_STREAM);
+        CASE_TO_STR(UDI_REQ_READ_REGISTERS);
+        CASE_TO_STR(UDI_REQ_WRITE_REGISTERS);
+        CASE_TO_STR(UDI_REQ_READ_VECTOR_REGISTERS);
+        CASE_TO_STR(UDI_REQ_WRITE_VECTOR_REGISTERS);
+        CASE_TO_STR(UDI_REQ_SET_EVENT_PAYLOAD);
+        CASE_TO_STR(UDI_REQ_SET_EVENT_MASK);
+        CASE_TO_STR(UDI_REQ_SET_SIGNAL_POLICY);
+        CASE_TO_STR(UDI_REQ_STOP_STATS);
+        CASE_TO_STR(UDI_REQ_SET_STOP_MODE);
+        CASE_TO_STR(UDI_REQ_STEP_RANGE);
+        CASE_TO_STR(UDI_REQ_STEP_OVER);
+        CASE_TO_STR(UDI_REQ_STEP_OUT);
+        CASE_TO_STR(UDI_REQ_RUN_INSTRUCTIONS);
+        CASE_TO_STR(UDI_REQ_RECORD_BRANCHES);
         default: return "UNKNOWN";
     }
 }
@@ -381,6 +965,7 @@ const char *event_type_str(udi_event_type_e event_type) {
         CASE_TO_STR(UDI_EVENT_PROCESS_FORK);
         CASE_TO_STR(UDI_EVENT_PROCESS_EXEC);
         CASE_TO_STR(UDI_EVENT_SINGLE_STEP);
+        CASE_TO_STR(UDI_EVENT_BATCH);
         default: return "UNSPECIFIED";
     }
 }
@@ -465,6 +1050,63 @@ const char *register_str(udi_register_e reg) {
         CASE_TO_STR(UDI_X86_64_XMM13);
         CASE_TO_STR(UDI_X86_64_XMM14);
         CASE_TO_STR(UDI_X86_64_XMM15);
+        CASE_TO_STR(UDI_X86_64_YMM0);
+        CASE_TO_STR(UDI_X86_64_YMM1);
+        CASE_TO_STR(UDI_X86_64_YMM2);
+        CASE_TO_STR(UDI_X86_64_YMM3);
+        CASE_TO_STR(UDI_X86_64_YMM4);
+        CASE_TO_STR(UDI_X86_64_YMM5);
+        CASE_TO_STR(UDI_X86_64_YMM6);
+        CASE_TO_STR(UDI_X86_64_YMM7);
+        CASE_TO_STR(UDI_X86_64_YMM8);
+        CASE_TO_STR(UDI_X86_64_YMM9);
+        CASE_TO_STR(UDI_X86_64_YMM10);
+        CASE_TO_STR(UDI_X86_64_YMM11);
+        CASE_TO_STR(UDI_X86_64_YMM12);
+        CASE_TO_STR(UDI_X86_64_YMM13);
+        CASE_TO_STR(UDI_X86_64_YMM14);
+        CASE_TO_STR(UDI_X86_64_YMM15);
+        CASE_TO_STR(UDI_X86_64_ZMM0);
+        CASE_TO_STR(UDI_X86_64_ZMM1);
+        CASE_TO_STR(UDI_X86_64_ZMM2);
+        CASE_TO_STR(UDI_X86_64_ZMM3);
+        CASE_TO_STR(UDI_X86_64_ZMM4);
+        CASE_TO_STR(UDI_X86_64_ZMM5);
+        CASE_TO_STR(UDI_X86_64_ZMM6);
+        CASE_TO_STR(UDI_X86_64_ZMM7);
+        CASE_TO_STR(UDI_X86_64_ZMM8);
+        CASE_TO_STR(UDI_X86_64_ZMM9);
+        CASE_TO_STR(UDI_X86_64_ZMM10);
+        CASE_TO_STR(UDI_X86_64_ZMM11);
+        CASE_TO_STR(UDI_X86_64_ZMM12);
+        CASE_TO_STR(UDI_X86_64_ZMM13);
+        CASE_TO_STR(UDI_X86_64_ZMM14);
+        CASE_TO_STR(UDI_X86_64_ZMM15);
+        CASE_TO_STR(UDI_X86_64_ZMM16);
+        CASE_TO_STR(UDI_X86_64_ZMM17);
+        CASE_TO_STR(UDI_X86_64_ZMM18);
+        CASE_TO_STR(UDI_X86_64_ZMM19);
+        CASE_TO_STR(UDI_X86_64_ZMM20);
+        CASE_TO_STR(UDI_X86_64_ZMM21);
+        CASE_TO_STR(UDI_X86_64_ZMM22);
+        CASE_TO_STR(UDI_X86_64_ZMM23);
+        CASE_TO_STR(UDI_X86_64_ZMM24);
+        CASE_TO_STR(UDI_X86_64_ZMM25);
+        CASE_TO_STR(UDI_X86_64_ZMM26);
+        CASE_TO_STR(UDI_X86_64_ZMM27);
+        CASE_TO_STR(UDI_X86_64_ZMM28);
+        CASE_TO_STR(UDI_X86_64_ZMM29);
+        CASE_TO_STR(UDI_X86_64_ZMM30);
+        CASE_TO_STR(UDI_X86_64_ZMM31);
+        CASE_TO_STR(UDI_X86_64_K0);
+        CASE_TO_STR(UDI_X86_64_K1);
+        CASE_TO_STR(UDI_X86_64_K2);
+        CASE_TO_STR(UDI_X86_64_K3);
+        CASE_TO_STR(UDI_X86_64_K4);
+        CASE_TO_STR(UDI_X86_64_K5);
+        CASE_TO_STR(UDI_X86_64_K6);
+        CASE_TO_STR(UDI_X86_64_K7);
+        CASE_TO_STR(UDI_X86_64_MXCSR);
         CASE_TO_STR(UDI_X86_64_MAX);
         default: return "UNSPECIFIED";
     }
@@ -497,6 +1139,30 @@ int validate_register(udi_register_e reg, udi_errmsg *errmsg) {
     return result;
 }
 
+void get_register_range(udi_arch_e arch, udi_register_e *first, udi_register_e *last) {
+    switch (arch) {
+        case UDI_ARCH_X86:
+            *first = UDI_X86_MIN + 1;
+            *last = UDI_X86_MAX;
+            break;
+        case UDI_ARCH_X86_64:
+        default:
+            *first = UDI_X86_64_MIN + 1;
+            *last = UDI_X86_64_MAX;
+            break;
+    }
+}
+
+udi_register_e get_stack_pointer_register(udi_arch_e arch) {
+    switch (arch) {
+        case UDI_ARCH_X86:
+            return UDI_X86_ESP;
+        case UDI_ARCH_X86_64:
+        default:
+            return UDI_X86_64_RSP;
+    }
+}
+
 static const char * const LEFT_SQ = "[";
 static const char * const RIGHT_SQ = "]";
 static const char * const COLON = ":";
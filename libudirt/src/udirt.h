@@ -32,6 +32,7 @@ extern "C" {
 extern const char * const REQUEST_FILE_NAME;
 extern const char * const RESPONSE_FILE_NAME;
 extern const char * const EVENTS_FILE_NAME;
+extern const char * const BRANCHES_FILE_NAME;
 extern const char * const UDI_DEBUG_ENV;
 extern const uint64_t UDI_SINGLE_THREAD_ID;
 
@@ -50,6 +51,7 @@ void udi_free(void *ptr);
 void *udi_malloc(size_t length);
 void *udi_calloc(size_t count, size_t size);
 void *udi_realloc(void *ptr, size_t length);
+void *udi_memalign(size_t alignment, size_t length);
 
 // helper functions
 const char *request_type_str(udi_request_type_e req_type); 
@@ -127,6 +129,131 @@ void set_single_step(thread *thr, int single_step);
 breakpoint *get_single_step_breakpoint(thread *thr);
 void set_single_step_breakpoint(thread *thr, breakpoint *bp);
 
+/** How the next step of a thread is taken with the trap flag */
+typedef enum {
+    STEP_TRACE_NONE = 0,
+    STEP_TRACE_PENDING, // the trap flag is set once the thread resumes
+    STEP_TRACE_ACTIVE,  // the trap flag is set in the context of the running thread
+} step_trace_e;
+
+/** The state of a thread stepping through a range without reporting events */
+typedef struct step_state_struct {
+    uint64_t range_start;
+    uint64_t range_end; // 0 when the thread is not stepping through a range
+    int prev_single_step;
+    int over_calls;
+    int out;
+
+    // non-zero while the thread runs a call that is stepped over, the return address breakpoint
+    // only ends the call when it is hit with at least this stack pointer
+    uint64_t return_sp;
+
+    // non-zero while the thread runs a fixed number of instructions
+    uint64_t run_count;
+    uint64_t executed;
+
+    // the next step is taken with the trap flag instead of a breakpoint
+    step_trace_e trace;
+} step_state;
+
+/**
+ * @return the stepping state of the thread
+ */
+step_state *get_step_state(thread *thr);
+
+/**
+ * Single steps the thread without reporting an event until its pc leaves the range [start, end)
+ *
+ * @param thr the thread
+ * @param start the start of the range
+ * @param end the end of the range
+ * @param over_calls non-zero if calls are stepped over instead of into
+ * @param out non-zero if the range ends once the current function returns
+ */
+void set_step_range(thread *thr, uint64_t start, uint64_t end, int over_calls, int out);
+
+/**
+ * @return non-zero if the thread is stepping through a range that contains the pc
+ */
+int is_in_step_range(thread *thr, uint64_t pc);
+
+/**
+ * @return non-zero unless the thread runs a call that is stepped over and the context is in a
+ * deeper frame than the call, such as a recursive call of the same function
+ */
+int is_step_return_frame(thread *thr, const void *context);
+
+/**
+ * Stops stepping through the range of the thread and restores the single step setting it had
+ * before
+ *
+ * @param thr the thread
+ */
+void end_step_range(thread *thr);
+
+/**
+ * Prepares the next step of the thread. The step traps with the trap flag when the instruction
+ * allows it, otherwise a breakpoint is installed at the successor of the instruction
+ *
+ * @param thr the thread
+ * @param context the context of the thread
+ * @param errmsg the error message populated on error
+ *
+ * @return 0 on success; non-zero on failure
+ */
+int install_step_breakpoint(thread *thr, const void *context, udi_errmsg *errmsg);
+
+/** The taken branches of a thread, recorded into a ring buffer shared with the debugger */
+typedef struct branch_trace_struct {
+    branch_trace_header *header; // NULL when the thread is not recording
+    uint8_t *data;
+
+    // the last target written to the ring buffer, the next target is encoded relative to it
+    uint64_t last_target;
+
+    // the address after the instruction being stepped, 0 when it is not known
+    uint64_t fallthrough;
+
+    // the single step setting of the debugger, the thread single steps while it records
+    int user_single_step;
+} branch_trace;
+
+/**
+ * @return the branch recording state of the thread
+ */
+branch_trace *get_branch_trace(thread *thr);
+
+/**
+ * @return non-zero if the thread records the targets of its taken branches
+ */
+int is_recording_branches(thread *thr);
+
+/**
+ * Creates the ring buffer the thread records its taken branches into, shared with the debugger
+ * through a file in the thread directory
+ *
+ * @param thr the thread
+ * @param size the size of the ring buffer
+ * @param errmsg the error message populated on error
+ *
+ * @return 0 on success; non-zero on failure
+ */
+int map_branch_trace(thread *thr, uint32_t size, udi_errmsg *errmsg);
+
+/**
+ * Releases the ring buffer of the thread. The file stays in place so the debugger can drain the
+ * remaining records
+ *
+ * @param thr the thread
+ */
+void unmap_branch_trace(thread *thr);
+
+/**
+ * @return the path of the file shared with the debugger, allocated with udi_malloc, or NULL on
+ * failure
+ */
+char *get_branch_trace_path(thread *thr);
+
 /**
  * Called before the process is continued after a thread death event was published
  *
@@ -173,6 +300,80 @@ int write_memory(uint8_t *dest, const uint8_t *src, size_t num_bytes, udi_errmsg
 
 const char *get_mem_errstr();
 
+// memory map
+
+/** Returned when the platform cannot read the memory map of the debuggee */
+extern const int MEMORY_MAP_UNSUPPORTED;
+
+/**
+ * Gets the memory map for the debuggee, loading it if the cached map is out of date
+ *
+ * @param regions populated with the regions, sorted by address
+ * @param num_regions populated with the number of regions
+ * @param errmsg the error message populated on error
+ *
+ * @return 0 on success; MEMORY_MAP_UNSUPPORTED if the platform has no memory map; non-zero on
+ * failure
+ */
+int get_memory_map(const memory_region **regions, size_t *num_regions, udi_errmsg *errmsg);
+
+/**
+ * Marks the cached memory map out of date. Called whenever the mappings could have changed.
+ */
+void invalidate_memory_map();
+
+/**
+ * Checks that the specified range is covered by mapped memory
+ *
+ * @param addr the start of the range
+ * @param len the length of the range
+ *
+ * @return zero if the range is known to be unmapped; non-zero otherwise
+ */
+int is_range_mapped(uint64_t addr, uint64_t len);
+
+/**
+ * Reads the memory map for the debuggee from the OS
+ *
+ * @param regions populated with an array allocated with udi_malloc
+ * @param num_regions populated with the number of regions
+ * @param errmsg the error message populated on error
+ *
+ * @return 0 on success; MEMORY_MAP_UNSUPPORTED if the platform has no memory map; non-zero on
+ * failure
+ */
+int load_memory_map(memory_region **regions, size_t *num_regions, udi_errmsg *errmsg);
+
+typedef void (*search_hit_callback)(void *ctx, uint64_t addr);
+int search_memory(uint64_t addr,
+                  uint64_t len,
+                  const uint8_t *pattern,
+                  const uint8_t *mask,
+                  size_t pattern_len,
+                  uint32_t max_hits,
+                  search_hit_callback callback,
+                  void *ctx,
+                  udi_errmsg *errmsg);
+
+/**
+ * @return the maximum size of the LZ4 compressed form of data of the specified length
+ */
+size_t compress_bound(size_t len);
+
+int compress_lz4(const uint8_t *src,
+                 size_t len,
+                 uint8_t *dst,
+                 size_t *dst_len,
+                 udi_errmsg *errmsg);
+
+typedef void (*hash_block_callback)(void *ctx, int readable, uint64_t hash);
+int hash_memory(uint64_t addr,
+                uint64_t len,
+                uint32_t block_size,
+                hash_block_callback callback,
+                void *ctx,
+                udi_errmsg *errmsg);
+
 // disassembly interface //
 
 /**
@@ -186,6 +387,64 @@ const char *get_mem_errstr();
  */
 uint64_t get_ctf_successor(uint64_t pc, udi_errmsg *errmsg, const void *context);
 
+typedef enum {
+    CTF_OTHER = 0, // any instruction that is not a call or a return
+    CTF_CALL,      // a call, which returns to the instruction that follows it
+    CTF_RETURN,    // a return from a function
+    CTF_NO_TRACE,  // an instruction that cannot be stepped with the trap flag
+} ctf_kind_e;
+
+/**
+ * Classifies the instruction at the specified pc for stepping over calls and out of functions
+ *
+ * @param pc the program counter
+ * @param kind populated with the kind of the instruction
+ * @param len populated with the length of the instruction
+ * @param errmsg the error message populated on failure
+ *
+ * @return 0 on success; non-zero on failure
+ */
+int get_ctf_kind(uint64_t pc, ctf_kind_e *kind, unsigned int *len, udi_errmsg *errmsg);
+
+// displaced stepping
+
+/** the size of the buffer a thread executes a displaced instruction in */
+#define DISPLACED_PAD_SIZE 32
+
+typedef enum {
+    DISPLACED_EMULATED = 0, // the context was updated as if the instruction executed
+    DISPLACED_COPIED,       // the context pc points at a copy of the instruction in the pad
+    DISPLACED_IN_PLACE,     // the instruction cannot be moved and must execute at its address
+} displaced_step_e;
+
+typedef struct displaced_step_struct {
+    displaced_step_e type;
+
+    // for a copied instruction, the address of the breakpoint that follows it in the pad and the
+    // address execution continues at once the breakpoint is hit
+    uint64_t trap_addr;
+    uint64_t resume_addr;
+} displaced_step;
+
+/**
+ * Prepares the context to execute the instruction at the specified pc without removing the
+ * breakpoint installed at the pc, so other threads running through the pc still hit it
+ *
+ * @param pc the pc
+ * @param pad the buffer for a copy of the instruction, DISPLACED_PAD_SIZE bytes of executable
+ * memory
+ * @param context the context, updated to execute the instruction
+ * @param step populated with how the instruction is executed
+ * @param errmsg the error message populated on failure
+ *
+ * @return 0 on success; non-zero on failure
+ */
+int displace_instruction(uint64_t pc,
+                         uint8_t *pad,
+                         void *context,
+                         displaced_step *step,
+                         udi_errmsg *errmsg);
+
 // register interface //
 
 /**
@@ -198,6 +457,22 @@ uint64_t get_ctf_successor(uint64_t pc, udi_errmsg *errmsg, const void *context)
  */
 int validate_register(udi_register_e reg, udi_errmsg *errmsg);
 
+/**
+ * Gets the range of valid registers for the architecture
+ *
+ * @param arch the architecture
+ * @param first populated with the first register in the range
+ * @param last populated with the register after the last register in the range
+ */
+void get_register_range(udi_arch_e arch, udi_register_e *first, udi_register_e *last);
+
+/**
+ * @param arch the architecture
+ *
+ * @return the stack pointer register for the architecture
+ */
+udi_register_e get_stack_pointer_register(udi_arch_e arch);
+
 /**
  * Gets the specified register, with validation
  *
@@ -228,6 +503,68 @@ int set_register(udi_register_e reg,
                  uint64_t value,
                  void *context);
 
+/**
+ * Gets the specified register as bytes, in little-endian order, with validation. This
+ * supports registers wider than 64 bits.
+ *
+ * @param reg the register to retrieve
+ * @param errmsg the error message (populated on error)
+ * @param value the output buffer, which must hold get_register_size(reg) bytes
+ * @param context the context (from which the register is retrieved)
+ *
+ * @return 0 on success; non-zero on failure
+ */
+int get_register_bytes(udi_register_e reg,
+                       udi_errmsg *errmsg,
+                       uint8_t *value,
+                       const void *context);
+
+/**
+ * Sets the specified register from bytes, in little-endian order, with validation. This
+ * supports registers wider than 64 bits.
+ *
+ * @param reg the register to set
+ * @param errmsg the error message (populated on error)
+ * @param value the new value, which must contain get_register_size(reg) bytes
+ * @param context the context (in which the register is set)
+ *
+ * @return 0 on success; non-zero on failure
+ */
+int set_register_bytes(udi_register_e reg,
+                       udi_errmsg *errmsg,
+                       const uint8_t *value,
+                       void *context);
+
+/**
+ * Gets the size of the specified register
+ *
+ * @param reg the register
+ *
+ * @return the size in bytes, 0 if the register is unknown
+ */
+size_t get_register_size(udi_register_e reg);
+
+/**
+ * Gets the width of the widest vector registers accessible in the context
+ *
+ * @param errmsg the error message populated when no vector registers are accessible
+ * @param context the context
+ *
+ * @return the width in bytes, 0 if no vector registers are accessible
+ */
+size_t get_vector_register_width(udi_errmsg *errmsg, const void *context);
+
+/**
+ * Gets the range of vector registers with the specified width
+ *
+ * @param width the width in bytes
+ * @param first populated with the first register in the range
+ * @param last populated with the register after the last register in the range
+ *
+ * @return 0 on success; non-zero if there are no vector registers with the width
+ */
+int get_vector_register_range(size_t width, udi_register_e *first, udi_register_e *last);
+
 /**
  * Check if the specified register is a general-purpose register
  *
@@ -262,6 +599,14 @@ uint64_t get_pc(const void *context);
  */
 void rewind_pc(void *context);
 
+/**
+ * Sets or clears the trap flag in the context, which traps once the next instruction executes
+ *
+ * @param context the context
+ * @param enabled non-zero to set the trap flag
+ */
+void set_trace_flag(void *context, int enabled);
+
 // breakpoint handling
 struct breakpoint_struct {
     unsigned char saved_bytes[8];
@@ -282,12 +627,21 @@ breakpoint *find_breakpoint(uint64_t breakpoint_addr);
 // architecture specific breakpoint handling
 int write_breakpoint_instruction(breakpoint *bp, udi_errmsg *errmsg);
 int write_saved_bytes(breakpoint *bp, udi_errmsg *errmsg);
+int is_breakpoint_instruction_at(uint64_t addr);
 udi_arch_e get_architecture();
 
 // continue handling //
 
-/** The breakpoint used to single step from a user breakpoint */
-extern breakpoint *continue_bp;
+/**
+ * @return non-zero if a thread still needs to step over the breakpoint it was stopped at
+ */
+int continue_pending();
+
+/**
+ * @return the next thread that needs to step over the breakpoint it was stopped at, NULL if the
+ * process is not multithreaded
+ */
+thread *get_continue_thread();
 
 /**
  * A hook ran after the continue response has been sent
@@ -296,10 +650,121 @@ extern breakpoint *continue_bp;
  */
 void post_continue_hook(uint32_t sig_val);
 
+/**
+ * Sets the handling of a signal received by the process
+ *
+ * @param sig the signal
+ * @param policy the policy
+ * @param errmsg the error message populated on failure
+ *
+ * @return the result of the operation
+ */
+int set_signal_policy(uint32_t sig, udi_signal_policy_e policy, udi_errmsg *errmsg);
+
+// non-stop mode //
+
+/**
+ * @return non-zero if an event only stops the thread that triggered it
+ */
+int is_non_stop_mode();
+
+/**
+ * Sets the stop mode, which takes effect once no thread is stopped
+ *
+ * @param mode the mode
+ * @param errmsg the error message populated on failure
+ *
+ * @return the result of the operation
+ */
+int set_stop_mode(udi_stop_mode_e mode, udi_errmsg *errmsg);
+
+/**
+ * @param thr the thread
+ *
+ * @return non-zero if the thread is stopped waiting for the debugger in non-stop mode
+ */
+int is_thread_stopped(thread *thr);
+
+/**
+ * Resumes a thread stopped in non-stop mode. Called after the continue response has been sent.
+ *
+ * @param thr the thread
+ * @param sig_val the value of the signal to continue the thread with
+ */
+void continue_thread(thread *thr, uint32_t sig_val);
+
+// stop latency
+
+typedef struct udi_stop_stats_struct {
+    uint64_t stops;
+    uint32_t threads;
+    uint64_t fanout_ns;
+    uint64_t arrival_ns;
+    uint64_t total_ns;
+    uint64_t max_total_ns;
+} udi_stop_stats;
+
+/**
+ * Gets the timing of the stops of all threads. The threads, fanout, arrival and total fields
+ * describe the last stop: the number of threads signaled, the time to signal them, the time
+ * until the last one stopped and the time until the stopping thread resumed.
+ *
+ * @param stats populated with the stats
+ */
+void get_stop_stats(udi_stop_stats *stats);
+
 // event reporting
 
 extern udirt_fd events_handle;
 
+/**
+ * Starts collecting events into a batch instead of writing them to the events handle, so the
+ * events of all threads stopped at the same time are reported together
+ */
+void begin_event_batch();
+
+/**
+ * @return non-zero if events are being collected into a batch
+ */
+int is_event_batch_active();
+
+/**
+ * @return the number of events collected into the current batch
+ */
+uint32_t get_event_batch_size();
+
+/**
+ * Writes the collected events as a single batch event and stops collecting events
+ *
+ * @param tid the thread that is reporting the batch
+ * @param errmsg the error message populated on error
+ *
+ * @return the result of writing the batch
+ */
+int flush_event_batch(uint64_t tid, udi_errmsg *errmsg);
+
+/**
+ * @param event_type the event type
+ *
+ * @return non-zero if the debugger has masked the specified event type
+ */
+int is_event_masked(udi_event_type_e event_type);
+
+/**
+ * @return non-zero if thread create or death events were not reported when they occurred
+ * because they were masked
+ */
+int has_deferred_thread_events();
+
+/**
+ * Writes the thread create and death events that were not reported when they occurred
+ *
+ * @param errmsg the error message populated on error
+ *
+ * @return the result of writing the events
+ */
+int write_deferred_thread_events(udi_errmsg *errmsg);
+
 /**
  * Handles the breakpoint event that occurred at the specified breakpoint
  *
@@ -317,6 +782,22 @@ int decode_breakpoint(thread *thr,
                       int *wait_for_request,
                       udi_errmsg *errmsg);
 
+/**
+ * Handles the trap that occurred after the thread executed an instruction with the trap flag set
+ * for its single step
+ *
+ * @param thr the thread that trapped
+ * @param context the context passed to the signal handler
+ * @param wait_for_request populated on success
+ * @param errmsg the error message populated on error
+ *
+ * @return the result of decoding the event
+ */
+int decode_trace_trap(thread *thr,
+                      void *context,
+                      int *wait_for_request,
+                      udi_errmsg *errmsg);
+
 
 /**
  * @param bp the breakpoint
@@ -343,6 +824,8 @@ int handle_thread_create_event(uint64_t creator_tid,
 int handle_thread_death_event(uint64_t tid,
                               udi_errmsg *errmsg);
 
+int handle_signal_event(uint64_t tid, uint64_t addr, uint32_t sig, udi_errmsg *errmsg);
+
 int handle_unknown_event(uint64_t tid, udi_errmsg *errmsg);
 
 int handle_error_event(uint64_t tid, udi_errmsg *errmsg);
@@ -17,8 +17,8 @@
 
 static struct mock_data *write_data;
 static uint8_t *read_data = NULL;
-static uint8_t read_data_idx = 0;
-static uint8_t read_data_size = 0;
+static size_t read_data_idx = 0;
+static size_t read_data_size = 0;
 
 static
 void save_data(struct mock_data **global, const uint8_t *data, size_t len) {
@@ -55,6 +55,10 @@ void add_read_data(const uint8_t *data, size_t len) {
     read_data_size += len;
 }
 
+size_t get_unread_data_len() {
+    return read_data_size - read_data_idx;
+}
+
 const struct mock_data *get_written_data() {
     return write_data;
 }
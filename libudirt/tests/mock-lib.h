@@ -25,6 +25,7 @@ struct mock_data {
 };
 
 void add_read_data(const uint8_t *data, size_t len);
+size_t get_unread_data_len();
 const struct mock_data *get_written_data();
 void mock_data_to_buffer(const struct mock_data *data, char *buf, size_t len);
 void reset_mock_data();
@@ -45,9 +45,57 @@ void field2_callback(void *ctx, cbor_data data, uint64_t len) {
     complete_item(ctx);
 }
 
-int main() {
+static
+void add_pair(cbor_item_t *map, const char *key, cbor_item_t *value) {
+    struct cbor_pair pair;
+    pair.key = cbor_move(cbor_build_string(key));
+    pair.value = cbor_move(value);
+    bool add_result = cbor_map_add(map, pair);
+    assert(add_result);
+}
+
+static
+cbor_item_t *build_uint_array(const uint64_t *values, size_t len) {
+    cbor_item_t *array = cbor_new_definite_array(len);
+    for (size_t i = 0; i < len; ++i) {
+        bool add_result = cbor_array_push(array, cbor_move(cbor_build_uint64(values[i])));
+        assert(add_result);
+    }
+
+    return array;
+}
+
+/**
+ * Reads the request data in the map, checking that the request consumed all of it
+ */
+static
+int read_test_request(cbor_item_t *root, const struct msg_config *config, void *req) {
+    cbor_mutable_data buffer = NULL;
+    size_t buffer_size = 0;
+    size_t length = cbor_serialize_alloc(root, &buffer, &buffer_size);
+    test_assert(length != 0);
+    test_assert(buffer != NULL);
+    test_assert(buffer_size == length);
+
+    add_read_data(buffer, length);
+    udi_free(buffer);
+    cbor_decref(&root);
+
+    udi_errmsg errmsg;
+    memset(&errmsg, 0, sizeof(errmsg));
+    errmsg.size = ERRMSG_SIZE;
+
+    int result = read_request_data(TEST_FD, config, req, &errmsg);
+    test_assert(get_unread_data_len() == 0);
+
+    return result;
+}
+
+static
+void test_request() {
     struct msg_item fields[2];
     struct msg_config config;
+    memset(&config, 0, sizeof(config));
 
     config.items = fields;
     config.num_items = 2;
@@ -60,44 +108,305 @@ int main() {
     fields[1].callbacks = invalid_callbacks;
     fields[1].callbacks.string = field2_callback;
 
-    init_req_handling();
-
     struct test_req req;
-    udi_errmsg errmsg;
+    memset(&req, 0, sizeof(req));
+
+    cbor_item_t *root = cbor_new_definite_map(2);
+    add_pair(root, "field1", cbor_build_uint32(13));
+    add_pair(root, "field2", cbor_build_string("test string"));
 
+    int result = read_test_request(root, &config, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.field1 == 13);
+    test_assert(strcmp(req.field2, "test string") == 0);
+}
+
+static
+void test_search_request() {
+    static struct msg_config config;
+    static struct msg_item items[5];
+    search_init_config(&config, items);
+
+    search_mem_req req;
     memset(&req, 0, sizeof(req));
-    memset(&errmsg, 0, sizeof(errmsg));
+
+    uint8_t pattern[] = { 0xde, 0xad, 0xbe, 0xef };
+    uint8_t mask[] = { 0xff, 0x00, 0xff, 0xff };
+
+    cbor_item_t *root = cbor_new_definite_map(5);
+    add_pair(root, "addr", cbor_build_uint64(0x7f0000001000ULL));
+    add_pair(root, "len", cbor_build_uint32(0x2000));
+    add_pair(root, "pattern", cbor_build_bytestring(pattern, sizeof(pattern)));
+    add_pair(root, "mask", cbor_build_bytestring(mask, sizeof(mask)));
+    add_pair(root, "max", cbor_build_uint8(3));
+
+    int result = read_test_request(root, &config, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.addr == 0x7f0000001000ULL);
+    test_assert(req.len == 0x2000);
+    test_assert(req.pattern_len == sizeof(pattern));
+    test_assert(memcmp(req.pattern, pattern, sizeof(pattern)) == 0);
+    test_assert(req.mask_len == sizeof(mask));
+    test_assert(memcmp(req.mask, mask, sizeof(mask)) == 0);
+    test_assert(req.max_hits == 3);
+}
+
+static
+void test_search_request_empty_pattern() {
+    static struct msg_config config;
+    static struct msg_item items[5];
+    search_init_config(&config, items);
+
+    search_mem_req req;
+    memset(&req, 0, sizeof(req));
+
+    // an empty pattern and mask leave the buffers unset, the handler rejects the pattern
+    cbor_item_t *root = cbor_new_definite_map(5);
+    add_pair(root, "addr", cbor_build_uint8(0));
+    add_pair(root, "len", cbor_build_uint64(UINT64_MAX));
+    add_pair(root, "pattern", cbor_build_bytestring(NULL, 0));
+    add_pair(root, "mask", cbor_build_bytestring(NULL, 0));
+    add_pair(root, "max", cbor_build_uint32(UINT32_MAX));
+
+    int result = read_test_request(root, &config, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.len == UINT64_MAX);
+    test_assert(req.pattern == NULL);
+    test_assert(req.pattern_len == 0);
+    test_assert(req.mask == NULL);
+    test_assert(req.max_hits == UINT32_MAX);
+}
+
+static
+int read_hash_request(const uint64_t *addrs,
+                      size_t num_addrs,
+                      const uint64_t *lens,
+                      size_t num_lens,
+                      uint32_t block_size,
+                      hash_mem_req *req)
+{
+    static struct msg_config config;
+    static struct msg_item items[3];
+    hash_init_config(&config, items);
+
+    memset(req, 0, sizeof(*req));
+
+    cbor_item_t *root = cbor_new_definite_map(3);
+    add_pair(root, "addrs", build_uint_array(addrs, num_addrs));
+    add_pair(root, "lens", build_uint_array(lens, num_lens));
+    add_pair(root, "block", cbor_build_uint32(block_size));
+
+    return read_test_request(root, &config, req);
+}
+
+static
+void test_hash_request() {
+    uint64_t addrs[] = { 0x1000, 0x7f0000000000ULL };
+    uint64_t lens[] = { 0x100, 0x2001 };
+
+    hash_mem_req req;
+    int result = read_hash_request(addrs, 2, lens, 2, 0, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.num_addrs == 2);
+    test_assert(req.num_lens == 2);
+    test_assert(memcmp(req.addrs, addrs, sizeof(addrs)) == 0);
+    test_assert(memcmp(req.lens, lens, sizeof(lens)) == 0);
+
+    udi_errmsg errmsg;
     errmsg.size = ERRMSG_SIZE;
+    test_assert(RESULT_SUCCESS == validate_hash_request(&req, &errmsg));
+    test_assert(req.block_size == DEFAULT_HASH_BLOCK_SIZE);
 
-    cbor_item_t *root = cbor_new_definite_map(2);
+    // empty arrays complete without any elements
+    result = read_hash_request(NULL, 0, NULL, 0, MIN_HASH_BLOCK_SIZE, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.num_addrs == 0);
+    test_assert(RESULT_SUCCESS == validate_hash_request(&req, &errmsg));
+}
 
-    struct cbor_pair field1_pair;
-    field1_pair.key = cbor_move(cbor_build_string("field1"));
-    field1_pair.value = cbor_move(cbor_build_uint32(13));
-    bool add_result = cbor_map_add(root, field1_pair);
-    assert(add_result);
+static
+void test_hash_request_invalid() {
+    udi_errmsg errmsg;
+    errmsg.size = ERRMSG_SIZE;
 
-    struct cbor_pair field2_pair;
-    field2_pair.key = cbor_move(cbor_build_string("field2"));
-    field2_pair.value = cbor_move(cbor_build_string("test string"));
-    add_result = cbor_map_add(root, field2_pair);
-    assert(add_result);
+    // the ranges past the limit are read and discarded
+    size_t num_ranges = MAX_HASH_RANGES + 1;
+    uint64_t *values = (uint64_t *)calloc(num_ranges, sizeof(uint64_t));
+    test_assert(values != NULL);
 
-    cbor_mutable_data buffer = NULL;
-    size_t buffer_size = 0;
-    size_t length = cbor_serialize_alloc(root, &buffer, &buffer_size);
-    test_assert(length != 0);
-    test_assert(buffer != NULL);
-    test_assert(buffer_size == length);
+    hash_mem_req req;
+    int result = read_hash_request(values, num_ranges, values, num_ranges, 0, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.addrs == NULL);
+    test_assert(req.addrs_read == num_ranges);
+    test_assert(req.lens_read == num_ranges);
+    test_assert(RESULT_FAILURE == validate_hash_request(&req, &errmsg));
 
-    add_read_data(buffer, length);
-    udi_free(buffer);
-    cbor_decref(&root);
+    free(values);
 
-    int result = read_request_data(TEST_FD, &config, &req, &errmsg);
+    uint64_t addrs[] = { 0x1000, 0x2000 };
+    uint64_t lens[] = { 0x100 };
+    result = read_hash_request(addrs, 2, lens, 1, 0, &req);
     test_assert(RESULT_SUCCESS == result);
-    test_assert(req.field1 == 13);
-    test_assert(strcmp(req.field2, "test string") == 0);
+    test_assert(RESULT_FAILURE == validate_hash_request(&req, &errmsg));
+
+    result = read_hash_request(addrs, 1, lens, 1, MIN_HASH_BLOCK_SIZE + 1, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(RESULT_FAILURE == validate_hash_request(&req, &errmsg));
+
+    // a length that would wrap the rounded up block count
+    uint64_t zero_addr[] = { 0 };
+    uint64_t max_len[] = { UINT64_MAX };
+    result = read_hash_request(zero_addr, 1, max_len, 1, MIN_HASH_BLOCK_SIZE, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(RESULT_FAILURE == validate_hash_request(&req, &errmsg));
+
+    uint64_t wrap_addr[] = { UINT64_MAX };
+    result = read_hash_request(wrap_addr, 1, lens, 1, 0, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(RESULT_FAILURE == validate_hash_request(&req, &errmsg));
+}
+
+static
+int read_write_regs_request(size_t len, write_regs_req *req) {
+    static struct msg_config config;
+    static struct msg_item items[1];
+    write_regs_init_config(&config, items);
+
+    memset(req, 0, sizeof(*req));
+
+    // every other register is left unchanged
+    cbor_item_t *values = cbor_new_definite_array(len);
+    for (size_t i = 0; i < len; ++i) {
+        cbor_item_t *value = (i % 2 == 0) ? cbor_build_uint64(i) : cbor_new_null();
+        bool add_result = cbor_array_push(values, cbor_move(value));
+        assert(add_result);
+    }
+
+    cbor_item_t *root = cbor_new_definite_map(1);
+    add_pair(root, "values", values);
+
+    return read_test_request(root, &config, req);
+}
+
+static
+void test_write_regs_request() {
+    udi_register_e first, last;
+    get_register_range(get_architecture(), &first, &last);
+    size_t num_regs = last - first;
+
+    write_regs_req req;
+    int result = read_write_regs_request(num_regs, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(!req.bad_length);
+    test_assert(req.values_read == num_regs);
+    for (size_t i = 0; i < num_regs; ++i) {
+        test_assert(req.present[i] == (i % 2 == 0));
+        if (req.present[i]) {
+            test_assert(req.values[i] == i);
+        }
+    }
+
+    // the elements of an array with the wrong length are still read
+    result = read_write_regs_request(num_regs + 1, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.bad_length);
+    test_assert(req.values == NULL);
+    test_assert(req.values_read == num_regs + 1);
+
+    result = read_write_regs_request(1, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.bad_length);
+    test_assert(req.values_read == 1);
+
+    result = read_write_regs_request(0, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.bad_length);
+}
+
+static
+int read_event_payload_request(size_t num_regs, int with_stack, event_payload_req *req) {
+    static struct msg_config config;
+    static struct msg_item items[2];
+    event_payload_init_config(&config, items);
+
+    memset(req, 0, sizeof(*req));
+
+    cbor_item_t *regs = cbor_new_definite_array(num_regs);
+    for (size_t i = 0; i < num_regs; ++i) {
+        bool add_result = cbor_array_push(regs, cbor_move(cbor_build_uint16(UDI_X86_64_RAX + i)));
+        assert(add_result);
+    }
+
+    cbor_item_t *root = cbor_new_definite_map(with_stack ? 2 : 1);
+    add_pair(root, "regs", regs);
+    if (with_stack) {
+        add_pair(root, "stack", cbor_build_uint32(256));
+    }
+
+    return read_test_request(root, &config, req);
+}
+
+static
+void test_event_payload_request() {
+    event_payload_req req;
+    int result = read_event_payload_request(2, 1, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.num_regs == 2);
+    test_assert(req.regs[0] == UDI_X86_64_RAX);
+    test_assert(req.regs[1] == UDI_X86_64_RAX + 1);
+    test_assert(req.stack == 256);
+
+    // the stack is optional
+    result = read_event_payload_request(1, 0, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.num_regs == 1);
+    test_assert(req.stack == 0);
+
+    result = read_event_payload_request(0, 1, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.num_regs == 0);
+    test_assert(req.stack == 256);
+
+    // the registers past the limit are read and discarded
+    result = read_event_payload_request(MAX_EVENT_PAYLOAD_REGS + 1, 1, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.num_regs == MAX_EVENT_PAYLOAD_REGS + 1);
+    test_assert(req.regs_read == MAX_EVENT_PAYLOAD_REGS + 1);
+    test_assert(req.stack == 256);
+}
+
+static
+void test_read_request_optional_codec() {
+    static struct msg_config config;
+    static struct msg_item items[3];
+    read_init_config(&config, items);
+
+    read_mem_req req;
+    memset(&req, 0, sizeof(req));
+
+    cbor_item_t *root = cbor_new_definite_map(2);
+    add_pair(root, "addr", cbor_build_uint64(0x1000));
+    add_pair(root, "len", cbor_build_uint16(512));
+
+    int result = read_test_request(root, &config, &req);
+    test_assert(RESULT_SUCCESS == result);
+    test_assert(req.addr == 0x1000);
+    test_assert(req.len == 512);
+    test_assert(req.codec == 0);
+}
+
+int main() {
+    init_req_handling();
+
+    test_request();
+    test_search_request();
+    test_search_request_empty_pattern();
+    test_hash_request();
+    test_hash_request_invalid();
+    test_write_regs_request();
+    test_event_payload_request();
+    test_read_request_optional_codec();
 
     cleanup_mock_lib();
 